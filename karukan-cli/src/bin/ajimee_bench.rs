@@ -7,7 +7,7 @@ use anyhow::{Context, Result};
 use clap::Parser;
 use karukan_engine::kana::normalize_nfkc;
 use karukan_engine::kanji::{
-    KanjiError, LlamaCppModel, build_jinen_prompt, clean_model_output, get_path_by_id,
+    KanjiError, LlamaCppModel, LlamaToken, clean_model_output, get_path_by_id,
     get_tokenizer_path_by_id, registry,
 };
 use serde::{Deserialize, Serialize};
@@ -47,6 +47,11 @@ struct Cli {
     /// Context window size
     #[arg(long, default_value_t = 512)]
     n_ctx: u32,
+
+    /// Examples decoded together as concurrent sequences of one context
+    /// (1 = one at a time; the context grows to n_ctx per sequence)
+    #[arg(long, default_value_t = 1)]
+    batch_size: usize,
 }
 
 /// A single AJIMEE-Bench evaluation item
@@ -182,34 +187,49 @@ fn main() -> Result<()> {
         serde_json::from_str(&data).context("Failed to parse evaluation_items.json")?;
     eprintln!("Loaded {} examples", items.len());
 
-    let mut results: Vec<ItemResult> = Vec::with_capacity(items.len());
-    let mut exact_matches = 0usize;
-    let mut total_cer = 0.0f64;
-    let mut nfkc_exact_matches = 0usize;
-    let mut nfkc_total_cer = 0.0f64;
-
+    // Build prompts (the input is already katakana in AJIMEE-Bench)
+    let mut examples = Vec::with_capacity(items.len());
+    let mut prompts: Vec<Vec<LlamaToken>> = Vec::with_capacity(items.len());
     for (idx, item) in items.iter().enumerate() {
         if item.input.is_empty() {
             continue;
         }
-
-        // The input is already katakana in AJIMEE-Bench
-        let reading = &item.input;
-
         let context = if cli.no_context {
             ""
         } else {
             item.context_text.as_deref().unwrap_or("")
         };
-
-        // Build prompt and generate
-        let prompt = build_jinen_prompt(reading, context);
         let tokens = model
-            .tokenize(&prompt)
+            .tokenize_prompt(&item.input, context)
             .with_context(|| format!("Failed to tokenize example {}", idx + 1))?;
+        examples.push((item, context));
+        prompts.push(tokens);
+    }
+
+    // Generate
+    let start = std::time::Instant::now();
+    let batch_size = cli.batch_size.max(1);
+    let generated: Vec<Vec<LlamaToken>> = if batch_size == 1 {
+        prompts
+            .iter()
+            .map(|tokens| {
+                let output_tokens = model.generate(tokens, 100, eos)?;
+                Ok(output_tokens[tokens.len()..].to_vec())
+            })
+            .collect::<Result<_>>()?
+    } else {
+        model.generate_batch(&prompts, 100, eos, batch_size)?
+    };
+    let elapsed = start.elapsed().as_secs_f64();
+
+    let mut results: Vec<ItemResult> = Vec::with_capacity(examples.len());
+    let mut exact_matches = 0usize;
+    let mut total_cer = 0.0f64;
+    let mut nfkc_exact_matches = 0usize;
+    let mut nfkc_total_cer = 0.0f64;
 
-        let output_tokens = model.generate(&tokens, 100, eos)?;
-        let generated = &output_tokens[tokens.len()..];
+    for ((item, context), generated) in examples.iter().zip(&generated) {
+        let reading = &item.input;
         let text = model.decode(generated, true)?;
 
         // Post-process: clean special tokens, truncate at stop tokens
@@ -312,6 +332,13 @@ fn main() -> Result<()> {
         nfkc_exact_match_rate * 100.0
     );
     println!("Avg min CER      (NFKC): {:.4}", nfkc_avg_min_cer);
+    println!("{}", "-".repeat(50));
+    println!(
+        "Generation time: {:.1}s ({:.1} examples/s, batch size {})",
+        elapsed,
+        num_examples as f64 / elapsed.max(f64::EPSILON),
+        batch_size
+    );
     println!("{}", "=".repeat(50));
 
     // Save detailed results if requested
@@ -0,0 +1,126 @@
+//! Shared conversion daemon
+//!
+//! Owns the kana-kanji models for every client on the machine (fcitx5 addons
+//! with `daemon = true`, `karukan-server --daemon`) and serves them over a
+//! Unix socket; see `karukan_engine::daemon`.
+
+use std::os::unix::fs::PermissionsExt;
+use std::os::unix::net::UnixListener;
+use std::path::PathBuf;
+use std::sync::Arc;
+use std::time::Duration;
+
+use anyhow::{Context, Result, bail};
+use clap::Parser;
+use karukan_engine::daemon::{self, DaemonClient, DaemonServer};
+use karukan_engine::kanji::batch::DEFAULT_MAX_BATCH;
+use karukan_engine::kanji::{BatchConfig, ModelOptions, registry};
+use tracing_subscriber::{layer::SubscriberExt, util::SubscriberInitExt};
+
+/// Karukan conversion daemon
+#[derive(Parser, Debug)]
+#[command(name = "karukan-daemon")]
+#[command(about = "Serve kana-kanji conversion to all karukan clients", long_about = None)]
+struct Args {
+    /// Enable verbose logging (debug level)
+    #[arg(short, long)]
+    verbose: bool,
+
+    /// Socket path (default: $KARUKAN_DAEMON_SOCKET or $XDG_RUNTIME_DIR/karukan/daemon.sock)
+    #[arg(long)]
+    socket: Option<PathBuf>,
+
+    /// Model variant to load at startup (repeatable; others load on first request)
+    #[arg(long)]
+    model: Vec<String>,
+
+    /// Threads per model (0 = llama.cpp default)
+    #[arg(long, default_value_t = 0)]
+    n_threads: u32,
+
+    /// Model layers offloaded to the GPU (needs a build with a GPU backend)
+    #[arg(long, default_value_t = 0)]
+    n_gpu_layers: u32,
+
+    /// Most greedy conversions decoded together per model
+    #[arg(long, default_value_t = DEFAULT_MAX_BATCH)]
+    max_batch: usize,
+
+    /// Longest a conversion waits for others to share its batch, in ms
+    /// (0 = batch only what is already queued)
+    #[arg(long, default_value_t = 0)]
+    batch_wait_ms: u64,
+
+    /// Let every local user connect (for one daemon shared by all sessions)
+    #[arg(long)]
+    shared: bool,
+
+    /// Read the preloaded models into memory and lock them there
+    #[arg(long)]
+    lock_model: bool,
+}
+
+fn main() -> Result<()> {
+    let args = Args::parse();
+
+    let default_filter = if args.verbose {
+        "karukan_daemon=debug,karukan_engine=debug"
+    } else {
+        "karukan_daemon=info,karukan_engine=info"
+    };
+    tracing_subscriber::registry()
+        .with(
+            tracing_subscriber::EnvFilter::try_from_default_env()
+                .unwrap_or_else(|_| default_filter.into()),
+        )
+        .with(tracing_subscriber::fmt::layer())
+        .init();
+
+    let socket = args
+        .socket
+        .or_else(daemon::default_socket_path)
+        .context("no socket path: pass --socket or set $XDG_RUNTIME_DIR")?;
+    if socket.exists() {
+        if DaemonClient::connect(&socket).is_ok() {
+            bail!("a daemon is already listening on {}", socket.display());
+        }
+        // Left behind by a daemon that did not shut down cleanly
+        std::fs::remove_file(&socket)
+            .with_context(|| format!("failed to remove stale socket {}", socket.display()))?;
+    }
+    if let Some(parent) = socket.parent() {
+        std::fs::create_dir_all(parent)
+            .with_context(|| format!("failed to create {}", parent.display()))?;
+    }
+    let listener = UnixListener::bind(&socket)
+        .with_context(|| format!("failed to bind {}", socket.display()))?;
+    if args.shared {
+        std::fs::set_permissions(&socket, std::fs::Permissions::from_mode(0o666))?;
+    }
+
+    let options = ModelOptions {
+        n_gpu_layers: args.n_gpu_layers,
+        ..ModelOptions::default()
+    };
+    let batch = BatchConfig {
+        max_batch: args.max_batch,
+        max_wait: Duration::from_millis(args.batch_wait_ms),
+    };
+    let server = Arc::new(DaemonServer::new(args.n_threads, options, batch));
+    let models = if args.model.is_empty() {
+        vec![registry().default_model.clone()]
+    } else {
+        args.model
+    };
+    for model in &models {
+        match server.load(model) {
+            Ok(name) => tracing::info!("Loaded {} ({})", model, name),
+            Err(e) => tracing::warn!("Failed to load {}: {}", model, e),
+        }
+    }
+    server.warm_up(args.lock_model);
+
+    tracing::info!("Daemon listening on {}", socket.display());
+    server.serve(listener)?;
+    Ok(())
+}
@@ -7,13 +7,17 @@ use axum::{
 };
 use clap::Parser;
 use karukan_engine::RomajiConverter;
+use karukan_engine::daemon::{self, DaemonClient};
 use karukan_engine::kana::hiragana_to_katakana;
+use karukan_engine::kanji::batch::DEFAULT_MAX_BATCH;
+use karukan_engine::kanji::llamacpp::MAX_BATCH_SEQUENCES;
 use karukan_engine::kanji::{
-    LlamaCppModel, LlamaToken, build_jinen_prompt, clean_model_output, get_tokenizer_path,
+    KanjiError, LlamaCppModel, LlamaToken, clean_model_output, get_tokenizer_path,
     get_variant_path, registry,
 };
 use serde::{Deserialize, Serialize};
 use std::collections::HashMap;
+use std::path::PathBuf;
 use std::sync::{Arc, RwLock};
 use tower_http::{
     cors::{Any, CorsLayer},
@@ -41,6 +45,19 @@ struct Args {
     /// Host to bind to
     #[arg(long, default_value = "127.0.0.1")]
     host: String,
+
+    /// Convert on a running karukan-daemon instead of loading the models
+    /// (falls back to in-process models if it does not answer)
+    #[arg(long)]
+    daemon: bool,
+
+    /// Socket of the daemon (default: $KARUKAN_DAEMON_SOCKET or $XDG_RUNTIME_DIR/karukan/daemon.sock)
+    #[arg(long)]
+    daemon_socket: Option<PathBuf>,
+
+    /// Most readings of a /api/kanji/convert_batch request decoded together
+    #[arg(long, default_value_t = DEFAULT_MAX_BATCH)]
+    max_batch: usize,
 }
 
 #[derive(Clone)]
@@ -56,6 +73,10 @@ struct AppState {
     llamacpp_models: Arc<RwLock<HashMap<String, LlamaCppModelInfo>>>,
     /// Debug mode enabled (--debug flag)
     debug_mode: bool,
+    /// Conversion daemon serving the models instead of `llamacpp_models` (--daemon flag)
+    daemon: Option<Arc<DaemonClient>>,
+    /// Most readings decoded together by /api/kanji/convert_batch (--max-batch flag)
+    max_batch: usize,
 }
 
 #[derive(Debug, Deserialize)]
@@ -155,6 +176,39 @@ struct ModelsResponse {
     default: String,
 }
 
+/// One reading of a batch conversion request
+#[derive(Debug, Deserialize)]
+struct KanjiBatchItem {
+    hiragana: String,
+    #[serde(default)]
+    context: String,
+}
+
+/// Batch kanji conversion request: greedy decoding, one candidate per item
+#[derive(Debug, Deserialize)]
+struct KanjiBatchRequest {
+    items: Vec<KanjiBatchItem>,
+    /// Model to use (optional, uses default if not specified)
+    #[serde(default)]
+    model: Option<String>,
+}
+
+#[derive(Debug, Serialize)]
+struct KanjiBatchResult {
+    candidates: Vec<String>,
+    katakana: String,
+}
+
+#[derive(Debug, Serialize)]
+struct KanjiBatchResponse {
+    /// One result per request item, in request order
+    results: Vec<KanjiBatchResult>,
+    inference_time_ms: f64,
+    model: String,
+    /// Most items decoded together (--max-batch)
+    batch_size: usize,
+}
+
 #[tokio::main]
 async fn main() {
     let args = Args::parse();
@@ -175,7 +229,96 @@ async fn main() {
         .with(tracing_subscriber::fmt::layer())
         .init();
 
-    // Try to load llama.cpp models from HuggingFace (driven by models.toml)
+    // Models are loaded in-process unless the conversion daemon answers
+    let daemon = if args.daemon {
+        match args
+            .daemon_socket
+            .clone()
+            .or_else(daemon::default_socket_path)
+        {
+            Some(socket) => match DaemonClient::connect(&socket) {
+                Ok(client) => {
+                    tracing::info!("Using conversion daemon at {}", socket.display());
+                    Some(Arc::new(client))
+                }
+                Err(e) => {
+                    tracing::warn!(
+                        "Daemon at {} unavailable, loading models in-process: {}",
+                        socket.display(),
+                        e
+                    );
+                    None
+                }
+            },
+            None => {
+                tracing::warn!(
+                    "No daemon socket (pass --daemon-socket or set $XDG_RUNTIME_DIR), loading models in-process"
+                );
+                None
+            }
+        }
+    } else {
+        None
+    };
+    let llamacpp_models = if daemon.is_some() {
+        HashMap::new()
+    } else {
+        load_llamacpp_models()
+    };
+
+    if args.debug {
+        tracing::info!("Debug mode enabled - tokenization API available at /api/tokenize");
+    }
+
+    let state = AppState {
+        converter: Arc::new(RwLock::new(RomajiConverter::new())),
+        llamacpp_models: Arc::new(RwLock::new(llamacpp_models)),
+        debug_mode: args.debug,
+        daemon,
+        max_batch: args.max_batch.clamp(1, MAX_BATCH_SEQUENCES),
+    };
+
+    // Setup CORS
+    let cors = CorsLayer::new()
+        .allow_origin(Any)
+        .allow_methods(Any)
+        .allow_headers(Any);
+
+    // Build router
+    let mut app = Router::new()
+        .route("/api/convert", post(convert_handler))
+        .route("/api/reset", post(reset_handler))
+        .route("/api/kanji/convert", post(kanji_convert_handler))
+        .route("/api/kanji/convert_batch", post(kanji_batch_handler))
+        .route("/api/models", get(models_handler))
+        .route("/health", get(health_handler));
+
+    // Add debug-only routes
+    if args.debug {
+        app = app.route("/api/tokenize", post(tokenize_handler));
+    }
+
+    let app = app
+        .fallback_service(ServeDir::new("static"))
+        .layer(DefaultBodyLimit::max(256 * 1024)) // 256 KB
+        .layer(cors)
+        .with_state(state);
+
+    // Start server
+    let bind_addr = format!("{}:{}", args.host, args.port);
+    let listener = tokio::net::TcpListener::bind(&bind_addr)
+        .await
+        .expect("failed to bind server address");
+
+    tracing::info!("Server listening on http://{}", bind_addr);
+
+    axum::serve(listener, app)
+        .await
+        .expect("failed to run server");
+}
+
+/// Download and load every llama.cpp model listed in models.toml (keyed by variant id)
+fn load_llamacpp_models() -> HashMap<String, LlamaCppModelInfo> {
     let mut llamacpp_models = HashMap::new();
     let reg = registry();
 
@@ -250,53 +393,7 @@ async fn main() {
     } else {
         tracing::info!("Loaded {} llama.cpp model(s)", llamacpp_models.len());
     }
-
-    if args.debug {
-        tracing::info!("Debug mode enabled - tokenization API available at /api/tokenize");
-    }
-
-    let state = AppState {
-        converter: Arc::new(RwLock::new(RomajiConverter::new())),
-        llamacpp_models: Arc::new(RwLock::new(llamacpp_models)),
-        debug_mode: args.debug,
-    };
-
-    // Setup CORS
-    let cors = CorsLayer::new()
-        .allow_origin(Any)
-        .allow_methods(Any)
-        .allow_headers(Any);
-
-    // Build router
-    let mut app = Router::new()
-        .route("/api/convert", post(convert_handler))
-        .route("/api/reset", post(reset_handler))
-        .route("/api/kanji/convert", post(kanji_convert_handler))
-        .route("/api/models", get(models_handler))
-        .route("/health", get(health_handler));
-
-    // Add debug-only routes
-    if args.debug {
-        app = app.route("/api/tokenize", post(tokenize_handler));
-    }
-
-    let app = app
-        .fallback_service(ServeDir::new("static"))
-        .layer(DefaultBodyLimit::max(256 * 1024)) // 256 KB
-        .layer(cors)
-        .with_state(state);
-
-    // Start server
-    let bind_addr = format!("{}:{}", args.host, args.port);
-    let listener = tokio::net::TcpListener::bind(&bind_addr)
-        .await
-        .expect("failed to bind server address");
-
-    tracing::info!("Server listening on http://{}", bind_addr);
-
-    axum::serve(listener, app)
-        .await
-        .expect("failed to run server");
+    llamacpp_models
 }
 
 async fn convert_handler(
@@ -349,6 +446,22 @@ fn resolve_default_model_id(models: &HashMap<String, LlamaCppModelInfo>) -> Stri
 }
 
 async fn models_handler(State(state): State<AppState>) -> impl IntoResponse {
+    // The daemon loads any registry variant on first use
+    if state.daemon.is_some() {
+        let models = registry()
+            .iter_variants()
+            .map(|(_, variant)| ModelInfo {
+                id: variant.id.clone(),
+                name: variant.display_name.clone(),
+                model_id: variant.id.clone(),
+            })
+            .collect();
+        return Json(ModelsResponse {
+            models,
+            default: registry().default_model.clone(),
+        });
+    }
+
     let llamacpp_models = state.llamacpp_models.read().expect("lock poisoned");
 
     let mut models: Vec<ModelInfo> = llamacpp_models
@@ -371,28 +484,236 @@ async fn models_handler(State(state): State<AppState>) -> impl IntoResponse {
     })
 }
 
+/// The model a conversion request asks for, or the default one
+fn resolve_request_model_id(
+    state: &AppState,
+    requested: Option<&str>,
+) -> Result<String, (StatusCode, String)> {
+    if let Some(model_id) = requested {
+        return Ok(model_id.to_string());
+    }
+    if state.daemon.is_some() {
+        return Ok(registry().default_model.clone());
+    }
+    let llamacpp_models = state.llamacpp_models.read().expect("lock poisoned");
+    let default_id = resolve_default_model_id(&llamacpp_models);
+    if default_id.is_empty() {
+        return Err((
+            StatusCode::SERVICE_UNAVAILABLE,
+            "No models loaded".to_string(),
+        ));
+    }
+    Ok(default_id)
+}
+
 async fn kanji_convert_handler(
     State(state): State<AppState>,
     Json(req): Json<KanjiConvertRequest>,
 ) -> Result<Json<KanjiConvertResponse>, (StatusCode, String)> {
     let katakana = hiragana_to_katakana(&req.hiragana);
+    let model_id = resolve_request_model_id(&state, req.model.as_deref())?;
+
+    if let Some(daemon) = &state.daemon {
+        return daemon_convert(Arc::clone(daemon), &req, &katakana, &model_id).await;
+    }
+    llamacpp_convert(&state, &req, &katakana, &model_id).await
+}
 
-    // Determine which model to use
-    let model_id = if let Some(ref model_str) = req.model {
-        model_str.clone()
+/// Handle kanji conversion on the conversion daemon.
+///
+/// The daemon only returns candidates, so the token visualization fields are empty.
+async fn daemon_convert(
+    daemon: Arc<DaemonClient>,
+    req: &KanjiConvertRequest,
+    katakana: &str,
+    model_id: &str,
+) -> Result<Json<KanjiConvertResponse>, (StatusCode, String)> {
+    let beam_size = req.num_candidates.clamp(1, 20);
+    let (model, reading, context) = (
+        model_id.to_string(),
+        req.hiragana.clone(),
+        req.context.clone(),
+    );
+
+    let start = std::time::Instant::now();
+    let result = tokio::task::spawn_blocking(move || {
+        let display_name = daemon.load(&model)?;
+        let candidates = daemon.convert(&model, &reading, &context, beam_size)?;
+        Ok::<_, KanjiError>((display_name, candidates))
+    })
+    .await
+    .map_err(|e| {
+        (
+            StatusCode::INTERNAL_SERVER_ERROR,
+            format!("Daemon request failed: {}", e),
+        )
+    })?;
+    let (display_name, candidates) = result.map_err(|e| {
+        tracing::error!("daemon conversion error: {:?}", e);
+        (StatusCode::BAD_GATEWAY, format!("Daemon error: {:?}", e))
+    })?;
+    let inference_time_ms = start.elapsed().as_secs_f64() * 1000.0;
+
+    Ok(Json(KanjiConvertResponse {
+        candidates,
+        katakana: katakana.to_string(),
+        inference_time_ms,
+        top_k: None,
+        model: display_name,
+        input_tokens: None,
+        output_tokens: None,
+        tokens: None,
+        candidate_tokens: None,
+        beam_search_type: Some(if beam_size == 1 { "greedy" } else { "true" }.to_string()),
+    }))
+}
+
+/// Convert many readings at once.
+///
+/// Items run as concurrent sequences of one multi-sequence llama.cpp context,
+/// `max_batch` at a time (`LlamaCppModel::generate_batch`); on the daemon they
+/// are sent side by side so its model worker batches them.
+async fn kanji_batch_handler(
+    State(state): State<AppState>,
+    Json(req): Json<KanjiBatchRequest>,
+) -> Result<Json<KanjiBatchResponse>, (StatusCode, String)> {
+    let model_id = resolve_request_model_id(&state, req.model.as_deref())?;
+    let max_batch = state.max_batch;
+    let items: Vec<(String, String)> = req
+        .items
+        .into_iter()
+        .map(|item| (item.hiragana, item.context))
+        .collect();
+
+    let start = std::time::Instant::now();
+    let (display_name, candidates) = if let Some(daemon) = &state.daemon {
+        let daemon = Arc::clone(daemon);
+        let items = items.clone();
+        tokio::task::spawn_blocking(move || {
+            daemon_convert_batch(&daemon, &model_id, &items, max_batch)
+        })
+        .await
+        .map_err(|e| {
+            (
+                StatusCode::INTERNAL_SERVER_ERROR,
+                format!("Daemon request failed: {}", e),
+            )
+        })?
+        .map_err(|e| {
+            tracing::error!("daemon batch conversion error: {:?}", e);
+            (StatusCode::BAD_GATEWAY, format!("Daemon error: {:?}", e))
+        })?
     } else {
-        let llamacpp_models = state.llamacpp_models.read().expect("lock poisoned");
-        let default_id = resolve_default_model_id(&llamacpp_models);
-        if default_id.is_empty() {
-            return Err((
-                StatusCode::SERVICE_UNAVAILABLE,
-                "No models loaded".to_string(),
-            ));
-        }
-        default_id
+        let model_info = state
+            .llamacpp_models
+            .read()
+            .expect("lock poisoned")
+            .get(&model_id)
+            .cloned()
+            .ok_or_else(|| {
+                (
+                    StatusCode::NOT_FOUND,
+                    format!("llama.cpp model '{}' not loaded", model_id),
+                )
+            })?;
+        let items = items.clone();
+        let candidates = tokio::task::spawn_blocking(move || {
+            llamacpp_convert_batch(&model_info.model, &items, max_batch)
+        })
+        .await
+        .map_err(|e| {
+            (
+                StatusCode::INTERNAL_SERVER_ERROR,
+                format!("Batch conversion failed: {}", e),
+            )
+        })?
+        .map_err(|e| {
+            tracing::error!("llama.cpp batch conversion error: {}", e);
+            (
+                StatusCode::INTERNAL_SERVER_ERROR,
+                format!("Generate error: {}", e),
+            )
+        })?;
+        (model_info.display_name, candidates)
     };
+    let inference_time_ms = start.elapsed().as_secs_f64() * 1000.0;
+    tracing::debug!(
+        "batch of {} converted in {:.1} ms",
+        items.len(),
+        inference_time_ms
+    );
 
-    llamacpp_convert(&state, &req, &katakana, &model_id).await
+    let results = items
+        .iter()
+        .zip(candidates)
+        .map(|((hiragana, _), candidates)| KanjiBatchResult {
+            candidates,
+            katakana: hiragana_to_katakana(hiragana),
+        })
+        .collect();
+    Ok(Json(KanjiBatchResponse {
+        results,
+        inference_time_ms,
+        model: display_name,
+        batch_size: max_batch,
+    }))
+}
+
+/// Greedy candidates for each (hiragana, context) item with an in-process model
+fn llamacpp_convert_batch(
+    model: &LlamaCppModel,
+    items: &[(String, String)],
+    max_batch: usize,
+) -> Result<Vec<Vec<String>>, KanjiError> {
+    let prompts = items
+        .iter()
+        .map(|(hiragana, context)| model.tokenize_prompt(&hiragana_to_katakana(hiragana), context))
+        .collect::<Result<Vec<_>, _>>()?;
+    let eos_token_id = Some(model.eos_token_id().0);
+    let outputs = model.generate_batch(&prompts, 64, eos_token_id, max_batch)?;
+
+    items
+        .iter()
+        .zip(outputs)
+        .map(|((hiragana, _), generated)| {
+            let output = clean_model_output(&model.decode(&generated, true)?);
+            Ok(vec![if output.is_empty() {
+                hiragana.clone()
+            } else {
+                output
+            }])
+        })
+        .collect()
+}
+
+/// Greedy candidates for each (hiragana, context) item on the daemon,
+/// `max_batch` requests in flight at a time
+fn daemon_convert_batch(
+    daemon: &DaemonClient,
+    model_id: &str,
+    items: &[(String, String)],
+    max_batch: usize,
+) -> Result<(String, Vec<Vec<String>>), KanjiError> {
+    let display_name = daemon.load(model_id)?;
+    let mut candidates = Vec::with_capacity(items.len());
+    for chunk in items.chunks(max_batch) {
+        let results: Vec<_> = std::thread::scope(|scope| {
+            let handles: Vec<_> = chunk
+                .iter()
+                .map(|(hiragana, context)| {
+                    scope.spawn(move || daemon.convert(model_id, hiragana, context, 1))
+                })
+                .collect();
+            handles
+                .into_iter()
+                .map(|handle| handle.join().expect("daemon request thread panicked"))
+                .collect()
+        });
+        for result in results {
+            candidates.push(result?);
+        }
+    }
+    Ok((display_name, candidates))
 }
 
 /// Tokenize request (debug mode only)
@@ -519,20 +840,17 @@ async fn llamacpp_convert(
         tokens
     };
 
-    // Build prompt in jinen format
     // Note: NFKC normalization is handled by the tokenizer's normalizer (tokenizer.json).
-    let prompt = build_jinen_prompt(katakana, &req.context);
     tracing::debug!(
-        "llama.cpp prompt: katakana='{}', context='{}', prompt_len={}",
+        "llama.cpp prompt: katakana='{}', context='{}'",
         katakana,
-        req.context,
-        prompt.len()
+        req.context
     );
 
     let start = std::time::Instant::now();
 
-    // Tokenize and generate
-    let input_tokens = model.tokenize(&prompt).map_err(|e| {
+    // Tokenize the jinen prompt and generate
+    let input_tokens = model.tokenize_prompt(katakana, &req.context).map_err(|e| {
         tracing::error!("llama.cpp tokenize error: {}", e);
         (
             StatusCode::INTERNAL_SERVER_ERROR,
@@ -0,0 +1,367 @@
+//! Client side of the daemon socket
+
+use std::io::{self, Read};
+use std::os::unix::net::UnixStream;
+use std::path::{Path, PathBuf};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+use tracing::debug;
+
+use super::protocol::{PROTOCOL_VERSION, Request, Response, read_payload};
+use crate::kanji::KanjiError;
+
+type Result<T> = crate::kanji::error::Result<T>;
+
+/// After a failed connect, requests fail immediately for this long
+const RECONNECT_BACKOFF: Duration = Duration::from_secs(2);
+
+/// Longest wait for the answer to a conversion or token count
+const REPLY_TIMEOUT: Duration = Duration::from_secs(10);
+
+/// How often a waiting request polls `should_stop`
+const POLL_INTERVAL: Duration = Duration::from_millis(5);
+
+/// Connection to a running `karukan-daemon`.
+///
+/// Each request takes an idle connection (or opens one) and returns it when
+/// done, so requests from several threads run side by side on the daemon
+/// instead of queueing on one socket. A connection that fails mid-request is
+/// dropped; a stale idle one (daemon restarted) is replaced once transparently.
+pub struct DaemonClient {
+    path: PathBuf,
+    idle: Mutex<Vec<UnixStream>>,
+    /// Set by a failed connect: no new connection is tried before this time
+    retry_at: Mutex<Option<Instant>>,
+}
+
+impl DaemonClient {
+    /// Connect to the daemon at `path`; fails if nothing answers there
+    pub fn connect(path: impl Into<PathBuf>) -> Result<Self> {
+        let client = Self {
+            path: path.into(),
+            idle: Mutex::new(Vec::new()),
+            retry_at: Mutex::new(None),
+        };
+        let stream = client.open()?;
+        client.release(stream);
+        Ok(client)
+    }
+
+    pub fn socket_path(&self) -> &Path {
+        &self.path
+    }
+
+    /// False while connecting is backed off after a failure
+    pub fn is_available(&self) -> bool {
+        self.retry_at
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .is_none_or(|at| Instant::now() >= at)
+    }
+
+    /// Make the daemon load model variant `model`; returns its display name.
+    /// Waits as long as the load takes (it may download the model).
+    pub fn load(&self, model: &str) -> Result<String> {
+        let request = Request::Load {
+            model: model.to_string(),
+        };
+        match self.call(&request, None, &|| false)? {
+            Response::Loaded { display_name } => Ok(display_name),
+            other => Err(unexpected(other)),
+        }
+    }
+
+    /// `KanaKanjiConverter::convert` on the daemon's instance of `model`
+    pub fn convert(
+        &self,
+        model: &str,
+        reading: &str,
+        context: &str,
+        num_candidates: usize,
+    ) -> Result<Vec<String>> {
+        self.convert_cancellable(model, reading, context, num_candidates, &|| false)
+    }
+
+    /// `convert`, returning `KanjiError::Cancelled` as soon as `should_stop`
+    /// fires while waiting (the daemon finishes the conversion regardless)
+    pub fn convert_cancellable(
+        &self,
+        model: &str,
+        reading: &str,
+        context: &str,
+        num_candidates: usize,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Vec<String>> {
+        let request = Request::Convert {
+            model: model.to_string(),
+            reading: reading.to_string(),
+            context: context.to_string(),
+            num_candidates: num_candidates.min(u8::MAX as usize) as u8,
+        };
+        match self.call(&request, Some(REPLY_TIMEOUT), should_stop)? {
+            Response::Candidates(candidates) => Ok(candidates),
+            other => Err(unexpected(other)),
+        }
+    }
+
+    /// `KanaKanjiConverter::count_input_tokens` with the tokenizer of `model`
+    pub fn count_input_tokens(&self, model: &str, reading: &str) -> Result<usize> {
+        let request = Request::CountTokens {
+            model: model.to_string(),
+            reading: reading.to_string(),
+        };
+        match self.call(&request, Some(REPLY_TIMEOUT), &|| false)? {
+            Response::TokenCount(count) => Ok(count as usize),
+            other => Err(unexpected(other)),
+        }
+    }
+
+    /// Send `request` and wait for the answer (at most `timeout`, None = forever)
+    fn call(
+        &self,
+        request: &Request,
+        timeout: Option<Duration>,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Response> {
+        let pooled = self.idle.lock().unwrap_or_else(|e| e.into_inner()).pop();
+        let response = match pooled {
+            Some(stream) => match exchange(stream, request, timeout, should_stop) {
+                // Only a peer that went away (daemon restarted) is worth a second
+                // try; a timeout means it is busy, and resending doubles its load
+                Err(e) if is_closed(&e) => {
+                    debug!("daemon: reconnecting after {}", e);
+                    exchange(self.open()?, request, timeout, should_stop)
+                }
+                result => result,
+            },
+            None => exchange(self.open()?, request, timeout, should_stop),
+        };
+        let (stream, response) = response.map_err(|e| match e.kind() {
+            io::ErrorKind::Interrupted => KanjiError::Cancelled,
+            _ => KanjiError::Inference(e.into()),
+        })?;
+        self.release(stream);
+        match response {
+            Response::Error(message) => Err(KanjiError::Inference(message.into())),
+            response => Ok(response),
+        }
+    }
+
+    fn release(&self, stream: UnixStream) {
+        self.idle
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .push(stream);
+    }
+
+    /// Open a connection and exchange hellos (backed off after failures)
+    fn open(&self) -> Result<UnixStream> {
+        let mut retry_at = self.retry_at.lock().unwrap_or_else(|e| e.into_inner());
+        if retry_at.is_some_and(|at| Instant::now() < at) {
+            return Err(KanjiError::Inference(
+                format!("daemon at {:?} unavailable", self.path).into(),
+            ));
+        }
+        let opened = UnixStream::connect(&self.path).and_then(|stream| {
+            let hello = Request::Hello {
+                version: PROTOCOL_VERSION,
+            };
+            match exchange(stream, &hello, Some(REPLY_TIMEOUT), &|| false)? {
+                (stream, Response::Hello { version }) if version == PROTOCOL_VERSION => Ok(stream),
+                (_, Response::Error(message)) => Err(io::Error::other(message)),
+                (_, other) => Err(io::Error::other(format!("unexpected hello {:?}", other))),
+            }
+        });
+        match opened {
+            Ok(stream) => {
+                *retry_at = None;
+                Ok(stream)
+            }
+            Err(e) => {
+                debug!("daemon: cannot connect to {:?}: {}", self.path, e);
+                *retry_at = Some(Instant::now() + RECONNECT_BACKOFF);
+                Err(KanjiError::Inference(e.into()))
+            }
+        }
+    }
+}
+
+/// Whether `e` says the connection was closed before any of the reply arrived
+/// (`exchange` reports a reply cut off midway as `ErrorKind::Other`)
+fn is_closed(e: &io::Error) -> bool {
+    matches!(
+        e.kind(),
+        io::ErrorKind::UnexpectedEof | io::ErrorKind::BrokenPipe | io::ErrorKind::ConnectionReset
+    )
+}
+
+/// A read error after part of the reply arrived: never retried
+fn cut_off(e: io::Error) -> io::Error {
+    io::Error::other(format!("daemon reply cut off: {}", e))
+}
+
+/// Write `request` on `stream` and read the response, polling `should_stop`
+/// until an answer starts to arrive (`Interrupted` if it fired)
+fn exchange(
+    mut stream: UnixStream,
+    request: &Request,
+    timeout: Option<Duration>,
+    should_stop: &dyn Fn() -> bool,
+) -> io::Result<(UnixStream, Response)> {
+    request.write_to(&mut stream)?;
+    let start = Instant::now();
+    stream.set_read_timeout(Some(POLL_INTERVAL))?;
+    let mut len = [0u8; 4];
+    let mut filled = 0;
+    while filled < len.len() {
+        match stream.read(&mut len[filled..]) {
+            Ok(0) if filled == 0 => return Err(io::ErrorKind::UnexpectedEof.into()),
+            Ok(0) => return Err(cut_off(io::ErrorKind::UnexpectedEof.into())),
+            Ok(n) => filled += n,
+            Err(e)
+                if matches!(
+                    e.kind(),
+                    io::ErrorKind::WouldBlock | io::ErrorKind::TimedOut
+                ) =>
+            {
+                if filled == 0 && should_stop() {
+                    return Err(io::ErrorKind::Interrupted.into());
+                }
+                if timeout.is_some_and(|timeout| start.elapsed() >= timeout) {
+                    return Err(io::ErrorKind::TimedOut.into());
+                }
+            }
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+            Err(e) if filled == 0 => return Err(e),
+            Err(e) => return Err(cut_off(e)),
+        }
+    }
+    // The answer has started; read the rest of the frame without polling
+    stream.set_read_timeout(Some(REPLY_TIMEOUT))?;
+    let payload = read_payload(&mut stream, len).map_err(cut_off)?;
+    let response = Response::decode(&payload)?;
+    Ok((stream, response))
+}
+
+fn unexpected(response: Response) -> KanjiError {
+    KanjiError::Inference(format!("unexpected daemon response {:?}", response).into())
+}
+
+#[cfg(test)]
+mod tests {
+    use std::io::Write;
+    use std::os::unix::net::UnixListener;
+    use std::sync::Arc;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    use super::super::DaemonServer;
+    use super::*;
+    use crate::kanji::{BatchConfig, ModelOptions};
+
+    #[test]
+    fn test_connect_fails_without_daemon() {
+        let dir = tempfile::tempdir().unwrap();
+        assert!(DaemonClient::connect(dir.path().join("missing.sock")).is_err());
+    }
+
+    #[test]
+    fn test_requests_reach_the_daemon() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("daemon.sock");
+        let listener = UnixListener::bind(&path).unwrap();
+        let server = Arc::new(DaemonServer::new(
+            0,
+            ModelOptions::default(),
+            BatchConfig::default(),
+        ));
+        std::thread::spawn(move || server.serve(listener));
+
+        let client = DaemonClient::connect(&path).unwrap();
+        // Unknown variants fail on the daemon without loading anything;
+        // the error comes back and the connection stays usable
+        for _ in 0..2 {
+            let Err(KanjiError::Inference(message)) = client.load("no-such-model") else {
+                panic!("expected the daemon's error");
+            };
+            assert!(message.to_string().contains("no-such-model"), "{}", message);
+            assert!(matches!(
+                client.convert("no-such-model", "かんじ", "", 1),
+                Err(KanjiError::Inference(_))
+            ));
+        }
+        assert!(client.is_available());
+    }
+
+    /// Stand-in daemon: answers hellos, and the `n`th conversion with `reply(n)`
+    /// (None closes the connection after writing `partial` bytes of a frame)
+    fn fake_daemon(
+        listener: UnixListener,
+        reply: fn(usize) -> Option<Response>,
+        partial: fn(usize) -> usize,
+    ) -> Arc<AtomicUsize> {
+        let connections = Arc::new(AtomicUsize::new(0));
+        let converts = Arc::new(AtomicUsize::new(0));
+        let counted = connections.clone();
+        std::thread::spawn(move || {
+            for mut stream in listener.incoming().map_while(|s| s.ok()) {
+                counted.fetch_add(1, Ordering::SeqCst);
+                let converts = converts.clone();
+                std::thread::spawn(move || {
+                    while let Ok(request) = Request::read_from(&mut stream) {
+                        let response = match request {
+                            Request::Hello { version } => Response::Hello { version },
+                            _ => {
+                                let n = converts.fetch_add(1, Ordering::SeqCst);
+                                match reply(n) {
+                                    Some(response) => response,
+                                    None => {
+                                        let _ = stream.write_all(&[7, 0, 0, 0][..partial(n)]);
+                                        return;
+                                    }
+                                }
+                            }
+                        };
+                        if response.write_to(&mut stream).is_err() {
+                            return;
+                        }
+                    }
+                });
+            }
+        });
+        connections
+    }
+
+    #[test]
+    fn test_retries_only_when_closed_before_the_reply() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("daemon.sock");
+        // 0: answered; 1: closed without a reply; 2: the retry, answered;
+        // 3: closed halfway through the length prefix
+        let connections = fake_daemon(
+            UnixListener::bind(&path).unwrap(),
+            |n| matches!(n, 0 | 2).then(|| Response::Candidates(vec!["漢字".into()])),
+            |n| if n == 3 { 2 } else { 0 },
+        );
+        let client = DaemonClient::connect(&path).unwrap();
+
+        assert_eq!(client.convert("m", "かんじ", "", 1).unwrap(), ["漢字"]);
+        assert_eq!(client.convert("m", "かんじ", "", 1).unwrap(), ["漢字"]);
+        assert_eq!(connections.load(Ordering::SeqCst), 2);
+        assert!(client.convert("m", "かんじ", "", 1).is_err());
+        assert_eq!(connections.load(Ordering::SeqCst), 2);
+    }
+
+    #[test]
+    fn test_is_closed() {
+        for kind in [
+            io::ErrorKind::UnexpectedEof,
+            io::ErrorKind::BrokenPipe,
+            io::ErrorKind::ConnectionReset,
+        ] {
+            assert!(is_closed(&kind.into()));
+            assert!(!is_closed(&cut_off(kind.into())));
+        }
+        assert!(!is_closed(&io::ErrorKind::TimedOut.into()));
+    }
+}
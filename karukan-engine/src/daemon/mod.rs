@@ -0,0 +1,37 @@
+//! Out-of-process conversion daemon
+//!
+//! `karukan-daemon` loads each model variant once per machine and serves
+//! conversions to every client (the fcitx5 addons of all sessions, the HTTP
+//! server) over a Unix socket. Greedy conversions that arrive while a model is
+//! busy are decoded together as one multi-sequence batch on the next round.
+//!
+//! Clients use `DaemonClient`; when the socket does not answer they load the
+//! models in-process as before. Dictionaries are not served: KRKN files are
+//! memory-mapped, so processes already share their pages.
+
+mod client;
+pub mod protocol;
+mod server;
+
+use std::path::PathBuf;
+
+pub use client::DaemonClient;
+pub use server::DaemonServer;
+
+/// Environment variable overriding `default_socket_path`
+pub const SOCKET_ENV: &str = "KARUKAN_DAEMON_SOCKET";
+
+/// Socket the daemon listens on and clients connect to by default:
+/// `$KARUKAN_DAEMON_SOCKET`, else `$XDG_RUNTIME_DIR/karukan/daemon.sock`.
+///
+/// None without either: a shared directory such as /tmp would let any local
+/// user put a socket there first and receive everything typed, so the path
+/// must then be given explicitly. The default is per user; to share one daemon
+/// between users, point the daemon and every client at the same path.
+pub fn default_socket_path() -> Option<PathBuf> {
+    if let Some(path) = std::env::var_os(SOCKET_ENV) {
+        return Some(PathBuf::from(path));
+    }
+    std::env::var_os("XDG_RUNTIME_DIR")
+        .map(|dir| PathBuf::from(dir).join("karukan").join("daemon.sock"))
+}
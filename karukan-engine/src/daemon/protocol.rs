@@ -0,0 +1,346 @@
+//! Wire format of the daemon socket
+//!
+//! Every message is one frame: a little-endian `u32` payload length followed by
+//! the payload. A payload starts with an opcode byte; strings are a `u16`
+//! byte length plus UTF-8, string lists a `u16` count plus the strings.
+//! A connection starts with a `Hello` exchange that checks `PROTOCOL_VERSION`.
+
+use std::io::{self, Read, Write};
+
+/// Bumped on every incompatible change of the wire format
+pub const PROTOCOL_VERSION: u8 = 1;
+
+/// Largest payload either side accepts
+pub const MAX_FRAME_LEN: usize = 1 << 20;
+
+const OP_HELLO: u8 = 0x01;
+const OP_LOAD: u8 = 0x02;
+const OP_CONVERT: u8 = 0x03;
+const OP_COUNT_TOKENS: u8 = 0x04;
+
+const OP_HELLO_REPLY: u8 = 0x81;
+const OP_LOADED: u8 = 0x82;
+const OP_CANDIDATES: u8 = 0x83;
+const OP_TOKEN_COUNT: u8 = 0x84;
+const OP_ERROR: u8 = 0xff;
+
+/// Client → daemon
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Request {
+    /// First message of a connection
+    Hello { version: u8 },
+    /// Make sure a model variant is loaded; answered with `Response::Loaded`
+    Load { model: String },
+    /// Convert `reading` with model variant `model`; answered with `Response::Candidates`
+    Convert {
+        model: String,
+        reading: String,
+        context: String,
+        num_candidates: u8,
+    },
+    /// Count the reading's tokens with the model's tokenizer; answered with `Response::TokenCount`
+    CountTokens { model: String, reading: String },
+}
+
+/// Daemon → client
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Response {
+    Hello {
+        version: u8,
+    },
+    Loaded {
+        display_name: String,
+    },
+    Candidates(Vec<String>),
+    TokenCount(u32),
+    /// The request failed; the connection stays usable
+    Error(String),
+}
+
+impl Request {
+    pub fn encode(&self) -> io::Result<Vec<u8>> {
+        let mut out = Vec::new();
+        match self {
+            Request::Hello { version } => {
+                out.push(OP_HELLO);
+                out.push(*version);
+            }
+            Request::Load { model } => {
+                out.push(OP_LOAD);
+                put_str(&mut out, model)?;
+            }
+            Request::Convert {
+                model,
+                reading,
+                context,
+                num_candidates,
+            } => {
+                out.push(OP_CONVERT);
+                put_str(&mut out, model)?;
+                put_str(&mut out, reading)?;
+                put_str(&mut out, context)?;
+                out.push(*num_candidates);
+            }
+            Request::CountTokens { model, reading } => {
+                out.push(OP_COUNT_TOKENS);
+                put_str(&mut out, model)?;
+                put_str(&mut out, reading)?;
+            }
+        }
+        Ok(out)
+    }
+
+    pub fn decode(payload: &[u8]) -> io::Result<Self> {
+        let mut r = Reader(payload);
+        let request = match r.u8()? {
+            OP_HELLO => Request::Hello { version: r.u8()? },
+            OP_LOAD => Request::Load { model: r.str()? },
+            OP_CONVERT => Request::Convert {
+                model: r.str()?,
+                reading: r.str()?,
+                context: r.str()?,
+                num_candidates: r.u8()?,
+            },
+            OP_COUNT_TOKENS => Request::CountTokens {
+                model: r.str()?,
+                reading: r.str()?,
+            },
+            op => return Err(invalid(format!("unknown request opcode {:#04x}", op))),
+        };
+        r.finish()?;
+        Ok(request)
+    }
+
+    pub fn write_to(&self, w: &mut impl Write) -> io::Result<()> {
+        write_frame(w, &self.encode()?)
+    }
+
+    pub fn read_from(r: &mut impl Read) -> io::Result<Self> {
+        Self::decode(&read_frame(r)?)
+    }
+}
+
+impl Response {
+    pub fn encode(&self) -> io::Result<Vec<u8>> {
+        let mut out = Vec::new();
+        match self {
+            Response::Hello { version } => {
+                out.push(OP_HELLO_REPLY);
+                out.push(*version);
+            }
+            Response::Loaded { display_name } => {
+                out.push(OP_LOADED);
+                put_str(&mut out, display_name)?;
+            }
+            Response::Candidates(candidates) => {
+                out.push(OP_CANDIDATES);
+                let count = u16::try_from(candidates.len())
+                    .map_err(|_| invalid("too many candidates".to_string()))?;
+                out.extend_from_slice(&count.to_le_bytes());
+                for candidate in candidates {
+                    put_str(&mut out, candidate)?;
+                }
+            }
+            Response::TokenCount(count) => {
+                out.push(OP_TOKEN_COUNT);
+                out.extend_from_slice(&count.to_le_bytes());
+            }
+            Response::Error(message) => {
+                out.push(OP_ERROR);
+                // Error messages are informational; cut rather than fail
+                let mut end = message.len().min(u16::MAX as usize);
+                while !message.is_char_boundary(end) {
+                    end -= 1;
+                }
+                put_str(&mut out, &message[..end])?;
+            }
+        }
+        Ok(out)
+    }
+
+    pub fn decode(payload: &[u8]) -> io::Result<Self> {
+        let mut r = Reader(payload);
+        let response = match r.u8()? {
+            OP_HELLO_REPLY => Response::Hello { version: r.u8()? },
+            OP_LOADED => Response::Loaded {
+                display_name: r.str()?,
+            },
+            OP_CANDIDATES => {
+                let count = r.u16()?;
+                Response::Candidates((0..count).map(|_| r.str()).collect::<io::Result<_>>()?)
+            }
+            OP_TOKEN_COUNT => Response::TokenCount(u32::from_le_bytes(r.take_array()?)),
+            OP_ERROR => Response::Error(r.str()?),
+            op => return Err(invalid(format!("unknown response opcode {:#04x}", op))),
+        };
+        r.finish()?;
+        Ok(response)
+    }
+
+    pub fn write_to(&self, w: &mut impl Write) -> io::Result<()> {
+        write_frame(w, &self.encode()?)
+    }
+
+    pub fn read_from(r: &mut impl Read) -> io::Result<Self> {
+        Self::decode(&read_frame(r)?)
+    }
+}
+
+/// Write `payload` as one frame
+pub fn write_frame(w: &mut impl Write, payload: &[u8]) -> io::Result<()> {
+    if payload.len() > MAX_FRAME_LEN {
+        return Err(invalid(format!("frame of {} bytes", payload.len())));
+    }
+    let mut frame = Vec::with_capacity(4 + payload.len());
+    frame.extend_from_slice(&(payload.len() as u32).to_le_bytes());
+    frame.extend_from_slice(payload);
+    w.write_all(&frame)?;
+    w.flush()
+}
+
+/// Read one frame and return its payload
+pub fn read_frame(r: &mut impl Read) -> io::Result<Vec<u8>> {
+    let mut len = [0u8; 4];
+    r.read_exact(&mut len)?;
+    read_payload(r, len)
+}
+
+/// Read the rest of a frame whose length prefix `len` was already read
+pub fn read_payload(r: &mut impl Read, len: [u8; 4]) -> io::Result<Vec<u8>> {
+    let len = u32::from_le_bytes(len) as usize;
+    if len > MAX_FRAME_LEN {
+        return Err(invalid(format!("frame of {} bytes", len)));
+    }
+    let mut payload = vec![0u8; len];
+    r.read_exact(&mut payload)?;
+    Ok(payload)
+}
+
+fn invalid(message: String) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message)
+}
+
+fn put_str(out: &mut Vec<u8>, s: &str) -> io::Result<()> {
+    let len =
+        u16::try_from(s.len()).map_err(|_| invalid(format!("string of {} bytes", s.len())))?;
+    out.extend_from_slice(&len.to_le_bytes());
+    out.extend_from_slice(s.as_bytes());
+    Ok(())
+}
+
+/// Cursor over a payload
+struct Reader<'a>(&'a [u8]);
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> io::Result<&'a [u8]> {
+        if self.0.len() < n {
+            return Err(invalid("truncated message".to_string()));
+        }
+        let (head, rest) = self.0.split_at(n);
+        self.0 = rest;
+        Ok(head)
+    }
+
+    fn take_array<const N: usize>(&mut self) -> io::Result<[u8; N]> {
+        Ok(self.take(N)?.try_into().expect("take returns N bytes"))
+    }
+
+    fn u8(&mut self) -> io::Result<u8> {
+        Ok(self.take(1)?[0])
+    }
+
+    fn u16(&mut self) -> io::Result<u16> {
+        Ok(u16::from_le_bytes(self.take_array()?))
+    }
+
+    fn str(&mut self) -> io::Result<String> {
+        let len = self.u16()? as usize;
+        let bytes = self.take(len)?;
+        String::from_utf8(bytes.to_vec()).map_err(|e| invalid(e.to_string()))
+    }
+
+    fn finish(&self) -> io::Result<()> {
+        if self.0.is_empty() {
+            Ok(())
+        } else {
+            Err(invalid(format!("{} trailing bytes", self.0.len())))
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_roundtrip() {
+        let requests = [
+            Request::Hello {
+                version: PROTOCOL_VERSION,
+            },
+            Request::Load {
+                model: "jinen-v1-small-q5".to_string(),
+            },
+            Request::Convert {
+                model: "jinen-v1-small-q5".to_string(),
+                reading: "かんじ".to_string(),
+                context: "今日は".to_string(),
+                num_candidates: 3,
+            },
+            Request::CountTokens {
+                model: "jinen-v1-xsmall-q5".to_string(),
+                reading: "".to_string(),
+            },
+        ];
+        for request in requests {
+            let mut wire = Vec::new();
+            request.write_to(&mut wire).unwrap();
+            assert_eq!(Request::read_from(&mut wire.as_slice()).unwrap(), request);
+        }
+
+        let responses = [
+            Response::Hello {
+                version: PROTOCOL_VERSION,
+            },
+            Response::Loaded {
+                display_name: "jinen-v1-small".to_string(),
+            },
+            Response::Candidates(vec!["漢字".to_string(), "感じ".to_string()]),
+            Response::Candidates(vec![]),
+            Response::TokenCount(7),
+            Response::Error("unknown model variant".to_string()),
+        ];
+        for response in responses {
+            let mut wire = Vec::new();
+            response.write_to(&mut wire).unwrap();
+            assert_eq!(Response::read_from(&mut wire.as_slice()).unwrap(), response);
+        }
+    }
+
+    #[test]
+    fn test_rejects_malformed_frames() {
+        // Truncated frame
+        let mut wire = Vec::new();
+        Request::Load {
+            model: "m".to_string(),
+        }
+        .write_to(&mut wire)
+        .unwrap();
+        wire.pop();
+        assert!(Request::read_from(&mut wire.as_slice()).is_err());
+
+        // Oversized length prefix
+        let wire = (MAX_FRAME_LEN as u32 + 1).to_le_bytes();
+        assert!(read_frame(&mut wire.as_slice()).is_err());
+
+        // Unknown opcode and trailing bytes
+        assert!(Request::decode(&[0x7f]).is_err());
+        assert!(Request::decode(&[OP_HELLO, PROTOCOL_VERSION, 0]).is_err());
+
+        // Strings longer than a u16 length cannot be sent
+        let long = Request::Load {
+            model: "x".repeat(u16::MAX as usize + 1),
+        };
+        assert!(long.encode().is_err());
+    }
+}
@@ -0,0 +1,282 @@
+//! Daemon side: model workers and the per-connection request loop
+
+use std::collections::HashMap;
+use std::io;
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::sync::{Arc, Mutex, mpsc};
+
+use tracing::{debug, info, warn};
+
+use super::protocol::{PROTOCOL_VERSION, Request, Response};
+use crate::kanji::{
+    Backend, BatchConfig, ConversionConfig, KanaKanjiConverter, KanjiError, ModelOptions,
+};
+
+type Result<T> = crate::kanji::error::Result<T>;
+
+/// One queued conversion and where to send its result
+struct Job {
+    reading: String,
+    context: String,
+    num_candidates: usize,
+    reply: mpsc::Sender<Result<Vec<String>>>,
+}
+
+/// A loaded model and the queue of its worker thread
+struct ModelWorker {
+    converter: Arc<KanaKanjiConverter>,
+    jobs: mpsc::Sender<Job>,
+}
+
+/// The worker of one model variant, empty until it is loaded
+type WorkerSlot = Mutex<Option<Arc<ModelWorker>>>;
+
+/// Conversion daemon serving every model variant clients ask for.
+///
+/// Each model is loaded on first use and gets one worker thread, so requests
+/// for the same model never run concurrently (as on an in-process inference
+/// lane). The worker takes the jobs queued while it was busy, waiting up to
+/// `BatchConfig::max_wait` for more: greedy ones are decoded as one batch
+/// (`KanaKanjiConverter::convert_batch`), beam searches one after another.
+pub struct DaemonServer {
+    models: Mutex<HashMap<String, Arc<WorkerSlot>>>,
+    n_threads: u32,
+    options: ModelOptions,
+    batch: BatchConfig,
+}
+
+impl DaemonServer {
+    /// Daemon loading models with `n_threads` (0 = llama.cpp default) and
+    /// `options`, batching greedy conversions per model as `batch` allows
+    pub fn new(n_threads: u32, options: ModelOptions, batch: BatchConfig) -> Self {
+        Self {
+            models: Mutex::new(HashMap::new()),
+            n_threads,
+            options,
+            batch,
+        }
+    }
+
+    /// Load `variant_id` unless already loaded; returns its display name
+    pub fn load(&self, variant_id: &str) -> Result<String> {
+        Ok(self
+            .worker(variant_id)?
+            .converter
+            .model_display_name()
+            .to_string())
+    }
+
+    /// Warm up every loaded model (see `KanaKanjiConverter::warm_up`)
+    pub fn warm_up(&self, lock_pages: bool) {
+        let slots: Vec<_> = self
+            .models
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .values()
+            .cloned()
+            .collect();
+        let workers = slots
+            .iter()
+            .filter_map(|slot| slot.lock().unwrap_or_else(|e| e.into_inner()).clone());
+        for worker in workers {
+            if let Err(e) = worker.converter.warm_up(lock_pages) {
+                warn!(
+                    "Warm-up failed for {}: {}",
+                    worker.converter.model_display_name(),
+                    e
+                );
+            }
+        }
+    }
+
+    /// The worker of `variant_id`, loading the model on first use.
+    /// Loads happen outside the map lock, under the variant's own slot, so
+    /// concurrent first requests load it once without blocking other models.
+    fn worker(&self, variant_id: &str) -> Result<Arc<ModelWorker>> {
+        let slot = Arc::clone(
+            self.models
+                .lock()
+                .unwrap_or_else(|e| e.into_inner())
+                .entry(variant_id.to_string())
+                .or_default(),
+        );
+        let mut loaded = slot.lock().unwrap_or_else(|e| e.into_inner());
+        if let Some(worker) = loaded.as_ref() {
+            return Ok(Arc::clone(worker));
+        }
+        match self.spawn_worker(variant_id) {
+            Ok(worker) => {
+                let worker = Arc::new(worker);
+                *loaded = Some(Arc::clone(&worker));
+                Ok(worker)
+            }
+            Err(e) => {
+                // Requests waiting on the slot retry the load; drop it only if
+                // no one else holds it, so unknown variants do not pile up
+                let mut models = self.models.lock().unwrap_or_else(|e| e.into_inner());
+                if Arc::strong_count(&slot) == 2 {
+                    models.remove(variant_id);
+                }
+                Err(e)
+            }
+        }
+    }
+
+    /// Load `variant_id` and start its worker thread
+    fn spawn_worker(&self, variant_id: &str) -> Result<ModelWorker> {
+        info!("daemon: loading model {}", variant_id);
+        let backend = Backend::from_variant_id(variant_id)?;
+        let mut converter =
+            KanaKanjiConverter::with_options(backend, ConversionConfig::default(), self.options)?;
+        if self.n_threads > 0 {
+            converter.set_n_threads(self.n_threads);
+        }
+        let converter = Arc::new(converter);
+        let (jobs, rx) = mpsc::channel();
+        let worker_converter = Arc::clone(&converter);
+        let batch = self.batch;
+        std::thread::Builder::new()
+            .name("karukan-daemon-model".to_string())
+            .spawn(move || run_worker(&worker_converter, &rx, &batch))
+            .map_err(|e| KanjiError::ModelLoad(e.into()))?;
+        Ok(ModelWorker { converter, jobs })
+    }
+
+    /// Accept clients on `listener` until it fails, one thread per connection
+    pub fn serve(self: Arc<Self>, listener: UnixListener) -> io::Result<()> {
+        for stream in listener.incoming() {
+            let stream = match stream {
+                Ok(stream) => stream,
+                Err(e) => {
+                    warn!("daemon: accept failed: {}", e);
+                    continue;
+                }
+            };
+            let server = Arc::clone(&self);
+            std::thread::Builder::new()
+                .name("karukan-daemon-client".to_string())
+                .spawn(move || {
+                    if let Err(e) = server.handle_connection(stream) {
+                        debug!("daemon: connection closed: {}", e);
+                    }
+                })?;
+        }
+        Ok(())
+    }
+
+    /// Answer the requests of one client until it disconnects
+    fn handle_connection(&self, mut stream: UnixStream) -> io::Result<()> {
+        match Request::read_from(&mut stream)? {
+            Request::Hello {
+                version: PROTOCOL_VERSION,
+            } => Response::Hello {
+                version: PROTOCOL_VERSION,
+            }
+            .write_to(&mut stream)?,
+            other => {
+                let message = format!("expected hello for protocol {}", PROTOCOL_VERSION);
+                debug!("daemon: rejecting {:?}: {}", other, message);
+                return Response::Error(message).write_to(&mut stream);
+            }
+        }
+        loop {
+            let request = match Request::read_from(&mut stream) {
+                Ok(request) => request,
+                Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => return Ok(()),
+                Err(e) => return Err(e),
+            };
+            self.respond(request).write_to(&mut stream)?;
+        }
+    }
+
+    fn respond(&self, request: Request) -> Response {
+        let result = match request {
+            Request::Hello { .. } => Ok(Response::Hello {
+                version: PROTOCOL_VERSION,
+            }),
+            Request::Load { model } => self
+                .load(&model)
+                .map(|display_name| Response::Loaded { display_name }),
+            Request::Convert {
+                model,
+                reading,
+                context,
+                num_candidates,
+            } => self.worker(&model).and_then(|worker| {
+                let (reply, rx) = mpsc::channel();
+                let job = Job {
+                    reading,
+                    context,
+                    num_candidates: usize::from(num_candidates).max(1),
+                    reply,
+                };
+                if worker.jobs.send(job).is_err() {
+                    return Err(KanjiError::Inference("model worker stopped".into()));
+                }
+                rx.recv()
+                    .unwrap_or_else(|_| Err(KanjiError::Inference("model worker stopped".into())))
+                    .map(Response::Candidates)
+            }),
+            Request::CountTokens { model, reading } => self
+                .worker(&model)
+                .and_then(|worker| worker.converter.count_input_tokens(&reading))
+                .map(|count| Response::TokenCount(count as u32)),
+        };
+        result.unwrap_or_else(|e| Response::Error(error_chain(&e)))
+    }
+}
+
+/// Run queued jobs for one model, batching the greedy ones queued together
+fn run_worker(converter: &KanaKanjiConverter, jobs: &mpsc::Receiver<Job>, batch: &BatchConfig) {
+    while let Ok(first) = jobs.recv() {
+        let pending = batch.collect(jobs, first);
+        let (greedy, beam): (Vec<Job>, Vec<Job>) =
+            pending.into_iter().partition(|job| job.num_candidates == 1);
+
+        if greedy.len() > 1 {
+            debug!("daemon: batching {} conversions", greedy.len());
+            let inputs: Vec<(&str, &str)> = greedy
+                .iter()
+                .map(|job| (job.reading.as_str(), job.context.as_str()))
+                .collect();
+            match converter.convert_batch(&inputs, batch) {
+                Ok(results) => {
+                    for (job, candidates) in greedy.iter().zip(results) {
+                        let _ = job.reply.send(Ok(candidates));
+                    }
+                }
+                Err(e) => {
+                    let message = error_chain(&e);
+                    for job in &greedy {
+                        let _ = job
+                            .reply
+                            .send(Err(KanjiError::Inference(message.clone().into())));
+                    }
+                }
+            }
+        } else {
+            // A lone conversion keeps the cached session and its KV prefix
+            for job in greedy {
+                let _ = job
+                    .reply
+                    .send(converter.convert(&job.reading, &job.context, 1));
+            }
+        }
+        for job in beam {
+            let result = converter.convert(&job.reading, &job.context, job.num_candidates);
+            let _ = job.reply.send(result);
+        }
+    }
+}
+
+/// `e` and its sources, joined with ": "
+fn error_chain(e: &dyn std::error::Error) -> String {
+    let mut message = e.to_string();
+    let mut source = e.source();
+    while let Some(cause) = source {
+        message.push_str(": ");
+        message.push_str(&cause.to_string());
+        source = cause.source();
+    }
+    message
+}
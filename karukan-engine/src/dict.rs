@@ -1,8 +1,10 @@
 use std::collections::HashMap;
 use std::fs::File;
-use std::io::{BufRead, BufReader, BufWriter, Read, Write};
+use std::io::{BufRead, BufReader, Read, Write};
+use std::ops::{Deref, Range};
 use std::path::Path;
 
+use memmap2::Mmap;
 use unicode_normalization::UnicodeNormalization;
 
 /// Errors that can occur during dictionary operations.
@@ -26,7 +28,16 @@ use yada::builder::DoubleArrayBuilder;
 use crate::kana::katakana_to_hiragana;
 
 const MAGIC: &[u8; 4] = b"KRKN";
-const VERSION: u32 = 1;
+/// Legacy layout: length-prefixed entries, decoded into owned strings on load
+const VERSION_V1: u32 = 1;
+/// Current layout: flat tables read in place (see `Dictionary::save`)
+const VERSION: u32 = 2;
+
+const HEADER_LEN: usize = 32;
+/// reading_off (u32), first_candidate (u32), reading_len (u16), num_candidates (u16)
+const ENTRY_LEN: usize = 12;
+/// surface_off (u32), score (f32), surface_len (u16)
+const CANDIDATE_LEN: usize = 10;
 
 /// A candidate surface form with its score.
 #[derive(Debug, Clone)]
@@ -42,17 +53,264 @@ pub struct DictEntry {
     pub candidates: Vec<Candidate>,
 }
 
+/// A candidate borrowed from a Dictionary.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct CandidateRef<'a> {
+    pub surface: &'a str,
+    pub score: f32,
+}
+
+impl CandidateRef<'_> {
+    /// Copy into an owned `Candidate`.
+    pub fn to_candidate(&self) -> Candidate {
+        Candidate {
+            surface: self.surface.to_string(),
+            score: self.score,
+        }
+    }
+}
+
+/// The candidates of one reading, decoded lazily from the candidate table.
+#[derive(Clone, Copy)]
+pub struct Candidates<'a> {
+    table: &'a [u8],
+    pool: &'a [u8],
+}
+
+impl<'a> Candidates<'a> {
+    pub fn len(&self) -> usize {
+        self.table.len() / CANDIDATE_LEN
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.table.is_empty()
+    }
+
+    /// Decode the candidate at `index`. Returns `None` if out of range or corrupt.
+    pub fn get(&self, index: usize) -> Option<CandidateRef<'a>> {
+        let record = self
+            .table
+            .get(index * CANDIDATE_LEN..(index + 1) * CANDIDATE_LEN)?;
+        let surface = pool_str(self.pool, read_u32(record, 0), read_u16(record, 8))?;
+        let score = f32::from_bits(read_u32(record, 4));
+        Some(CandidateRef { surface, score })
+    }
+
+    pub fn iter(&self) -> CandidatesIter<'a> {
+        CandidatesIter {
+            candidates: *self,
+            next: 0,
+        }
+    }
+}
+
+impl std::fmt::Debug for Candidates<'_> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_list().entries(self.iter()).finish()
+    }
+}
+
+impl<'a> IntoIterator for Candidates<'a> {
+    type Item = CandidateRef<'a>;
+    type IntoIter = CandidatesIter<'a>;
+
+    fn into_iter(self) -> Self::IntoIter {
+        self.iter()
+    }
+}
+
+/// Iterator over `Candidates` (corrupt records are skipped).
+pub struct CandidatesIter<'a> {
+    candidates: Candidates<'a>,
+    next: usize,
+}
+
+impl<'a> Iterator for CandidatesIter<'a> {
+    type Item = CandidateRef<'a>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        while self.next < self.candidates.len() {
+            let index = self.next;
+            self.next += 1;
+            if let Some(candidate) = self.candidates.get(index) {
+                return Some(candidate);
+            }
+        }
+        None
+    }
+}
+
 /// Result of a dictionary lookup, borrowing from the Dictionary.
 #[derive(Debug)]
 pub struct LookupResult<'a> {
     pub reading: &'a str,
-    pub candidates: &'a [Candidate],
+    pub candidates: Candidates<'a>,
+}
+
+/// Bytes of a dictionary in the KRKN v2 layout.
+enum Storage {
+    /// Built or converted in memory
+    Heap(Vec<u8>),
+    /// Read in place from the page cache (shared between processes)
+    Mapped(Mmap),
+}
+
+impl Deref for Storage {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self {
+            Storage::Heap(bytes) => bytes,
+            Storage::Mapped(map) => map,
+        }
+    }
+}
+
+/// Byte ranges of the sections of a KRKN v2 image.
+struct Layout {
+    trie: Range<usize>,
+    entries: Range<usize>,
+    candidates: Range<usize>,
+    pool: Range<usize>,
+}
+
+impl Layout {
+    /// Validate the header of a v2 image and compute its section ranges.
+    fn parse(bytes: &[u8]) -> Result<Self> {
+        if bytes.len() < HEADER_LEN {
+            return Err(DictError::Format("truncated header".to_string()));
+        }
+        if &bytes[0..4] != MAGIC {
+            return Err(DictError::Format(
+                "invalid magic: expected KRKN".to_string(),
+            ));
+        }
+        let version = read_u32(bytes, 4);
+        if version != VERSION {
+            return Err(DictError::Format(format!("unsupported version: {version}")));
+        }
+
+        let trie_len = read_u32(bytes, 8) as usize;
+        let num_entries = read_u32(bytes, 12) as usize;
+        let num_candidates = read_u32(bytes, 16) as usize;
+        let pool_len = read_u32(bytes, 20) as usize;
+
+        let section = |start: usize, len: Option<usize>| -> Result<Range<usize>> {
+            len.and_then(|len| start.checked_add(len))
+                .map(|end| start..end)
+                .ok_or_else(|| DictError::Format("section size overflow".to_string()))
+        };
+        let trie = section(HEADER_LEN, Some(trie_len))?;
+        let entries = section(
+            trie.end.next_multiple_of(4),
+            num_entries.checked_mul(ENTRY_LEN),
+        )?;
+        let candidates = section(entries.end, num_candidates.checked_mul(CANDIDATE_LEN))?;
+        let pool = section(candidates.end, Some(pool_len))?;
+        if pool.end > bytes.len() {
+            return Err(DictError::Format(format!(
+                "truncated: expected {} bytes, got {}",
+                pool.end,
+                bytes.len()
+            )));
+        }
+
+        Ok(Layout {
+            trie,
+            entries,
+            candidates,
+            pool,
+        })
+    }
+}
+
+fn read_u16(bytes: &[u8], at: usize) -> u16 {
+    u16::from_le_bytes([bytes[at], bytes[at + 1]])
+}
+
+fn read_u32(bytes: &[u8], at: usize) -> u32 {
+    u32::from_le_bytes([bytes[at], bytes[at + 1], bytes[at + 2], bytes[at + 3]])
+}
+
+/// Borrow `len` bytes at `offset` of the string pool as UTF-8.
+fn pool_str(pool: &[u8], offset: u32, len: u16) -> Option<&str> {
+    let start = offset as usize;
+    std::str::from_utf8(pool.get(start..start + len as usize)?).ok()
+}
+
+/// Length of a string as stored in the entry/candidate tables.
+fn str_len(s: &str, what: &str) -> Result<u16> {
+    u16::try_from(s.len())
+        .map_err(|_| DictError::Format(format!("{what} too long: {} bytes", s.len())))
+}
+
+/// Append `s` to the string pool, returning its offset.
+fn push_pool(pool: &mut Vec<u8>, s: &str) -> Result<u32> {
+    let offset = u32::try_from(pool.len())
+        .map_err(|_| DictError::Format("string pool exceeds 4 GiB".to_string()))?;
+    pool.extend_from_slice(s.as_bytes());
+    Ok(offset)
+}
+
+/// Encode sorted, deduplicated entries as a KRKN v2 image.
+fn encode(entries: &[DictEntry]) -> Result<Vec<u8>> {
+    let keyset: Vec<(&[u8], u32)> = entries
+        .iter()
+        .enumerate()
+        .map(|(i, e)| (e.reading.as_bytes(), i as u32))
+        .collect();
+    let trie_bytes = DoubleArrayBuilder::build(&keyset)
+        .ok_or_else(|| DictError::Format("failed to build double-array trie".to_string()))?;
+
+    let num_candidates: usize = entries.iter().map(|e| e.candidates.len()).sum();
+    let mut entry_table = Vec::with_capacity(entries.len() * ENTRY_LEN);
+    let mut candidate_table = Vec::with_capacity(num_candidates * CANDIDATE_LEN);
+    let mut pool = Vec::new();
+
+    let mut first_candidate = 0u32;
+    for entry in entries {
+        let reading_len = str_len(&entry.reading, "reading")?;
+        let num = u16::try_from(entry.candidates.len())
+            .map_err(|_| DictError::Format(format!("too many candidates for {}", entry.reading)))?;
+        entry_table.extend_from_slice(&push_pool(&mut pool, &entry.reading)?.to_le_bytes());
+        entry_table.extend_from_slice(&first_candidate.to_le_bytes());
+        entry_table.extend_from_slice(&reading_len.to_le_bytes());
+        entry_table.extend_from_slice(&num.to_le_bytes());
+
+        for cand in &entry.candidates {
+            let surface_len = str_len(&cand.surface, "surface")?;
+            candidate_table.extend_from_slice(&push_pool(&mut pool, &cand.surface)?.to_le_bytes());
+            candidate_table.extend_from_slice(&cand.score.to_le_bytes());
+            candidate_table.extend_from_slice(&surface_len.to_le_bytes());
+        }
+        first_candidate += num as u32;
+    }
+
+    let mut out = Vec::with_capacity(
+        HEADER_LEN + trie_bytes.len() + 3 + entry_table.len() + candidate_table.len() + pool.len(),
+    );
+    out.extend_from_slice(MAGIC);
+    out.extend_from_slice(&VERSION.to_le_bytes());
+    out.extend_from_slice(&(trie_bytes.len() as u32).to_le_bytes());
+    out.extend_from_slice(&(entries.len() as u32).to_le_bytes());
+    out.extend_from_slice(&first_candidate.to_le_bytes());
+    out.extend_from_slice(&(pool.len() as u32).to_le_bytes());
+    out.resize(HEADER_LEN, 0);
+    out.extend_from_slice(&trie_bytes);
+    out.resize(out.len().next_multiple_of(4), 0);
+    out.extend_from_slice(&entry_table);
+    out.extend_from_slice(&candidate_table);
+    out.extend_from_slice(&pool);
+    Ok(out)
 }
 
 /// A double-array trie dictionary for kana-kanji conversion.
+///
+/// The dictionary is always held in the KRKN v2 layout: lookups decode entries
+/// on demand and return slices borrowed from the backing bytes.
 pub struct Dictionary {
-    trie: DoubleArray<Vec<u8>>,
-    entries: Vec<DictEntry>,
+    storage: Storage,
+    layout: Layout,
 }
 
 // JSON deserialization types
@@ -69,26 +327,60 @@ struct JsonEntry {
 }
 
 impl Dictionary {
+    fn from_storage(storage: Storage) -> Result<Self> {
+        let layout = Layout::parse(&storage)?;
+        Ok(Dictionary { storage, layout })
+    }
+
     /// Build a Dictionary from pre-sorted entries.
     ///
     /// Entries must already be sorted by `reading` bytes and deduplicated.
     /// This is the shared final step for all dictionary builders.
     fn build_from_entries(entries: Vec<DictEntry>) -> Result<Self> {
-        let keyset: Vec<(&[u8], u32)> = entries
-            .iter()
-            .enumerate()
-            .map(|(i, e)| (e.reading.as_bytes(), i as u32))
-            .collect();
+        Self::from_storage(Storage::Heap(encode(&entries)?))
+    }
+
+    /// Number of readings in the dictionary.
+    pub fn len(&self) -> usize {
+        self.layout.entries.len() / ENTRY_LEN
+    }
 
-        let trie_bytes = DoubleArrayBuilder::build(&keyset)
-            .ok_or_else(|| DictError::Format("failed to build double-array trie".to_string()))?;
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
 
-        Ok(Dictionary {
-            trie: DoubleArray::new(trie_bytes),
-            entries,
+    /// Whether the dictionary is read in place from a memory-mapped file.
+    pub fn is_mapped(&self) -> bool {
+        matches!(self.storage, Storage::Mapped(_))
+    }
+
+    fn trie(&self) -> DoubleArray<&[u8]> {
+        DoubleArray::new(&self.storage[self.layout.trie.clone()])
+    }
+
+    /// Decode the entry at `index` of the entry table.
+    fn entry(&self, index: usize) -> Option<LookupResult<'_>> {
+        let bytes: &[u8] = &self.storage;
+        let record =
+            bytes[self.layout.entries.clone()].get(index * ENTRY_LEN..(index + 1) * ENTRY_LEN)?;
+        let pool = &bytes[self.layout.pool.clone()];
+        let reading = pool_str(pool, read_u32(record, 0), read_u16(record, 8))?;
+
+        let first = read_u32(record, 4) as usize;
+        let num = read_u16(record, 10) as usize;
+        let table = bytes[self.layout.candidates.clone()]
+            .get(first * CANDIDATE_LEN..(first + num) * CANDIDATE_LEN)?;
+        Some(LookupResult {
+            reading,
+            candidates: Candidates { table, pool },
         })
     }
 
+    /// Iterate over all entries in reading order.
+    pub fn entries(&self) -> impl Iterator<Item = LookupResult<'_>> {
+        (0..self.len()).filter_map(|i| self.entry(i))
+    }
+
     /// Build a Dictionary from a JSON file.
     ///
     /// The JSON format is an array of `{reading, candidates: [{surface, score}]}`.
@@ -127,61 +419,62 @@ impl Dictionary {
         Self::build_from_entries(entries)
     }
 
-    /// Save the dictionary to a binary file.
+    /// Save the dictionary to a binary file (KRKN v2).
     ///
-    /// Format:
+    /// Format (all integers little-endian):
     /// ```text
     /// [4B] magic "KRKN"
-    /// [4B] version (1u32 LE)
-    /// [4B] trie_len (u32 LE)
-    /// [trie_len B] trie bytes
-    /// [4B] num_entries (u32 LE)
-    /// For each entry:
-    ///   [2B] reading_len (u16 LE)
-    ///   [reading_len B] reading (UTF-8)
-    ///   [2B] num_candidates (u16 LE)
-    ///   For each candidate:
-    ///     [2B] surface_len (u16 LE)
-    ///     [surface_len B] surface (UTF-8)
-    ///     [4B] score (f32 LE)
+    /// [4B] version (2u32)
+    /// [4B] trie_len (u32)
+    /// [4B] num_entries (u32)
+    /// [4B] num_candidates (u32)
+    /// [4B] pool_len (u32)
+    /// [8B] reserved (zero)
+    /// [trie_len B] double-array trie (value = entry index), zero-padded to 4 bytes
+    /// num_entries × 12B entry table, sorted by reading bytes:
+    ///   [4B] reading offset in pool (u32)
+    ///   [4B] index of the first candidate (u32)
+    ///   [2B] reading_len (u16)
+    ///   [2B] num_candidates (u16)
+    /// num_candidates × 10B candidate table, in stored order within each entry:
+    ///   [4B] surface offset in pool (u32)
+    ///   [4B] score (f32)
+    ///   [2B] surface_len (u16)
+    /// [pool_len B] string pool (UTF-8)
     /// ```
+    ///
+    /// The file is written to a uniquely named temp file next to `path` and
+    /// renamed into place, so processes that still map the old file keep a
+    /// consistent view even while another process saves the same path.
     pub fn save(&self, path: impl AsRef<Path>) -> Result<()> {
-        let file = File::create(path.as_ref())?;
-        let mut w = BufWriter::new(file);
-
-        // Magic + version
-        w.write_all(MAGIC)?;
-        w.write_all(&VERSION.to_le_bytes())?;
-
-        // Trie data
-        let trie_bytes: &[u8] = &self.trie.0;
-        w.write_all(&(trie_bytes.len() as u32).to_le_bytes())?;
-        w.write_all(trie_bytes)?;
-
-        // Entries
-        w.write_all(&(self.entries.len() as u32).to_le_bytes())?;
-        for entry in &self.entries {
-            let reading_bytes = entry.reading.as_bytes();
-            w.write_all(&(reading_bytes.len() as u16).to_le_bytes())?;
-            w.write_all(reading_bytes)?;
-
-            w.write_all(&(entry.candidates.len() as u16).to_le_bytes())?;
-            for cand in &entry.candidates {
-                let surface_bytes = cand.surface.as_bytes();
-                w.write_all(&(surface_bytes.len() as u16).to_le_bytes())?;
-                w.write_all(surface_bytes)?;
-                w.write_all(&cand.score.to_le_bytes())?;
-            }
-        }
+        let entries: Vec<DictEntry> = self
+            .entries()
+            .map(|e| DictEntry {
+                reading: e.reading.to_string(),
+                candidates: e.candidates.iter().map(|c| c.to_candidate()).collect(),
+            })
+            .collect();
+        let bytes = encode(&entries)?;
 
-        w.flush()?;
+        let path = path.as_ref();
+        let dir = match path.parent() {
+            Some(dir) if !dir.as_os_str().is_empty() => dir,
+            _ => Path::new("."),
+        };
+        let mut tmp = tempfile::NamedTempFile::new_in(dir)?;
+        tmp.write_all(&bytes)?;
+        tmp.persist(path).map_err(|e| e.error)?;
         Ok(())
     }
 
     /// Load a dictionary from a binary file.
+    ///
+    /// KRKN v2 files are memory-mapped and read in place, so every process that
+    /// loads the same file shares its physical pages. v1 files are decoded and
+    /// converted to the v2 layout in memory.
     pub fn load(path: impl AsRef<Path>) -> Result<Self> {
         let file = File::open(path.as_ref())?;
-        let mut r = BufReader::new(file);
+        let mut r = BufReader::new(&file);
 
         // Magic
         let mut magic = [0u8; 4];
@@ -195,12 +488,38 @@ impl Dictionary {
         // Version
         let mut buf4 = [0u8; 4];
         r.read_exact(&mut buf4)?;
-        let version = u32::from_le_bytes(buf4);
-        if version != VERSION {
-            return Err(DictError::Format(format!("unsupported version: {version}")));
+        match u32::from_le_bytes(buf4) {
+            VERSION => {
+                // SAFETY: the mapping is read-only, and dictionary files are
+                // replaced by rename (see `save`) rather than modified in place.
+                let map = unsafe { Mmap::map(&file)? };
+                Self::from_storage(Storage::Mapped(map))
+            }
+            VERSION_V1 => Self::load_v1(r),
+            version => Err(DictError::Format(format!("unsupported version: {version}"))),
         }
+    }
+
+    /// Decode the body of a v1 file (after magic and version).
+    ///
+    /// v1 layout:
+    /// ```text
+    /// [4B] trie_len (u32 LE)
+    /// [trie_len B] trie bytes
+    /// [4B] num_entries (u32 LE)
+    /// For each entry:
+    ///   [2B] reading_len (u16 LE)
+    ///   [reading_len B] reading (UTF-8)
+    ///   [2B] num_candidates (u16 LE)
+    ///   For each candidate:
+    ///     [2B] surface_len (u16 LE)
+    ///     [surface_len B] surface (UTF-8)
+    ///     [4B] score (f32 LE)
+    /// ```
+    fn load_v1(mut r: impl Read) -> Result<Self> {
+        let mut buf4 = [0u8; 4];
 
-        // Trie
+        // Trie (rebuilt by `build_from_entries`)
         r.read_exact(&mut buf4)?;
         let trie_len = u32::from_le_bytes(buf4) as usize;
         const MAX_TRIE_LEN: usize = 100 * 1024 * 1024; // 100 MB
@@ -210,8 +529,7 @@ impl Dictionary {
                 trie_len, MAX_TRIE_LEN
             )));
         }
-        let mut trie_bytes = vec![0u8; trie_len];
-        r.read_exact(&mut trie_bytes)?;
+        std::io::copy(&mut (&mut r).take(trie_len as u64), &mut std::io::sink())?;
 
         // Entries
         r.read_exact(&mut buf4)?;
@@ -259,34 +577,21 @@ impl Dictionary {
             });
         }
 
-        Ok(Dictionary {
-            trie: DoubleArray::new(trie_bytes),
-            entries,
-        })
+        Self::build_from_entries(entries)
     }
 
     /// Common prefix search: returns all entries whose reading is a prefix of `input`.
     pub fn common_prefix_search(&self, input: &str) -> Vec<LookupResult<'_>> {
-        self.trie
+        self.trie()
             .common_prefix_search(input.as_bytes())
-            .filter_map(|(value, _len)| {
-                let entry = self.entries.get(value as usize)?;
-                Some(LookupResult {
-                    reading: &entry.reading,
-                    candidates: &entry.candidates,
-                })
-            })
+            .filter_map(|(value, _len)| self.entry(value as usize))
             .collect()
     }
 
     /// Exact match search: returns the entry whose reading exactly matches `input`.
     pub fn exact_match_search(&self, input: &str) -> Option<LookupResult<'_>> {
-        let value = self.trie.exact_match_search(input.as_bytes())?;
-        let entry = self.entries.get(value as usize)?;
-        Some(LookupResult {
-            reading: &entry.reading,
-            candidates: &entry.candidates,
-        })
+        let value = self.trie().exact_match_search(input.as_bytes())?;
+        self.entry(value as usize)
     }
 
     /// Write all entries in the dictionary to `writer` (for inspection/debugging).
@@ -294,8 +599,8 @@ impl Dictionary {
     /// Each line is tab-separated: `reading\tsurface\tscore`.
     /// Returns the total number of entries written.
     pub fn dump_all(&self, writer: &mut dyn std::io::Write) -> std::io::Result<usize> {
-        for entry in &self.entries {
-            for cand in &entry.candidates {
+        for entry in self.entries() {
+            for cand in entry.candidates {
                 writeln!(
                     writer,
                     "{}\t{}\t{}",
@@ -303,7 +608,7 @@ impl Dictionary {
                 )?;
             }
         }
-        Ok(self.entries.len())
+        Ok(self.len())
     }
 
     /// Search entries by surface form (substring match).
@@ -311,10 +616,14 @@ impl Dictionary {
     /// Returns a list of (reading, surface, score) tuples where surface contains `query`.
     pub fn search_by_surface(&self, query: &str) -> Vec<(String, String, f32)> {
         let mut results = Vec::new();
-        for entry in &self.entries {
-            for cand in &entry.candidates {
+        for entry in self.entries() {
+            for cand in entry.candidates {
                 if cand.surface.contains(query) {
-                    results.push((entry.reading.clone(), cand.surface.clone(), cand.score));
+                    results.push((
+                        entry.reading.to_string(),
+                        cand.surface.to_string(),
+                        cand.score,
+                    ));
                 }
             }
         }
@@ -433,15 +742,15 @@ impl Dictionary {
         let mut merged: HashMap<String, Vec<Candidate>> = HashMap::new();
         let mut reading_order: Vec<String> = Vec::new();
 
-        for dict in dicts {
-            for entry in dict.entries {
-                if !merged.contains_key(&entry.reading) {
-                    reading_order.push(entry.reading.clone());
+        for dict in &dicts {
+            for entry in dict.entries() {
+                if !merged.contains_key(entry.reading) {
+                    reading_order.push(entry.reading.to_string());
                 }
-                let candidates = merged.entry(entry.reading).or_default();
+                let candidates = merged.entry(entry.reading.to_string()).or_default();
                 for cand in entry.candidates {
                     if !candidates.iter().any(|c| c.surface == cand.surface) {
-                        candidates.push(cand);
+                        candidates.push(cand.to_candidate());
                     }
                 }
             }
@@ -631,9 +940,9 @@ mod tests {
         let dict = Dictionary::build_from_json(json_file.path()).unwrap();
 
         // Readings should be converted to hiragana
-        assert!(dict.entries.iter().any(|e| e.reading == "きょう"));
-        assert!(dict.entries.iter().any(|e| e.reading == "きょうと"));
-        assert!(dict.entries.iter().any(|e| e.reading == "とうきょう"));
+        assert!(dict.entries().any(|e| e.reading == "きょう"));
+        assert!(dict.entries().any(|e| e.reading == "きょうと"));
+        assert!(dict.entries().any(|e| e.reading == "とうきょう"));
     }
 
     #[test]
@@ -645,10 +954,10 @@ mod tests {
         assert_eq!(result.reading, "きょう");
         assert_eq!(result.candidates.len(), 2);
         // Candidates should be sorted by score ascending
-        assert_eq!(result.candidates[0].surface, "京");
-        assert!((result.candidates[0].score - 0.8).abs() < f32::EPSILON);
-        assert_eq!(result.candidates[1].surface, "今日");
-        assert!((result.candidates[1].score - 1.5).abs() < f32::EPSILON);
+        assert_eq!(result.candidates.get(0).unwrap().surface, "京");
+        assert!((result.candidates.get(0).unwrap().score - 0.8).abs() < f32::EPSILON);
+        assert_eq!(result.candidates.get(1).unwrap().surface, "今日");
+        assert!((result.candidates.get(1).unwrap().score - 1.5).abs() < f32::EPSILON);
 
         assert!(dict.exact_match_search("きょうとふ").is_none());
     }
@@ -680,13 +989,149 @@ mod tests {
         let result = loaded.exact_match_search("きょう").unwrap();
         assert_eq!(result.reading, "きょう");
         assert_eq!(result.candidates.len(), 2);
-        assert_eq!(result.candidates[0].surface, "京");
-        assert!((result.candidates[0].score - 0.8).abs() < f32::EPSILON);
+        assert_eq!(result.candidates.get(0).unwrap().surface, "京");
+        assert!((result.candidates.get(0).unwrap().score - 0.8).abs() < f32::EPSILON);
 
         let results = loaded.common_prefix_search("きょうと");
         assert_eq!(results.len(), 2);
     }
 
+    #[test]
+    fn test_load_v2_is_mapped_and_presorted() {
+        let json_file = create_test_json();
+        let dict = Dictionary::build_from_json(json_file.path()).unwrap();
+        assert!(!dict.is_mapped());
+
+        let bin_file = NamedTempFile::new().unwrap();
+        dict.save(bin_file.path()).unwrap();
+        let loaded = Dictionary::load(bin_file.path()).unwrap();
+        assert!(loaded.is_mapped());
+        assert_eq!(loaded.len(), 3);
+
+        let result = loaded.exact_match_search("きょう").unwrap();
+        let surfaces: Vec<&str> = result.candidates.iter().map(|c| c.surface).collect();
+        assert_eq!(surfaces, ["京", "今日"]);
+        assert_eq!(result.candidates.get(1).unwrap().score, 1.5);
+        assert!(result.candidates.get(2).is_none());
+
+        let readings: Vec<&str> = loaded.entries().map(|e| e.reading).collect();
+        assert_eq!(readings, ["きょう", "きょうと", "とうきょう"]);
+    }
+
+    #[test]
+    fn test_save_keeps_candidate_order() {
+        // Not sorted by score, e.g. the priority order of a merged dictionary
+        let dict = Dictionary::build_from_entries(vec![DictEntry {
+            reading: "きょう".to_string(),
+            candidates: vec![
+                Candidate {
+                    surface: "今日".to_string(),
+                    score: 1.5,
+                },
+                Candidate {
+                    surface: "京".to_string(),
+                    score: 0.0,
+                },
+            ],
+        }])
+        .unwrap();
+        let bin_file = NamedTempFile::new().unwrap();
+        dict.save(bin_file.path()).unwrap();
+        let loaded = Dictionary::load(bin_file.path()).unwrap();
+
+        let result = loaded.exact_match_search("きょう").unwrap();
+        let surfaces: Vec<&str> = result.candidates.iter().map(|c| c.surface).collect();
+        assert_eq!(surfaces, ["今日", "京"]);
+    }
+
+    #[test]
+    fn test_concurrent_saves_keep_mapped_copy_intact() {
+        let json_file = create_test_json();
+        let dict = Dictionary::build_from_json(json_file.path()).unwrap();
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("dict.bin");
+        dict.save(&path).unwrap();
+        let mapped = Dictionary::load(&path).unwrap();
+
+        std::thread::scope(|s| {
+            for _ in 0..4 {
+                s.spawn(|| {
+                    for _ in 0..20 {
+                        dict.save(&path).unwrap();
+                    }
+                });
+            }
+        });
+
+        // Each save renames its own temp file over the target
+        assert_eq!(std::fs::read_dir(dir.path()).unwrap().count(), 1);
+        assert_eq!(
+            mapped
+                .exact_match_search("きょう")
+                .unwrap()
+                .candidates
+                .len(),
+            2
+        );
+        assert_eq!(Dictionary::load(&path).unwrap().len(), 3);
+    }
+
+    /// Write `entries` in the legacy v1 layout
+    fn write_v1(entries: &[(&str, &[(&str, f32)])]) -> NamedTempFile {
+        let mut f = NamedTempFile::new().unwrap();
+        f.write_all(MAGIC).unwrap();
+        f.write_all(&VERSION_V1.to_le_bytes()).unwrap();
+        let trie = [0u8; 8];
+        f.write_all(&(trie.len() as u32).to_le_bytes()).unwrap();
+        f.write_all(&trie).unwrap();
+        f.write_all(&(entries.len() as u32).to_le_bytes()).unwrap();
+        for (reading, cands) in entries {
+            f.write_all(&(reading.len() as u16).to_le_bytes()).unwrap();
+            f.write_all(reading.as_bytes()).unwrap();
+            f.write_all(&(cands.len() as u16).to_le_bytes()).unwrap();
+            for (surface, score) in *cands {
+                f.write_all(&(surface.len() as u16).to_le_bytes()).unwrap();
+                f.write_all(surface.as_bytes()).unwrap();
+                f.write_all(&score.to_le_bytes()).unwrap();
+            }
+        }
+        f.flush().unwrap();
+        f
+    }
+
+    #[test]
+    fn test_load_v1_compat() {
+        let f = write_v1(&[
+            ("きょう", &[("今日", 1.5), ("京", 0.8)]),
+            ("きょうと", &[("京都", 2.0)]),
+        ]);
+        let dict = Dictionary::load(f.path()).unwrap();
+        assert!(!dict.is_mapped());
+
+        // Candidates are still sorted by score on load
+        let result = dict.exact_match_search("きょう").unwrap();
+        assert_eq!(result.candidates.get(0).unwrap().surface, "京");
+        assert_eq!(dict.common_prefix_search("きょうと").len(), 2);
+    }
+
+    #[test]
+    fn test_load_rejects_truncated_v2() {
+        let json_file = create_test_json();
+        let dict = Dictionary::build_from_json(json_file.path()).unwrap();
+        let bin_file = NamedTempFile::new().unwrap();
+        dict.save(bin_file.path()).unwrap();
+
+        let bytes = std::fs::read(bin_file.path()).unwrap();
+        std::fs::write(bin_file.path(), &bytes[..bytes.len() - 1]).unwrap();
+        assert!(matches!(
+            Dictionary::load(bin_file.path()),
+            Err(DictError::Format(_))
+        ));
+
+        std::fs::write(bin_file.path(), &bytes[..HEADER_LEN - 1]).unwrap();
+        assert!(Dictionary::load(bin_file.path()).is_err());
+    }
+
     #[test]
     fn test_no_match() {
         let json_file = create_test_json();
@@ -819,18 +1264,18 @@ col0,col1,col2,4500,今日,col5,col6,col7,col8,col9,col10,キョウ
         let dict = Dictionary::build_from_mozc_tsv(tsv_file.path()).unwrap();
 
         // Should have 3 readings
-        assert_eq!(dict.entries.len(), 3);
+        assert_eq!(dict.len(), 3);
 
         // Check exact match
         let result = dict.exact_match_search("きょう").unwrap();
         assert_eq!(result.candidates.len(), 2);
-        assert_eq!(result.candidates[0].surface, "今日");
-        assert_eq!(result.candidates[1].surface, "京");
-        assert!((result.candidates[0].score - 0.0).abs() < f32::EPSILON);
+        assert_eq!(result.candidates.get(0).unwrap().surface, "今日");
+        assert_eq!(result.candidates.get(1).unwrap().surface, "京");
+        assert!((result.candidates.get(0).unwrap().score - 0.0).abs() < f32::EPSILON);
 
         let result = dict.exact_match_search("きょうと").unwrap();
         assert_eq!(result.candidates.len(), 1);
-        assert_eq!(result.candidates[0].surface, "京都");
+        assert_eq!(result.candidates.get(0).unwrap().surface, "京都");
     }
 
     #[test]
@@ -845,9 +1290,14 @@ col0,col1,col2,4500,今日,col5,col6,col7,col8,col9,col10,キョウ
         f.flush().unwrap();
 
         let dict = Dictionary::build_from_mozc_tsv(f.path()).unwrap();
-        assert_eq!(dict.entries.len(), 1);
+        assert_eq!(dict.len(), 1);
         assert_eq!(
-            dict.exact_match_search("きょう").unwrap().candidates[0].surface,
+            dict.exact_match_search("きょう")
+                .unwrap()
+                .candidates
+                .get(0)
+                .unwrap()
+                .surface,
             "今日"
         );
     }
@@ -865,8 +1315,8 @@ col0,col1,col2,4500,今日,col5,col6,col7,col8,col9,col10,キョウ
         let result = dict.exact_match_search("きょう").unwrap();
         // "今日" should appear only once (deduplicated)
         assert_eq!(result.candidates.len(), 2);
-        assert_eq!(result.candidates[0].surface, "今日");
-        assert_eq!(result.candidates[1].surface, "京");
+        assert_eq!(result.candidates.get(0).unwrap().surface, "今日");
+        assert_eq!(result.candidates.get(1).unwrap().surface, "京");
     }
 
     #[test]
@@ -891,7 +1341,7 @@ col0,col1,col2,4500,今日,col5,col6,col7,col8,col9,col10,キョウ
         let dict = Dictionary::load_auto(tsv_file.path()).unwrap();
         let result = dict.exact_match_search("きょう").unwrap();
         assert_eq!(result.candidates.len(), 2);
-        assert_eq!(result.candidates[0].surface, "今日");
+        assert_eq!(result.candidates.get(0).unwrap().surface, "今日");
     }
 
     #[test]
@@ -915,8 +1365,8 @@ col0,col1,col2,4500,今日,col5,col6,col7,col8,col9,col10,キョウ
         // "きょう" should have candidates from both, dict1 first
         let result = merged.exact_match_search("きょう").unwrap();
         assert_eq!(result.candidates.len(), 2);
-        assert_eq!(result.candidates[0].surface, "今日");
-        assert_eq!(result.candidates[1].surface, "教");
+        assert_eq!(result.candidates.get(0).unwrap().surface, "今日");
+        assert_eq!(result.candidates.get(1).unwrap().surface, "教");
 
         // "きょうと" from dict1
         assert!(merged.exact_match_search("きょうと").is_some());
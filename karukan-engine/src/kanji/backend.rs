@@ -1,9 +1,19 @@
 //! Backend interface for kanji conversion using llama.cpp
 
+use std::fs::File;
+use std::path::PathBuf;
+use std::sync::Mutex;
+
+use memmap2::{Advice, Mmap};
+use tracing::warn;
+
+use super::batch::BatchConfig;
 use super::error::KanjiError;
+use super::hardware::ModelOptions;
 use super::hf_download::{get_tokenizer_path, get_variant_path};
 use super::llamacpp::LlamaCppModel;
 use super::model_config::{ModelFamily, VariantConfig, registry};
+use super::throughput::ThroughputSnapshot;
 use super::{CONTEXT_TOKEN, INPUT_START_TOKEN, OUTPUT_START_TOKEN};
 use crate::kana::hiragana_to_katakana;
 
@@ -70,6 +80,11 @@ impl Backend {
             .ok_or_else(|| KanjiError::UnknownVariant(variant_id.to_string()))?;
         Self::from_variant(family, variant)
     }
+
+    /// Display name of the model (variant id, or "custom")
+    pub fn display_name(&self) -> &str {
+        &self.display_name
+    }
 }
 
 /// Kanji converter using llama.cpp backend
@@ -77,6 +92,9 @@ pub struct KanaKanjiConverter {
     model: LlamaCppModel,
     config: ConversionConfig,
     display_name: String,
+    gguf_path: PathBuf,
+    /// Locked mapping of the GGUF file kept by `warm_up` (None unless locked)
+    resident: Mutex<Option<Mmap>>,
 }
 
 impl KanaKanjiConverter {
@@ -87,11 +105,26 @@ impl KanaKanjiConverter {
 
     /// Create a new converter with the specified backend and configuration
     pub fn with_config(backend: Backend, config: ConversionConfig) -> Result<Self> {
-        let model = LlamaCppModel::from_file(&backend.gguf_path, &backend.tokenizer_json_path)?;
+        Self::with_options(backend, config, ModelOptions::default())
+    }
+
+    /// Create a new converter with explicit llama.cpp runtime options (see `hardware::tune`)
+    pub fn with_options(
+        backend: Backend,
+        config: ConversionConfig,
+        options: ModelOptions,
+    ) -> Result<Self> {
+        let model = LlamaCppModel::from_file_with_options(
+            &backend.gguf_path,
+            &backend.tokenizer_json_path,
+            options,
+        )?;
         Ok(KanaKanjiConverter {
             model,
             config,
             display_name: backend.display_name,
+            gguf_path: PathBuf::from(backend.gguf_path),
+            resident: Mutex::new(None),
         })
     }
 
@@ -114,24 +147,39 @@ impl KanaKanjiConverter {
         reading: &str,
         context: &str,
         num_candidates: usize,
+    ) -> Result<Vec<String>> {
+        self.convert_cancellable(reading, context, num_candidates, &|| false)
+    }
+
+    /// Convert hiragana to kanji candidates, aborting when `should_stop` returns true
+    ///
+    /// Greedy decoding (`num_candidates == 1`) polls `should_stop` between decode
+    /// steps, beam search before every sequence evaluation. Returns
+    /// `KanjiError::Cancelled` when aborted.
+    pub fn convert_cancellable(
+        &self,
+        reading: &str,
+        context: &str,
+        num_candidates: usize,
+        should_stop: &dyn Fn() -> bool,
     ) -> Result<Vec<String>> {
         // Convert hiragana to katakana (model expects katakana input)
         let katakana = hiragana_to_katakana(reading);
 
-        // Build prompt in jinen format
-        let prompt = build_jinen_prompt(&katakana, context);
-
-        // Tokenize
-        let tokens = self.model.tokenize(&prompt)?;
+        // Tokenize the prompt in jinen format
+        let tokens = self.model.tokenize_prompt(&katakana, context)?;
         let eos = Some(self.model.eos_token_id().0);
 
         let mut candidates = Vec::with_capacity(num_candidates);
 
         if num_candidates == 1 {
             // Single candidate: use greedy decoding (faster)
-            let output_tokens = self
-                .model
-                .generate(&tokens, self.config.max_new_tokens, eos)?;
+            let output_tokens = self.model.generate_cancellable(
+                &tokens,
+                self.config.max_new_tokens,
+                eos,
+                should_stop,
+            )?;
             let generated = &output_tokens[tokens.len()..];
             let text = self.model.decode(generated, true)?;
             let clean = clean_model_output(&text);
@@ -141,11 +189,12 @@ impl KanaKanjiConverter {
             }
         } else {
             // Multiple candidates: use beam search
-            let results = self.model.generate_beam_search(
+            let results = self.model.generate_beam_search_cancellable(
                 &tokens,
                 self.config.max_new_tokens,
                 eos,
                 num_candidates,
+                should_stop,
             )?;
 
             for (output_tokens, _score) in results {
@@ -166,6 +215,94 @@ impl KanaKanjiConverter {
         Ok(candidates)
     }
 
+    /// Convert several (reading, context) pairs at once with greedy decoding
+    ///
+    /// The pairs run as concurrent sequences of one llama.cpp context (see
+    /// `LlamaCppModel::generate_batch`), so they share decode steps; at most
+    /// `config.batch_size()` at a time. Returns one candidate list per pair, as
+    /// `convert(reading, context, 1)` would.
+    pub fn convert_batch(
+        &self,
+        inputs: &[(&str, &str)],
+        config: &BatchConfig,
+    ) -> Result<Vec<Vec<String>>> {
+        let prompts = inputs
+            .iter()
+            .map(|(reading, context)| {
+                self.model
+                    .tokenize_prompt(&hiragana_to_katakana(reading), context)
+            })
+            .collect::<Result<Vec<_>>>()?;
+        let eos = Some(self.model.eos_token_id().0);
+        let outputs = self.model.generate_batch(
+            &prompts,
+            self.config.max_new_tokens,
+            eos,
+            config.batch_size(),
+        )?;
+
+        inputs
+            .iter()
+            .zip(outputs)
+            .map(|((reading, _), generated)| {
+                let clean = clean_model_output(&self.model.decode(&generated, true)?);
+                Ok(vec![if clean.is_empty() {
+                    reading.to_string()
+                } else {
+                    clean
+                }])
+            })
+            .collect()
+    }
+
+    /// Make the first real conversion as fast as later ones.
+    ///
+    /// llama.cpp maps the GGUF file lazily, so its pages would otherwise be read
+    /// from disk during the first decode. This asks the kernel to read the whole
+    /// file ahead (`madvise(MADV_WILLNEED)` on a mapping of it). With `lock_pages`
+    /// the mapping is also `mlock`ed and kept, so the pages stay resident. A
+    /// failed lock (e.g. `RLIMIT_MEMLOCK`) is logged and ignored.
+    ///
+    /// Then runs one dummy greedy conversion, which loads the tokenizer and
+    /// allocates the cached llama.cpp context and its compute buffers.
+    pub fn warm_up(&self, lock_pages: bool) -> Result<()> {
+        let file = File::open(&self.gguf_path).map_err(|e| KanjiError::ModelLoad(e.into()))?;
+        // SAFETY: the mapping is read-only and model files are never modified in place
+        let map = unsafe { Mmap::map(&file) }.map_err(|e| KanjiError::ModelLoad(e.into()))?;
+        if let Err(e) = map.advise(Advice::WillNeed) {
+            warn!("warm_up: madvise failed for {:?}: {}", self.gguf_path, e);
+        }
+        if lock_pages {
+            match map.lock() {
+                Ok(()) => *self.resident.lock().unwrap_or_else(|e| e.into_inner()) = Some(map),
+                Err(e) => warn!("warm_up: mlock failed for {:?}: {}", self.gguf_path, e),
+            }
+        }
+
+        self.convert("あ", "", 1).map(|_| ())
+    }
+
+    /// Free the llama.cpp context (KV cache, compute buffers) and unlock the
+    /// pages locked by `warm_up`, for when the converter sits idle.
+    ///
+    /// The weights stay mapped from the GGUF file, so the kernel may evict them
+    /// under memory pressure and read them back on demand; the next conversion
+    /// (or `warm_up`) recreates the context. Returns false, releasing nothing,
+    /// while a conversion is running.
+    pub fn release_buffers(&self) -> bool {
+        if !self.model.release_session() {
+            return false;
+        }
+        *self.resident.lock().unwrap_or_else(|e| e.into_inner()) = None;
+        true
+    }
+
+    /// Measured prefill/decode cost per token on this machine, with this
+    /// converter's thread count (None until a greedy conversion ran)
+    pub fn throughput(&self) -> Option<ThroughputSnapshot> {
+        self.model.throughput()
+    }
+
     /// Get a human-readable model name for display
     pub fn model_display_name(&self) -> &str {
         &self.display_name
@@ -174,7 +311,7 @@ impl KanaKanjiConverter {
     /// Count only the input (reading) tokens, excluding context and special tokens
     pub fn count_input_tokens(&self, reading: &str) -> Result<usize> {
         let katakana = hiragana_to_katakana(reading);
-        let tokens = self.model.tokenize(&katakana)?;
+        let tokens = self.model.tokenize_reading(&katakana)?;
         Ok(tokens.len())
     }
 }
@@ -0,0 +1,124 @@
+//! Grouping conversions into multi-sequence batches
+//!
+//! `KanaKanjiConverter::convert_batch` decodes several greedy conversions as
+//! concurrent sequences of one llama.cpp context. `BatchConfig` bounds how
+//! large such a batch gets and, when requests arrive one by one (the daemon's
+//! model workers), how long the first of them waits for others to join it.
+
+use std::sync::mpsc::{Receiver, RecvTimeoutError};
+use std::time::{Duration, Instant};
+
+use super::llamacpp::MAX_BATCH_SEQUENCES;
+
+/// Sequences decoded together by default
+pub const DEFAULT_MAX_BATCH: usize = 8;
+
+/// Size and latency limits of a conversion batch
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct BatchConfig {
+    /// Most conversions decoded together (clamped to 1..=`MAX_BATCH_SEQUENCES`)
+    pub max_batch: usize,
+    /// Longest the first queued conversion waits for others before its batch
+    /// starts. Zero batches only what is already queued, so a lone request
+    /// never waits; larger values trade latency for throughput under load.
+    pub max_wait: Duration,
+}
+
+impl Default for BatchConfig {
+    fn default() -> Self {
+        Self {
+            max_batch: DEFAULT_MAX_BATCH,
+            max_wait: Duration::ZERO,
+        }
+    }
+}
+
+impl BatchConfig {
+    /// `max_batch` within the range a multi-sequence context supports
+    pub fn batch_size(&self) -> usize {
+        self.max_batch.clamp(1, MAX_BATCH_SEQUENCES)
+    }
+
+    /// `first` plus whatever else `rx` yields until the batch is full or
+    /// `max_wait` has passed since this call (queued items are always taken)
+    pub fn collect<T>(&self, rx: &Receiver<T>, first: T) -> Vec<T> {
+        let deadline = Instant::now() + self.max_wait;
+        let mut batch = vec![first];
+        while batch.len() < self.batch_size() {
+            let item = match rx.try_recv() {
+                Ok(item) => item,
+                Err(_) => {
+                    let remaining = deadline.saturating_duration_since(Instant::now());
+                    if remaining.is_zero() {
+                        break;
+                    }
+                    match rx.recv_timeout(remaining) {
+                        Ok(item) => item,
+                        Err(RecvTimeoutError::Timeout | RecvTimeoutError::Disconnected) => break,
+                    }
+                }
+            };
+            batch.push(item);
+        }
+        batch
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::mpsc;
+
+    use super::*;
+
+    #[test]
+    fn test_collect_takes_queued_items_up_to_max_batch() {
+        let (tx, rx) = mpsc::channel();
+        for i in 1..10 {
+            tx.send(i).unwrap();
+        }
+        let config = BatchConfig {
+            max_batch: 4,
+            max_wait: Duration::ZERO,
+        };
+        assert_eq!(config.collect(&rx, 0), vec![0, 1, 2, 3]);
+        assert_eq!(config.collect(&rx, 0), vec![0, 4, 5, 6]);
+    }
+
+    #[test]
+    fn test_collect_without_wait_does_not_block() {
+        let (_tx, rx) = mpsc::channel::<i32>();
+        let start = Instant::now();
+        assert_eq!(BatchConfig::default().collect(&rx, 7), vec![7]);
+        assert!(start.elapsed() < Duration::from_millis(100));
+    }
+
+    #[test]
+    fn test_collect_waits_for_late_items_until_deadline() {
+        let (tx, rx) = mpsc::channel();
+        let sender = std::thread::spawn(move || {
+            std::thread::sleep(Duration::from_millis(10));
+            tx.send(1).unwrap();
+            // Kept open past the deadline: collect must stop on its own
+            std::thread::sleep(Duration::from_millis(300));
+            drop(tx);
+        });
+        let config = BatchConfig {
+            max_batch: 4,
+            max_wait: Duration::from_millis(100),
+        };
+        let start = Instant::now();
+        assert_eq!(config.collect(&rx, 0), vec![0, 1]);
+        assert!(start.elapsed() < Duration::from_millis(300));
+        sender.join().unwrap();
+    }
+
+    #[test]
+    fn test_batch_size_is_clamped() {
+        let config = |max_batch| BatchConfig {
+            max_batch,
+            max_wait: Duration::ZERO,
+        };
+        assert_eq!(config(0).batch_size(), 1);
+        assert_eq!(config(1000).batch_size(), MAX_BATCH_SEQUENCES);
+    }
+}
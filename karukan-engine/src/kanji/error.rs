@@ -17,6 +17,9 @@ pub enum KanjiError {
 
     #[error("inference failed")]
     Inference(#[source] Box<dyn std::error::Error + Send + Sync>),
+
+    #[error("inference cancelled")]
+    Cancelled,
 }
 
 pub type Result<T> = std::result::Result<T, KanjiError>;
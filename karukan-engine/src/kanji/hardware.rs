@@ -0,0 +1,299 @@
+//! Hardware probing and per-device tuning of llama.cpp runtime options
+//!
+//! `ModelOptions` holds the llama.cpp settings that depend on the machine rather
+//! than the model: GPU layer offload, KV cache type and batch sizes. `tune`
+//! loads a model with a few candidate option sets, times the same probe
+//! conversions with each and keeps the fastest one whose output matches the
+//! CPU baseline (GPU kernels or a quantized KV cache that change the result are
+//! rejected). The result is cached per model and device, so the probe runs once.
+
+use std::collections::BTreeMap;
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+use serde::{Deserialize, Serialize};
+use tracing::{debug, info, warn};
+
+use super::backend::{Backend, ConversionConfig, KanaKanjiConverter};
+use super::llamacpp::gpu_offload_supported;
+
+type Result<T> = super::error::Result<T>;
+
+/// Layer count meaning "offload every layer" (llama.cpp clamps it to the model)
+pub const ALL_LAYERS: u32 = 999;
+
+/// Readings converted by the probe (short, typical and context-free input)
+const PROBE_READINGS: &[&str] = &["あした", "きょうはいいてんきですね", "かなかんじへんかん"];
+
+/// Timed passes over `PROBE_READINGS` per candidate (after one untimed pass)
+const PROBE_PASSES: usize = 2;
+
+/// Element type of the KV cache
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(rename_all = "lowercase")]
+pub enum KvCacheType {
+    /// 16-bit floats (llama.cpp default)
+    #[default]
+    F16,
+    /// 8-bit quantized (half the memory of F16)
+    Q8_0,
+    /// 4-bit quantized
+    Q4_0,
+}
+
+/// Device-dependent llama.cpp runtime options of one model
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+pub struct ModelOptions {
+    /// Layers offloaded to the GPU (0 = CPU only, `ALL_LAYERS` = all)
+    #[serde(default)]
+    pub n_gpu_layers: u32,
+    /// KV cache element type (keys and values)
+    #[serde(default)]
+    pub kv_cache_type: KvCacheType,
+    /// Logical batch size of the greedy context (0 = llama.cpp default)
+    #[serde(default)]
+    pub n_batch: u32,
+    /// Physical batch size of the greedy context (0 = llama.cpp default)
+    #[serde(default)]
+    pub n_ubatch: u32,
+}
+
+/// What the probe found out about this machine
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct HardwareProfile {
+    /// llama.cpp was built with a GPU backend and found a device
+    pub gpu_offload: bool,
+    /// Logical CPUs available to this process
+    pub cpu_threads: usize,
+}
+
+impl HardwareProfile {
+    /// Probe the current machine
+    pub fn probe() -> Self {
+        Self {
+            gpu_offload: gpu_offload_supported(),
+            cpu_threads: std::thread::available_parallelism().map_or(1, |n| n.get()),
+        }
+    }
+
+    /// Key identifying the device in the tuning cache
+    pub fn fingerprint(&self) -> String {
+        format!(
+            "{}-{}-cpu{}-{}",
+            std::env::consts::OS,
+            std::env::consts::ARCH,
+            self.cpu_threads,
+            if self.gpu_offload { "gpu" } else { "nogpu" }
+        )
+    }
+
+    /// Option sets to try, the CPU baseline first
+    fn candidates(&self) -> Vec<ModelOptions> {
+        let cpu = ModelOptions::default();
+        let mut candidates = vec![
+            cpu,
+            ModelOptions {
+                kv_cache_type: KvCacheType::Q8_0,
+                ..cpu
+            },
+            // Prompts are short: a small physical batch keeps the compute buffers small
+            ModelOptions {
+                n_batch: 256,
+                n_ubatch: 64,
+                ..cpu
+            },
+        ];
+        if self.gpu_offload {
+            let gpu = ModelOptions {
+                n_gpu_layers: ALL_LAYERS,
+                ..cpu
+            };
+            candidates.push(gpu);
+            candidates.push(ModelOptions {
+                kv_cache_type: KvCacheType::Q8_0,
+                ..gpu
+            });
+        }
+        candidates
+    }
+}
+
+/// Tuned options per model and device, persisted as TOML
+#[derive(Debug, Default, Serialize, Deserialize)]
+pub struct TuningCache {
+    #[serde(default)]
+    pub entries: BTreeMap<String, ModelOptions>,
+}
+
+impl TuningCache {
+    /// Load the cache from `path` (empty if missing or unreadable)
+    pub fn load(path: &Path) -> Self {
+        let Ok(text) = std::fs::read_to_string(path) else {
+            return Self::default();
+        };
+        toml::from_str(&text).unwrap_or_else(|e| {
+            warn!("Ignoring invalid tuning cache {:?}: {}", path, e);
+            Self::default()
+        })
+    }
+
+    /// Write the cache to `path`, creating its directory
+    pub fn save(&self, path: &Path) -> anyhow::Result<()> {
+        if let Some(parent) = path.parent() {
+            std::fs::create_dir_all(parent)?;
+        }
+        std::fs::write(path, toml::to_string(self)?)?;
+        Ok(())
+    }
+
+    /// Cache key of `model` run with `n_threads` on `profile`
+    pub fn key(model: &str, n_threads: u32, profile: &HardwareProfile) -> String {
+        format!("{}@{}-t{}", model, profile.fingerprint(), n_threads)
+    }
+}
+
+/// Convert every probe reading once; returns the outputs and the total time
+fn run_probe(converter: &KanaKanjiConverter) -> Result<(Vec<String>, Duration)> {
+    let start = Instant::now();
+    let mut outputs = Vec::with_capacity(PROBE_READINGS.len());
+    for reading in PROBE_READINGS {
+        outputs.push(
+            converter
+                .convert(reading, "", 1)?
+                .into_iter()
+                .next()
+                .unwrap_or_default(),
+        );
+    }
+    Ok((outputs, start.elapsed()))
+}
+
+/// Time one candidate: load the model with `options`, run an untimed pass,
+/// then `PROBE_PASSES` timed ones
+fn measure(
+    backend: &Backend,
+    n_threads: u32,
+    options: ModelOptions,
+) -> Result<(Vec<String>, Duration)> {
+    let mut converter =
+        KanaKanjiConverter::with_options(backend.clone(), ConversionConfig::default(), options)?;
+    if n_threads > 0 {
+        converter.set_n_threads(n_threads);
+    }
+    let (outputs, _) = run_probe(&converter)?;
+    let mut total = Duration::ZERO;
+    for _ in 0..PROBE_PASSES {
+        total += run_probe(&converter)?.1;
+    }
+    Ok((outputs, total))
+}
+
+/// Choose the fastest runtime options for `backend` on this machine.
+///
+/// Returns the cached choice for this model, thread count and device if
+/// `cache_path` has one; otherwise benchmarks the candidates and stores the
+/// winner there. Candidates that fail to load or whose output differs from
+/// the CPU baseline are skipped; if even the baseline fails, its error is returned.
+pub fn tune(
+    backend: &Backend,
+    n_threads: u32,
+    profile: &HardwareProfile,
+    cache_path: Option<&Path>,
+) -> Result<ModelOptions> {
+    let key = TuningCache::key(backend.display_name(), n_threads, profile);
+    let mut cache = cache_path.map(TuningCache::load).unwrap_or_default();
+    if let Some(options) = cache.entries.get(&key) {
+        debug!("tuning: cached {} -> {:?}", key, options);
+        return Ok(*options);
+    }
+
+    let mut candidates = profile.candidates().into_iter();
+    let baseline = candidates.next().unwrap_or_default();
+    let (reference, mut best_time) = measure(backend, n_threads, baseline)?;
+    let mut best = baseline;
+    debug!("tuning: {} {:?} took {:?}", key, baseline, best_time);
+    for options in candidates {
+        match measure(backend, n_threads, options) {
+            Ok((outputs, _)) if outputs != reference => {
+                debug!("tuning: {} {:?} changes the output, skipped", key, options);
+            }
+            Ok((_, time)) => {
+                debug!("tuning: {} {:?} took {:?}", key, options, time);
+                if time < best_time {
+                    best = options;
+                    best_time = time;
+                }
+            }
+            Err(e) => debug!("tuning: {} {:?} failed: {}", key, options, e),
+        }
+    }
+    info!("tuning: {} -> {:?}", key, best);
+
+    cache.entries.insert(key, best);
+    if let Some(path) = cache_path
+        && let Err(e) = cache.save(path)
+    {
+        warn!("Failed to save tuning cache {:?}: {}", path, e);
+    }
+    Ok(best)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_candidates_start_with_cpu_baseline() {
+        let cpu_only = HardwareProfile {
+            gpu_offload: false,
+            cpu_threads: 8,
+        };
+        let candidates = cpu_only.candidates();
+        assert_eq!(candidates[0], ModelOptions::default());
+        assert!(candidates.iter().all(|o| o.n_gpu_layers == 0));
+
+        let with_gpu = HardwareProfile {
+            gpu_offload: true,
+            ..cpu_only
+        };
+        assert_eq!(with_gpu.candidates()[0], ModelOptions::default());
+        assert!(
+            with_gpu
+                .candidates()
+                .iter()
+                .any(|o| o.n_gpu_layers == ALL_LAYERS)
+        );
+        assert_ne!(cpu_only.fingerprint(), with_gpu.fingerprint());
+    }
+
+    #[test]
+    fn test_tuning_cache_roundtrip() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("tuning.toml");
+        let profile = HardwareProfile {
+            gpu_offload: true,
+            cpu_threads: 4,
+        };
+        let key = TuningCache::key("jinen-v1-small-q5", 2, &profile);
+        let options = ModelOptions {
+            n_gpu_layers: ALL_LAYERS,
+            kv_cache_type: KvCacheType::Q8_0,
+            n_batch: 256,
+            n_ubatch: 64,
+        };
+
+        let mut cache = TuningCache::default();
+        cache.entries.insert(key.clone(), options);
+        cache.save(&path).unwrap();
+        assert!(
+            std::fs::read_to_string(&path)
+                .unwrap()
+                .contains("kv_cache_type = \"q8_0\"")
+        );
+        assert_eq!(TuningCache::load(&path).entries.get(&key), Some(&options));
+
+        // A missing or corrupt file is an empty cache
+        std::fs::write(&path, "not toml [").unwrap();
+        assert!(TuningCache::load(&path).entries.is_empty());
+    }
+}
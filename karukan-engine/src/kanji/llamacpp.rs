@@ -6,8 +6,13 @@
 //! Enable with the `llamacpp` feature flag.
 
 use super::error::KanjiError;
+use super::hardware::{KvCacheType, ModelOptions};
+use super::throughput::{Throughput, ThroughputSnapshot};
+use super::tokenizer::PromptTokenizer;
+use crate::latency::{self, Stage};
 type Result<T> = super::error::Result<T>;
-use llama_cpp_2::context::params::LlamaContextParams;
+use llama_cpp_2::context::LlamaContext;
+use llama_cpp_2::context::params::{self as context_params, LlamaContextParams};
 use llama_cpp_2::llama_backend::LlamaBackend;
 use llama_cpp_2::llama_batch::LlamaBatch;
 use llama_cpp_2::model::LlamaModel;
@@ -16,7 +21,11 @@ use llama_cpp_2::sampling::LlamaSampler;
 use llama_cpp_2::token::LlamaToken;
 use std::num::NonZeroU32;
 use std::path::Path;
-use std::sync::OnceLock;
+use std::sync::{Mutex, OnceLock, TryLockError};
+use std::time::Instant;
+
+/// Most sequences one multi-sequence context holds (beam width or batched prompts)
+pub const MAX_BATCH_SEQUENCES: usize = 64;
 
 /// Global llama.cpp backend (can only be initialized once)
 static LLAMA_BACKEND: OnceLock<std::result::Result<LlamaBackend, String>> = OnceLock::new();
@@ -36,11 +45,39 @@ fn get_backend() -> Result<&'static LlamaBackend> {
     }
 }
 
+/// Whether llama.cpp can offload layers to a GPU (built with a GPU backend and a device found)
+pub fn gpu_offload_supported() -> bool {
+    get_backend().is_ok_and(|backend| backend.supports_gpu_offload())
+}
+
+impl From<KvCacheType> for context_params::KvCacheType {
+    fn from(kind: KvCacheType) -> Self {
+        match kind {
+            KvCacheType::F16 => context_params::KvCacheType::F16,
+            KvCacheType::Q8_0 => context_params::KvCacheType::Q8_0,
+            KvCacheType::Q4_0 => context_params::KvCacheType::Q4_0,
+        }
+    }
+}
+
 /// Convert bytes to hex display format for partial UTF-8 sequences
 fn bytes_to_hex_display(bytes: &[u8]) -> String {
     bytes.iter().map(|b| format!("<{:02X}>", b)).collect()
 }
 
+/// Tokenizer ids as llama.cpp tokens (the vocabularies are the same)
+fn to_llama_tokens(ids: Vec<u32>) -> Vec<LlamaToken> {
+    ids.into_iter().map(|id| LlamaToken(id as i32)).collect()
+}
+
+/// llama.cpp tokens as tokenizer ids, without copying
+fn as_token_ids(tokens: &[LlamaToken]) -> &[u32] {
+    const _: () = assert!(std::mem::size_of::<LlamaToken>() == std::mem::size_of::<u32>());
+    // SAFETY: `LlamaToken` is a `#[repr(transparent)]` wrapper of an `i32`, which
+    // has the size and alignment of `u32`; ids are never negative
+    unsafe { std::slice::from_raw_parts(tokens.as_ptr().cast::<u32>(), tokens.len()) }
+}
+
 /// Load and configure an external HuggingFace tokenizer from a `tokenizer.json` file.
 fn load_tokenizer<P: AsRef<Path>>(path: P) -> Result<tokenizers::Tokenizer> {
     let mut tokenizer =
@@ -59,15 +96,139 @@ struct BeamState {
     score: f32,
 }
 
+/// Long-lived llama.cpp context (sequence 0) and the tokens held in its KV cache.
+///
+/// Consecutive prompts share most of their prefix (context token, surrounding
+/// text and the reading typed so far), so only the tokens after the longest
+/// common prefix need to be prefilled.
+struct CachedContext {
+    /// Borrows `LlamaCppModel::model`; see `LlamaCppModel::new_cached_context`
+    ctx: LlamaContext<'static>,
+    batch: LlamaBatch,
+    /// Tokens whose KV entries are stored at positions `0..tokens.len()`
+    tokens: Vec<LlamaToken>,
+}
+
+// SAFETY: a llama.cpp context may be used from any thread as long as it is not
+// used concurrently; `LlamaCppModel` only hands it out behind a Mutex.
+unsafe impl Send for CachedContext {}
+
+impl CachedContext {
+    /// Make the KV cache hold exactly `tokens`, decoding only the tokens after the
+    /// longest common prefix with the cached ones. Afterwards the logits of the
+    /// last token are available.
+    fn prefill(&mut self, tokens: &[LlamaToken]) -> Result<usize> {
+        if tokens.is_empty() {
+            return Err(KanjiError::Inference("empty input sequence".into()));
+        }
+        let common = self
+            .tokens
+            .iter()
+            .zip(tokens)
+            .take_while(|(a, b)| a == b)
+            .count();
+        // Always re-decode at least the last token so its logits are fresh
+        let mut keep = common.min(tokens.len() - 1);
+        if keep < self.tokens.len() {
+            let removed = self
+                .ctx
+                .clear_kv_cache_seq(Some(0), Some(keep as u32), None)
+                .map_err(|e| KanjiError::Inference(e.into()))?;
+            if !removed {
+                // Partial removal unsupported: start over
+                self.ctx.clear_kv_cache();
+                keep = 0;
+            }
+            self.tokens.truncate(keep);
+        }
+
+        self.batch.clear();
+        for (i, token) in tokens.iter().enumerate().skip(keep) {
+            let is_last = i == tokens.len() - 1;
+            self.batch
+                .add(*token, i as i32, &[0], is_last)
+                .map_err(|e| KanjiError::Inference(e.into()))?;
+        }
+        self.decode()?;
+        self.tokens.extend_from_slice(&tokens[keep..]);
+        Ok(tokens.len() - keep)
+    }
+
+    /// Decode one token at the next position
+    fn push(&mut self, token: LlamaToken) -> Result<()> {
+        self.batch.clear();
+        self.batch
+            .add(token, self.tokens.len() as i32, &[0], true)
+            .map_err(|e| KanjiError::Inference(e.into()))?;
+        self.decode()?;
+        self.tokens.push(token);
+        Ok(())
+    }
+
+    /// Decode the pending batch; the KV cache is dropped on failure
+    fn decode(&mut self) -> Result<()> {
+        if let Err(e) = self.ctx.decode(&mut self.batch) {
+            self.ctx.clear_kv_cache();
+            self.tokens.clear();
+            return Err(KanjiError::Inference(e.into()));
+        }
+        Ok(())
+    }
+}
+
+/// Token with the highest logit (what the greedy sampler picks)
+fn argmax_token(logits: &[f32]) -> LlamaToken {
+    let best = logits
+        .iter()
+        .enumerate()
+        .max_by(|a, b| a.1.total_cmp(b.1))
+        .map_or(0, |(i, _)| i);
+    LlamaToken(best as i32)
+}
+
+/// Decode `tokens` into sequence 0 (logits for the last one only) and copy the
+/// resulting KV entries to sequences `1..n_seq`.
+fn prefill_shared_prompt(
+    ctx: &mut LlamaContext<'_>,
+    batch: &mut LlamaBatch,
+    tokens: &[LlamaToken],
+    n_seq: usize,
+) -> Result<()> {
+    if tokens.is_empty() {
+        return Err(KanjiError::Inference("empty input sequence".into()));
+    }
+    batch.clear();
+    for (i, token) in tokens.iter().enumerate() {
+        batch
+            .add(*token, i as i32, &[0], i == tokens.len() - 1)
+            .map_err(|e| KanjiError::Inference(e.into()))?;
+    }
+    ctx.decode(batch)
+        .map_err(|e| KanjiError::Inference(e.into()))?;
+    for seq in 1..n_seq as i32 {
+        ctx.copy_kv_cache_seq(0, seq, None, None)
+            .map_err(|e| KanjiError::Inference(e.into()))?;
+    }
+    Ok(())
+}
+
 /// llama.cpp based GPT-2 model for GGUF inference
 pub struct LlamaCppModel {
-    model: LlamaModel,
+    /// Reusable context for greedy decoding and sequence evaluation.
+    /// Declared before `model` so it is dropped first (it borrows the model).
+    session: Mutex<Option<CachedContext>>,
+    /// Boxed so the address borrowed by `session` stays stable when `Self` moves
+    model: Box<LlamaModel>,
     n_ctx: u32,
-    /// External HuggingFace tokenizer (always required).
+    /// External HuggingFace tokenizer (always required), with the prompt fast path.
     /// `tokenize()` and `decode()` use this instead of llama.cpp's built-in tokenizer.
-    external_tokenizer: tokenizers::Tokenizer,
+    tokenizer: PromptTokenizer,
     /// Number of threads for inference (0 = use llama.cpp default)
     n_threads: u32,
+    /// GPU offload, KV cache type and batch sizes the model was loaded with
+    options: ModelOptions,
+    /// Measured prefill/decode cost per token with the current thread count
+    throughput: Throughput,
 }
 
 impl LlamaCppModel {
@@ -75,20 +236,34 @@ impl LlamaCppModel {
     ///
     /// GPT-2 models use CPU only (Metal has issues with GPT-2).
     pub fn from_file<P: AsRef<Path>, T: AsRef<Path>>(path: P, tokenizer_json: T) -> Result<Self> {
+        Self::from_file_with_options(path, tokenizer_json, ModelOptions::default())
+    }
+
+    /// Load a GGUF model with explicit runtime options.
+    ///
+    /// GPU offload is only safe for options `hardware::tune` verified against
+    /// the CPU output (Metal has issues with GPT-2).
+    pub fn from_file_with_options<P: AsRef<Path>, T: AsRef<Path>>(
+        path: P,
+        tokenizer_json: T,
+        options: ModelOptions,
+    ) -> Result<Self> {
         let backend = get_backend()?;
 
-        // GPT-2 has Metal issues, use CPU
-        let model_params = LlamaModelParams::default().with_n_gpu_layers(0);
+        let model_params = LlamaModelParams::default().with_n_gpu_layers(options.n_gpu_layers);
 
         let model = LlamaModel::load_from_file(backend, path.as_ref(), &model_params)
             .map_err(|e| KanjiError::ModelLoad(e.into()))?;
-        let external_tokenizer = load_tokenizer(tokenizer_json)?;
+        let tokenizer = PromptTokenizer::new(load_tokenizer(tokenizer_json)?);
 
         Ok(Self {
-            model,
+            session: Mutex::new(None),
+            model: Box::new(model),
             n_ctx: 256,
-            external_tokenizer,
+            tokenizer,
             n_threads: 0,
+            options,
+            throughput: Throughput::default(),
         })
     }
 
@@ -125,13 +300,16 @@ impl LlamaCppModel {
 
         let model = LlamaModel::load_from_file(backend, path.as_ref(), &params)
             .map_err(|e| KanjiError::ModelLoad(e.into()))?;
-        let external_tokenizer = load_tokenizer(tokenizer_json)?;
+        let tokenizer = PromptTokenizer::new(load_tokenizer(tokenizer_json)?);
 
         Ok(Self {
-            model,
+            session: Mutex::new(None),
+            model: Box::new(model),
             n_ctx: 256,
-            external_tokenizer,
+            tokenizer,
             n_threads: 0,
+            options: ModelOptions::default(),
+            throughput: Throughput::default(),
         })
     }
 
@@ -147,13 +325,16 @@ impl LlamaCppModel {
 
         let model = LlamaModel::load_from_file(backend, path.as_ref(), &model_params)
             .map_err(|e| KanjiError::ModelLoad(e.into()))?;
-        let external_tokenizer = load_tokenizer(tokenizer_json)?;
+        let tokenizer = PromptTokenizer::new(load_tokenizer(tokenizer_json)?);
 
         Ok(Self {
-            model,
+            session: Mutex::new(None),
+            model: Box::new(model),
             n_ctx,
-            external_tokenizer,
+            tokenizer,
             n_threads: 0,
+            options: ModelOptions::default(),
+            throughput: Throughput::default(),
         })
     }
 
@@ -161,13 +342,28 @@ impl LlamaCppModel {
     /// 0 means use llama.cpp default (typically all cores).
     pub fn set_n_threads(&mut self, n: u32) {
         self.n_threads = n;
+        // Costs measured with the old thread count no longer apply
+        self.throughput = Throughput::default();
+        // The cached context was created with the old thread count
+        *self.session.get_mut().unwrap_or_else(|e| e.into_inner()) = None;
     }
 
-    /// Build LlamaContextParams with configured n_threads
+    /// Build LlamaContextParams with configured n_threads, KV cache type and batch sizes
     fn context_params(&self) -> LlamaContextParams {
-        let params = LlamaContextParams::default().with_n_ctx(Some(
+        let mut params = LlamaContextParams::default().with_n_ctx(Some(
             NonZeroU32::new(self.n_ctx).expect("n_ctx must be non-zero"),
         ));
+        if self.options.kv_cache_type != KvCacheType::F16 {
+            params = params
+                .with_type_k(self.options.kv_cache_type.into())
+                .with_type_v(self.options.kv_cache_type.into());
+        }
+        if self.options.n_batch > 0 {
+            params = params.with_n_batch(self.options.n_batch);
+        }
+        if self.options.n_ubatch > 0 {
+            params = params.with_n_ubatch(self.options.n_ubatch);
+        }
         if self.n_threads > 0 {
             params
                 .with_n_threads(self.n_threads as i32)
@@ -177,18 +373,106 @@ impl LlamaCppModel {
         }
     }
 
+    /// Create a context for `CachedContext`.
+    fn new_cached_context(&self) -> Result<CachedContext> {
+        let backend = get_backend()?;
+        let ctx = self
+            .model
+            .new_context(backend, self.context_params())
+            .map_err(|e| KanjiError::Inference(e.into()))?;
+        // SAFETY: the context borrows `*self.model`, which is boxed (stable address)
+        // and outlives it: the cached context lives in `self.session`, dropped
+        // before `self.model`, and temporary ones never escape `with_session`.
+        let ctx = unsafe { std::mem::transmute::<LlamaContext<'_>, LlamaContext<'static>>(ctx) };
+        Ok(CachedContext {
+            ctx,
+            batch: LlamaBatch::new(512, 1),
+            tokens: Vec::new(),
+        })
+    }
+
+    /// Create a context holding `n_seq` sequences of up to `self.n_ctx` tokens
+    /// each, with batches large enough for the whole input.
+    fn new_beam_context(&self, input_len: usize, n_seq: usize) -> Result<LlamaContext<'_>> {
+        let backend = get_backend()?;
+        let n_seq = n_seq.clamp(1, MAX_BATCH_SEQUENCES) as u32;
+        // Set n_batch and n_ubatch large enough to avoid batch splitting
+        // which causes "coupled sequences" error
+        let batch_size = input_len
+            .max(n_seq as usize)
+            .saturating_add(64)
+            .min(u32::MAX as usize) as u32;
+        let n_ctx =
+            NonZeroU32::new(self.n_ctx.saturating_mul(n_seq)).expect("n_ctx must be non-zero");
+        let ctx_params = self
+            .context_params()
+            .with_n_ctx(Some(n_ctx))
+            .with_n_seq_max(n_seq)
+            .with_n_batch(batch_size)
+            .with_n_ubatch(batch_size);
+        self.model
+            .new_context(backend, ctx_params)
+            .map_err(|e| KanjiError::Inference(e.into()))
+    }
+
+    /// Run `f` on the reusable context, creating it on first use.
+    ///
+    /// If another thread is using it, `f` runs on a temporary context instead,
+    /// so concurrent conversions never wait for each other.
+    fn with_session<R>(&self, f: impl FnOnce(&mut CachedContext) -> Result<R>) -> Result<R> {
+        let mut guard = match self.session.try_lock() {
+            Ok(guard) => guard,
+            Err(TryLockError::Poisoned(e)) => {
+                // A panic mid-decode may have left the KV cache inconsistent
+                let mut guard = e.into_inner();
+                *guard = None;
+                guard
+            }
+            Err(TryLockError::WouldBlock) => return f(&mut self.new_cached_context()?),
+        };
+        let session = match guard.as_mut() {
+            Some(session) => session,
+            None => guard.insert(self.new_cached_context()?),
+        };
+        f(session)
+    }
+
+    /// Free the reusable context (KV cache and compute buffers); the next
+    /// conversion creates a new one. Returns false, freeing nothing, while a
+    /// conversion is using it.
+    pub fn release_session(&self) -> bool {
+        let mut guard = match self.session.try_lock() {
+            Ok(guard) => guard,
+            Err(TryLockError::Poisoned(e)) => e.into_inner(),
+            Err(TryLockError::WouldBlock) => return false,
+        };
+        *guard = None;
+        true
+    }
+
     /// Tokenize a string using the external tokenizer
     pub fn tokenize(&self, text: &str) -> Result<Vec<LlamaToken>> {
-        let encoding = self
-            .external_tokenizer
-            .encode(text, false)
-            .map_err(KanjiError::Inference)?;
-        let tokens: Vec<LlamaToken> = encoding
-            .get_ids()
-            .iter()
-            .map(|&id| LlamaToken(id as i32))
-            .collect();
-        Ok(tokens)
+        let ids = latency::time(Stage::Tokenize, || self.tokenizer.encode(text))?;
+        Ok(to_llama_tokens(ids))
+    }
+
+    /// Tokenize the jinen prompt for `katakana` after `context`.
+    ///
+    /// Same tokens as `tokenize(&build_jinen_prompt(katakana, context))`, but
+    /// the special tokens are pre-tokenized and the last context and reading
+    /// are reused, so a keystroke usually encodes only the new reading (or
+    /// nothing: see `kanji::tokenizer`).
+    pub fn tokenize_prompt(&self, katakana: &str, context: &str) -> Result<Vec<LlamaToken>> {
+        let ids = latency::time(Stage::Tokenize, || {
+            self.tokenizer.encode_prompt(katakana, context)
+        })?;
+        Ok(to_llama_tokens(ids))
+    }
+
+    /// Tokens `katakana` takes up in a prompt
+    pub fn tokenize_reading(&self, katakana: &str) -> Result<Vec<LlamaToken>> {
+        let ids = latency::time(Stage::Tokenize, || self.tokenizer.encode_reading(katakana))?;
+        Ok(to_llama_tokens(ids))
     }
 
     /// Decode tokens to string using the external tokenizer
@@ -196,12 +480,8 @@ impl LlamaCppModel {
     /// When `skip_special_tokens` is true, special tokens (BOS, EOS, EOG) are
     /// excluded from the output.
     pub fn decode(&self, tokens: &[LlamaToken], skip_special_tokens: bool) -> Result<String> {
-        let ids: Vec<u32> = tokens.iter().map(|t| t.0 as u32).collect();
-        let text = self
-            .external_tokenizer
-            .decode(&ids, skip_special_tokens)
-            .map_err(KanjiError::Inference)?;
-        Ok(text)
+        self.tokenizer
+            .decode(as_token_ids(tokens), skip_special_tokens)
     }
 
     /// Decode a single token for display purposes.
@@ -240,9 +520,119 @@ impl LlamaCppModel {
             max_new_tokens,
             eos_token_id,
             LlamaSampler::greedy(),
+            &|| false,
         )
     }
 
+    /// Generate tokens with greedy decoding, aborting when `should_stop` returns true.
+    ///
+    /// `should_stop` is polled before every decode step; once it returns true,
+    /// `KanjiError::Cancelled` is returned without finishing the sequence.
+    pub fn generate_cancellable(
+        &self,
+        input_tokens: &[LlamaToken],
+        max_new_tokens: usize,
+        eos_token_id: Option<i32>,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Vec<LlamaToken>> {
+        self.generate_with_sampler(
+            input_tokens,
+            max_new_tokens,
+            eos_token_id,
+            LlamaSampler::greedy(),
+            should_stop,
+        )
+    }
+
+    /// Greedy decoding of several prompts at once, one sequence per prompt.
+    ///
+    /// All prompts are prefilled in one decode call, and every step then decodes
+    /// the next token of each unfinished sequence in a single batch, so N
+    /// conversions take about as many decode calls as the longest one of them.
+    /// Inputs beyond `max_batch` (at most `MAX_BATCH_SEQUENCES`) are processed
+    /// in further rounds.
+    ///
+    /// Returns the generated tokens of each prompt (without EOS), in input order.
+    /// Uses a fresh multi-sequence context, not the cached greedy session.
+    pub fn generate_batch(
+        &self,
+        inputs: &[Vec<LlamaToken>],
+        max_new_tokens: usize,
+        eos_token_id: Option<i32>,
+        max_batch: usize,
+    ) -> Result<Vec<Vec<LlamaToken>>> {
+        if inputs.iter().any(|tokens| tokens.is_empty()) {
+            return Err(KanjiError::Inference("empty input sequence".into()));
+        }
+        let mut outputs = Vec::with_capacity(inputs.len());
+        for chunk in inputs.chunks(max_batch.clamp(1, MAX_BATCH_SEQUENCES)) {
+            outputs.extend(self.generate_batch_chunk(chunk, max_new_tokens, eos_token_id)?);
+        }
+        Ok(outputs)
+    }
+
+    /// `generate_batch` for at most `MAX_BATCH_SEQUENCES` non-empty prompts
+    fn generate_batch_chunk(
+        &self,
+        inputs: &[Vec<LlamaToken>],
+        max_new_tokens: usize,
+        eos_token_id: Option<i32>,
+    ) -> Result<Vec<Vec<LlamaToken>>> {
+        let model_eos = self.model.token_eos();
+        let prompt_len: usize = inputs.iter().map(Vec::len).sum();
+        let mut ctx = self.new_beam_context(prompt_len, inputs.len())?;
+        let mut batch = LlamaBatch::new(prompt_len.max(inputs.len()), 1);
+
+        // Batch index holding the logits of each active sequence's last token
+        let mut logits_at: Vec<i32> = Vec::with_capacity(inputs.len());
+        latency::time(Stage::Prefill, || {
+            batch.clear();
+            for (seq, tokens) in inputs.iter().enumerate() {
+                for (pos, token) in tokens.iter().enumerate() {
+                    let is_last = pos == tokens.len() - 1;
+                    batch
+                        .add(*token, pos as i32, &[seq as i32], is_last)
+                        .map_err(|e| KanjiError::Inference(e.into()))?;
+                }
+                logits_at.push(batch.n_tokens() - 1);
+            }
+            ctx.decode(&mut batch)
+                .map_err(|e| KanjiError::Inference(e.into()))
+        })?;
+
+        // Per-token costs of a shared batch are not comparable to single-sequence
+        // decoding, so `throughput` is left to the interactive paths
+        let decode_start = Instant::now();
+        let mut outputs: Vec<Vec<LlamaToken>> = vec![Vec::new(); inputs.len()];
+        let mut active: Vec<usize> = (0..inputs.len()).collect();
+        for _ in 0..max_new_tokens {
+            let mut still_active = Vec::with_capacity(active.len());
+            batch.clear();
+            for (&seq, &index) in active.iter().zip(&logits_at) {
+                let token = argmax_token(ctx.get_logits_ith(index));
+                if self.is_eos_token(token, eos_token_id, model_eos) {
+                    continue;
+                }
+                outputs[seq].push(token);
+                let pos = inputs[seq].len() + outputs[seq].len() - 1;
+                batch
+                    .add(token, pos as i32, &[seq as i32], true)
+                    .map_err(|e| KanjiError::Inference(e.into()))?;
+                still_active.push(seq);
+            }
+            if still_active.is_empty() {
+                break;
+            }
+            ctx.decode(&mut batch)
+                .map_err(|e| KanjiError::Inference(e.into()))?;
+            logits_at = (0..still_active.len() as i32).collect();
+            active = still_active;
+        }
+        latency::record(Stage::Decode, decode_start.elapsed());
+
+        Ok(outputs)
+    }
+
     /// Generate multiple candidates using true beam search algorithm
     ///
     /// This implements proper beam search that tracks cumulative probabilities
@@ -262,7 +652,34 @@ impl LlamaCppModel {
         eos_token_id: Option<i32>,
         beam_size: usize,
     ) -> Result<Vec<(Vec<LlamaToken>, f32)>> {
-        self.generate_beam_search_impl(input_tokens, max_new_tokens, eos_token_id, beam_size)
+        self.generate_beam_search_cancellable(
+            input_tokens,
+            max_new_tokens,
+            eos_token_id,
+            beam_size,
+            &|| false,
+        )
+    }
+
+    /// Beam search that aborts when `should_stop` returns true.
+    ///
+    /// `should_stop` is polled before every sequence evaluation; once it returns
+    /// true, `KanjiError::Cancelled` is returned.
+    pub fn generate_beam_search_cancellable(
+        &self,
+        input_tokens: &[LlamaToken],
+        max_new_tokens: usize,
+        eos_token_id: Option<i32>,
+        beam_size: usize,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Vec<(Vec<LlamaToken>, f32)>> {
+        self.generate_beam_search_impl(
+            input_tokens,
+            max_new_tokens,
+            eos_token_id,
+            beam_size,
+            should_stop,
+        )
     }
 
     /// Generate multiple candidates using depth-1 beam selection followed by greedy decoding
@@ -295,7 +712,7 @@ impl LlamaCppModel {
 
     /// Generate multiple candidates using batch inference (depth-1 beam + greedy)
     ///
-    /// Uses shared KV cache for input tokens across all sequences.
+    /// The input is prefilled once and its KV entries are copied to every beam sequence.
     /// Selects top-k initial tokens, then generates greedily for each beam.
     fn generate_beam_search_d1_greedy_batch(
         &self,
@@ -304,45 +721,19 @@ impl LlamaCppModel {
         eos_token_id: Option<i32>,
         beam_size: usize,
     ) -> Result<Vec<(Vec<LlamaToken>, f32)>> {
-        let backend = get_backend()?;
-
-        // Set n_batch and n_ubatch large enough to avoid batch splitting
-        // which causes "coupled sequences" error
-        let batch_size = input_tokens
-            .len()
-            .saturating_mul(beam_size)
-            .saturating_add(64)
-            .min(u32::MAX as usize) as u32;
-        let ctx_params = self
-            .context_params()
-            .with_n_seq_max(beam_size.try_into().unwrap_or(32))
-            .with_n_batch(batch_size)
-            .with_n_ubatch(batch_size);
-
-        let mut ctx = self
-            .model
-            .new_context(backend, ctx_params)
-            .map_err(|e| KanjiError::Inference(e.into()))?;
+        let mut ctx = self.new_beam_context(input_tokens.len(), beam_size)?;
 
         let model_eos = self.model.token_eos();
         let input_len = input_tokens.len();
 
-        // Step 1: Process input tokens for ALL sequences in one batch
-        // Add each token separately for each sequence (not coupled)
-        let mut batch = LlamaBatch::new(512, 1);
+        // Step 1: Prefill the input once on sequence 0 and share its KV entries
+        // with the other sequences instead of decoding the prompt per beam
+        let mut batch = LlamaBatch::new(input_len.max(beam_size).max(512), 1);
+        latency::time(Stage::Prefill, || {
+            prefill_shared_prompt(&mut ctx, &mut batch, input_tokens, beam_size)
+        })?;
 
-        for (i, token) in input_tokens.iter().enumerate() {
-            for seq_id in 0..beam_size as i32 {
-                let is_last = i == input_len - 1 && seq_id == 0; // Only first seq needs logits
-                batch
-                    .add(*token, i as i32, &[seq_id], is_last)
-                    .map_err(|e| KanjiError::Inference(e.into()))?;
-            }
-        }
-        ctx.decode(&mut batch)
-            .map_err(|e| KanjiError::Inference(e.into()))?;
-
-        // Step 2: Get top-k initial tokens (from any seq, all have same logits at this point)
+        // Step 2: Get top-k initial tokens from the prompt's last position
         let logits = ctx.get_logits();
         let (top_tokens, top_log_probs) = self.get_top_k_tokens(logits, beam_size);
 
@@ -449,19 +840,224 @@ impl LlamaCppModel {
     ///    - Keep only the best beam_size candidates globally
     /// 3. Repeat until all beams reach EOS or max_new_tokens
     ///
-    /// True beam search implementation without KV cache sharing.
-    /// This implementation processes full sequences at each step to avoid
-    /// KV cache copy issues with GPT-2 models. It's slower but more reliable.
+    /// Runs every beam in one multi-sequence context (see
+    /// `generate_beam_search_batched`). If that context cannot be used (e.g. the
+    /// KV cache is too small for the beams), falls back to evaluating the beams
+    /// one by one on the shared session.
     fn generate_beam_search_impl(
         &self,
         input_tokens: &[LlamaToken],
         max_new_tokens: usize,
         eos_token_id: Option<i32>,
         beam_size: usize,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Vec<(Vec<LlamaToken>, f32)>> {
+        if beam_size > 1 && !input_tokens.is_empty() {
+            match self.generate_beam_search_batched(
+                input_tokens,
+                max_new_tokens,
+                eos_token_id,
+                beam_size,
+                should_stop,
+            ) {
+                Err(KanjiError::Inference(e)) => {
+                    tracing::debug!("batched beam search failed, evaluating beams one by one: {e}");
+                }
+                result => return result,
+            }
+        }
+        self.generate_beam_search_sequential(
+            input_tokens,
+            max_new_tokens,
+            eos_token_id,
+            beam_size,
+            should_stop,
+        )
+    }
+
+    /// Beam search with every beam in its own sequence of one context.
+    ///
+    /// The input is prefilled once and shared through KV-cache sequence copies.
+    /// Each step decodes the newest token of every active beam in a single batch.
+    /// A surviving candidate reuses its parent's sequence; siblings of the same
+    /// parent get a copy of it in a sequence whose beam died, so no prefix is
+    /// ever decoded twice.
+    fn generate_beam_search_batched(
+        &self,
+        input_tokens: &[LlamaToken],
+        max_new_tokens: usize,
+        eos_token_id: Option<i32>,
+        beam_size: usize,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Vec<(Vec<LlamaToken>, f32)>> {
+        let model_eos = self.model.token_eos();
+        let input_len = input_tokens.len();
+
+        if should_stop() {
+            return Err(KanjiError::Cancelled);
+        }
+        let mut ctx = self.new_beam_context(input_len, beam_size)?;
+        let mut batch = LlamaBatch::new(input_len.max(beam_size).max(512), 1);
+        let prefill_start = Instant::now();
+        latency::time(Stage::Prefill, || {
+            prefill_shared_prompt(&mut ctx, &mut batch, input_tokens, beam_size)
+        })?;
+        self.throughput
+            .record_prefill(input_len, prefill_start.elapsed());
+        let decode_start = Instant::now();
+        let mut steps = 0;
+
+        let (top_tokens, top_log_probs) = self.get_top_k_tokens(ctx.get_logits(), beam_size);
+
+        // Beams whose last token is not decoded yet; `seqs[i]` holds the KV
+        // entries of input + `beams[i].tokens` minus the last token
+        let mut beams: Vec<BeamState> = Vec::with_capacity(beam_size);
+        let mut seqs: Vec<i32> = Vec::with_capacity(beam_size);
+        let mut finished_beams: Vec<BeamState> = Vec::new();
+        for (&token, &log_prob) in top_tokens.iter().zip(top_log_probs.iter()) {
+            let beam = BeamState {
+                tokens: vec![token],
+                score: log_prob,
+            };
+            if self.is_eos_token(token, eos_token_id, model_eos) {
+                finished_beams.push(beam);
+            } else {
+                seqs.push(beams.len() as i32);
+                beams.push(beam);
+            }
+        }
+
+        let expand_k = beam_size.max(4);
+
+        for _step in 0..(max_new_tokens - 1) {
+            if beams.is_empty() {
+                break;
+            }
+
+            if finished_beams.len() >= beam_size {
+                let best_finished = finished_beams
+                    .iter()
+                    .map(|b| b.score)
+                    .fold(f32::NEG_INFINITY, f32::max);
+                let best_active = beams
+                    .iter()
+                    .map(|b| b.score)
+                    .fold(f32::NEG_INFINITY, f32::max);
+                if best_active < best_finished {
+                    break;
+                }
+            }
+
+            if should_stop() {
+                return Err(KanjiError::Cancelled);
+            }
+            // Advance every active beam by one token in a single decode
+            batch.clear();
+            for (beam, &seq) in beams.iter().zip(&seqs) {
+                let token = *beam.tokens.last().expect("beams are never empty");
+                let pos = (input_len + beam.tokens.len() - 1) as i32;
+                batch
+                    .add(token, pos, &[seq], true)
+                    .map_err(|e| KanjiError::Inference(e.into()))?;
+            }
+            ctx.decode(&mut batch)
+                .map_err(|e| KanjiError::Inference(e.into()))?;
+            steps += 1;
+
+            // (parent index, candidate); logits of beam i are at batch index i
+            let mut candidates: Vec<(usize, BeamState)> = Vec::new();
+            for (parent, beam) in beams.iter().enumerate() {
+                let logits = ctx.get_logits_ith(parent as i32);
+                let (top_tokens, top_log_probs) = self.get_top_k_tokens(logits, expand_k);
+                for (&token, &log_prob) in top_tokens.iter().zip(top_log_probs.iter()) {
+                    let mut new_tokens = beam.tokens.clone();
+                    new_tokens.push(token);
+                    candidates.push((
+                        parent,
+                        BeamState {
+                            tokens: new_tokens,
+                            score: beam.score + log_prob,
+                        },
+                    ));
+                }
+            }
+
+            candidates.sort_by(|a, b| b.1.score.total_cmp(&a.1.score));
+            candidates.truncate(beam_size);
+
+            let mut survivors: Vec<(usize, BeamState)> = Vec::with_capacity(beam_size);
+            for (parent, candidate) in candidates {
+                let last_token = *candidate.tokens.last().expect("candidates are never empty");
+                if self.is_eos_token(last_token, eos_token_id, model_eos) {
+                    finished_beams.push(candidate);
+                } else {
+                    survivors.push((parent, candidate));
+                }
+            }
+
+            // The best child of each parent keeps the parent's sequence
+            let mut claimed = vec![false; beams.len()];
+            let mut new_seqs: Vec<Option<i32>> = survivors
+                .iter()
+                .map(|&(parent, _)| {
+                    (!std::mem::replace(&mut claimed[parent], true)).then_some(seqs[parent])
+                })
+                .collect();
+            // Every other sequence is free again (parents without surviving
+            // children, or never used because a first token was EOS)
+            let mut free: Vec<i32> = (0..beam_size as i32)
+                .filter(|seq| !new_seqs.contains(&Some(*seq)))
+                .collect();
+            for &seq in &free {
+                ctx.clear_kv_cache_seq(Some(seq as u32), None, None)
+                    .map_err(|e| KanjiError::Inference(e.into()))?;
+            }
+            for ((parent, _), new_seq) in survivors.iter().zip(new_seqs.iter_mut()) {
+                if new_seq.is_none() {
+                    let dst = free.pop().expect("one free sequence per extra child");
+                    ctx.copy_kv_cache_seq(seqs[*parent], dst, None, None)
+                        .map_err(|e| KanjiError::Inference(e.into()))?;
+                    *new_seq = Some(dst);
+                }
+            }
+
+            seqs = new_seqs.into_iter().flatten().collect();
+            beams = survivors.into_iter().map(|(_, beam)| beam).collect();
+        }
+        latency::record(Stage::Decode, decode_start.elapsed());
+        self.throughput
+            .beam_step
+            .record(steps, decode_start.elapsed());
+
+        let mut all_results: Vec<(Vec<LlamaToken>, f32)> = finished_beams
+            .into_iter()
+            .chain(beams)
+            .map(|b| (b.tokens, b.score))
+            .collect();
+        all_results.sort_by(|a, b| b.1.total_cmp(&a.1));
+        all_results.truncate(beam_size);
+
+        Ok(all_results)
+    }
+
+    /// Beam search evaluating each beam's full sequence on the shared session.
+    ///
+    /// Slower than the batched variant (one decode per beam and step) but needs
+    /// only a single-sequence context.
+    fn generate_beam_search_sequential(
+        &self,
+        input_tokens: &[LlamaToken],
+        max_new_tokens: usize,
+        eos_token_id: Option<i32>,
+        beam_size: usize,
+        should_stop: &dyn Fn() -> bool,
     ) -> Result<Vec<(Vec<LlamaToken>, f32)>> {
         let model_eos = self.model.token_eos();
 
         // Step 1: Get initial logits
+        if should_stop() {
+            return Err(KanjiError::Cancelled);
+        }
         let initial_logits = self.eval_sequence(input_tokens)?;
         let (top_tokens, top_log_probs) = self.get_top_k_tokens(&initial_logits, beam_size);
 
@@ -510,6 +1106,9 @@ impl LlamaCppModel {
             let mut candidates: Vec<BeamState> = Vec::new();
 
             for beam in &beams {
+                if should_stop() {
+                    return Err(KanjiError::Cancelled);
+                }
                 // Build full sequence: input_tokens + beam.tokens
                 let mut full_seq: Vec<LlamaToken> = input_tokens.to_vec();
                 full_seq.extend(&beam.tokens);
@@ -566,28 +1165,13 @@ impl LlamaCppModel {
 
     /// Process a token sequence and return the logits at the last position.
     ///
-    /// Creates a fresh context for each call. Used by true beam search where
-    /// each beam needs independent evaluation.
+    /// Runs on the reusable context, so sequences sharing a prefix with the
+    /// previous call (e.g. beams of the same prompt) only decode their new tokens.
     fn eval_sequence(&self, tokens: &[LlamaToken]) -> Result<Vec<f32>> {
-        let backend = get_backend()?;
-        let ctx_params = self.context_params();
-
-        let mut ctx = self
-            .model
-            .new_context(backend, ctx_params)
-            .map_err(|e| KanjiError::Inference(e.into()))?;
-
-        let mut batch = LlamaBatch::new(512, 1);
-        for (i, token) in tokens.iter().enumerate() {
-            let is_last = i == tokens.len() - 1;
-            batch
-                .add(*token, i as i32, &[0], is_last)
-                .map_err(|e| KanjiError::Inference(e.into()))?;
-        }
-        ctx.decode(&mut batch)
-            .map_err(|e| KanjiError::Inference(e.into()))?;
-
-        Ok(ctx.get_logits().to_vec())
+        self.with_session(|session| {
+            session.prefill(tokens)?;
+            Ok(session.ctx.get_logits().to_vec())
+        })
     }
 
     /// Get top-k tokens from logits with log probabilities
@@ -639,69 +1223,68 @@ impl LlamaCppModel {
         max_new_tokens: usize,
         eos_token_id: Option<i32>,
         mut sampler: LlamaSampler,
+        should_stop: &dyn Fn() -> bool,
     ) -> Result<Vec<LlamaToken>> {
-        let backend = get_backend()?;
-        let ctx_params = self.context_params();
+        if should_stop() {
+            return Err(KanjiError::Cancelled);
+        }
 
-        let mut ctx = self
-            .model
-            .new_context(backend, ctx_params)
-            .map_err(|e| KanjiError::Inference(e.into()))?;
+        self.with_session(|session| {
+            // Only the tokens after the prefix shared with the previous call are prefilled
+            let prefill_start = Instant::now();
+            let prefilled = latency::time(Stage::Prefill, || session.prefill(input_tokens))?;
+            self.throughput
+                .record_prefill(prefilled, prefill_start.elapsed());
 
-        let mut batch = LlamaBatch::new(512, 1);
-        let mut generated = input_tokens.to_vec();
+            let mut generated = input_tokens.to_vec();
+            let decode_start = Instant::now();
 
-        // Process input tokens
-        for (i, token) in input_tokens.iter().enumerate() {
-            let is_last = i == input_tokens.len() - 1;
-            batch
-                .add(*token, i as i32, &[0], is_last)
-                .map_err(|e| KanjiError::Inference(e.into()))?;
-        }
+            // Get model's EOS token for comparison
+            let model_eos = self.model.token_eos();
 
-        ctx.decode(&mut batch)
-            .map_err(|e| KanjiError::Inference(e.into()))?;
+            // Generate new tokens
+            for _ in 0..max_new_tokens {
+                let new_token = sampler.sample(&session.ctx, -1);
 
-        let mut n_cur = input_tokens.len();
+                // Check for EOS using the provided token ID
+                if let Some(eos) = eos_token_id
+                    && new_token.0 == eos
+                {
+                    break;
+                }
 
-        // Get model's EOS token for comparison
-        let model_eos = self.model.token_eos();
+                // Check against model's EOS token
+                if new_token == model_eos {
+                    break;
+                }
 
-        // Generate new tokens
-        for _ in 0..max_new_tokens {
-            let new_token = sampler.sample(&ctx, -1);
+                // Check if model thinks it's end of generation
+                if self.model.is_eog_token(new_token) {
+                    break;
+                }
 
-            // Check for EOS using the provided token ID
-            if let Some(eos) = eos_token_id
-                && new_token.0 == eos
-            {
-                break;
-            }
+                // The KV cache stays consistent, so a cancelled decode is still reusable
+                if should_stop() {
+                    return Err(KanjiError::Cancelled);
+                }
 
-            // Check against model's EOS token
-            if new_token == model_eos {
-                break;
-            }
+                generated.push(new_token);
 
-            // Check if model thinks it's end of generation
-            if self.model.is_eog_token(new_token) {
-                break;
+                // Decode just the new token
+                session.push(new_token)?;
             }
+            latency::record(Stage::Decode, decode_start.elapsed());
+            self.throughput
+                .decode
+                .record(generated.len() - input_tokens.len(), decode_start.elapsed());
 
-            generated.push(new_token);
-
-            // Prepare next batch with just the new token
-            batch.clear();
-            batch
-                .add(new_token, n_cur as i32, &[0], true)
-                .map_err(|e| KanjiError::Inference(e.into()))?;
-
-            ctx.decode(&mut batch)
-                .map_err(|e| KanjiError::Inference(e.into()))?;
-            n_cur += 1;
-        }
+            Ok(generated)
+        })
+    }
 
-        Ok(generated)
+    /// Measured prefill/decode cost per token (None until a greedy decode ran)
+    pub fn throughput(&self) -> Option<ThroughputSnapshot> {
+        self.throughput.snapshot()
     }
 
     /// Get the EOS token ID from the model
@@ -1,21 +1,28 @@
 //! Kanji conversion using llama.cpp GGUF inference
 
 mod backend;
+pub mod batch;
 pub mod error;
+pub mod hardware;
 pub mod hf_download;
 pub mod llamacpp;
 pub mod model_config;
+pub mod throughput;
+mod tokenizer;
 
 pub use backend::{
     Backend, ConversionConfig, KanaKanjiConverter, build_jinen_prompt, clean_model_output,
 };
+pub use batch::BatchConfig;
 pub use error::KanjiError;
+pub use hardware::{HardwareProfile, KvCacheType, ModelOptions};
 pub use hf_download::{
     download_gguf, get_path_by_id, get_tokenizer_path, get_tokenizer_path_by_id, get_variant_path,
 };
 pub use llama_cpp_2::token::LlamaToken;
 pub use llamacpp::{LlamaCppModel, NllScorer};
 pub use model_config::{ModelFamily, ModelRegistry, VariantConfig, registry};
+pub use throughput::ThroughputSnapshot;
 
 /// Special tokens for jinen format
 pub const CONTEXT_TOKEN: char = '\u{ee02}';
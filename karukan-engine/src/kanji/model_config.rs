@@ -36,6 +36,12 @@ pub struct VariantConfig {
     pub filename: String,
     /// Human-readable name shown in UI
     pub display_name: String,
+    /// Weight quantization type (e.g. "Q5_K_M")
+    #[serde(default)]
+    pub quantization: Option<String>,
+    /// Bits per weight of the quantization, used to pick a variant for the device
+    #[serde(default)]
+    pub bits: Option<u32>,
 }
 
 static REGISTRY: OnceLock<ModelRegistry> = OnceLock::new();
@@ -63,6 +69,29 @@ impl ModelRegistry {
         None
     }
 
+    /// Variant of `variant_id`'s family to run on this device.
+    ///
+    /// With GPU offload the weights no longer compete for CPU memory bandwidth,
+    /// so the highest-precision variant (most `bits`) is chosen; on CPU the
+    /// configured variant is kept. Returns None for an unknown variant id.
+    pub fn variant_for_device(
+        &self,
+        variant_id: &str,
+        gpu_offload: bool,
+    ) -> Option<&VariantConfig> {
+        let (family, variant) = self.find_variant(variant_id)?;
+        if !gpu_offload {
+            return Some(variant);
+        }
+        family
+            .variants
+            .values()
+            .filter(|v| v.bits.is_some())
+            .max_by_key(|v| (v.bits, v.id == variant.id))
+            .filter(|best| best.bits > variant.bits)
+            .or(Some(variant))
+    }
+
     /// Return the default `(family, variant)` pair.
     pub fn default_variant(&self) -> Option<(&ModelFamily, &VariantConfig)> {
         self.find_variant(&self.default_model)
@@ -147,6 +176,20 @@ mod tests {
         assert_eq!(count, 2, "Expected exactly 2 variants, got {}", count);
     }
 
+    #[test]
+    fn test_variant_for_device() {
+        let reg = registry();
+        for gpu_offload in [false, true] {
+            let variant = reg
+                .variant_for_device("jinen-v1-small-q5", gpu_offload)
+                .expect("variant not found");
+            // Only one quantization per family is published so far
+            assert_eq!(variant.id, "jinen-v1-small-q5");
+            assert_eq!(variant.quantization.as_deref(), Some("Q5_K_M"));
+        }
+        assert!(reg.variant_for_device("nonexistent-model", true).is_none());
+    }
+
     #[test]
     fn test_unknown_variant_returns_none() {
         let reg = registry();
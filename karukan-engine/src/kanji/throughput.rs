@@ -0,0 +1,123 @@
+//! Online inference cost estimates per model
+//!
+//! Every greedy decode and batched beam search records how long its prefill and
+//! decode phases took per token. The estimates are exponentially weighted
+//! moving averages, so they follow the machine's current load and the model's
+//! thread count (a model with a different `n_threads` is a new instance).
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Duration;
+
+/// Weight of a new sample in the moving average
+const SMOOTHING: f64 = 0.2;
+
+/// Prefill runs shorter than this reflect the fixed cost of one decode call,
+/// not the model's prompt throughput
+const MIN_PREFILL_TOKENS: usize = 2;
+
+/// Moving average of microseconds per token (lock-free; 0 = no sample yet)
+#[derive(Debug, Default)]
+pub struct CostEstimate {
+    /// `f64` bits of the average
+    bits: AtomicU64,
+}
+
+impl CostEstimate {
+    /// Add a measurement of `tokens` tokens taking `elapsed`
+    pub fn record(&self, tokens: usize, elapsed: Duration) {
+        if tokens == 0 {
+            return;
+        }
+        let sample = elapsed.as_secs_f64() * 1e6 / tokens as f64;
+        // Lost updates under contention only drop a sample
+        let average = match self.get() {
+            Some(old) => old + SMOOTHING * (sample - old),
+            None => sample,
+        };
+        // Keep 0 reserved for "no sample"
+        self.bits
+            .store(average.max(f64::MIN_POSITIVE).to_bits(), Ordering::Relaxed);
+    }
+
+    /// Current average in microseconds per token (None until the first sample)
+    pub fn get(&self) -> Option<f64> {
+        let bits = self.bits.load(Ordering::Relaxed);
+        (bits != 0).then(|| f64::from_bits(bits))
+    }
+}
+
+/// Measured inference cost of one model
+#[derive(Debug, Default)]
+pub struct Throughput {
+    /// Prompt prefill, per prompt token
+    pub prefill: CostEstimate,
+    /// Greedy decode, per generated token
+    pub decode: CostEstimate,
+    /// Batched beam search, per step (one token for every active beam)
+    pub beam_step: CostEstimate,
+}
+
+impl Throughput {
+    /// Record a prefill of `tokens` prompt tokens (short ones are ignored)
+    pub fn record_prefill(&self, tokens: usize, elapsed: Duration) {
+        if tokens >= MIN_PREFILL_TOKENS {
+            self.prefill.record(tokens, elapsed);
+        }
+    }
+
+    /// Current estimates, or None until both prefill and greedy decode were measured
+    pub fn snapshot(&self) -> Option<ThroughputSnapshot> {
+        Some(ThroughputSnapshot {
+            prefill_us: self.prefill.get()?,
+            decode_us: self.decode.get()?,
+            beam_step_us: self.beam_step.get(),
+        })
+    }
+}
+
+/// Point-in-time copy of a model's `Throughput` (microseconds per token)
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct ThroughputSnapshot {
+    pub prefill_us: f64,
+    pub decode_us: f64,
+    /// None until a beam search was measured
+    pub beam_step_us: Option<f64>,
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_moving_average() {
+        let estimate = CostEstimate::default();
+        assert_eq!(estimate.get(), None);
+        estimate.record(10, Duration::from_micros(1000));
+        assert_eq!(estimate.get(), Some(100.0));
+        estimate.record(1, Duration::from_micros(200));
+        let average = estimate.get().unwrap();
+        assert!((average - 120.0).abs() < 1e-9, "{}", average);
+        // Empty measurements carry no information
+        estimate.record(0, Duration::from_secs(1));
+        assert_eq!(estimate.get(), Some(average));
+    }
+
+    #[test]
+    fn test_snapshot_needs_prefill_and_decode() {
+        let throughput = Throughput::default();
+        throughput.decode.record(4, Duration::from_micros(400));
+        assert_eq!(throughput.snapshot(), None);
+        // A one-token prefill only measures a single decode call
+        throughput.record_prefill(1, Duration::from_micros(50));
+        assert_eq!(throughput.snapshot(), None);
+        throughput.record_prefill(8, Duration::from_micros(400));
+        assert_eq!(
+            throughput.snapshot(),
+            Some(ThroughputSnapshot {
+                prefill_us: 50.0,
+                decode_us: 100.0,
+                beam_step_us: None,
+            })
+        );
+    }
+}
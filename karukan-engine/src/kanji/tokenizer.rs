@@ -0,0 +1,417 @@
+//! Jinen prompt tokenization with cached special tokens, context and katakana
+//!
+//! A prompt is `CONTEXT_TOKEN context INPUT_START_TOKEN katakana OUTPUT_START_TOKEN`.
+//! The special tokens are added tokens of the tokenizer, which splits them off
+//! before anything else and encodes the text between them on its own. So the
+//! prompt's tokens are the three special token ids around the separately
+//! encoded context and katakana. While typing, the context rarely changes and
+//! the reading is converted more than once per key (token count, then the
+//! conversion itself), so `PromptTokenizer` keeps the last encoding of each and,
+//! when the tokenizer gives every katakana character a token of its own, maps
+//! readings through a character → token table without running the tokenizer.
+//!
+//! Both shortcuts are checked against the full tokenizer when the model loads
+//! and stay off if their output could differ from it.
+
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+use super::error::{KanjiError, Result};
+use super::{CONTEXT_TOKEN, INPUT_START_TOKEN, OUTPUT_START_TOKEN};
+
+/// Characters a reading is made of after `hiragana_to_katakana`: ァ..ヺ and ー
+fn reading_chars() -> impl Iterator<Item = char> {
+    ('\u{30A1}'..='\u{30FA}').chain(['ー'])
+}
+
+fn is_reading_char(c: char) -> bool {
+    ('\u{30A1}'..='\u{30FA}').contains(&c) || c == 'ー'
+}
+
+/// (katakana, context) pairs the segment-wise encoding is checked on
+const PROBES: &[(&str, &str)] = &[
+    ("カンジ", ""),
+    ("キョウハイイテンキ", "今日は"),
+    ("ニューラルカナカンジヘンカン", "子どもと遊びに行く "),
+    ("ア", " ABC 123、。 "),
+    ("ヴァイオリン", "ｶﾀｶﾅとＡＢＣ"),
+];
+
+/// Readings the character table is checked on (besides every single character)
+const READING_PROBES: &[&str] = &[
+    "カンジ",
+    "キョウハイイテンキデスネ",
+    "ニューラルカナカンジヘンカン",
+    "ヴァイオリン",
+    "ッッッーー",
+];
+
+/// What `PromptTokenizer` needs from a tokenizer (tests use a fake one)
+pub(super) trait Encode {
+    fn encode(&self, text: &str) -> Result<Vec<u32>>;
+    fn decode(&self, ids: &[u32], skip_special_tokens: bool) -> Result<String>;
+    fn vocab_size(&self) -> usize;
+}
+
+impl Encode for tokenizers::Tokenizer {
+    fn encode(&self, text: &str) -> Result<Vec<u32>> {
+        let encoding =
+            tokenizers::Tokenizer::encode(self, text, false).map_err(KanjiError::Inference)?;
+        Ok(encoding.get_ids().to_vec())
+    }
+
+    fn decode(&self, ids: &[u32], skip_special_tokens: bool) -> Result<String> {
+        tokenizers::Tokenizer::decode(self, ids, skip_special_tokens).map_err(KanjiError::Inference)
+    }
+
+    fn vocab_size(&self) -> usize {
+        self.get_vocab_size(true)
+    }
+}
+
+/// Ids of the jinen special tokens
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct SpecialIds {
+    context: u32,
+    input_start: u32,
+    output_start: u32,
+}
+
+/// The most recent text encoded for one prompt segment and its ids
+#[derive(Default)]
+struct LastEncoding(Mutex<Option<(String, Vec<u32>)>>);
+
+impl LastEncoding {
+    /// Append the ids of `text` to `out`, encoding it only if it is not the
+    /// cached text. A busy cache is bypassed rather than waited for.
+    fn encode_into<E: Encode>(&self, tokenizer: &E, text: &str, out: &mut Vec<u32>) -> Result<()> {
+        if let Ok(guard) = self.0.try_lock()
+            && let Some((cached, ids)) = guard.as_ref()
+            && cached == text
+        {
+            out.extend_from_slice(ids);
+            return Ok(());
+        }
+        let ids = tokenizer.encode(text)?;
+        out.extend_from_slice(&ids);
+        if let Ok(mut guard) = self.0.try_lock() {
+            *guard = Some((text.to_string(), ids));
+        }
+        Ok(())
+    }
+}
+
+/// Tokenizer with the prompt fast path (see the module docs)
+pub(super) struct PromptTokenizer<E = tokenizers::Tokenizer> {
+    tokenizer: E,
+    /// None if the prompt must be encoded as a whole
+    special: Option<SpecialIds>,
+    /// Token of each reading character; empty if readings need the tokenizer
+    reading_chars: HashMap<char, u32>,
+    context: LastEncoding,
+    katakana: LastEncoding,
+}
+
+impl<E: Encode> PromptTokenizer<E> {
+    pub fn new(tokenizer: E) -> Self {
+        let mut this = Self {
+            tokenizer,
+            special: None,
+            reading_chars: HashMap::new(),
+            context: LastEncoding::default(),
+            katakana: LastEncoding::default(),
+        };
+        match this.detect_special_ids() {
+            Ok(special) => this.special = special,
+            Err(e) => tracing::debug!("prompt fast path unavailable: {}", e),
+        }
+        if this.special.is_some() {
+            match this.detect_reading_chars() {
+                Ok(table) => this.reading_chars = table,
+                Err(e) => tracing::debug!("katakana token table unavailable: {}", e),
+            }
+        }
+        tracing::debug!(
+            "tokenizer fast path: prompt={}, katakana table={} chars",
+            this.special.is_some(),
+            this.reading_chars.len()
+        );
+        this
+    }
+
+    pub fn encode(&self, text: &str) -> Result<Vec<u32>> {
+        self.tokenizer.encode(text)
+    }
+
+    pub fn decode(&self, ids: &[u32], skip_special_tokens: bool) -> Result<String> {
+        self.tokenizer.decode(ids, skip_special_tokens)
+    }
+
+    /// Ids of the jinen prompt for `katakana` after `context`; the same as
+    /// encoding `build_jinen_prompt(katakana, context)`
+    pub fn encode_prompt(&self, katakana: &str, context: &str) -> Result<Vec<u32>> {
+        let Some(special) = self.special else {
+            return self
+                .tokenizer
+                .encode(&super::build_jinen_prompt(katakana, context));
+        };
+        let mut ids = Vec::with_capacity(katakana.chars().count() + context.len() / 2 + 3);
+        ids.push(special.context);
+        if !context.is_empty() {
+            self.context
+                .encode_into(&self.tokenizer, context, &mut ids)?;
+        }
+        ids.push(special.input_start);
+        self.encode_reading_into(katakana, &mut ids)?;
+        ids.push(special.output_start);
+        Ok(ids)
+    }
+
+    /// Ids `katakana` takes up in a prompt (what the model reads for it)
+    pub fn encode_reading(&self, katakana: &str) -> Result<Vec<u32>> {
+        if self.special.is_none() {
+            return self.tokenizer.encode(katakana);
+        }
+        let mut ids = Vec::with_capacity(katakana.chars().count());
+        self.encode_reading_into(katakana, &mut ids)?;
+        Ok(ids)
+    }
+
+    fn encode_reading_into(&self, katakana: &str, out: &mut Vec<u32>) -> Result<()> {
+        if katakana.is_empty() {
+            return Ok(());
+        }
+        if !self.reading_chars.is_empty() {
+            let start = out.len();
+            for c in katakana.chars() {
+                match self.reading_chars.get(&c) {
+                    Some(&id) => out.push(id),
+                    None => {
+                        out.truncate(start);
+                        return self.katakana.encode_into(&self.tokenizer, katakana, out);
+                    }
+                }
+            }
+            return Ok(());
+        }
+        self.katakana.encode_into(&self.tokenizer, katakana, out)
+    }
+
+    /// Special token ids, if encoding the segments separately gives the same
+    /// ids as encoding the whole prompt on every probe
+    fn detect_special_ids(&self) -> Result<Option<SpecialIds>> {
+        let single = |c: char| -> Result<Option<u32>> {
+            let ids = self.tokenizer.encode(&c.to_string())?;
+            Ok(match ids.as_slice() {
+                &[id] => Some(id),
+                _ => None,
+            })
+        };
+        let (Some(context), Some(input_start), Some(output_start)) = (
+            single(CONTEXT_TOKEN)?,
+            single(INPUT_START_TOKEN)?,
+            single(OUTPUT_START_TOKEN)?,
+        ) else {
+            return Ok(None);
+        };
+        let special = SpecialIds {
+            context,
+            input_start,
+            output_start,
+        };
+        for &(katakana, context) in PROBES {
+            let whole = self
+                .tokenizer
+                .encode(&super::build_jinen_prompt(katakana, context))?;
+            let mut segments = vec![special.context];
+            if !context.is_empty() {
+                segments.extend(self.tokenizer.encode(context)?);
+            }
+            segments.push(special.input_start);
+            segments.extend(self.tokenizer.encode(katakana)?);
+            segments.push(special.output_start);
+            if whole != segments {
+                return Ok(None);
+            }
+        }
+        Ok(Some(special))
+    }
+
+    /// Token of every reading character, if the tokenizer never merges a
+    /// reading character with anything else: each one encodes to a single
+    /// token, and no vocabulary entry longer than one character contains a
+    /// reading character or a partial UTF-8 sequence (a byte-level token that
+    /// could span characters). Empty otherwise.
+    fn detect_reading_chars(&self) -> Result<HashMap<char, u32>> {
+        let mut table = HashMap::new();
+        for c in reading_chars() {
+            if let &[id] = self.tokenizer.encode(&c.to_string())?.as_slice() {
+                table.insert(c, id);
+            }
+        }
+        for id in 0..self.tokenizer.vocab_size() as u32 {
+            let text = self.tokenizer.decode(&[id], false)?;
+            if text.chars().nth(1).is_some()
+                && text
+                    .chars()
+                    .any(|c| is_reading_char(c) || c == char::REPLACEMENT_CHARACTER)
+            {
+                return Ok(HashMap::new());
+            }
+        }
+        let all: String = reading_chars().filter(|c| table.contains_key(c)).collect();
+        for reading in READING_PROBES.iter().copied().chain([all.as_str()]) {
+            let Some(via_table) = reading
+                .chars()
+                .map(|c| table.get(&c).copied())
+                .collect::<Option<Vec<u32>>>()
+            else {
+                continue;
+            };
+            if via_table != self.tokenizer.encode(reading)? {
+                return Ok(HashMap::new());
+            }
+        }
+        Ok(table)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::cell::Cell;
+
+    use super::*;
+
+    /// Character-level tokenizer with optional quirks. Ids are allocated on
+    /// first sight; every reading character and `merge` have one from the start.
+    struct FakeTokenizer {
+        vocab: Mutex<Vec<String>>,
+        /// Extra token matched greedily
+        merge: Option<&'static str>,
+        /// Emit a word-boundary marker before the first ordinary character of
+        /// the input (like a SentencePiece metaspace), so a segment encodes
+        /// differently on its own than inside the prompt
+        leading_marker: bool,
+        calls: Cell<usize>,
+    }
+
+    impl FakeTokenizer {
+        fn new(merge: Option<&'static str>, leading_marker: bool) -> Self {
+            let mut vocab = vec!["▁".to_string()];
+            vocab.extend(reading_chars().map(String::from));
+            vocab.extend(merge.map(String::from));
+            Self {
+                vocab: Mutex::new(vocab),
+                merge,
+                leading_marker,
+                calls: Cell::new(0),
+            }
+        }
+
+        fn id(&self, piece: &str) -> u32 {
+            let mut vocab = self.vocab.lock().unwrap();
+            match vocab.iter().position(|p| p == piece) {
+                Some(id) => id as u32,
+                None => {
+                    vocab.push(piece.to_string());
+                    vocab.len() as u32 - 1
+                }
+            }
+        }
+    }
+
+    impl Encode for FakeTokenizer {
+        fn encode(&self, text: &str) -> Result<Vec<u32>> {
+            self.calls.set(self.calls.get() + 1);
+            let specials = [CONTEXT_TOKEN, INPUT_START_TOKEN, OUTPUT_START_TOKEN];
+            let mut ids = Vec::new();
+            let mut marked = !self.leading_marker;
+            let mut rest = text;
+            while let Some(c) = rest.chars().next() {
+                let piece = match self.merge {
+                    Some(merge) if rest.starts_with(merge) => merge,
+                    _ => &rest[..c.len_utf8()],
+                };
+                if !marked && !specials.contains(&c) {
+                    ids.push(self.id("▁"));
+                    marked = true;
+                }
+                ids.push(self.id(piece));
+                rest = &rest[piece.len()..];
+            }
+            Ok(ids)
+        }
+
+        fn decode(&self, ids: &[u32], _skip_special_tokens: bool) -> Result<String> {
+            let vocab = self.vocab.lock().unwrap();
+            Ok(ids.iter().map(|&id| vocab[id as usize].as_str()).collect())
+        }
+
+        fn vocab_size(&self) -> usize {
+            self.vocab.lock().unwrap().len()
+        }
+    }
+
+    fn assert_matches_full_encoding(tokenizer: &PromptTokenizer<FakeTokenizer>) {
+        let cases = [
+            ("カンジ", "今日は"),
+            ("カンジ", ""),
+            ("", "文脈"),
+            ("テスト", "今日は"),
+        ];
+        for (katakana, context) in cases {
+            let prompt = super::super::build_jinen_prompt(katakana, context);
+            assert_eq!(
+                tokenizer.encode_prompt(katakana, context).unwrap(),
+                tokenizer.encode(&prompt).unwrap(),
+                "{} / {}",
+                katakana,
+                context
+            );
+        }
+    }
+
+    #[test]
+    fn test_fast_path_matches_full_encoding() {
+        let tokenizer = PromptTokenizer::new(FakeTokenizer::new(None, false));
+        assert!(tokenizer.special.is_some());
+        assert_eq!(tokenizer.reading_chars.len(), 91);
+        assert_matches_full_encoding(&tokenizer);
+    }
+
+    #[test]
+    fn test_cached_context_and_table_skip_the_tokenizer() {
+        let tokenizer = PromptTokenizer::new(FakeTokenizer::new(None, false));
+        tokenizer.encode_prompt("カ", "今日は").unwrap();
+        let calls = tokenizer.tokenizer.calls.get();
+        // Same context, reading only from the table: no tokenizer call
+        tokenizer.encode_prompt("カン", "今日は").unwrap();
+        tokenizer.encode_prompt("カンジ", "今日は").unwrap();
+        assert_eq!(tokenizer.tokenizer.calls.get(), calls);
+        // A new context is encoded once
+        tokenizer.encode_prompt("カンジ", "明日は").unwrap();
+        assert_eq!(tokenizer.tokenizer.calls.get(), calls + 1);
+    }
+
+    #[test]
+    fn test_merging_tokenizer_disables_the_table() {
+        let tokenizer = PromptTokenizer::new(FakeTokenizer::new(Some("カン"), false));
+        assert!(tokenizer.special.is_some());
+        assert!(tokenizer.reading_chars.is_empty());
+        assert_matches_full_encoding(&tokenizer);
+
+        // The reading is still encoded once for repeated conversions
+        assert_eq!(tokenizer.encode_reading("カンジ").unwrap().len(), 2);
+        let calls = tokenizer.tokenizer.calls.get();
+        tokenizer.encode_prompt("カンジ", "").unwrap();
+        assert_eq!(tokenizer.tokenizer.calls.get(), calls);
+    }
+
+    #[test]
+    fn test_segment_dependent_tokenizer_uses_full_encoding() {
+        let tokenizer = PromptTokenizer::new(FakeTokenizer::new(None, true));
+        assert!(tokenizer.special.is_none());
+        assert!(tokenizer.reading_chars.is_empty());
+        assert_matches_full_encoding(&tokenizer);
+    }
+}
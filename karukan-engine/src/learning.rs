@@ -2,105 +2,242 @@
 //!
 //! Records which surface forms the user chose for each reading, and
 //! boosts those candidates on subsequent conversions. Persisted as a
-//! simple TSV file (`reading\tsurface\tfrequency\tlast_access`).
+//! simple TSV file (`reading\tsurface\tfrequency\tlast_access`), plus an
+//! append-only journal in the same format holding updates made since the
+//! last full snapshot.
+//!
+//! Readings are kept sorted, so prefix queries are a range scan over the
+//! matching readings only. Surfaces are interned across readings, and an
+//! index grouping entries by frequency finds the lowest-score entry without a
+//! full scan, so the cache stays within `max_entries` after every update.
 
-use std::collections::HashMap;
+use std::collections::{BTreeMap, BTreeSet, HashSet};
+use std::fmt::Write as _;
 use std::io::{BufRead, Write};
-use std::path::Path;
+use std::ops::Bound;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
 use std::time::{SystemTime, UNIX_EPOCH};
 
 /// A single learned conversion entry.
 #[derive(Debug, Clone)]
 pub struct LearningEntry {
-    /// Surface form (e.g. "今日")
-    pub surface: String,
+    /// Surface form (e.g. "今日"), shared by every reading that learned it
+    pub surface: Arc<str>,
     /// Number of times this surface was selected
     pub frequency: u32,
     /// Last selection time as Unix timestamp (seconds)
     pub last_access: u64,
 }
 
+/// Eviction index key within one frequency: `(last_access, reading, surface)`
+type EvictionKey = (u64, Arc<str>, Arc<str>);
+
 /// In-memory cache of user learning data.
 ///
 /// Keyed by reading (hiragana). Each reading maps to a list of surface
 /// entries with frequency and recency metadata.
 #[derive(Debug)]
 pub struct LearningCache {
-    entries: HashMap<String, Vec<LearningEntry>>,
+    /// Entries per reading, sorted by reading for prefix range scans
+    entries: BTreeMap<Arc<str>, Vec<LearningEntry>>,
+    /// Interned surface strings
+    surfaces: HashSet<Arc<str>>,
+    /// Entries grouped by frequency, oldest first. Among entries of equal
+    /// frequency the oldest scores lowest, so the lowest-score entry overall is
+    /// the first entry of one of these sets.
+    eviction: BTreeMap<u32, BTreeSet<EvictionKey>>,
+    /// Total number of (reading, surface) pairs
+    len: usize,
     max_entries: usize,
     dirty: bool,
+    /// Journal lines for updates not yet written to disk
+    journal: Vec<String>,
+    /// Lines in the on-disk journal since the last snapshot
+    journal_lines: usize,
+    /// Journal length that triggers a full snapshot (compaction)
+    journal_limit: usize,
+    /// Next write must be a full snapshot (no snapshot on disk yet, or a write failed)
+    force_snapshot: bool,
+}
+
+/// A pending disk write taken from a `LearningCache` with `take_write`.
+///
+/// The text is prepared under the cache lock; `commit` does the I/O and can
+/// run after the lock is released.
+#[derive(Debug)]
+pub enum LearningWrite {
+    /// Lines to append to the journal
+    Append(String),
+    /// Full TSV snapshot replacing the file (and truncating the journal)
+    Snapshot(String),
+}
+
+/// Journal file next to a learning cache file (`learning.tsv.journal`)
+pub fn journal_path(path: &Path) -> PathBuf {
+    let mut journal = path.as_os_str().to_owned();
+    journal.push(".journal");
+    PathBuf::from(journal)
+}
+
+impl LearningWrite {
+    /// Write to `path` (snapshot) or its journal (append).
+    ///
+    /// Snapshots are written to a temporary file and renamed into place, so a
+    /// crash never leaves a truncated cache behind.
+    pub fn commit(&self, path: &Path) -> anyhow::Result<()> {
+        if let Some(parent) = path.parent() {
+            std::fs::create_dir_all(parent)?;
+        }
+        match self {
+            LearningWrite::Append(lines) => {
+                let mut journal = std::fs::OpenOptions::new()
+                    .create(true)
+                    .append(true)
+                    .open(journal_path(path))?;
+                journal.write_all(lines.as_bytes())?;
+            }
+            LearningWrite::Snapshot(text) => {
+                let mut tmp = path.as_os_str().to_owned();
+                tmp.push(".tmp");
+                std::fs::write(&tmp, text)?;
+                std::fs::rename(&tmp, path)?;
+                match std::fs::remove_file(journal_path(path)) {
+                    Err(e) if e.kind() != std::io::ErrorKind::NotFound => return Err(e.into()),
+                    _ => {}
+                }
+            }
+        }
+        Ok(())
+    }
 }
 
 impl LearningCache {
     /// Default maximum number of total entries across all readings.
     pub const DEFAULT_MAX_ENTRIES: usize = 10_000;
 
+    /// Default journal length before the next write compacts into a snapshot.
+    pub const DEFAULT_JOURNAL_LIMIT: usize = 1_000;
+
     /// Create an empty cache with the given entry limit.
     pub fn new(max_entries: usize) -> Self {
         Self {
-            entries: HashMap::new(),
+            entries: BTreeMap::new(),
+            surfaces: HashSet::new(),
+            eviction: BTreeMap::new(),
+            len: 0,
             max_entries,
             dirty: false,
+            journal: Vec::new(),
+            journal_lines: 0,
+            journal_limit: Self::DEFAULT_JOURNAL_LIMIT,
+            force_snapshot: true,
         }
     }
 
-    /// Record a user selection. Increments frequency and updates last_access.
+    /// Record a user selection. Increments frequency and updates last_access,
+    /// then evicts the lowest-score entry if over capacity.
     pub fn record(&mut self, reading: &str, surface: &str) {
         let now = now_unix();
-        let entries = self.entries.entry(reading.to_string()).or_default();
-
-        if let Some(entry) = entries.iter_mut().find(|e| e.surface == surface) {
-            entry.frequency += 1;
-            entry.last_access = now;
-        } else {
-            entries.push(LearningEntry {
-                surface: surface.to_string(),
-                frequency: 1,
-                last_access: now,
-            });
-        }
+        let frequency = self.upsert(reading, surface, |frequency, last_access| {
+            *frequency += 1;
+            *last_access = now;
+        });
+        self.journal.push(format!(
+            "{}\t{}\t{}\t{}\n",
+            reading, surface, frequency, now
+        ));
         self.dirty = true;
+        self.evict();
     }
 
-    /// Exact-match lookup: returns `(surface, score)` pairs sorted by score descending.
-    pub fn lookup(&self, reading: &str) -> Vec<(String, f64)> {
-        let now = now_unix();
-        let Some(entries) = self.entries.get(reading) else {
-            return Vec::new();
+    /// Merge a persisted entry, keeping the larger frequency and last_access.
+    ///
+    /// Journal lines carry absolute values, so replaying one twice (or over a
+    /// newer snapshot) is harmless.
+    fn merge_entry(&mut self, reading: &str, surface: &str, frequency: u32, last_access: u64) {
+        self.upsert(reading, surface, |f, t| {
+            *f = (*f).max(frequency);
+            *t = (*t).max(last_access);
+        });
+    }
+
+    /// Insert or update the `(reading, surface)` entry with `update(frequency,
+    /// last_access)` (both 0 for a new entry), keeping the eviction index in
+    /// sync. Returns the new frequency.
+    fn upsert(
+        &mut self,
+        reading: &str,
+        surface: &str,
+        update: impl FnOnce(&mut u32, &mut u64),
+    ) -> u32 {
+        let reading: Arc<str> = match self.entries.get_key_value(reading) {
+            Some((key, _)) => Arc::clone(key),
+            None => Arc::from(reading),
         };
-        let mut scored: Vec<(String, f64)> = entries
-            .iter()
-            .map(|e| (e.surface.clone(), score(e, now)))
-            .collect();
-        scored.sort_by(|a, b| b.1.total_cmp(&a.1));
-        scored
+        let entries = self.entries.entry(Arc::clone(&reading)).or_default();
+        let entry = match entries.iter().position(|e| &*e.surface == surface) {
+            Some(i) => {
+                let entry = &mut entries[i];
+                remove_from_index(
+                    &mut self.eviction,
+                    entry.frequency,
+                    &(
+                        entry.last_access,
+                        Arc::clone(&reading),
+                        Arc::clone(&entry.surface),
+                    ),
+                );
+                entry
+            }
+            None => {
+                let surface = match self.surfaces.get(surface) {
+                    Some(interned) => Arc::clone(interned),
+                    None => {
+                        let interned: Arc<str> = Arc::from(surface);
+                        self.surfaces.insert(Arc::clone(&interned));
+                        interned
+                    }
+                };
+                self.len += 1;
+                entries.push(LearningEntry {
+                    surface,
+                    frequency: 0,
+                    last_access: 0,
+                });
+                entries.last_mut().unwrap()
+            }
+        };
+        update(&mut entry.frequency, &mut entry.last_access);
+        self.eviction.entry(entry.frequency).or_default().insert((
+            entry.last_access,
+            reading,
+            Arc::clone(&entry.surface),
+        ));
+        entry.frequency
     }
 
-    /// Prefix-match lookup: returns `(reading, surface, score)` triples
-    /// for all readings that start with `prefix`, sorted by score descending.
-    pub fn prefix_lookup(&self, prefix: &str) -> Vec<(String, String, f64)> {
-        let now = now_unix();
-        let mut results: Vec<(String, String, f64)> = Vec::new();
-        for (reading, entries) in &self.entries {
-            if reading.starts_with(prefix) {
-                for entry in entries {
-                    results.push((reading.clone(), entry.surface.clone(), score(entry, now)));
-                }
+    /// Remove one entry (given by its eviction index key) from every structure
+    fn remove(&mut self, frequency: u32, key: EvictionKey) {
+        remove_from_index(&mut self.eviction, frequency, &key);
+        let (_, reading, surface) = key;
+        if let Some(entries) = self.entries.get_mut(&*reading) {
+            entries.retain(|e| e.surface != surface);
+            if entries.is_empty() {
+                self.entries.remove(&*reading);
             }
         }
-        results.sort_by(|a, b| b.2.total_cmp(&a.2));
-        results
+        self.len -= 1;
+        // Only the interner and `surface` itself are left: no reading uses it anymore
+        if Arc::strong_count(&surface) == 2 {
+            self.surfaces.remove(&*surface);
+        }
     }
 
-    /// Load a learning cache from a TSV file.
-    ///
-    /// Format: `reading\tsurface\tfrequency\tlast_access`
-    /// Lines starting with `#` are comments.
-    pub fn load(path: &Path, max_entries: usize) -> anyhow::Result<Self> {
-        let file = std::fs::File::open(path)?;
-        let reader = std::io::BufReader::new(file);
-        let mut cache = Self::new(max_entries);
-
+    /// Read `reading\tsurface\tfrequency\tlast_access` lines into the cache.
+    /// Returns the number of entries read.
+    fn read_tsv(&mut self, reader: impl BufRead) -> anyhow::Result<usize> {
+        let mut count = 0;
         for line in reader.lines() {
             let line = line?;
             let line = line.trim();
@@ -121,53 +258,145 @@ impl LearningCache {
                 Ok(v) => v,
                 Err(_) => continue,
             };
+            self.merge_entry(reading, surface, frequency, last_access);
+            count += 1;
+        }
+        Ok(count)
+    }
 
-            cache
-                .entries
-                .entry(reading.to_string())
-                .or_default()
-                .push(LearningEntry {
-                    surface: surface.to_string(),
-                    frequency,
-                    last_access,
-                });
+    /// Exact-match lookup: returns `(surface, score)` pairs sorted by score descending.
+    pub fn lookup(&self, reading: &str) -> Vec<(&str, f64)> {
+        let now = now_unix();
+        let Some(entries) = self.entries.get(reading) else {
+            return Vec::new();
+        };
+        let mut scored: Vec<(&str, f64)> = entries
+            .iter()
+            .map(|e| (&*e.surface, score(e, now)))
+            .collect();
+        scored.sort_by(|a, b| b.1.total_cmp(&a.1));
+        scored
+    }
+
+    /// Prefix-match lookup: returns `(reading, surface, score)` triples
+    /// for all readings that start with `prefix`, sorted by score descending.
+    pub fn prefix_lookup(&self, prefix: &str) -> Vec<(&str, &str, f64)> {
+        let mut results = self.scan_prefix(prefix, true);
+        results.sort_by(|a, b| b.2.total_cmp(&a.2));
+        results
+    }
+
+    /// Predictive lookup: the `limit` best `(reading, surface, score)` triples
+    /// whose reading extends `prefix` (the exact reading is left to `lookup`),
+    /// sorted by score descending.
+    pub fn predict(&self, prefix: &str, limit: usize) -> Vec<(&str, &str, f64)> {
+        let mut results = self.scan_prefix(prefix, false);
+        if results.len() > limit {
+            results.select_nth_unstable_by(limit, |a, b| b.2.total_cmp(&a.2));
+            results.truncate(limit);
+        }
+        results.sort_by(|a, b| b.2.total_cmp(&a.2));
+        results
+    }
+
+    /// Scored entries of the readings starting with `prefix` (unsorted)
+    fn scan_prefix(&self, prefix: &str, include_exact: bool) -> Vec<(&str, &str, f64)> {
+        let now = now_unix();
+        self.entries
+            .range::<str, _>((Bound::Included(prefix), Bound::Unbounded))
+            .take_while(|(reading, _)| reading.starts_with(prefix))
+            .filter(|(reading, _)| include_exact || reading.len() > prefix.len())
+            .flat_map(|(reading, entries)| {
+                entries
+                    .iter()
+                    .map(move |e| (&**reading, &*e.surface, score(e, now)))
+            })
+            .collect()
+    }
+
+    /// Load a learning cache from a TSV file, then replay its journal (if any).
+    ///
+    /// Format: `reading\tsurface\tfrequency\tlast_access`
+    /// Lines starting with `#` are comments.
+    pub fn load(path: &Path, max_entries: usize) -> anyhow::Result<Self> {
+        let file = std::fs::File::open(path)?;
+        let mut cache = Self::new(max_entries);
+        cache.read_tsv(std::io::BufReader::new(file))?;
+
+        match std::fs::File::open(journal_path(path)) {
+            Ok(journal) => {
+                cache.journal_lines = cache.read_tsv(std::io::BufReader::new(journal))?;
+            }
+            Err(e) if e.kind() == std::io::ErrorKind::NotFound => {}
+            Err(e) => return Err(e.into()),
         }
 
+        // A smaller max_entries than the file was written with
+        cache.evict();
+
         // Not dirty — just loaded from disk
         cache.dirty = false;
+        cache.force_snapshot = false;
         Ok(cache)
     }
 
-    /// Save the cache to a TSV file, evicting low-score entries if over capacity.
-    pub fn save(&mut self, path: &Path) -> anyhow::Result<()> {
-        self.evict();
-
-        if let Some(parent) = path.parent() {
-            std::fs::create_dir_all(parent)?;
+    /// Take the pending changes as a disk write, or None if nothing changed.
+    ///
+    /// Small updates become journal appends; once the journal reaches its limit
+    /// (or no snapshot exists yet) the whole cache is serialized instead, after
+    /// evicting low-score entries if over capacity. The cache is marked clean;
+    /// call `write_failed` if committing the write fails.
+    pub fn take_write(&mut self) -> Option<LearningWrite> {
+        if !self.dirty {
+            return None;
+        }
+        self.dirty = false;
+        let lines = std::mem::take(&mut self.journal);
+        if self.force_snapshot || self.journal_lines + lines.len() > self.journal_limit {
+            self.force_snapshot = false;
+            self.journal_lines = 0;
+            Some(LearningWrite::Snapshot(self.serialize()))
+        } else {
+            self.journal_lines += lines.len();
+            Some(LearningWrite::Append(lines.concat()))
         }
+    }
 
-        let file = std::fs::File::create(path)?;
-        let mut writer = std::io::BufWriter::new(file);
-        writeln!(writer, "# karukan learning cache v1")?;
-
-        // Sort readings for deterministic output
-        let mut readings: Vec<&String> = self.entries.keys().collect();
-        readings.sort();
-
-        for reading in readings {
-            if let Some(entries) = self.entries.get(reading) {
-                for entry in entries {
-                    writeln!(
-                        writer,
-                        "{}\t{}\t{}\t{}",
-                        reading, entry.surface, entry.frequency, entry.last_access
-                    )?;
-                }
+    /// Mark a taken write as lost, so the next write is a full snapshot.
+    pub fn write_failed(&mut self) {
+        self.dirty = true;
+        self.force_snapshot = true;
+    }
+
+    /// Serialize the whole cache as TSV, evicting low-score entries if over capacity.
+    fn serialize(&mut self) -> String {
+        self.evict();
+
+        let mut out = String::from("# karukan learning cache v1\n");
+        // Readings are sorted, so the output is deterministic
+        for (reading, entries) in &self.entries {
+            for entry in entries {
+                let _ = writeln!(
+                    out,
+                    "{}\t{}\t{}\t{}",
+                    reading, entry.surface, entry.frequency, entry.last_access
+                );
             }
         }
+        out
+    }
 
-        writer.flush()?;
-        self.dirty = false;
+    /// Save the whole cache to a TSV file synchronously (atomic snapshot),
+    /// evicting low-score entries if over capacity.
+    pub fn save(&mut self, path: &Path) -> anyhow::Result<()> {
+        self.dirty = true;
+        self.force_snapshot = true;
+        if let Some(write) = self.take_write()
+            && let Err(e) = write.commit(path)
+        {
+            self.write_failed();
+            return Err(e);
+        }
         Ok(())
     }
 
@@ -178,48 +407,42 @@ impl LearningCache {
 
     /// Total number of (reading, surface) pairs across all readings.
     pub fn entry_count(&self) -> usize {
-        self.entries.values().map(|v| v.len()).sum()
+        self.len
     }
 
     /// Evict lowest-score entries until total count is within `max_entries`.
+    ///
+    /// Each eviction compares only the oldest entry of every distinct frequency.
     fn evict(&mut self) {
-        let total = self.entry_count();
-        if total <= self.max_entries {
+        if self.len <= self.max_entries {
             return;
         }
-
         let now = now_unix();
-        // Collect all entries with their (reading, index, score)
-        let mut all: Vec<(String, usize, f64)> = Vec::with_capacity(total);
-        for (reading, entries) in &self.entries {
-            for (i, entry) in entries.iter().enumerate() {
-                all.push((reading.clone(), i, score(entry, now)));
-            }
-        }
-        // Sort by score ascending (lowest first = eviction candidates)
-        all.sort_by(|a, b| a.2.total_cmp(&b.2));
-
-        let to_remove = total - self.max_entries;
-        // Collect indices to remove, grouped by reading
-        let mut remove_set: HashMap<String, Vec<usize>> = HashMap::new();
-        for &(ref reading, idx, _) in all.iter().take(to_remove) {
-            remove_set.entry(reading.clone()).or_default().push(idx);
+        while self.len > self.max_entries {
+            let Some((frequency, key)) = self
+                .eviction
+                .iter()
+                .filter_map(|(&frequency, keys)| Some((frequency, keys.first()?)))
+                .min_by(|a, b| raw_score(a.0, a.1.0, now).total_cmp(&raw_score(b.0, b.1.0, now)))
+                .map(|(frequency, key)| (frequency, key.clone()))
+            else {
+                break;
+            };
+            self.remove(frequency, key);
         }
+    }
+}
 
-        // Remove entries in reverse index order to preserve indices
-        for (reading, indices) in &mut remove_set {
-            indices.sort_unstable();
-            indices.reverse();
-            if let Some(entries) = self.entries.get_mut(reading) {
-                for &idx in indices.iter() {
-                    if idx < entries.len() {
-                        entries.remove(idx);
-                    }
-                }
-                if entries.is_empty() {
-                    self.entries.remove(reading);
-                }
-            }
+/// Remove `key` from the eviction index bucket of `frequency`
+fn remove_from_index(
+    eviction: &mut BTreeMap<u32, BTreeSet<EvictionKey>>,
+    frequency: u32,
+    key: &EvictionKey,
+) {
+    if let Some(keys) = eviction.get_mut(&frequency) {
+        keys.remove(key);
+        if keys.is_empty() {
+            eviction.remove(&frequency);
         }
     }
 }
@@ -229,13 +452,17 @@ impl LearningCache {
 /// Inspired by mozc's UserHistoryPredictor: recent selections rank higher,
 /// with a logarithmic frequency term to reward repeated use.
 fn score(entry: &LearningEntry, now: u64) -> f64 {
-    let age_days = if now > entry.last_access {
-        (now - entry.last_access) / 86400
-    } else {
-        0
-    };
+    raw_score(entry.frequency, entry.last_access, now)
+}
+
+/// `score` of an entry given by its frequency and last access time.
+///
+/// Never increases with age and grows with frequency, which the eviction
+/// index relies on.
+fn raw_score(frequency: u32, last_access: u64, now: u64) -> f64 {
+    let age_days = now.saturating_sub(last_access) / 86400;
     let recency = 1.0 / (1.0 + age_days as f64);
-    let freq = (entry.frequency as f64).ln_1p();
+    let freq = (frequency as f64).ln_1p();
     recency * 10.0 + freq
 }
 
@@ -284,7 +511,7 @@ mod tests {
         let results = cache.prefix_lookup("きょう");
         assert_eq!(results.len(), 2);
         // Both "きょう" and "きょうと" should match
-        let readings: Vec<&str> = results.iter().map(|(r, _, _)| r.as_str()).collect();
+        let readings: Vec<&str> = results.iter().map(|(r, _, _)| *r).collect();
         assert!(readings.contains(&"きょう"));
         assert!(readings.contains(&"きょうと"));
     }
@@ -320,6 +547,90 @@ mod tests {
         assert_eq!(results[0].0, "今日"); // frequency 2
     }
 
+    #[test]
+    fn test_small_updates_append_to_journal() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("learning.tsv");
+        let mut cache = LearningCache::new(100);
+        cache.record("きょう", "今日");
+
+        // First write has no snapshot to append to
+        let write = cache.take_write().unwrap();
+        assert!(matches!(write, LearningWrite::Snapshot(_)));
+        write.commit(&path).unwrap();
+        assert!(cache.take_write().is_none());
+
+        cache.record("きょう", "今日");
+        cache.record("あした", "明日");
+        let write = cache.take_write().unwrap();
+        assert!(matches!(&write, LearningWrite::Append(lines) if lines.lines().count() == 2));
+        write.commit(&path).unwrap();
+
+        // The snapshot is untouched; load replays the journal on top of it
+        let snapshot = std::fs::read_to_string(&path).unwrap();
+        assert!(!snapshot.contains("明日"));
+        let loaded = LearningCache::load(&path, 100).unwrap();
+        assert_eq!(loaded.entry_count(), 2);
+        assert_eq!(loaded.entries["きょう"][0].frequency, 2);
+        assert_eq!(loaded.journal_lines, 2);
+    }
+
+    #[test]
+    fn test_journal_compacts_into_snapshot() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("learning.tsv");
+        let mut cache = LearningCache::new(100);
+        cache.journal_limit = 2;
+        cache.save(&path).unwrap();
+
+        cache.record("a", "A");
+        cache.record("b", "B");
+        cache.take_write().unwrap().commit(&path).unwrap();
+        assert!(journal_path(&path).exists());
+
+        cache.record("c", "C");
+        let write = cache.take_write().unwrap();
+        assert!(matches!(write, LearningWrite::Snapshot(_)));
+        write.commit(&path).unwrap();
+        assert!(!journal_path(&path).exists());
+        assert_eq!(LearningCache::load(&path, 100).unwrap().entry_count(), 3);
+    }
+
+    #[test]
+    fn test_journal_replay_keeps_newest_values() {
+        let file = NamedTempFile::new().unwrap();
+        std::fs::write(file.path(), "きょう\t今日\t5\t1700000100\n").unwrap();
+        // A stale journal line (e.g. left behind by a crash during compaction)
+        std::fs::write(
+            journal_path(file.path()),
+            "きょう\t今日\t3\t1700000000\nきょう\t京\t1\t1700000200\n",
+        )
+        .unwrap();
+
+        let cache = LearningCache::load(file.path(), 100).unwrap();
+        let kyou = &cache.entries["きょう"];
+        assert_eq!(kyou.len(), 2);
+        assert_eq!(kyou[0].frequency, 5);
+        assert_eq!(kyou[0].last_access, 1700000100);
+        std::fs::remove_file(journal_path(file.path())).unwrap();
+    }
+
+    #[test]
+    fn test_write_failed_forces_snapshot() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("learning.tsv");
+        LearningCache::new(100).save(&path).unwrap();
+        let mut cache = LearningCache::load(&path, 100).unwrap();
+        cache.record("きょう", "今日");
+        let _lost = cache.take_write().unwrap();
+        cache.write_failed();
+        assert!(cache.is_dirty());
+        assert!(matches!(
+            cache.take_write().unwrap(),
+            LearningWrite::Snapshot(text) if text.contains("今日")
+        ));
+    }
+
     #[test]
     fn test_dirty_flag() {
         let mut cache = LearningCache::new(100);
@@ -356,16 +667,88 @@ mod tests {
         assert!(cache.entry_count() <= 3);
     }
 
+    #[test]
+    fn test_eviction_on_record_keeps_highest_scores() {
+        let file = NamedTempFile::new().unwrap();
+        let now = now_unix();
+        let day = 86400;
+        std::fs::write(
+            file.path(),
+            format!(
+                "a\tA\t50\t{}\nb\tB\t1\t{}\nc\tC\t3\t{}\n",
+                now - 100 * day,
+                now - 2 * day,
+                now - 50 * day
+            ),
+        )
+        .unwrap();
+        let mut cache = LearningCache::load(file.path(), 3).unwrap();
+
+        // Over capacity right away: the lowest score (C: 0.2 + ln 4) goes,
+        // not the oldest (A: 0.1 + ln 51)
+        cache.record("d", "D");
+        assert_eq!(cache.entry_count(), 3);
+        assert!(cache.lookup("c").is_empty());
+        assert_eq!(cache.lookup("a").len(), 1);
+        assert_eq!(cache.lookup("d").len(), 1);
+
+        // Loading with a smaller limit evicts down to it
+        cache.save(file.path()).unwrap();
+        let loaded = LearningCache::load(file.path(), 1).unwrap();
+        assert_eq!(loaded.entry_count(), 1);
+        assert_eq!(loaded.lookup("d")[0].0, "D");
+    }
+
+    #[test]
+    fn test_surfaces_interned() {
+        let file = NamedTempFile::new().unwrap();
+        std::fs::write(
+            file.path(),
+            "こんにちは\t今日は\t1\t1700000000\nきょうは\t今日は\t1\t1700000000\n",
+        )
+        .unwrap();
+        let mut cache = LearningCache::load(file.path(), 2).unwrap();
+        assert_eq!(cache.surfaces.len(), 1);
+
+        // One reading is evicted; the other still uses the shared surface
+        cache.record("あ", "亜");
+        assert_eq!(cache.entry_count(), 2);
+        assert_eq!(cache.surfaces.len(), 2);
+
+        // Once its last reading is evicted, the surface is released
+        cache.record("い", "胃");
+        assert!(!cache.surfaces.contains("今日は"));
+        assert_eq!(cache.surfaces.len(), 2);
+    }
+
+    #[test]
+    fn test_predict_excludes_exact_and_limits() {
+        let mut cache = LearningCache::new(100);
+        cache.record("きょう", "今日");
+        cache.record("きょうと", "京都");
+        cache.record("きょうと", "京都");
+        cache.record("きょうとし", "京都市");
+        cache.record("きよう", "器用");
+
+        let results = cache.predict("きょう", 1);
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].0, "きょうと");
+        assert_eq!(results[0].1, "京都");
+
+        let readings: Vec<&str> = cache.predict("きょう", 10).iter().map(|r| r.0).collect();
+        assert_eq!(readings, ["きょうと", "きょうとし"]);
+    }
+
     #[test]
     fn test_score_recency() {
         let now = now_unix();
         let recent = LearningEntry {
-            surface: "A".to_string(),
+            surface: "A".into(),
             frequency: 1,
             last_access: now,
         };
         let old = LearningEntry {
-            surface: "B".to_string(),
+            surface: "B".into(),
             frequency: 1,
             last_access: now.saturating_sub(30 * 86400), // 30 days ago
         };
@@ -376,12 +759,12 @@ mod tests {
     fn test_score_frequency() {
         let now = now_unix();
         let high_freq = LearningEntry {
-            surface: "A".to_string(),
+            surface: "A".into(),
             frequency: 100,
             last_access: now,
         };
         let low_freq = LearningEntry {
-            surface: "B".to_string(),
+            surface: "B".into(),
             frequency: 1,
             last_access: now,
         };
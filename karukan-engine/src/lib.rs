@@ -1,10 +1,16 @@
+#[cfg(unix)]
+pub mod daemon;
 pub mod dict;
 pub mod kana;
 pub mod kanji;
+pub mod latency;
 pub mod learning;
 pub mod romaji;
 
-pub use dict::{Candidate as DictCandidate, DictEntry, Dictionary, LookupResult};
+pub use dict::{
+    Candidate as DictCandidate, CandidateRef as DictCandidateRef, Candidates as DictCandidates,
+    DictEntry, Dictionary, LookupResult,
+};
 pub use kana::{hiragana_to_katakana, katakana_to_hiragana, normalize_nfkc};
 pub use kanji::{Backend, KanaKanjiConverter};
 pub use learning::LearningCache;
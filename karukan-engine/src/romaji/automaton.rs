@@ -0,0 +1,205 @@
+use std::sync::OnceLock;
+
+use super::rules::build_rules;
+use super::trie::{SearchResult, TrieNode};
+
+/// No transition (state 0 is the root, which is never a transition target)
+const NONE: u16 = 0;
+
+/// Compiled, immutable romaji automaton.
+///
+/// Built once from the `TrieNode` rules: transitions live in one dense table
+/// indexed by `state * class_count + class`, where `class` is a small index for
+/// each ASCII character that appears in a rule, and all outputs are slices of
+/// one string pool. A lookup is two array reads per input character, with no
+/// hashing or pointer chasing.
+#[derive(Debug)]
+pub struct RomajiAutomaton {
+    /// ASCII character → class + 1 (0 = character not used by any rule)
+    classes: [u8; 128],
+    class_count: usize,
+    /// `state * class_count + class` → next state (`NONE` = no transition)
+    transitions: Vec<u16>,
+    /// Per state: `(offset, len)` of its output in `pool` (len 0 = no output)
+    outputs: Vec<(u32, u32)>,
+    /// Per state: whether any transition leaves it
+    has_children: Vec<bool>,
+    pool: String,
+}
+
+impl RomajiAutomaton {
+    /// The automaton for the default rules, compiled on first use and shared
+    /// by every converter in the process
+    pub fn shared() -> &'static Self {
+        static SHARED: OnceLock<RomajiAutomaton> = OnceLock::new();
+        SHARED.get_or_init(|| Self::compile(&build_rules()))
+    }
+
+    /// Compile a rule trie. Rules must use ASCII characters only.
+    pub fn compile(trie: &TrieNode) -> Self {
+        let mut classes = [0u8; 128];
+        let mut class_count = 0usize;
+        collect_classes(trie, &mut classes, &mut class_count);
+
+        let mut automaton = Self {
+            classes,
+            class_count,
+            transitions: Vec::new(),
+            outputs: Vec::new(),
+            has_children: Vec::new(),
+            pool: String::new(),
+        };
+        automaton.add_state(trie);
+        automaton
+    }
+
+    /// Append `node` and (recursively) its children; returns its state id
+    fn add_state(&mut self, node: &TrieNode) -> u16 {
+        let state = self.outputs.len();
+        let id = u16::try_from(state).expect("romaji rules exceed u16 states");
+        let output = match &node.output {
+            Some(s) => {
+                let offset = self.pool.len() as u32;
+                self.pool.push_str(s);
+                (offset, s.len() as u32)
+            }
+            None => (0, 0),
+        };
+        self.outputs.push(output);
+        self.has_children.push(!node.children.is_empty());
+        self.transitions
+            .resize(self.transitions.len() + self.class_count, NONE);
+
+        // Sorted so the layout does not depend on HashMap iteration order
+        let mut children: Vec<_> = node.children.iter().collect();
+        children.sort_by_key(|(ch, _)| **ch);
+        for (ch, child) in children {
+            let class = self
+                .class_of(*ch)
+                .expect("class collected for every rule char");
+            let next = self.add_state(child);
+            self.transitions[state * self.class_count + class] = next;
+        }
+        id
+    }
+
+    fn class_of(&self, ch: char) -> Option<usize> {
+        let class = *self.classes.get(ch as usize)?;
+        (class != 0).then(|| class as usize - 1)
+    }
+
+    fn step(&self, state: u16, ch: char) -> Option<u16> {
+        let class = self.class_of(ch)?;
+        let next = self.transitions[state as usize * self.class_count + class];
+        (next != NONE).then_some(next)
+    }
+
+    fn output(&self, state: u16) -> Option<&str> {
+        let (offset, len) = self.outputs[state as usize];
+        (len != 0).then(|| &self.pool[offset as usize..(offset + len) as usize])
+    }
+
+    /// Search for the longest matching prefix (same semantics as
+    /// `TrieNode::search_longest`)
+    pub fn search_longest(&self, input: &str) -> SearchResult<'_> {
+        let mut state = 0u16;
+        let mut last_match: Option<(usize, &str)> = None;
+        let mut has_continuation = false;
+
+        for (idx, ch) in input.chars().enumerate() {
+            let Some(next) = self.step(state, ch) else {
+                break;
+            };
+            state = next;
+            if let Some(output) = self.output(state) {
+                last_match = Some((idx + 1, output));
+            }
+            has_continuation = self.has_children[state as usize];
+        }
+
+        match last_match {
+            Some((len, output)) => SearchResult {
+                matched_len: len,
+                output: Some(output),
+                has_continuation,
+            },
+            None => SearchResult {
+                matched_len: 0,
+                output: None,
+                has_continuation: self.has_children[0],
+            },
+        }
+    }
+
+    /// Whether `input` is a (possibly complete) prefix of some rule
+    pub fn is_prefix(&self, input: &str) -> bool {
+        input
+            .chars()
+            .try_fold(0u16, |state, ch| self.step(state, ch))
+            .is_some()
+    }
+}
+
+/// Assign a class to every character used by the rules under `node`
+fn collect_classes(node: &TrieNode, classes: &mut [u8; 128], count: &mut usize) {
+    for (ch, child) in &node.children {
+        let slot = classes
+            .get_mut(*ch as usize)
+            .expect("romaji rules must be ASCII");
+        if *slot == 0 {
+            *count += 1;
+            *slot = u8::try_from(*count).expect("at most 127 ASCII classes");
+        }
+        collect_classes(child, classes, count);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Every input up to three ASCII characters gives the same result as the trie
+    #[test]
+    fn test_matches_trie() {
+        let trie = build_rules();
+        let automaton = RomajiAutomaton::compile(&trie);
+        let alphabet: Vec<char> = (' '..='~').collect();
+        let mut input = String::new();
+        for &a in &alphabet {
+            for &b in &alphabet {
+                for &c in ['a', 'n', 'y', 'h', 's', 'z', '.', '1'].iter() {
+                    input.clear();
+                    input.extend([a, b, c]);
+                    for end in 1..=3 {
+                        let prefix = &input[..end];
+                        assert_eq!(
+                            automaton.search_longest(prefix),
+                            trie.search_longest(prefix),
+                            "input {:?}",
+                            prefix
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn test_non_ascii_input() {
+        let automaton = RomajiAutomaton::shared();
+        let result = automaton.search_longest("あka");
+        assert_eq!(result.matched_len, 0);
+        assert!(result.output.is_none());
+        assert!(!automaton.is_prefix("ä"));
+    }
+
+    #[test]
+    fn test_is_prefix() {
+        let automaton = RomajiAutomaton::shared();
+        assert!(automaton.is_prefix(""));
+        assert!(automaton.is_prefix("k"));
+        assert!(automaton.is_prefix("ky"));
+        assert!(automaton.is_prefix("kya"));
+        assert!(!automaton.is_prefix("kq"));
+    }
+}
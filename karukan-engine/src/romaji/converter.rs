@@ -1,5 +1,4 @@
-use super::rules::build_rules;
-use super::trie::TrieNode;
+use super::automaton::RomajiAutomaton;
 use crate::kana::hiragana_to_katakana;
 
 /// Events that can occur during conversion
@@ -27,7 +26,8 @@ pub enum BackspaceResult {
 /// Romaji to Hiragana converter with state management
 #[derive(Debug)]
 pub struct RomajiConverter {
-    trie: TrieNode,
+    /// Compiled rules shared by every converter
+    rules: &'static RomajiAutomaton,
     buffer: String,
     output: String,
 }
@@ -36,7 +36,7 @@ impl RomajiConverter {
     /// Create a new converter with default rules
     pub fn new() -> Self {
         Self {
-            trie: build_rules(),
+            rules: RomajiAutomaton::shared(),
             buffer: String::new(),
             output: String::new(),
         }
@@ -113,7 +113,7 @@ impl RomajiConverter {
         }
 
         // Search for longest match
-        let search = self.trie.search_longest(&self.buffer);
+        let search = self.rules.search_longest(&self.buffer);
 
         if let Some(hiragana) = search.output {
             // Found a match
@@ -140,30 +140,16 @@ impl RomajiConverter {
             let Some(first_char) = self.buffer.chars().next() else {
                 return ConversionEvent::Buffered;
             };
-            let first_char_has_children = self.trie.children.contains_key(&first_char);
-
-            if first_char_has_children {
-                // Check if the current buffer could still lead to a match
-                // by walking the trie to see if we're on a valid path
-                let mut node = &self.trie;
-                let mut on_valid_path = true;
-                for ch in self.buffer.chars() {
-                    if let Some(child) = node.children.get(&ch) {
-                        node = child;
-                    } else {
-                        on_valid_path = false;
-                        break;
-                    }
-                }
-
-                if on_valid_path {
-                    // We're on a valid path in the trie, keep buffering
-                    return ConversionEvent::Buffered;
-                }
+            // Check if the current buffer could still lead to a match
+            if self.rules.is_prefix(&self.buffer) {
+                // We're on a valid path in the rules, keep buffering
+                return ConversionEvent::Buffered;
             }
 
             // First character doesn't start any rule, or buffer is not on valid path
-            let first_search = self.trie.search_longest(&first_char.to_string());
+            let first_search = self
+                .rules
+                .search_longest(first_char.encode_utf8(&mut [0; 4]));
 
             if let Some(hiragana) = first_search.output {
                 // First character has a valid conversion, use it
@@ -198,7 +184,7 @@ impl RomajiConverter {
         let mut result = String::new();
 
         while !self.buffer.is_empty() {
-            let search = self.trie.search_longest(&self.buffer);
+            let search = self.rules.search_longest(&self.buffer);
 
             if let Some(h) = search.output {
                 result.push_str(h);
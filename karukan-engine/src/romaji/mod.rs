@@ -1,3 +1,4 @@
+mod automaton;
 mod converter;
 mod rules;
 mod trie;
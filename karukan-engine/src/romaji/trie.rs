@@ -38,7 +38,10 @@ impl TrieNode {
         node.output = Some(hiragana.to_string());
     }
 
-    /// Search for the longest matching prefix in the trie
+    /// Search for the longest matching prefix in the trie.
+    ///
+    /// Reference for `RomajiAutomaton::search_longest`, which the converter uses.
+    #[cfg(test)]
     pub fn search_longest(&self, input: &str) -> SearchResult<'_> {
         let mut node = self;
         let mut last_match: Option<(usize, &str)> = None;
@@ -116,6 +116,55 @@ mod llamacpp_tests {
         }
     }
 
+    /// Batched greedy decoding gives the same output as one prompt at a time
+    #[test]
+    fn test_generate_batch_matches_sequential() {
+        let model = load_model().expect("Failed to load");
+        let eos = Some(model.eos_token_id().0);
+        let prompts: Vec<_> = [
+            "ワセダ",
+            "トウキョウ",
+            "ニホン",
+            "ニューラルカナカンジヘンカン",
+        ]
+        .iter()
+        .map(|input| {
+            model
+                .tokenize(&build_prompt(input))
+                .expect("Tokenize failed")
+        })
+        .collect();
+
+        // Batches of 2 also cover the split into several rounds
+        let batched = model
+            .generate_batch(&prompts, 20, eos, 2)
+            .expect("Batch generate failed");
+        assert_eq!(batched.len(), prompts.len());
+        for (tokens, generated) in prompts.iter().zip(&batched) {
+            let sequential = model.generate(tokens, 20, eos).expect("Generate failed");
+            assert_eq!(
+                model.decode(generated, true).expect("Decode failed"),
+                model
+                    .decode(&sequential[tokens.len()..], true)
+                    .expect("Decode failed")
+            );
+        }
+    }
+
+    /// A released session is recreated transparently by the next conversion
+    #[test]
+    fn test_release_session_then_generate() {
+        let model = load_model().expect("Failed to load");
+        let eos = Some(model.eos_token_id().0);
+        let tokens = model
+            .tokenize(&build_prompt("トウキョウ"))
+            .expect("Tokenize failed");
+        let before = model.generate(&tokens, 20, eos).expect("Generate failed");
+        assert!(model.release_session());
+        let after = model.generate(&tokens, 20, eos).expect("Generate failed");
+        assert_eq!(before, after);
+    }
+
     #[test]
     fn test_beam_search_basic() {
         let model = load_model().expect("Failed to load");
@@ -463,6 +512,31 @@ mod llamacpp_tests {
         );
     }
 
+    /// The prompt fast path tokenizes exactly like the whole prompt string
+    #[test]
+    fn test_tokenize_prompt_matches_tokenize() {
+        let model = load_model().expect("Failed to load");
+        let cases = [
+            ("ヘンカン", ""),
+            ("シカイ", "歯が痛いので"),
+            ("コウエン", "子どもと遊びに行くために近くの"),
+            ("ニューラルカナカンジヘンカン", " ＡＢＣ 123、"),
+            ("ヴァイオリン", "ｶﾀｶﾅ"),
+        ];
+        // Twice, so the second round runs on the cached context and reading
+        for _ in 0..2 {
+            for (input, context) in cases {
+                let whole = model
+                    .tokenize(&build_jinen_prompt(input, context))
+                    .expect("Tokenize failed");
+                let fast = model
+                    .tokenize_prompt(input, context)
+                    .expect("Tokenize failed");
+                assert_eq!(fast, whole, "'{}' + '{}'", input, context);
+            }
+        }
+    }
+
     /// Test token counts for various input lengths
     #[test]
     fn test_token_counts() {
@@ -0,0 +1,536 @@
+/*
+ * Karukan keystroke replay benchmark
+ *
+ * Replays recorded keystroke traces through the C FFI exactly as the fcitx5
+ * addon drives it: one karukan_engine_process_key_flags() call per key, then
+ * the input panel update KarukanState::updateUI() performs (applying the
+ * preedit delta, copying aux and commit text, rebuilding or re-using the
+ * candidate page). A mock
+ * panel stands in for fcitx's InputContext, so no fcitx instance is needed.
+ *
+ * Reports per-key latency percentiles, heap allocations per key (glibc only;
+ * counts both the Rust library and this process) and peak RSS, and fails if
+ * the preedit rebuilt from deltas ever differs from the engine's text.
+ *
+ * Usage: karukan-replay-bench [options] TRACE...
+ *   --iterations N   timed replays per trace (default 5)
+ *   --warmup N       untimed replays per trace first (default 1)
+ *   --max-p99-us N   exit with status 1 if any trace's p99 exceeds N µs
+ *   --report FILE    also write the per-stage latency report to FILE
+ *
+ * Models, dictionaries and settings are loaded like the addon does
+ * (~/.config/karukan-im/config.toml). The learning cache and tuning results
+ * are copied into scratch data and cache directories, so replays never change
+ * the user's history or the addon's caches.
+ */
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <xkbcommon/xkbcommon-keysyms.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "../../include/karukan.h"
+
+namespace {
+
+// Trace format version understood by this binary (first line: "karukan-trace 1")
+constexpr int kTraceVersion = 1;
+
+// Must match the X11 masks the addon passes (see kShiftMask etc. in karukan.cpp)
+constexpr uint32_t kShiftMask = 1;
+constexpr uint32_t kControlMask = 4;
+constexpr uint32_t kAltMask = 8;
+constexpr uint32_t kSuperMask = 64;
+
+// How long a "suggest" step waits for a background result
+constexpr int kSuggestTimeoutMs = 5000;
+
+std::atomic<uint64_t> allocationCount{0};
+
+// Keys after which the delta-built preedit differed from the engine's text
+uint64_t deltaMismatches = 0;
+
+}  // namespace
+
+#ifdef __GLIBC__
+// Count every heap allocation in the process, including the Rust library's
+// (the system allocator goes through malloc/calloc/realloc)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+namespace {
+
+struct Step {
+    enum class Kind { Key, Suggest, Reset };
+    Kind kind;
+    uint32_t keysym = 0;
+    uint32_t state = 0;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Step> steps;
+};
+
+// What the fcitx input panel would hold; updated like KarukanState::updateUI
+class MockPanel {
+public:
+    void apply(::KarukanEngine* engine, uint32_t updates) {
+        if ((updates & ~KARUKAN_UPDATE_CONSUMED) == 0) {
+            return;
+        }
+        if (updates & KARUKAN_UPDATE_COMMIT) {
+            committed_.append(karukan_engine_get_commit(engine),
+                              karukan_engine_get_commit_len(engine));
+            reset();
+        }
+        KarukanPreeditDelta delta;
+        if ((updates & KARUKAN_UPDATE_PREEDIT) &&
+            karukan_engine_get_preedit_delta(engine, &delta)) {
+            preedit_.replace(delta.start, delta.removed_len, delta.inserted, delta.inserted_len);
+            caret_ = delta.caret;
+        }
+        if (updates & KARUKAN_UPDATE_AUX) {
+            aux_.assign(karukan_engine_get_aux(engine), karukan_engine_get_aux_len(engine));
+        }
+        if (updates & KARUKAN_UPDATE_CANDIDATES) {
+            if (updates & KARUKAN_UPDATE_HIDE_CANDIDATES) {
+                hasCandidates_ = false;
+                candidates_.clear();
+            } else if (hasCandidates_ &&
+                       KARUKAN_UPDATE_CANDIDATE_CHANGE(updates) == KARUKAN_CANDIDATES_CURSOR) {
+                cursor_ = karukan_engine_get_candidate_cursor(engine);
+            } else {
+                updateCandidates(engine);
+            }
+        }
+    }
+
+    // Whether the preedit rebuilt from deltas matches the engine's full text
+    bool preeditMatches(::KarukanEngine* engine) const {
+        return preedit_ == std::string_view(karukan_engine_get_preedit(engine),
+                                            karukan_engine_get_preedit_len(engine));
+    }
+
+    void reset() {
+        preedit_.clear();
+        aux_.clear();
+        candidates_.clear();
+        hasCandidates_ = false;
+    }
+
+private:
+    void updateCandidates(::KarukanEngine* engine) {
+        candidates_.clear();
+        KarukanCandidateSnapshot snapshot;
+        if (!karukan_engine_get_candidate_snapshot(engine, &snapshot)) {
+            return;
+        }
+        for (uint32_t i = 0; i < snapshot.count; i++) {
+            candidates_.emplace_back(
+                std::string(snapshot.arena + snapshot.text_offsets[i], snapshot.text_lens[i]),
+                std::string(snapshot.arena + snapshot.annotation_offsets[i],
+                            snapshot.annotation_lens[i]));
+        }
+        cursor_ = snapshot.cursor;
+        hasCandidates_ = true;
+    }
+
+    std::string preedit_;
+    uint32_t caret_ = 0;
+    std::string aux_;
+    std::string committed_;
+    std::vector<std::pair<std::string, std::string>> candidates_;
+    uint32_t cursor_ = 0;
+    bool hasCandidates_ = false;
+};
+
+bool fail(const std::string& message) {
+    std::fprintf(stderr, "karukan-replay-bench: %s\n", message.c_str());
+    return false;
+}
+
+// "shift+ctrl+Left" → keysym + modifier mask
+bool parseKeySpec(const std::string& spec, Step& step) {
+    std::string rest = spec;
+    size_t plus;
+    while ((plus = rest.find('+')) != std::string::npos && plus + 1 < rest.size()) {
+        std::string modifier = rest.substr(0, plus);
+        if (modifier == "shift") {
+            step.state |= kShiftMask;
+        } else if (modifier == "ctrl") {
+            step.state |= kControlMask;
+        } else if (modifier == "alt") {
+            step.state |= kAltMask;
+        } else if (modifier == "super") {
+            step.state |= kSuperMask;
+        } else {
+            return false;
+        }
+        rest = rest.substr(plus + 1);
+    }
+    xkb_keysym_t keysym = xkb_keysym_from_name(rest.c_str(), XKB_KEYSYM_NO_FLAGS);
+    if (keysym == XKB_KEY_NoSymbol) {
+        keysym = xkb_keysym_from_name(rest.c_str(), XKB_KEYSYM_CASE_INSENSITIVE);
+    }
+    if (keysym == XKB_KEY_NoSymbol) {
+        return false;
+    }
+    step.kind = Step::Kind::Key;
+    step.keysym = keysym;
+    return true;
+}
+
+// Trace format (one command per line, '#' starts a comment):
+//   karukan-trace 1          header with the format version (required)
+//   type <ascii>             press each character (uppercase adds Shift)
+//   key <spec> [count]       press a key: [shift+|ctrl+|alt+|super+]<xkb keysym name>
+//   suggest                  wait for and apply a background auto-suggest result
+//   reset                    reset the engine (focus out)
+bool loadTrace(const std::string& path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) {
+        return fail("cannot open " + path);
+    }
+    trace.name = std::filesystem::path(path).stem().string();
+
+    std::string line;
+    int lineNo = 0;
+    bool sawHeader = false;
+    while (std::getline(in, line)) {
+        lineNo++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream words(line);
+        std::string command;
+        words >> command;
+        std::string where = path + ":" + std::to_string(lineNo);
+
+        if (!sawHeader) {
+            int version = 0;
+            if (command != "karukan-trace" || !(words >> version)) {
+                return fail(where + ": missing \"karukan-trace <version>\" header");
+            }
+            if (version != kTraceVersion) {
+                return fail(where + ": unsupported trace version " + std::to_string(version));
+            }
+            sawHeader = true;
+            continue;
+        }
+
+        if (command == "type") {
+            std::string text = line.substr(line.find("type") + 4);
+            text.erase(0, text.find_first_not_of(' '));
+            for (unsigned char c : text) {
+                if (c < 0x20 || c > 0x7e) {
+                    return fail(where + ": type only accepts printable ASCII");
+                }
+                Step step{Step::Kind::Key, c, std::isupper(c) ? kShiftMask : 0};
+                trace.steps.push_back(step);
+            }
+        } else if (command == "key") {
+            std::string spec;
+            int count = 1;
+            words >> spec;
+            if (!(words >> count)) {
+                count = 1;
+            }
+            Step step{Step::Kind::Key};
+            if (spec.empty() || count < 1 || !parseKeySpec(spec, step)) {
+                return fail(where + ": bad key \"" + spec + "\"");
+            }
+            trace.steps.insert(trace.steps.end(), count, step);
+        } else if (command == "suggest") {
+            trace.steps.push_back(Step{Step::Kind::Suggest});
+        } else if (command == "reset") {
+            trace.steps.push_back(Step{Step::Kind::Reset});
+        } else {
+            return fail(where + ": unknown command \"" + command + "\"");
+        }
+    }
+    if (!sawHeader) {
+        return fail(path + ": empty trace");
+    }
+    return true;
+}
+
+struct KeySample {
+    uint64_t us;
+    uint64_t allocations;
+};
+
+// Replay `trace` once; timed key samples are appended to `samples` if non-null
+void replay(::KarukanEngine* engine, const Trace& trace, std::vector<KeySample>* samples) {
+    MockPanel panel;
+    for (const Step& step : trace.steps) {
+        switch (step.kind) {
+        case Step::Kind::Key: {
+            uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            uint32_t updates =
+                karukan_engine_process_key_flags(engine, step.keysym, step.state, 0);
+            panel.apply(engine, updates);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if ((updates & KARUKAN_UPDATE_PREEDIT) && !panel.preeditMatches(engine)) {
+                deltaMismatches++;
+            }
+            if (samples) {
+                samples->push_back(KeySample{
+                    static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()),
+                    allocationCount.load(std::memory_order_relaxed) - allocationsBefore});
+            }
+            break;
+        }
+        case Step::Kind::Suggest: {
+            int fd = karukan_engine_suggest_fd(engine);
+            if (fd < 0) {
+                break;
+            }
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, kSuggestTimeoutMs) > 0 && karukan_engine_apply_suggestion(engine)) {
+                panel.apply(engine, karukan_engine_get_update_flags(engine));
+            }
+            break;
+        }
+        case Step::Kind::Reset:
+            karukan_engine_reset(engine);
+            panel.reset();
+            break;
+        }
+    }
+    // Leave the engine empty for the next replay
+    karukan_engine_reset(engine);
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+// Scratch directory removed with everything in it when the bench exits
+struct ScratchDir {
+    std::filesystem::path path;
+
+    ScratchDir() = default;
+    ScratchDir(const ScratchDir&) = delete;
+    ScratchDir& operator=(const ScratchDir&) = delete;
+    ~ScratchDir() {
+        if (!path.empty()) {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+    }
+};
+
+// Run the engine against copies of the user's learning cache and tuning
+// results: point XDG_DATA_HOME and XDG_CACHE_HOME at a scratch directory
+// holding links to the real dictionaries. The user dictionary cache is rebuilt
+// there, so the addon's own cache, its key and latency report stay untouched.
+// Leaves `scratch` empty (and the real directories in use) if it cannot isolate
+void isolateUserDirs(ScratchDir& scratch) {
+    namespace fs = std::filesystem;
+    const char* xdgData = std::getenv("XDG_DATA_HOME");
+    const char* xdgCache = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+    if (!home && (!xdgData || !xdgCache)) {
+        return;
+    }
+    fs::path realData =
+        xdgData ? fs::path(xdgData) / "karukan-im" : fs::path(home) / ".local/share/karukan-im";
+    fs::path realCache =
+        xdgCache ? fs::path(xdgCache) / "karukan-im" : fs::path(home) / ".cache/karukan-im";
+
+    std::string scratchTemplate = (fs::temp_directory_path() / "karukan-bench-XXXXXX").string();
+    if (!mkdtemp(scratchTemplate.data())) {
+        std::fprintf(stderr, "karukan-replay-bench: mkdtemp failed; using the real data dir\n");
+        return;
+    }
+    scratch.path = scratchTemplate;
+    fs::path data = scratch.path / "data" / "karukan-im";
+    fs::path cache = scratch.path / "cache" / "karukan-im";
+    std::error_code ec;
+    fs::create_directories(data, ec);
+    fs::create_directories(cache, ec);
+    for (const char* name : {"dict.bin", "user_dicts"}) {
+        if (fs::exists(realData / name)) {
+            fs::create_symlink(realData / name, data / name, ec);
+        }
+    }
+    if (fs::exists(realData / "learning.tsv")) {
+        fs::copy_file(realData / "learning.tsv", data / "learning.tsv", ec);
+    }
+    if (fs::exists(realCache / "tuning.toml")) {
+        fs::copy_file(realCache / "tuning.toml", cache / "tuning.toml", ec);
+    }
+    setenv("XDG_DATA_HOME", (scratch.path / "data").c_str(), 1);
+    setenv("XDG_CACHE_HOME", (scratch.path / "cache").c_str(), 1);
+    std::printf("data dir: %s (learning cache copied from %s)\n", data.c_str(), realData.c_str());
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: karukan-replay-bench [--iterations N] [--warmup N] [--max-p99-us N] "
+                 "[--report FILE] TRACE...\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 5;
+    int warmup = 1;
+    uint64_t maxP99Us = 0;
+    const char* reportPath = nullptr;
+    std::vector<std::string> tracePaths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--iterations" && hasValue) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && hasValue) {
+            warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--max-p99-us" && hasValue) {
+            maxP99Us = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--report" && hasValue) {
+            reportPath = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            tracePaths.push_back(arg);
+        }
+    }
+    if (tracePaths.empty()) {
+        usage();
+        return 2;
+    }
+
+    std::vector<Trace> traces(tracePaths.size());
+    for (size_t i = 0; i < tracePaths.size(); i++) {
+        if (!loadTrace(tracePaths[i], traces[i])) {
+            return 2;
+        }
+    }
+
+    ScratchDir scratch;
+    isolateUserDirs(scratch);
+
+    // Same loading path as the addon: one shared handle, warmed up before typing
+    auto loadStart = std::chrono::steady_clock::now();
+    ::KarukanShared* shared = karukan_shared_new();
+    if (karukan_shared_init(shared) != 0) {
+        std::fprintf(stderr, "karukan-replay-bench: model load failed; timing kana-only input\n");
+    }
+    while (!karukan_shared_is_warm(shared)) {
+        poll(nullptr, 0, 10);
+    }
+    auto loadMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - loadStart)
+                      .count();
+    ::KarukanEngine* engine = karukan_engine_new_with_shared(shared);
+    std::printf("load + warm-up: %lld ms\n\n", static_cast<long long>(loadMs));
+    karukan_latency_reset();
+
+    std::printf("%-20s %6s %8s %8s %8s %8s %10s %10s\n", "trace", "keys", "p50_us", "p90_us",
+                "p99_us", "max_us", "allocs/key", "max_allocs");
+    bool regressed = false;
+    for (const Trace& trace : traces) {
+        for (int i = 0; i < warmup; i++) {
+            replay(engine, trace, nullptr);
+        }
+        std::vector<KeySample> samples;
+        for (int i = 0; i < iterations; i++) {
+            replay(engine, trace, &samples);
+        }
+
+        std::vector<uint64_t> latencies;
+        uint64_t totalAllocations = 0;
+        uint64_t maxAllocations = 0;
+        for (const KeySample& sample : samples) {
+            latencies.push_back(sample.us);
+            totalAllocations += sample.allocations;
+            maxAllocations = std::max(maxAllocations, sample.allocations);
+        }
+        std::sort(latencies.begin(), latencies.end());
+        uint64_t p99 = percentile(latencies, 0.99);
+        double allocationsPerKey =
+            samples.empty() ? 0.0
+                            : static_cast<double>(totalAllocations) /
+                                  static_cast<double>(samples.size());
+        std::printf("%-20s %6zu %8llu %8llu %8llu %8llu %10.1f %10llu\n", trace.name.c_str(),
+                    samples.size() / static_cast<size_t>(iterations),
+                    static_cast<unsigned long long>(percentile(latencies, 0.50)),
+                    static_cast<unsigned long long>(percentile(latencies, 0.90)),
+                    static_cast<unsigned long long>(p99),
+                    static_cast<unsigned long long>(latencies.empty() ? 0 : latencies.back()),
+                    allocationsPerKey, static_cast<unsigned long long>(maxAllocations));
+        if (maxP99Us > 0 && p99 > maxP99Us) {
+            regressed = true;
+        }
+    }
+
+    if (deltaMismatches > 0) {
+        std::fprintf(stderr, "karukan-replay-bench: preedit delta mismatch on %llu keys\n",
+                     static_cast<unsigned long long>(deltaMismatches));
+    }
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("\npeak RSS: %ld KiB\n", usage.ru_maxrss);
+#ifndef __GLIBC__
+    std::printf("(allocation counts need glibc and are 0 here)\n");
+#endif
+
+    if (reportPath && karukan_latency_write_report(reportPath) != 0) {
+        std::fprintf(stderr, "karukan-replay-bench: failed to write %s\n", reportPath);
+    }
+
+    karukan_engine_free(engine);
+    karukan_shared_free(shared);
+
+    if (regressed) {
+        std::fprintf(stderr, "karukan-replay-bench: p99 above %llu us\n",
+                     static_cast<unsigned long long>(maxP99Us));
+    }
+    return regressed || deltaMismatches > 0 ? 1 : 0;
+}
@@ -4,6 +4,11 @@
 
 #include "karukan.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <string_view>
+
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/utf8.h>
@@ -18,6 +23,116 @@ constexpr uint32_t kControlMask = 4;  // ControlMask
 constexpr uint32_t kAltMask = 8;      // Mod1Mask
 constexpr uint32_t kSuperMask = 64;   // Mod4Mask
 
+// How often the latency report is rewritten while keys are being typed
+constexpr uint64_t kLatencyReportIntervalUs = 60 * 1000 * 1000;
+
+namespace {
+
+// How keyEvent treats a keysym in the modifier range (XKB_KEY_Shift_L..XKB_KEY_Hyper_R).
+// Mirrors keycode.rs: Keysym::is_modifier keys pass through untouched, except
+// the Keysym::is_mode_toggle_key ones (right Meta/Alt/Super/Hyper), which the
+// engine handles on press. Caps_Lock/Shift_Lock are ordinary keys there.
+enum class ModifierClass : uint8_t { PassThrough, Engine };
+
+constexpr std::array<ModifierClass, XKB_KEY_Hyper_R - XKB_KEY_Shift_L + 1> kModifierClasses = {
+    ModifierClass::PassThrough,  // Shift_L
+    ModifierClass::PassThrough,  // Shift_R
+    ModifierClass::PassThrough,  // Control_L
+    ModifierClass::PassThrough,  // Control_R
+    ModifierClass::Engine,       // Caps_Lock
+    ModifierClass::Engine,       // Shift_Lock
+    ModifierClass::PassThrough,  // Meta_L
+    ModifierClass::Engine,       // Meta_R (mode toggle)
+    ModifierClass::PassThrough,  // Alt_L
+    ModifierClass::Engine,       // Alt_R (mode toggle)
+    ModifierClass::PassThrough,  // Super_L
+    ModifierClass::Engine,       // Super_R (mode toggle)
+    ModifierClass::PassThrough,  // Hyper_L
+    ModifierClass::Engine,       // Hyper_R (mode toggle)
+};
+
+// Whether the engine can do anything with this key event. process_key never
+// consumes or updates anything for releases and pass-through modifiers, so
+// those skip the FFI round trip (and the UI update) entirely.
+constexpr bool engineHandlesKey(uint32_t keysym, bool isRelease) {
+    if (isRelease) {
+        return false;
+    }
+    if (keysym < XKB_KEY_Shift_L || keysym > XKB_KEY_Hyper_R) {
+        return true;
+    }
+    return kModifierClasses[keysym - XKB_KEY_Shift_L] == ModifierClass::Engine;
+}
+
+static_assert(!engineHandlesKey(XKB_KEY_a, true));
+static_assert(engineHandlesKey(XKB_KEY_a, false));
+static_assert(!engineHandlesKey(XKB_KEY_Shift_L, false));
+static_assert(!engineHandlesKey(XKB_KEY_Control_R, false));
+static_assert(engineHandlesKey(XKB_KEY_Alt_R, false));
+static_assert(engineHandlesKey(XKB_KEY_Super_R, false));
+static_assert(!engineHandlesKey(XKB_KEY_Super_L, false));
+
+// Records the lifetime of a scope into one of the Rust-side latency histograms
+class StageTimer {
+public:
+    explicit StageTimer(uint32_t stage)
+        : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        karukan_latency_record(
+            stage_, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    uint32_t stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+bool isUtf8Continuation(char c) { return (static_cast<unsigned char>(c) & 0xC0) == 0x80; }
+
+// The last `maxChars` characters of `text`, stopping after a newline
+std::string_view windowBefore(std::string_view text, size_t maxChars) {
+    size_t start = text.size();
+    for (size_t count = 0; start > 0 && count < maxChars; ++count) {
+        size_t prev = start - 1;
+        while (prev > 0 && isUtf8Continuation(text[prev])) {
+            --prev;
+        }
+        if (text[prev] == '\n') {
+            break;
+        }
+        start = prev;
+    }
+    return text.substr(start);
+}
+
+// The first `maxChars` characters of `text`, stopping before a newline
+std::string_view windowAfter(std::string_view text, size_t maxChars) {
+    size_t end = 0;
+    for (size_t count = 0; end < text.size() && count < maxChars; ++count) {
+        if (text[end] == '\n') {
+            break;
+        }
+        ++end;
+        while (end < text.size() && isUtf8Continuation(text[end])) {
+            ++end;
+        }
+    }
+    return text.substr(0, end);
+}
+
+uint64_t processedKeyCount() {
+    KarukanLatencySummary summary;
+    if (karukan_latency_get(KARUKAN_STAGE_PROCESS_KEY, &summary) != 0) {
+        return 0;
+    }
+    return summary.count;
+}
+
+}  // namespace
+
 // --- KarukanCandidateWord ---
 
 KarukanCandidateWord::KarukanCandidateWord(KarukanEngine* engine, Text text, int index,
@@ -41,26 +156,31 @@ KarukanCandidateList::KarukanCandidateList(KarukanEngine* engine, InputContext*
 }
 
 void KarukanCandidateList::updateCandidates(::KarukanEngine* rustEngine) {
-    // Clear existing candidates
-    while (totalSize() > 0) {
-        remove(0);
+    clear();
+
+    KarukanCandidateSnapshot snapshot;
+    if (!karukan_engine_get_candidate_snapshot(rustEngine, &snapshot)) {
+        return;
     }
 
-    uint32_t count = karukan_engine_get_candidate_count(rustEngine);
-    uint32_t cursor = karukan_engine_get_candidate_cursor(rustEngine);
+    // Build the whole page from the snapshot arena without per-index FFI calls
+    for (uint32_t i = 0; i < snapshot.count; i++) {
+        Text candidateText;
+        candidateText.append(
+            std::string(snapshot.arena + snapshot.text_offsets[i], snapshot.text_lens[i]));
+        std::string comment(snapshot.arena + snapshot.annotation_offsets[i],
+                            snapshot.annotation_lens[i]);
+        append<KarukanCandidateWord>(engine_, std::move(candidateText), i, comment);
+    }
 
-    for (uint32_t i = 0; i < count; i++) {
-        const char* text = karukan_engine_get_candidate(rustEngine, i);
-        if (text) {
-            Text candidateText;
-            candidateText.append(std::string(text));
-            const char* ann = karukan_engine_get_candidate_annotation(rustEngine, i);
-            std::string comment = (ann && ann[0] != '\0') ? std::string(ann) : "";
-            append<KarukanCandidateWord>(engine_, std::move(candidateText), i, comment);
-        }
+    if (snapshot.count > 0 && snapshot.cursor < snapshot.count) {
+        setGlobalCursorIndex(static_cast<int>(snapshot.cursor));
     }
+}
 
-    if (count > 0 && cursor < count) {
+void KarukanCandidateList::updateCursor(::KarukanEngine* rustEngine) {
+    uint32_t cursor = karukan_engine_get_candidate_cursor(rustEngine);
+    if (cursor < static_cast<uint32_t>(totalSize())) {
         setGlobalCursorIndex(static_cast<int>(cursor));
     }
 }
@@ -68,11 +188,24 @@ void KarukanCandidateList::updateCandidates(::KarukanEngine* rustEngine) {
 // --- KarukanState ---
 
 KarukanState::KarukanState(KarukanEngine* engine, InputContext* ic) : engine_(engine), ic_(ic) {
-    // Create Rust engine instance
-    rustEngine_ = karukan_engine_new();
+    // Create a lightweight Rust engine that uses the addon-wide shared resources
+    rustEngine_ = karukan_engine_new_with_shared(engine_->shared());
+
+    // Async suggest: apply finished live conversion results from the event loop
+    int fd = karukan_engine_suggest_fd(rustEngine_);
+    if (fd >= 0) {
+        suggestEvent_ = engine_->instance()->eventLoop().addIOEvent(
+            fd, IOEventFlag::In, [this](EventSourceIO*, int, IOEventFlags) {
+                if (karukan_engine_apply_suggestion(rustEngine_)) {
+                    updateUI(karukan_engine_get_update_flags(rustEngine_));
+                }
+                return true;
+            });
+    }
 }
 
 KarukanState::~KarukanState() {
+    suggestEvent_.reset();
     if (rustEngine_) {
         karukan_engine_free(rustEngine_);
     }
@@ -83,38 +216,15 @@ void KarukanState::keyEvent(KeyEvent& keyEvent) {
         return;
     }
 
-    // Initialize kanji converter on first use (model download + load may take time)
-    if (!engineInitialized_) {
-        // Show loading message before blocking init
-        {
-            auto& inputPanel = ic_->inputPanel();
-            Text aux;
-            aux.append("Karukan: Loading model...");
-            inputPanel.setAuxUp(aux);
-            ic_->updatePreedit();
-            ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
-        }
-
-        int initResult = karukan_engine_init(rustEngine_);
-        engineInitialized_ = true;
+    // Convert key event
+    uint32_t keysym = keyEvent.key().sym();
+    int isRelease = keyEvent.isRelease() ? 1 : 0;
 
-        // Clear loading message
-        {
-            auto& inputPanel = ic_->inputPanel();
-            if (initResult == 0) {
-                inputPanel.setAuxUp(Text());
-            } else {
-                Text aux;
-                aux.append("Karukan: Model load failed");
-                inputPanel.setAuxUp(aux);
-            }
-            ic_->updatePreedit();
-            ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
-        }
+    // Releases and bare modifiers: nothing for the engine to do
+    if (!engineHandlesKey(keysym, isRelease)) {
+        return;
     }
 
-    // Convert key event
-    uint32_t keysym = keyEvent.key().sym();
     uint32_t state = 0;
 
     if (keyEvent.key().states().test(KeyState::Shift)) {
@@ -130,85 +240,142 @@ void KarukanState::keyEvent(KeyEvent& keyEvent) {
         state |= kSuperMask;
     }
 
-    int isRelease = keyEvent.isRelease() ? 1 : 0;
-
     // Capture surrounding text at input start (Empty state) for accurate context.
     // For apps without SurroundingText capability (terminals), this clears
     // the context so stale data doesn't persist.
-    if (karukan_engine_is_empty(rustEngine_) && !isRelease) {
-        if (ic_->capabilityFlags().test(CapabilityFlag::SurroundingText) &&
-            ic_->surroundingText().isValid()) {
-            const auto& surrounding = ic_->surroundingText();
-            const std::string& text = surrounding.text();
-            uint32_t cursor = surrounding.cursor();
-            karukan_engine_set_surrounding_text(rustEngine_, text.c_str(), cursor);
-        } else {
-            karukan_engine_set_surrounding_text(rustEngine_, "", 0);
-        }
+    if (karukan_engine_is_empty(rustEngine_)) {
+        updateSurroundingText();
     }
 
-    // Process key through Rust engine
-    int consumed = karukan_engine_process_key(rustEngine_, keysym, state, isRelease);
+    // Process key through Rust engine; one call returns consumed + every pending update
+    uint32_t updates = karukan_engine_process_key_flags(rustEngine_, keysym, state, isRelease);
 
-    if (consumed) {
+    if (updates & KARUKAN_UPDATE_CONSUMED) {
         keyEvent.filterAndAccept();
     }
 
-    // Always update UI: some not-consumed keys (e.g., Shift toggle) still
-    // change engine state and produce UI actions. The has_* flags in the
-    // Rust engine guard against unnecessary updates.
-    updateUI();
+    // Always update UI: some not-consumed keys (e.g., the mode toggle keys)
+    // still change engine state and produce UI actions.
+    updateUI(updates);
+}
+
+void KarukanState::updateSurroundingText() {
+    if (!rustEngine_) {
+        return;
+    }
+    std::string_view before;
+    std::string_view after;
+    if (ic_->capabilityFlags().test(CapabilityFlag::SurroundingText) &&
+        ic_->surroundingText().isValid()) {
+        const auto& surrounding = ic_->surroundingText();
+        std::string_view text = surrounding.text();
+        // cursor() is a character offset; locating it is a byte scan with no copy.
+        // Only a window the engine actually uses is extracted and passed on.
+        size_t cursor = std::min<size_t>(
+            utf8::ncharByteLength(text.begin(), surrounding.cursor()), text.size());
+        size_t window = karukan_engine_surrounding_window(rustEngine_);
+        before = windowBefore(text.substr(0, cursor), window);
+        after = windowAfter(text.substr(cursor), window);
+    }
+
+    // Same window as last time: the engine already has this context
+    if (surroundingSent_ && before == surroundingBefore_ && after == surroundingAfter_) {
+        return;
+    }
+    karukan_engine_set_surrounding_window(rustEngine_, before.data(),
+                                          static_cast<uint32_t>(before.size()), after.data(),
+                                          static_cast<uint32_t>(after.size()));
+    surroundingBefore_.assign(before);
+    surroundingAfter_.assign(after);
+    surroundingSent_ = true;
+}
+
+void KarukanState::clearSurroundingText() {
+    if (!rustEngine_) {
+        return;
+    }
+    karukan_engine_set_surrounding_window(rustEngine_, nullptr, 0, nullptr, 0);
+    surroundingBefore_.clear();
+    surroundingAfter_.clear();
+    surroundingSent_ = true;
 }
 
 void KarukanState::reset() {
     if (rustEngine_) {
         karukan_engine_reset(rustEngine_);
     }
+    preeditCaret_ = 0;
 
-    ic_->inputPanel().reset();
+    // Skip the client round trip when there is nothing on screen to clear
+    auto& inputPanel = ic_->inputPanel();
+    if (inputPanel.empty()) {
+        return;
+    }
+    inputPanel.reset();
     ic_->updatePreedit();
     ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
-void KarukanState::updateUI() {
-    if (!rustEngine_) {
+void KarukanState::updateUI(uint32_t updates) {
+    // Nothing changed (e.g. a key the engine ignored): no client round trip
+    if (!rustEngine_ || (updates & ~KARUKAN_UPDATE_CONSUMED) == 0) {
         return;
     }
+    StageTimer timer(KARUKAN_STAGE_UPDATE_UI);
 
     auto& inputPanel = ic_->inputPanel();
+    // What changed during this update; each is flushed to the client at most once
+    bool clientPreeditChanged = false;
+    bool panelChanged = false;
 
     // On commit: send committed text, then reset the input panel to clear
     // preedit/candidates/aux in one shot.
     // New preedit/candidates/aux are re-set below if the engine produced them.
-    if (karukan_engine_has_commit(rustEngine_)) {
+    if (updates & KARUKAN_UPDATE_COMMIT) {
         const char* commitText = karukan_engine_get_commit(rustEngine_);
         if (commitText && karukan_engine_get_commit_len(rustEngine_) > 0) {
             ic_->commitString(commitText);
         }
-        inputPanel.reset();
+        // Committing drops the engine's surrounding context and preedit
+        surroundingSent_ = false;
+        preeditCaret_ = 0;
+        if (!inputPanel.empty()) {
+            inputPanel.reset();
+            clientPreeditChanged = true;
+            panelChanged = true;
+        }
     }
 
-    // Set preedit (new input after commit, or a regular update)
-    if (karukan_engine_has_preedit(rustEngine_)) {
+    // Set preedit (new input after commit, or a regular update). The delta is
+    // relative to what the panel shows, so an empty one with the same caret
+    // needs no round trip.
+    KarukanPreeditDelta delta;
+    bool preeditChanged = (updates & KARUKAN_UPDATE_PREEDIT) &&
+                          karukan_engine_get_preedit_delta(rustEngine_, &delta) &&
+                          (delta.removed_len > 0 || delta.inserted_len > 0 ||
+                           delta.caret != preeditCaret_);
+    if (preeditChanged) {
+        preeditCaret_ = delta.caret;
         const char* preeditText = karukan_engine_get_preedit(rustEngine_);
         uint32_t preeditLen = karukan_engine_get_preedit_len(rustEngine_);
-        uint32_t preeditCaret = karukan_engine_get_preedit_caret(rustEngine_);
 
         Text preedit;
         if (preeditText && preeditLen > 0) {
             preedit.append(std::string(preeditText, preeditLen), TextFormatFlag::Underline);
-            preedit.setCursor(static_cast<int>(preeditCaret));
+            preedit.setCursor(static_cast<int>(delta.caret));
         }
 
         if (ic_->capabilityFlags().test(CapabilityFlag::Preedit)) {
             inputPanel.setClientPreedit(preedit);
+            clientPreeditChanged = true;
         } else {
             inputPanel.setPreedit(preedit);
         }
+        panelChanged = true;
     }
 
     // Aux text (reading hint shown above candidates)
-    if (karukan_engine_has_aux(rustEngine_)) {
+    if (updates & KARUKAN_UPDATE_AUX) {
         const char* auxText = karukan_engine_get_aux(rustEngine_);
         uint32_t auxLen = karukan_engine_get_aux_len(rustEngine_);
 
@@ -219,32 +386,120 @@ void KarukanState::updateUI() {
         } else {
             inputPanel.setAuxUp(Text());
         }
+        panelChanged = true;
     }
 
     // Candidates
-    if (karukan_engine_has_candidates(rustEngine_)) {
-        if (karukan_engine_should_hide_candidates(rustEngine_)) {
+    if (updates & KARUKAN_UPDATE_CANDIDATES) {
+        if (updates & KARUKAN_UPDATE_HIDE_CANDIDATES) {
             inputPanel.setCandidateList(nullptr);
         } else {
-            auto candidateList = std::make_unique<KarukanCandidateList>(engine_, ic_);
-            candidateList->updateCandidates(rustEngine_);
-            inputPanel.setCandidateList(std::move(candidateList));
+            // Reuse the list already on the panel when the engine reports that only
+            // the cursor or page moved (inputPanel.reset() on commit drops it)
+            auto* current = dynamic_cast<KarukanCandidateList*>(inputPanel.candidateList().get());
+            uint32_t change = KARUKAN_UPDATE_CANDIDATE_CHANGE(updates);
+            if (current && change == KARUKAN_CANDIDATES_CURSOR) {
+                current->updateCursor(rustEngine_);
+            } else if (current && change == KARUKAN_CANDIDATES_PAGE) {
+                current->updateCandidates(rustEngine_);
+            } else {
+                auto candidateList = std::make_unique<KarukanCandidateList>(engine_, ic_);
+                candidateList->updateCandidates(rustEngine_);
+                inputPanel.setCandidateList(std::move(candidateList));
+            }
         }
+        panelChanged = true;
     }
 
-    ic_->updatePreedit();
-    ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
+    // Flush each changed part once
+    if (clientPreeditChanged) {
+        ic_->updatePreedit();
+    }
+    if (panelChanged) {
+        ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
+    }
 }
 
 // --- KarukanEngine ---
 
 KarukanEngine::KarukanEngine(Instance* instance)
     : instance_(instance),
+      shared_(karukan_shared_new()),
       factory_([this](InputContext& ic) { return new KarukanState(this, &ic); }) {
     instance_->inputContextManager().registerProperty("karukanState", &factory_);
+    startLatencyReports();
+
+    if (!shared_) {
+        return;
+    }
+    // Load the model/dictionaries in the background (download + load may take time).
+    // Keys typed meanwhile get romaji-to-kana conversion only.
+    if (karukan_shared_init_async(shared_) != 0) {
+        // Could not start a loader thread: fall back to loading synchronously
+        karukan_shared_init(shared_);
+        return;
+    }
+    int fd = karukan_shared_notify_fd(shared_);
+    if (fd >= 0) {
+        sharedReadyEvent_ = instance_->eventLoop().addIOEvent(
+            fd, IOEventFlag::In, [this](EventSourceIO* source, int, IOEventFlags) {
+                // One-shot: the fd stays readable after completion
+                source->setEnabled(false);
+                onSharedReady();
+                return true;
+            });
+    }
 }
 
-KarukanEngine::~KarukanEngine() = default;
+void KarukanEngine::startLatencyReports() {
+    // Keep ~/.cache/karukan-im/latency.txt current for profiling; skipped while idle
+    latencyReportEvent_ = instance_->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + kLatencyReportIntervalUs, 0,
+        [this](EventSourceTime* source, uint64_t) {
+            writeLatencyReport();
+            source->setNextInterval(kLatencyReportIntervalUs);
+            source->setOneShot();
+            return true;
+        });
+}
+
+void KarukanEngine::writeLatencyReport() {
+    uint64_t keys = processedKeyCount();
+    if (keys == reportedKeyCount_) {
+        return;
+    }
+    reportedKeyCount_ = keys;
+    // Written on a Rust thread: the event loop never waits on the disk
+    karukan_latency_queue_report(nullptr);
+}
+
+KarukanEngine::~KarukanEngine() {
+    sharedReadyEvent_.reset();
+    latencyReportEvent_.reset();
+    writeLatencyReport();
+    // Engines still alive keep their own reference, so the order relative to
+    // factory_ teardown does not matter.
+    if (shared_) {
+        karukan_shared_free(shared_);
+    }
+}
+
+void KarukanEngine::onSharedReady() {
+    // Loading already finished, so this returns the stored result immediately
+    if (karukan_shared_init(shared_) == 0) {
+        return;
+    }
+
+    // Tell the user why conversion stays kana-only
+    auto* ic = instance_->inputContextManager().lastFocusedInputContext();
+    if (!ic || instance_->inputMethodEngine(ic) != this) {
+        return;
+    }
+    Text aux;
+    aux.append("Karukan: Model load failed");
+    ic->inputPanel().setAuxUp(aux);
+    ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+}
 
 void KarukanEngine::keyEvent(const InputMethodEntry& entry, KeyEvent& keyEvent) {
     FCITX_UNUSED(entry);
@@ -270,19 +525,14 @@ void KarukanEngine::activate(const InputMethodEntry& entry, InputContextEvent& e
     auto* ic = event.inputContext();
     auto* state = ic->propertyFor(&factory_);
 
-    // Capture surrounding text on activation for accurate context.
-    // For apps without SurroundingText capability, this clears the context.
+    // Reload models released while idle; returns immediately
     if (state->rustEngine()) {
-        if (ic->capabilityFlags().test(CapabilityFlag::SurroundingText) &&
-            ic->surroundingText().isValid()) {
-            const auto& surrounding = ic->surroundingText();
-            const std::string& text = surrounding.text();
-            uint32_t cursor = surrounding.cursor();
-            karukan_engine_set_surrounding_text(state->rustEngine(), text.c_str(), cursor);
-        } else {
-            karukan_engine_set_surrounding_text(state->rustEngine(), "", 0);
-        }
+        karukan_engine_activate(state->rustEngine());
     }
+
+    // Capture surrounding text on activation for accurate context.
+    // For apps without SurroundingText capability, this clears the context.
+    state->updateSurroundingText();
 }
 
 void KarukanEngine::deactivate(const InputMethodEntry& entry, InputContextEvent& event) {
@@ -300,18 +550,17 @@ void KarukanEngine::deactivate(const InputMethodEntry& entry, InputContextEvent&
                 ic->commitString(commitText);
             }
         }
-        // Persist learning cache on deactivation (azooKey-style)
+        // Persist learning cache on deactivation (azooKey-style); queued, never blocks on disk I/O
         karukan_engine_save_learning(state->rustEngine());
     }
 
     // Invalidate fcitx5's surrounding text and clear Rust-side context
     // so stale data doesn't persist across sessions.
     ic->surroundingText().invalidate();
-    if (state->rustEngine()) {
-        karukan_engine_set_surrounding_text(state->rustEngine(), "", 0);
-    }
+    state->clearSurroundingText();
 
-    // reset() clears inputPanel (preedit/candidates/aux) and flushes UI
+    // reset() clears inputPanel (preedit/candidates/aux) and flushes UI once,
+    // only if something was shown
     state->reset();
 }
 
@@ -325,9 +574,7 @@ void KarukanEngine::selectCandidate(InputContext* ic, int index) {
 
     // Process the selection key (1-9)
     uint32_t keysym = XKB_KEY_1 + index;
-    karukan_engine_process_key(rustEngine, keysym, 0, 0);
-
-    state->updateUI();
+    state->updateUI(karukan_engine_process_key_flags(rustEngine, keysym, 0, 0));
 }
 
 }  // namespace fcitx
@@ -5,6 +5,10 @@
 #ifndef FCITX5_KARUKAN_KARUKAN_H
 #define FCITX5_KARUKAN_KARUKAN_H
 
+#include <memory>
+#include <string>
+
+#include <fcitx-utils/event.h>
 #include <fcitx/addonfactory.h>
 #include <fcitx/addonmanager.h>
 #include <fcitx/candidatelist.h>
@@ -37,6 +41,8 @@ class KarukanCandidateList : public CommonCandidateList {
 public:
     KarukanCandidateList(KarukanEngine* engine, InputContext* ic);
     void updateCandidates(::KarukanEngine* rustEngine);
+    // Move the cursor only; the page contents are unchanged
+    void updateCursor(::KarukanEngine* rustEngine);
 
 private:
     KarukanEngine* engine_;
@@ -51,7 +57,12 @@ public:
 
     void keyEvent(KeyEvent& keyEvent);
     void reset();
-    void updateUI();
+    // Apply the engine's pending updates (a KARUKAN_UPDATE_* mask) to the input panel
+    void updateUI(uint32_t updates);
+    // Pass the text around the cursor to the engine; skipped when unchanged
+    void updateSurroundingText();
+    // Clear the engine's surrounding context
+    void clearSurroundingText();
 
     ::KarukanEngine* rustEngine() { return rustEngine_; }
 
@@ -59,7 +70,15 @@ private:
     KarukanEngine* engine_;
     InputContext* ic_;
     ::KarukanEngine* rustEngine_{nullptr};
-    bool engineInitialized_{false};
+    // Window around the cursor the engine currently holds as context
+    // (valid only while surroundingSent_; a commit makes the engine drop it)
+    std::string surroundingBefore_;
+    std::string surroundingAfter_;
+    bool surroundingSent_{false};
+    // Caret of the preedit on the panel, to skip updates that change nothing
+    uint32_t preeditCaret_{0};
+    // Wakes up when a background auto-suggest result is ready (async_suggest only)
+    std::unique_ptr<EventSourceIO> suggestEvent_;
 };
 
 // Main engine class
@@ -77,10 +96,26 @@ public:
 
     void selectCandidate(InputContext* ic, int index);
 
+    ::KarukanShared* shared() { return shared_; }
+
     auto& factory() { return factory_; }
 
 private:
+    // Called from the event loop when background model loading finishes
+    void onSharedReady();
+    // Periodically dump the per-stage latency histograms (karukan_latency_queue_report)
+    void startLatencyReports();
+    void writeLatencyReport();
+
     Instance* instance_;
+    // Shared by every KarukanState; declared before factory_ so it exists
+    // before any per-IC state is created.
+    ::KarukanShared* shared_{nullptr};
+    // Watches the shared handle's notify fd until loading completes
+    std::unique_ptr<EventSourceIO> sharedReadyEvent_;
+    std::unique_ptr<EventSourceTime> latencyReportEvent_;
+    // ProcessKey sample count at the last report, to skip rewriting an unchanged report
+    uint64_t reportedKeyCount_{0};
     FactoryFor<KarukanState> factory_;
 };
 
@@ -17,6 +17,12 @@ extern "C" {
 /* Opaque handle to a Karukan engine instance */
 typedef struct KarukanEngine KarukanEngine;
 
+/*
+ * Opaque handle to process-wide resources (models, dictionaries, learning cache)
+ * shared by all engines created with karukan_engine_new_with_shared().
+ */
+typedef struct KarukanShared KarukanShared;
+
 /*
  * Create a new Karukan engine instance.
  * Returns a pointer to the engine, or NULL on failure.
@@ -27,6 +33,8 @@ KarukanEngine* karukan_engine_new(void);
 /*
  * Initialize the kanji converter (loads the neural network model).
  * This may take a few seconds on first call.
+ * For engines created with karukan_engine_new_with_shared(), this initializes
+ * the shared handle instead (see karukan_shared_init()).
  * Returns 0 on success, -1 on failure.
  */
 int karukan_engine_init(KarukanEngine* engine);
@@ -36,6 +44,98 @@ int karukan_engine_init(KarukanEngine* engine);
  */
 void karukan_engine_free(KarukanEngine* engine);
 
+/*
+ * Notify the engine that its input context was activated (focused).
+ * If the models were released while idle (conversion.idle_unload_secs,
+ * conversion.memory_pressure_threshold), this starts reloading them in the
+ * background and returns immediately; until the reload finishes, auto-suggest
+ * and live conversion show hiragana. Typing also counts as activity.
+ */
+void karukan_engine_activate(KarukanEngine* engine);
+
+/*
+ * Create a shared resource handle. Nothing is loaded until karukan_shared_init().
+ * The caller is responsible for releasing it with karukan_shared_free().
+ */
+KarukanShared* karukan_shared_new(void);
+
+/*
+ * Load the models, dictionaries and learning cache into the shared handle.
+ * Only the first call does any work; later calls return the first result.
+ * Blocks until loading finishes, including a load started by karukan_shared_init_async().
+ * Engines attached to the handle pick up the resources on their next key event.
+ * Returns 0 on success, -1 on failure.
+ */
+int karukan_shared_init(KarukanShared* shared);
+
+/*
+ * Start loading the shared resources on a background thread and return immediately.
+ * Until loading completes, attached engines only do romaji-to-kana conversion;
+ * they switch to kanji conversion on their next key event afterwards.
+ * Completion is signalled through karukan_shared_notify_fd(); call
+ * karukan_shared_init() afterwards to get the result without blocking.
+ * Returns 0 if loading started (or already happened), -1 on failure.
+ */
+int karukan_shared_init_async(KarukanShared* shared);
+
+/*
+ * Get a file descriptor that becomes readable once initialization completes,
+ * for polling from an event loop. It stays readable afterwards, so stop watching
+ * it once notified. The descriptor is owned by the handle: do not read from or close it.
+ * Returns -1 if unavailable.
+ */
+int karukan_shared_notify_fd(const KarukanShared* shared);
+
+/*
+ * Check whether karukan_shared_init() has completed.
+ * Returns 1 if initialized (successfully or not), 0 otherwise.
+ */
+int karukan_shared_is_initialized(const KarukanShared* shared);
+
+/*
+ * Check whether the models are ready for live conversion.
+ * With conversion.warm_up enabled, initialization is followed by a background
+ * warm-up (model file prefetch, optional mlock, one dummy conversion per
+ * model); auto-suggest and live conversion show hiragana until it finishes.
+ * Returns 1 once initialized and warmed up (or warm-up is disabled), 0 otherwise.
+ */
+int karukan_shared_is_warm(const KarukanShared* shared);
+
+/* Residency of the shared in-process models (karukan_shared_residency) */
+#define KARUKAN_RESIDENCY_RESIDENT 0       /* everything loaded */
+#define KARUKAN_RESIDENCY_LIGHT_RELEASED 1 /* light model released while idle */
+#define KARUKAN_RESIDENCY_RELEASED 2       /* also the main model's KV cache and buffers */
+#define KARUKAN_RESIDENCY_RELOADING 3      /* reloading in the background */
+
+/*
+ * Get where the shared in-process models are in the idle release cycle.
+ * Returns a KARUKAN_RESIDENCY_* value, or -1 if shared is NULL.
+ */
+int karukan_shared_residency(const KarukanShared* shared);
+
+/*
+ * Get how long the last reload after an idle release took, in milliseconds
+ * (from the activation that started it until the models were warm again).
+ * Returns 0 if no reload has completed yet.
+ */
+uint64_t karukan_shared_reload_ms(const KarukanShared* shared);
+
+/*
+ * Release the caller's reference to a shared handle.
+ * Engines created from it keep the resources alive until they are freed,
+ * so the handle and its engines may be freed in any order.
+ * Pending learning cache changes are written to disk before this returns.
+ */
+void karukan_shared_free(KarukanShared* shared);
+
+/*
+ * Create a lightweight engine instance that uses the resources of a shared handle.
+ * Only composition state is per-engine; models, dictionaries and the learning
+ * cache are shared. Returns NULL if shared is NULL.
+ * The caller is responsible for freeing the engine with karukan_engine_free().
+ */
+KarukanEngine* karukan_engine_new_with_shared(KarukanShared* shared);
+
 /*
  * Process a key event.
  *
@@ -57,6 +157,58 @@ int karukan_engine_process_key(
     int is_release
 );
 
+/* Bits returned by karukan_engine_process_key_flags() / karukan_engine_get_update_flags() */
+#define KARUKAN_UPDATE_CONSUMED (1u << 0)        /* the key was consumed by the IME */
+#define KARUKAN_UPDATE_PREEDIT (1u << 1)         /* same as karukan_engine_has_preedit() */
+#define KARUKAN_UPDATE_COMMIT (1u << 2)          /* same as karukan_engine_has_commit() */
+#define KARUKAN_UPDATE_AUX (1u << 3)             /* same as karukan_engine_has_aux() */
+#define KARUKAN_UPDATE_CANDIDATES (1u << 4)      /* same as karukan_engine_has_candidates() */
+#define KARUKAN_UPDATE_HIDE_CANDIDATES (1u << 5) /* same as karukan_engine_should_hide_candidates() */
+/* KARUKAN_CANDIDATES_* value of a candidates update (karukan_engine_get_candidate_change()) */
+#define KARUKAN_UPDATE_CANDIDATE_CHANGE(flags) (((flags) >> 8) & 0x3u)
+
+/*
+ * Process a key event, like karukan_engine_process_key(), but return every
+ * pending update as one KARUKAN_UPDATE_* mask instead of requiring a has_*
+ * call per kind.
+ *
+ * Key releases and modifier-only keys other than the mode toggle keys
+ * (Alt_R, Super_R, Meta_R, Hyper_R) are never consumed and never produce an
+ * update, so a frontend may skip calling this for them.
+ */
+uint32_t karukan_engine_process_key_flags(
+    KarukanEngine* engine,
+    uint32_t keysym,
+    uint32_t state,
+    int is_release
+);
+
+/*
+ * Get the pending updates as a KARUKAN_UPDATE_* mask (KARUKAN_UPDATE_CONSUMED
+ * is never set). Use after karukan_engine_apply_suggestion().
+ */
+uint32_t karukan_engine_get_update_flags(const KarukanEngine* engine);
+
+/*
+ * Get a file descriptor that becomes readable when a background auto-suggest
+ * (live conversion) result is ready. Only available when async_suggest is
+ * enabled in the settings; in that mode karukan_engine_process_key() shows
+ * hiragana immediately and runs inference on a worker thread.
+ * The descriptor is owned by the engine: do not read from or close it.
+ * Returns -1 if async suggest is disabled.
+ */
+int karukan_engine_suggest_fd(const KarukanEngine* engine);
+
+/*
+ * Apply a finished background auto-suggest result. Call this on the input
+ * thread whenever karukan_engine_suggest_fd() becomes readable.
+ * Results made stale by later key events are discarded.
+ *
+ * Returns 1 if preedit/candidates/aux changed (check the has_* functions as
+ * after karukan_engine_process_key()), 0 otherwise.
+ */
+int karukan_engine_apply_suggestion(KarukanEngine* engine);
+
 /*
  * Reset the engine state, clearing any pending input.
  */
@@ -79,6 +231,35 @@ void karukan_engine_set_surrounding_text(
     uint32_t cursor_pos
 );
 
+/*
+ * Set the surrounding text context from a bounded window around the cursor.
+ * Cheaper than karukan_engine_set_surrounding_text for large documents: the
+ * caller passes only the text it needs instead of the whole buffer.
+ *
+ * Parameters:
+ *   engine     - The engine instance
+ *   before     - UTF-8 text ending at the cursor (not null-terminated, may be NULL)
+ *   before_len - Length of before in bytes
+ *   after      - UTF-8 text starting at the cursor (not null-terminated, may be NULL)
+ *   after_len  - Length of after in bytes
+ *
+ * Only the current line and at most karukan_engine_surrounding_window()
+ * characters on each side are used. Invalid UTF-8 clears the context.
+ */
+void karukan_engine_set_surrounding_window(
+    KarukanEngine* engine,
+    const char* before,
+    uint32_t before_len,
+    const char* after,
+    uint32_t after_len
+);
+
+/*
+ * Get the number of characters before/after the cursor the engine uses as
+ * context (0 when surrounding context is disabled).
+ */
+uint32_t karukan_engine_surrounding_window(const KarukanEngine* engine);
+
 /* --- Preedit (composition) text --- */
 
 /*
@@ -104,6 +285,28 @@ uint32_t karukan_engine_get_preedit_len(const KarukanEngine* engine);
  */
 uint32_t karukan_engine_get_preedit_caret(const KarukanEngine* engine);
 
+/*
+ * Pending preedit change as one replacement: removing removed_len bytes at
+ * start of the preedit the UI is showing and inserting the inserted_len bytes
+ * at inserted gives the new preedit. A commit counts as clearing the shown
+ * preedit, so the first update after it inserts the whole text.
+ * inserted is not NUL-terminated and valid until the next process_key call.
+ */
+typedef struct KarukanPreeditDelta {
+    uint32_t start;        /* byte offset of the change */
+    uint32_t removed_len;  /* bytes removed at start */
+    const char* inserted;
+    uint32_t inserted_len;
+    uint32_t caret;        /* caret position in the new preedit (bytes) */
+} KarukanPreeditDelta;
+
+/*
+ * Fill out with the pending preedit change.
+ * Both lengths are 0 when the text did not change (the caret may have moved).
+ * Returns 1 if a preedit update is pending, 0 otherwise or if a pointer is NULL.
+ */
+int karukan_engine_get_preedit_delta(const KarukanEngine* engine, KarukanPreeditDelta* out);
+
 /* --- Commit text --- */
 
 /*
@@ -135,6 +338,19 @@ int karukan_engine_has_candidates(const KarukanEngine* engine);
  */
 int karukan_engine_should_hide_candidates(const KarukanEngine* engine);
 
+/* Values returned by karukan_engine_get_candidate_change() */
+#define KARUKAN_CANDIDATES_CURSOR 0 /* same page, only the cursor moved */
+#define KARUKAN_CANDIDATES_PAGE 1   /* same list, different page */
+#define KARUKAN_CANDIDATES_FULL 2   /* new list; rebuild from scratch */
+
+/*
+ * Get what changed in the pending candidate update (one of KARUKAN_CANDIDATES_*).
+ * Only meaningful when karukan_engine_has_candidates() returns 1 and the
+ * candidates are not hidden. On CURSOR the caller can keep its existing list
+ * and just move the cursor to karukan_engine_get_candidate_cursor().
+ */
+int karukan_engine_get_candidate_change(const KarukanEngine* engine);
+
 /*
  * Get the number of candidates.
  */
@@ -160,6 +376,34 @@ const char* karukan_engine_get_candidate_annotation(const KarukanEngine* engine,
  */
 uint32_t karukan_engine_get_candidate_cursor(const KarukanEngine* engine);
 
+/*
+ * Borrowed view of the current candidate page.
+ * Candidate i is the UTF-8 string at arena + text_offsets[i] with length
+ * text_lens[i] (also NUL-terminated); annotations use the same layout.
+ * All pointers are owned by the engine and valid until the next process_key call.
+ */
+typedef struct KarukanCandidateSnapshot {
+    uint32_t count;        /* candidates on the current page */
+    uint32_t cursor;       /* cursor position within the page */
+    uint32_t page;         /* current page (0-indexed) */
+    uint32_t total_pages;  /* number of pages */
+    uint32_t total_count;  /* candidates across all pages */
+    const char* arena;
+    uint32_t arena_len;
+    const uint32_t* text_offsets;
+    const uint32_t* text_lens;
+    const uint32_t* annotation_offsets;
+    const uint32_t* annotation_lens;
+} KarukanCandidateSnapshot;
+
+/*
+ * Fill out with a snapshot of the current candidate page in a single call,
+ * replacing the per-index getters above.
+ * Returns 1 on success, 0 if engine or out is NULL.
+ */
+int karukan_engine_get_candidate_snapshot(const KarukanEngine* engine,
+                                          KarukanCandidateSnapshot* out);
+
 /* --- Auxiliary text (reading hint) --- */
 
 /*
@@ -191,11 +435,93 @@ uint64_t karukan_engine_get_last_conversion_ms(const KarukanEngine* engine);
  */
 uint64_t karukan_engine_get_last_process_key_ms(const KarukanEngine* engine);
 
+/* --- Latency histograms --- */
+
+/*
+ * Pipeline stages with a process-wide latency histogram (microseconds).
+ * Every engine records into the same histograms.
+ */
+#define KARUKAN_STAGE_PROCESS_KEY 0     /* whole process_key call */
+#define KARUKAN_STAGE_ROMAJI 1          /* romaji-to-kana conversion */
+#define KARUKAN_STAGE_DICT_LOOKUP 2     /* user/system dictionary lookup */
+#define KARUKAN_STAGE_LEARNING_LOOKUP 3 /* learning cache lookup */
+#define KARUKAN_STAGE_TOKENIZE 4        /* tokenizer encode */
+#define KARUKAN_STAGE_PREFILL 5         /* prompt prefill */
+#define KARUKAN_STAGE_DECODE 6          /* token generation after prefill */
+#define KARUKAN_STAGE_INFERENCE 7       /* whole model inference per conversion */
+#define KARUKAN_STAGE_CACHE_FILL 8      /* filling the FFI caches */
+#define KARUKAN_STAGE_UPDATE_UI 9       /* frontend UI update (recorded by the addon) */
+
+typedef struct KarukanLatencySummary {
+    uint64_t count;
+    uint64_t mean_us;
+    uint64_t p50_us;
+    uint64_t p90_us;
+    uint64_t p99_us;
+    uint64_t max_us;
+} KarukanLatencySummary;
+
+/*
+ * Get the number of stages (valid stage ids are 0 .. count-1).
+ */
+uint32_t karukan_latency_stage_count(void);
+
+/*
+ * Record a measurement taken by the frontend (e.g. KARUKAN_STAGE_UPDATE_UI).
+ * Unknown stage ids are ignored.
+ */
+void karukan_latency_record(uint32_t stage, uint64_t us);
+
+/*
+ * Get the summary of a stage since the last reset.
+ * Percentiles are bucketed (within ~20%) and never exceed max_us.
+ * Returns 0 on success, -1 for an unknown stage or NULL out.
+ */
+int karukan_latency_get(uint32_t stage, KarukanLatencySummary* out);
+
+/*
+ * Space conversion fast path counters (process-wide).
+ * conversions: Space conversions started; hits: shown from learning/user
+ * dictionary before the model ran; merged: model results merged afterwards.
+ */
+typedef struct KarukanFastPathStats {
+    uint64_t conversions;
+    uint64_t hits;
+    uint64_t merged;
+} KarukanFastPathStats;
+
+/*
+ * Get the fast path counters since the last reset.
+ * Returns 0 on success, -1 for NULL out.
+ */
+int karukan_fast_path_get(KarukanFastPathStats* out);
+
+/*
+ * Clear all latency histograms and the fast path counters.
+ */
+void karukan_latency_reset(void);
+
+/*
+ * Write a table of all stages with samples (count, mean, p50, p90, p99, max),
+ * followed by a "fast_path" line with the fast path counters.
+ * Pass NULL to use the default path (~/.cache/karukan-im/latency.txt).
+ * Returns 0 on success, -1 on failure.
+ */
+int karukan_latency_write_report(const char* path);
+
+/*
+ * Same as karukan_latency_write_report, but the file is written on a
+ * background thread; returns without waiting for disk I/O.
+ * Returns 0 if the write was queued, -1 on failure.
+ */
+int karukan_latency_queue_report(const char* path);
+
 /* --- Learning cache --- */
 
 /*
  * Save the learning cache to disk if there are unsaved changes.
  * Called on deactivate (IME switch / window switch) for periodic persistence.
+ * Returns immediately: the write is coalesced and done on a background thread.
  */
 void karukan_engine_save_learning(KarukanEngine* engine);
 
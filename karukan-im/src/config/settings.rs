@@ -8,6 +8,7 @@ use std::path::{Path, PathBuf};
 
 use anyhow::Result;
 use directories::ProjectDirs;
+use karukan_engine::kanji::KvCacheType;
 use serde::{Deserialize, Serialize};
 use tracing::{debug, warn};
 
@@ -62,7 +63,61 @@ pub struct ConversionSettings {
     /// When a main model conversion exceeds this, the engine adaptively switches to light_model
     pub max_latency_ms: u64,
     /// Number of threads for llama.cpp inference (0 = all cores, llama.cpp default)
+    /// In adaptive mode this is the total budget shared by the main and light models
     pub n_threads: u32,
+    /// Threads given to the light model out of `n_threads` in adaptive mode
+    /// (0 = half of `n_threads`)
+    #[serde(default)]
+    pub light_n_threads: u32,
+    /// Run auto-suggest/live conversion inference on a background thread so key
+    /// input never waits for the model (results are applied when ready)
+    #[serde(default)]
+    pub async_suggest: bool,
+    /// Start the Space conversion (beam search) in the background after typing
+    /// has been idle for this many milliseconds (0 = disabled)
+    #[serde(default)]
+    pub speculative_delay_ms: u64,
+    /// Show learning/user dictionary candidates on Space without waiting for the
+    /// model when the top learning score reaches this value (0 = disabled).
+    /// Model candidates are merged in when ready; requires `async_suggest`.
+    #[serde(default)]
+    pub fast_path_min_score: f64,
+    /// After loading, prefetch the model files and run one dummy conversion per
+    /// model in the background so the first real conversion is not cold
+    #[serde(default)]
+    pub warm_up: bool,
+    /// Keep the model files locked in memory (mlock) after warm-up
+    #[serde(default)]
+    pub lock_model: bool,
+    /// Release the models after the IME has been unused for this many seconds
+    /// (0 = never): the light model first, then after another such period the
+    /// main model's KV cache and compute buffers. Reloaded on the next activation.
+    #[serde(default)]
+    pub idle_unload_secs: u64,
+    /// Release the models the same way (one step per check, only while the IME
+    /// is not being typed in) when the memory pressure of this process's cgroup,
+    /// or of the system, reaches this percentage (PSI `some avg10`; 0 = ignore)
+    #[serde(default)]
+    pub memory_pressure_threshold: f64,
+    /// Probe the hardware at load and benchmark each model to choose its variant,
+    /// GPU offload, KV cache type and batch sizes (cached per device in
+    /// `cache_dir/tuning.toml`); overrides `n_gpu_layers` and `kv_cache_type`
+    #[serde(default)]
+    pub auto_tune: bool,
+    /// Model layers offloaded to the GPU when `auto_tune` is off
+    /// (0 = CPU only; needs a build with a GPU backend)
+    #[serde(default)]
+    pub n_gpu_layers: u32,
+    /// KV cache element type when `auto_tune` is off (f16, q8_0, q4_0)
+    #[serde(default)]
+    pub kv_cache_type: KvCacheType,
+    /// Convert through a running `karukan-daemon` instead of loading the models
+    /// in this process (falls back to in-process models if it does not answer)
+    #[serde(default)]
+    pub daemon: bool,
+    /// Socket of the daemon (defaults to `karukan_engine::daemon::default_socket_path`)
+    #[serde(default)]
+    pub daemon_socket: Option<String>,
 }
 
 /// Learning cache settings
@@ -123,6 +178,11 @@ impl Settings {
         project_dirs().map(|dirs| dirs.config_dir().to_path_buf())
     }
 
+    /// Get the cache directory path (benchmark results, latency report)
+    pub fn cache_dir() -> Option<PathBuf> {
+        project_dirs().map(|dirs| dirs.cache_dir().to_path_buf())
+    }
+
     /// Get the configuration file path
     pub fn config_file() -> Option<PathBuf> {
         Self::config_dir().map(|dir| dir.join("config.toml"))
@@ -136,6 +196,20 @@ impl Settings {
         Self::data_dir().map(|dir| dir.join("user_dicts"))
     }
 
+    /// Get the compiled user dictionary cache path (merged `user_dict_dir()` contents).
+    ///
+    /// Default: `~/.cache/karukan-im/user_dicts.bin`
+    pub fn user_dict_cache_file() -> Option<PathBuf> {
+        project_dirs().map(|dirs| dirs.cache_dir().join("user_dicts.bin"))
+    }
+
+    /// Get the path the latency report is written to (see `karukan_latency_write_report`).
+    ///
+    /// Default: `~/.cache/karukan-im/latency.txt`
+    pub fn latency_report_file() -> Option<PathBuf> {
+        project_dirs().map(|dirs| dirs.cache_dir().join("latency.txt"))
+    }
+
     /// Get the learning cache file path.
     ///
     /// Default: `~/.local/share/karukan-im/learning.tsv`
@@ -1,10 +1,15 @@
 //! Conversion state handling (candidates, segments, commit)
 
 use std::collections::HashSet;
+use std::sync::atomic::Ordering;
 use std::time::Instant;
 
+use karukan_engine::kanji::KanjiError;
 use tracing::debug;
 
+use super::conversion_cache::ConversionKey;
+use super::inference_pool::{InferencePool, Lane, Priority, StopProbe, never_stop};
+use super::models::Models;
 use super::*;
 
 /// Maximum number of learning candidates to show
@@ -51,107 +56,226 @@ impl CandidateBuilder {
     }
 }
 
+/// Candidates of `convert_with_strategy`
+pub(super) struct StrategyOutput {
+    pub candidates: Vec<String>,
+    /// False if a lane's request was dropped (queue full) or failed, so the
+    /// candidates are partial and must not be cached
+    pub complete: bool,
+}
+
+/// Run the conversion described by `key` on the main/light models.
+///
+/// Shared by the input thread and background jobs. Each model runs on its lane
+/// of the inference pool at `priority` (also when it is served by the daemon);
+/// for parallel beam both lanes work at once. A failing or dropped request
+/// contributes no candidates and clears `StrategyOutput::complete`.
+/// `KanjiError::Cancelled` is returned if `should_stop` fired, so a partial
+/// parallel-beam result is never mistaken for a complete one.
+pub(super) fn convert_with_strategy(
+    pool: &InferencePool,
+    models: &Models,
+    key: &ConversionKey,
+    priority: Priority,
+    should_stop: &StopProbe,
+) -> Result<StrategyOutput, KanjiError> {
+    let submit = |lane: Lane, n: usize| {
+        let models = models.clone();
+        let (katakana, context) = (key.katakana.clone(), key.context.clone());
+        let should_stop = Arc::clone(should_stop);
+        pool.submit(lane, priority, move || {
+            models.convert_cancellable(lane, &katakana, &context, n, &*should_stop)
+        })
+    };
+    let complete = std::cell::Cell::new(true);
+    let wait = |rx: std::sync::mpsc::Receiver<Result<Vec<String>, KanjiError>>| match rx.recv() {
+        Ok(Ok(candidates)) => candidates,
+        Ok(Err(e)) => {
+            debug!("convert: lane failed: {}", e);
+            complete.set(false);
+            vec![]
+        }
+        Err(_) => {
+            debug!("convert: lane request dropped");
+            complete.set(false);
+            vec![]
+        }
+    };
+
+    let start = Instant::now();
+    let candidates = match &key.strategy {
+        ConversionStrategy::ParallelBeam { beam_width } => {
+            if !models.has_light() {
+                return Ok(StrategyOutput {
+                    candidates: vec![],
+                    complete: true,
+                });
+            }
+            let bw = *beam_width;
+            let default_top1 = submit(Lane::Main, 1);
+            let light_candidates = submit(Lane::Light, bw);
+            InputMethodEngine::merge_candidates_dedup(
+                wait(default_top1),
+                wait(light_candidates),
+                bw,
+            )
+        }
+        ConversionStrategy::LightModelOnly => {
+            if !models.has_light() {
+                return Ok(StrategyOutput {
+                    candidates: vec![],
+                    complete: true,
+                });
+            }
+            wait(submit(Lane::Light, 1))
+        }
+        ConversionStrategy::MainModelOnly => wait(submit(Lane::Main, 1)),
+        ConversionStrategy::MainModelBeam { beam_width } => wait(submit(Lane::Main, *beam_width)),
+    };
+    if should_stop() {
+        return Err(KanjiError::Cancelled);
+    }
+    latency::record(Stage::Inference, start.elapsed());
+    Ok(StrategyOutput {
+        candidates,
+        complete: complete.get(),
+    })
+}
+
 impl InputMethodEngine {
+    /// Build the conversion cache key for `reading`: the strategy chosen for
+    /// `num_candidates`, the model(s) it runs, the katakana input and the API context.
+    /// Returns None if no kanji converter is loaded.
+    pub(super) fn conversion_key(
+        &self,
+        reading: &str,
+        num_candidates: usize,
+    ) -> Option<ConversionKey> {
+        self.conversion_key_in_context(reading, num_candidates, self.truncate_context_for_api())
+    }
+
+    /// `conversion_key` with an explicit API context
+    pub(super) fn conversion_key_in_context(
+        &self,
+        reading: &str,
+        num_candidates: usize,
+        context: String,
+    ) -> Option<ConversionKey> {
+        let models = self.resources.models()?;
+        let main_model_name = models.main_name().to_string();
+        let strategy = self.determine_strategy(&models, reading, num_candidates);
+        let light_model_name = || models.light_name().map(str::to_string);
+        let model = match &strategy {
+            ConversionStrategy::ParallelBeam { .. } => {
+                format!(
+                    "{}+{}",
+                    main_model_name,
+                    light_model_name().unwrap_or_default()
+                )
+            }
+            ConversionStrategy::LightModelOnly => light_model_name().unwrap_or(main_model_name),
+            ConversionStrategy::MainModelOnly | ConversionStrategy::MainModelBeam { .. } => {
+                main_model_name
+            }
+        };
+        Some(ConversionKey {
+            model,
+            strategy,
+            katakana: karukan_engine::kana::hiragana_to_katakana(reading),
+            context,
+        })
+    }
+
     /// Run kana-kanji conversion for a reading via llama.cpp model.
     ///
     /// Determines the conversion strategy (main model, light model, or parallel beam),
     /// dispatches to the appropriate model(s), measures latency, and records which model was used.
+    /// Results are served from the shared conversion cache when the same request was seen before.
     fn run_kana_kanji_conversion(&mut self, reading: &str, num_candidates: usize) -> Vec<String> {
-        let Some(converter) = self.converters.kanji.as_ref() else {
+        let context = self.truncate_context_for_api();
+        self.run_kana_kanji_conversion_in_context(reading, num_candidates, context)
+    }
+
+    /// `run_kana_kanji_conversion` with an explicit API context
+    fn run_kana_kanji_conversion_in_context(
+        &mut self,
+        reading: &str,
+        num_candidates: usize,
+        context: String,
+    ) -> Vec<String> {
+        let Some(key) = self.conversion_key_in_context(reading, num_candidates, context) else {
             return vec![];
         };
-        let katakana = karukan_engine::kana::hiragana_to_katakana(reading);
-        let api_context = self.truncate_context_for_api();
-        let main_model_name = converter.model_display_name().to_string();
-
-        let strategy = self.determine_strategy(reading, num_candidates);
         debug!(
             "convert: reading=\"{}\" api_context=\"{}\" candidates={} strategy={:?}",
-            reading, api_context, num_candidates, strategy
+            reading, key.context, num_candidates, key.strategy
         );
 
-        let start = Instant::now();
+        if let Some(candidates) = self.resources.conversion_cache.get(&key) {
+            debug!("convert: cache hit for \"{}\"", reading);
+            // conversion_ms and the adaptive flag keep reflecting the last real inference
+            self.metrics.model_name = key.model;
+            return candidates;
+        }
+        let Some(models) = self.resources.models() else {
+            return vec![];
+        };
 
-        let candidates = match &strategy {
-            ConversionStrategy::ParallelBeam { beam_width } => {
-                let Some(light_converter) = self.converters.light_kanji.as_ref() else {
-                    return vec![];
-                };
-                let bw = *beam_width;
-                let (default_top1, light_candidates) = std::thread::scope(|s| {
-                    let h_default = s.spawn(|| {
-                        converter
-                            .convert(&katakana, &api_context, 1)
-                            .unwrap_or_default()
-                    });
-                    let h_beam = s.spawn(|| {
-                        light_converter
-                            .convert(&katakana, &api_context, bw)
-                            .unwrap_or_default()
-                    });
-                    (
-                        h_default.join().unwrap_or_default(),
-                        h_beam.join().unwrap_or_default(),
-                    )
-                });
-                Self::merge_candidates_dedup(default_top1, light_candidates, bw)
-            }
-            ConversionStrategy::LightModelOnly => {
-                let Some(light_converter) = self.converters.light_kanji.as_ref() else {
-                    return vec![];
-                };
-                light_converter
-                    .convert(&katakana, &api_context, 1)
-                    .unwrap_or_default()
-            }
-            ConversionStrategy::MainModelOnly => converter
-                .convert(&katakana, &api_context, 1)
-                .unwrap_or_default(),
-            ConversionStrategy::MainModelBeam { beam_width } => converter
-                .convert(&katakana, &api_context, *beam_width)
-                .unwrap_or_default(),
+        let priority = if num_candidates == 1 {
+            Priority::Interactive
+        } else {
+            Priority::Conversion
         };
+        let start = Instant::now();
+        let output = convert_with_strategy(
+            &self.resources.inference,
+            &models,
+            &key,
+            priority,
+            &never_stop(),
+        );
 
         self.metrics.conversion_ms = start.elapsed().as_millis() as u64;
-        self.update_adaptive_model_flag(&strategy);
-
-        self.metrics.model_name = match &strategy {
-            ConversionStrategy::ParallelBeam { .. } => {
-                let light_name = self
-                    .converters
-                    .light_kanji
-                    .as_ref()
-                    .map(|c| c.model_display_name().to_string())
-                    .unwrap_or_default();
-                format!("{}+{}", main_model_name, light_name)
-            }
-            ConversionStrategy::LightModelOnly => self
-                .converters
-                .light_kanji
-                .as_ref()
-                .map(|c| c.model_display_name().to_string())
-                .unwrap_or(main_model_name),
-            ConversionStrategy::MainModelOnly | ConversionStrategy::MainModelBeam { .. } => {
-                main_model_name
+        self.update_adaptive_model_flag(&key.strategy);
+        self.metrics.model_name = key.model.clone();
+
+        match output {
+            Ok(StrategyOutput {
+                candidates,
+                complete: true,
+            }) => {
+                self.resources
+                    .conversion_cache
+                    .insert(key, candidates.clone());
+                candidates
             }
-        };
-
-        candidates
+            // Partial or failed: shown once, converted again next time
+            Ok(StrategyOutput { candidates, .. }) => candidates,
+            Err(_) => vec![],
+        }
     }
 
     /// Run inference for auto-suggest and return candidates (raw strings).
     /// Initializes the kanji converter lazily. Falls back to the reading itself
-    /// if no candidates are produced.
+    /// if no candidates are produced, or while the models are warming up.
+    /// Live conversion behind a stable head only converts the reading after it.
     pub(super) fn run_auto_suggest(&mut self, reading: &str, num_candidates: usize) -> Vec<String> {
-        // Ensure kanji converter is initialized
-        if self.converters.kanji.is_none()
-            && let Err(e) = self.init_kanji_converter()
-        {
-            debug!("Failed to initialize kanji converter: {}", e);
+        // Ensure kanji converter is initialized; a cold model would stall typing
+        if self.resources.is_warming() || !self.ensure_kanji_converter() {
             return vec![reading.to_string()];
         }
 
-        let candidates = self.run_kana_kanji_conversion(reading, num_candidates);
+        let candidates = match self.live_tail(reading) {
+            Some((head, tail)) if tail.is_empty() => vec![head],
+            Some((head, tail)) => {
+                let context = self.live_tail_context(&head);
+                self.run_kana_kanji_conversion_in_context(&tail, num_candidates, context)
+                    .into_iter()
+                    .map(|c| format!("{}{}", head, c))
+                    .collect()
+            }
+            None => self.run_kana_kanji_conversion(reading, num_candidates),
+        };
 
         if candidates.is_empty() {
             vec![reading.to_string()]
@@ -182,8 +306,16 @@ impl InputMethodEngine {
             return EngineResult::consumed();
         }
 
-        // Get candidates from kanji converter (use full num_candidates for explicit conversion)
-        let mut candidates = self.build_conversion_candidates(&reading, self.config.num_candidates);
+        FAST_PATH_STATS.conversions.fetch_add(1, Ordering::Relaxed);
+        let fast_path = self.fast_path_confident(&reading);
+        let mut candidates = if fast_path {
+            // Show learning/dictionary candidates now; model candidates follow
+            FAST_PATH_STATS.hits.fetch_add(1, Ordering::Relaxed);
+            self.assemble_candidates(&reading, Vec::new())
+        } else {
+            // Get candidates from kanji converter (use full num_candidates for explicit conversion)
+            self.build_conversion_candidates(&reading, self.config.num_candidates)
+        };
 
         // If the previous auto-suggest result is not in the new candidates, insert it at the top
         // so it doesn't disappear when the conversion strategy changes.
@@ -235,9 +367,104 @@ impl InputMethodEngine {
                 })
                 .collect(),
         );
+        if fast_path {
+            self.submit_candidate_merge(&reading);
+        }
         self.enter_conversion_state(&reading, candidate_list)
     }
 
+    /// Whether Space can show the first page for `reading` without the model:
+    /// the fast path is enabled, model results can be merged in later (async
+    /// suggest), and the user dictionary has the reading or its top learning
+    /// score is high enough.
+    fn fast_path_confident(&self, reading: &str) -> bool {
+        let min_score = self.config.fast_path_min_score;
+        if min_score <= 0.0 || self.suggest.is_none() {
+            return false;
+        }
+        if let Some(dict) = &self.resources.dicts.user
+            && dict.exact_match_search(reading).is_some()
+        {
+            return true;
+        }
+        let Some(learning) = &self.resources.learning else {
+            return false;
+        };
+        let cache = learning.lock().unwrap_or_else(|e| e.into_inner());
+        cache
+            .lookup(reading)
+            .first()
+            .is_some_and(|(_, score)| *score >= min_score)
+    }
+
+    /// Merge background model candidates into the open conversion of their reading.
+    ///
+    /// They are inserted after the learning/user dictionary/model entries at the
+    /// top of the list; the selected candidate stays selected. Returns None if
+    /// the conversion is gone or nothing new was added.
+    pub(super) fn merge_model_candidates(
+        &mut self,
+        reading: &str,
+        model_candidates: Vec<String>,
+    ) -> Option<EngineResult> {
+        if reading != self.input_buf.text {
+            return None;
+        }
+        let InputState::Conversion { candidates, .. } = &self.state else {
+            return None;
+        };
+        let existing: HashSet<&str> = candidates
+            .candidates()
+            .iter()
+            .map(|c| c.text.as_str())
+            .collect();
+        let model_label = CandidateSource::Model.label();
+        let added: Vec<Candidate> = model_candidates
+            .into_iter()
+            .filter(|text| !existing.contains(text.as_str()))
+            .map(|text| Candidate {
+                text,
+                reading: Some(reading.to_string()),
+                annotation: Some(model_label.to_string()),
+                index: 0,
+            })
+            .collect();
+        FAST_PATH_STATS.merged.fetch_add(1, Ordering::Relaxed);
+        if added.is_empty() {
+            return None;
+        }
+
+        let top_labels = [
+            CandidateSource::Learning.label(),
+            CandidateSource::UserDictionary.label(),
+            model_label,
+        ];
+        let insert_at = candidates
+            .candidates()
+            .iter()
+            .take_while(|c| {
+                c.annotation
+                    .as_deref()
+                    .is_some_and(|a| top_labels.contains(&a))
+            })
+            .count();
+        let selected = candidates.selected_text().unwrap_or(reading).to_string();
+        let mut merged = candidates.candidates().to_vec();
+        merged.splice(insert_at..insert_at, added);
+        for (i, c) in merged.iter_mut().enumerate() {
+            c.index = i;
+        }
+        let mut list = CandidateList::new(merged);
+        if let Some(i) = list.candidates().iter().position(|c| c.text == selected) {
+            list.select(i);
+        }
+
+        if let InputState::Conversion { candidates, .. } = &mut self.state {
+            *candidates = list.clone();
+        }
+        Some(self.update_conversion_preedit(&selected, &list))
+    }
+
     /// Transition to Conversion state with the given reading and candidate list.
     ///
     /// Sets up the preedit (highlighted selected text), updates the state, and
@@ -268,20 +495,21 @@ impl InputMethodEngine {
     /// User dictionary results come first (higher priority), then system dictionary
     /// results sorted by score. Duplicates are removed via HashSet.
     fn search_dictionaries(&self, reading: &str, limit: usize) -> Vec<AnnotatedCandidate> {
+        let start = Instant::now();
         let mut candidates = Vec::new();
         let mut seen = HashSet::new();
 
         // User dictionary (higher priority)
-        if let Some(dict) = &self.dicts.user
+        if let Some(dict) = &self.resources.dicts.user
             && let Some(result) = dict.exact_match_search(reading)
         {
             for cand in result.candidates {
                 if candidates.len() >= limit {
                     break;
                 }
-                if seen.insert(cand.surface.clone()) {
+                if seen.insert(cand.surface) {
                     candidates.push(AnnotatedCandidate {
-                        text: cand.surface.clone(),
+                        text: cand.surface.to_string(),
                         source: CandidateSource::UserDictionary,
                         reading: None,
                     });
@@ -289,19 +517,17 @@ impl InputMethodEngine {
             }
         }
 
-        // System dictionary (sorted by score)
-        if let Some(dict) = &self.dicts.system
+        // System dictionary (candidates are stored sorted by score)
+        if let Some(dict) = &self.resources.dicts.system
             && let Some(result) = dict.exact_match_search(reading)
         {
-            let mut dict_candidates: Vec<_> = result.candidates.to_vec();
-            dict_candidates.sort_by(|a, b| a.score.total_cmp(&b.score));
-            for cand in dict_candidates {
+            for cand in result.candidates {
                 if candidates.len() >= limit {
                     break;
                 }
-                if seen.insert(cand.surface.clone()) {
+                if seen.insert(cand.surface) {
                     candidates.push(AnnotatedCandidate {
-                        text: cand.surface,
+                        text: cand.surface.to_string(),
                         source: CandidateSource::Dictionary,
                         reading: None,
                     });
@@ -309,6 +535,7 @@ impl InputMethodEngine {
             }
         }
 
+        latency::record(Stage::DictLookup, start.elapsed());
         candidates
     }
 
@@ -325,10 +552,7 @@ impl InputMethodEngine {
         num_candidates: usize,
     ) -> Vec<AnnotatedCandidate> {
         // Ensure kanji converter is initialized
-        if self.converters.kanji.is_none()
-            && let Err(e) = self.init_kanji_converter()
-        {
-            debug!("Failed to initialize kanji converter: {}", e);
+        if !self.ensure_kanji_converter() {
             return vec![AnnotatedCandidate {
                 text: reading.to_string(),
                 source: CandidateSource::Fallback,
@@ -337,7 +561,17 @@ impl InputMethodEngine {
         }
 
         let candidates = self.run_kana_kanji_conversion(reading, num_candidates);
+        self.assemble_candidates(reading, candidates)
+    }
 
+    /// Combine learning, dictionary and the given model candidates in display order.
+    ///
+    /// Priority: Learning → User Dictionary → Model → System Dictionary → Fallback
+    fn assemble_candidates(
+        &self,
+        reading: &str,
+        candidates: Vec<String>,
+    ) -> Vec<AnnotatedCandidate> {
         let hiragana = reading.to_string();
         let katakana = Self::hiragana_to_katakana(reading);
 
@@ -394,7 +628,11 @@ impl InputMethodEngine {
     ///
     /// Returns candidates from the learning cache suitable for auto-suggest display.
     pub(super) fn lookup_learning_candidates(&self, reading: &str) -> Vec<Candidate> {
-        let Some(cache) = &self.learning else {
+        let Some(learning) = &self.resources.learning else {
+            return vec![];
+        };
+        let start = Instant::now();
+        let Ok(cache) = learning.lock() else {
             return vec![];
         };
         let mut candidates: Vec<Candidate> = Vec::new();
@@ -406,9 +644,9 @@ impl InputMethodEngine {
             if candidates.len() >= MAX_LEARNING_CANDIDATES {
                 break;
             }
-            if seen.insert(surface.clone()) {
+            if seen.insert(surface) {
                 candidates.push(Candidate {
-                    text: surface,
+                    text: surface.to_string(),
                     reading: Some(reading.to_string()),
                     annotation: Some(label.clone()),
                     index: candidates.len(),
@@ -417,23 +655,21 @@ impl InputMethodEngine {
         }
 
         // Prefix match (predictive)
-        for (full_reading, surface, _score) in cache.prefix_lookup(reading) {
+        for (full_reading, surface, _score) in cache.predict(reading, MAX_LEARNING_CANDIDATES) {
             if candidates.len() >= MAX_LEARNING_CANDIDATES {
                 break;
             }
-            if full_reading == reading {
-                continue;
-            }
-            if seen.insert(surface.clone()) {
+            if seen.insert(surface) {
                 candidates.push(Candidate {
-                    text: surface,
-                    reading: Some(full_reading),
+                    text: surface.to_string(),
+                    reading: Some(full_reading.to_string()),
                     annotation: Some(label.clone()),
                     index: candidates.len(),
                 });
             }
         }
 
+        latency::record(Stage::LearningLookup, start.elapsed());
         candidates
     }
 
@@ -521,7 +757,9 @@ impl InputMethodEngine {
 
     /// Record a conversion selection in the learning cache.
     pub(super) fn record_learning(&mut self, reading: &str, surface: &str) {
-        if let Some(cache) = &mut self.learning {
+        if let Some(learning) = &self.resources.learning
+            && let Ok(mut cache) = learning.lock()
+        {
             cache.record(reading, surface);
         }
     }
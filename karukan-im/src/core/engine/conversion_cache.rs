@@ -0,0 +1,106 @@
+//! Process-wide cache of model conversion results
+//!
+//! Backspacing and retyping a kana, toggling live conversion or typing the same
+//! phrase in another window sends an identical request to the model. Results
+//! are kept in a small LRU keyed on everything the model output depends on, so
+//! such repeats skip inference. The cache lives in `SharedResources` and is
+//! shared by every input context.
+
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+use super::*;
+
+/// Number of cached conversions; entries are a few short strings each
+pub(super) const DEFAULT_CAPACITY: usize = 512;
+
+/// Everything a model conversion result depends on
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub(in crate::core) struct ConversionKey {
+    /// Display name of the model(s) that ran (main+light for parallel beam)
+    pub model: String,
+    pub strategy: ConversionStrategy,
+    /// Model input (katakana)
+    pub katakana: String,
+    /// Left context passed to the model
+    pub context: String,
+}
+
+struct Entry {
+    candidates: Vec<String>,
+    last_used: u64,
+}
+
+#[derive(Default)]
+struct Inner {
+    entries: HashMap<ConversionKey, Entry>,
+    /// Monotonic use counter for LRU ordering
+    clock: u64,
+}
+
+/// Bounded LRU of conversion results
+pub(in crate::core) struct ConversionCache {
+    inner: Mutex<Inner>,
+    capacity: usize,
+}
+
+impl ConversionCache {
+    pub fn new(capacity: usize) -> Self {
+        Self {
+            inner: Mutex::new(Inner::default()),
+            capacity,
+        }
+    }
+
+    /// Cached candidates for `key`, marking the entry as recently used
+    pub fn get(&self, key: &ConversionKey) -> Option<Vec<String>> {
+        let mut inner = self.inner.lock().unwrap_or_else(|e| e.into_inner());
+        inner.clock += 1;
+        let now = inner.clock;
+        let entry = inner.entries.get_mut(key)?;
+        entry.last_used = now;
+        Some(entry.candidates.clone())
+    }
+
+    /// Store a result, evicting the least recently used entry when full
+    pub fn insert(&self, key: ConversionKey, candidates: Vec<String>) {
+        if self.capacity == 0 || candidates.is_empty() {
+            return;
+        }
+        let mut inner = self.inner.lock().unwrap_or_else(|e| e.into_inner());
+        inner.clock += 1;
+        let last_used = inner.clock;
+        if inner.entries.len() >= self.capacity
+            && !inner.entries.contains_key(&key)
+            && let Some(oldest) = inner
+                .entries
+                .iter()
+                .min_by_key(|(_, e)| e.last_used)
+                .map(|(k, _)| k.clone())
+        {
+            inner.entries.remove(&oldest);
+        }
+        inner.entries.insert(
+            key,
+            Entry {
+                candidates,
+                last_used,
+            },
+        );
+    }
+
+    /// Drop every entry (models or dictionaries changed)
+    pub fn clear(&self) {
+        self.inner
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .entries
+            .clear();
+    }
+}
+
+impl Default for ConversionCache {
+    fn default() -> Self {
+        Self::new(DEFAULT_CAPACITY)
+    }
+}
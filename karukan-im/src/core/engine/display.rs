@@ -7,33 +7,20 @@ impl InputMethodEngine {
     /// Format: composed[:cursor] + romaji_buffer + composed[cursor:]
     /// In katakana mode, the composed parts are converted to katakana.
     pub(super) fn build_input_display(&self) -> String {
-        let before: String = self
-            .input_buf
-            .text
-            .chars()
-            .take(self.input_buf.cursor_pos)
-            .collect();
-        let after: String = self
-            .input_buf
-            .text
-            .chars()
-            .skip(self.input_buf.cursor_pos)
-            .collect();
+        let (before, after) = self.input_buf.text.split_at(self.input_buf.cursor_byte());
         let buffer = self.converters.romaji.buffer();
 
-        let katakana = self.input_mode == InputMode::Katakana;
-        let display_before = if katakana {
-            Self::hiragana_to_katakana(&before)
-        } else {
-            before
-        };
-        let display_after = if katakana {
-            Self::hiragana_to_katakana(&after)
-        } else {
-            after
-        };
-
-        format!("{}{}{}", display_before, buffer, display_after)
+        if self.input_mode == InputMode::Katakana {
+            let mut display = Self::hiragana_to_katakana(before);
+            display.push_str(buffer);
+            display.push_str(&Self::hiragana_to_katakana(after));
+            return display;
+        }
+        let mut display = String::with_capacity(before.len() + buffer.len() + after.len());
+        display.push_str(before);
+        display.push_str(buffer);
+        display.push_str(after);
+        display
     }
 
     /// Get the caret position in the display text (in characters)
@@ -45,18 +32,16 @@ impl InputMethodEngine {
     /// If live conversion text is present, shows live_text + romaji_buffer with caret at end.
     /// Otherwise shows the input buffer display with cursor-based caret.
     pub(super) fn build_composing_preedit(&self) -> Preedit {
-        let (display, caret) = if !self.live.text.is_empty() {
+        if !self.live.text.is_empty() {
             let buffer = self.converters.romaji.buffer();
-            let display = format!("{}{}", self.live.text, buffer);
-            let caret = display.chars().count();
-            (display, caret)
-        } else {
-            (self.build_input_display(), self.display_caret_position())
-        };
-        let len = display.chars().count();
-        let mut preedit = Preedit::with_text(&display);
-        preedit.set_caret(caret);
-        preedit.set_attributes(vec![PreeditAttribute::underline(0, len)]);
+            let mut display = String::with_capacity(self.live.text.len() + buffer.len());
+            display.push_str(&self.live.text);
+            display.push_str(buffer);
+            // Caret at the end
+            return Preedit::with_text_underlined(display);
+        }
+        let mut preedit = Preedit::with_text_underlined(self.build_input_display());
+        preedit.set_caret(self.display_caret_position());
         preedit
     }
 
@@ -131,10 +116,9 @@ impl InputMethodEngine {
 
     /// Get token count for a reading (returns None if converter not initialized)
     pub(super) fn get_token_count(&self, reading: &str) -> Option<usize> {
-        self.converters
-            .kanji
-            .as_ref()
-            .and_then(|c| c.count_input_tokens(reading).ok())
+        self.resources
+            .models()
+            .and_then(|models| models.count_input_tokens(reading).ok())
     }
 
     /// Get the display name of the model used for the last conversion
@@ -0,0 +1,233 @@
+//! Long-lived inference threads shared by every engine
+//!
+//! Each loaded model gets one worker thread ("lane"), so a model never runs more
+//! than one decode at a time no matter how many input contexts, background
+//! suggest jobs or speculative conversions ask for it. llama.cpp's own compute
+//! threads (`n_threads`) therefore stay within the configured budget instead of
+//! multiplying with every concurrent request.
+//!
+//! Requests wait in a small bounded queue ordered by priority: interactive
+//! auto-suggest/live conversion first, then Space conversion, then speculative
+//! work. When the queue is full the lowest-priority request is dropped.
+
+use std::panic::AssertUnwindSafe;
+use std::sync::{Arc, Condvar, Mutex, OnceLock, mpsc};
+
+use tracing::warn;
+
+/// Maximum number of queued (not yet running) requests per lane
+const QUEUE_CAPACITY: usize = 8;
+
+/// Which model a request runs on
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(in crate::core) enum Lane {
+    /// The model in the main (kanji) slot
+    Main,
+    /// The light model used for beam search
+    Light,
+}
+
+/// Scheduling class of an inference request (higher runs first)
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub(in crate::core) enum Priority {
+    /// Precomputed conversion nobody is waiting for yet
+    Speculative,
+    /// Space conversion
+    Conversion,
+    /// Auto-suggest / live conversion while typing
+    Interactive,
+}
+
+/// Returns true once a request should be abandoned (e.g. superseded by a newer key)
+pub(in crate::core) type StopProbe = Arc<dyn Fn() -> bool + Send + Sync>;
+
+/// Probe for requests that always run to completion
+pub(in crate::core) fn never_stop() -> StopProbe {
+    Arc::new(|| false)
+}
+
+type Task = Box<dyn FnOnce() + Send>;
+
+struct Queued {
+    priority: Priority,
+    seq: u64,
+    task: Task,
+}
+
+#[derive(Default)]
+struct QueueState {
+    tasks: Vec<Queued>,
+    next_seq: u64,
+    closed: bool,
+}
+
+impl QueueState {
+    /// Index of the task that should run next (highest priority, oldest first)
+    fn next(&self) -> Option<usize> {
+        (0..self.tasks.len())
+            .max_by_key(|&i| (self.tasks[i].priority, std::cmp::Reverse(self.tasks[i].seq)))
+    }
+
+    /// Index of the task to drop when full (lowest priority, newest first)
+    fn victim(&self) -> Option<usize> {
+        (0..self.tasks.len())
+            .min_by_key(|&i| (self.tasks[i].priority, std::cmp::Reverse(self.tasks[i].seq)))
+    }
+}
+
+#[derive(Default)]
+struct Queue {
+    state: Mutex<QueueState>,
+    ready: Condvar,
+}
+
+impl Queue {
+    /// Enqueue `task`. Returns false if it was rejected (queue full of work
+    /// with at least the same priority, or closed).
+    fn push(&self, priority: Priority, task: Task) -> bool {
+        let mut state = self.state.lock().unwrap_or_else(|e| e.into_inner());
+        if state.closed {
+            return false;
+        }
+        if state.tasks.len() >= QUEUE_CAPACITY {
+            match state.victim() {
+                Some(i) if state.tasks[i].priority < priority => {
+                    // Dropping the task drops its result sender; the waiter sees no result
+                    state.tasks.swap_remove(i);
+                }
+                _ => return false,
+            }
+        }
+        state.next_seq += 1;
+        let seq = state.next_seq;
+        state.tasks.push(Queued {
+            priority,
+            seq,
+            task,
+        });
+        self.ready.notify_one();
+        true
+    }
+
+    /// Block until a task is available; None once the queue is closed
+    fn pop(&self) -> Option<Task> {
+        let mut state = self.state.lock().unwrap_or_else(|e| e.into_inner());
+        loop {
+            if let Some(i) = state.next() {
+                return Some(state.tasks.swap_remove(i).task);
+            }
+            if state.closed {
+                return None;
+            }
+            state = self.ready.wait(state).unwrap_or_else(|e| e.into_inner());
+        }
+    }
+
+    fn close(&self) {
+        let mut state = self.state.lock().unwrap_or_else(|e| e.into_inner());
+        state.closed = true;
+        state.tasks.clear();
+        self.ready.notify_all();
+    }
+}
+
+/// One lane: a queue plus the thread draining it (spawned on first use)
+struct Worker {
+    name: &'static str,
+    queue: OnceLock<Option<Arc<Queue>>>,
+}
+
+impl Worker {
+    const fn new(name: &'static str) -> Self {
+        Self {
+            name,
+            queue: OnceLock::new(),
+        }
+    }
+
+    /// The lane's queue, or None if its thread could not be started
+    fn queue(&self) -> Option<&Arc<Queue>> {
+        self.queue
+            .get_or_init(|| {
+                let queue = Arc::new(Queue::default());
+                let worker_queue = Arc::clone(&queue);
+                let spawned = std::thread::Builder::new()
+                    .name(self.name.to_string())
+                    .spawn(move || {
+                        while let Some(task) = worker_queue.pop() {
+                            // A panicking task only loses its own result
+                            let _ = std::panic::catch_unwind(AssertUnwindSafe(task));
+                        }
+                    });
+                match spawned {
+                    Ok(_) => Some(queue),
+                    Err(e) => {
+                        warn!(
+                            "Failed to start {} thread, running inline: {}",
+                            self.name, e
+                        );
+                        None
+                    }
+                }
+            })
+            .as_ref()
+    }
+}
+
+impl Drop for Worker {
+    fn drop(&mut self) {
+        // The thread finishes its current task and exits
+        if let Some(Some(queue)) = self.queue.get() {
+            queue.close();
+        }
+    }
+}
+
+/// Per-model inference threads with a priority queue each
+pub(in crate::core) struct InferencePool {
+    main: Worker,
+    light: Worker,
+}
+
+impl InferencePool {
+    pub fn new() -> Self {
+        Self {
+            main: Worker::new("karukan-infer-main"),
+            light: Worker::new("karukan-infer-light"),
+        }
+    }
+
+    /// Queue `f` on `lane` and return a receiver for its result.
+    ///
+    /// The receiver reports a disconnect if the request was dropped (queue full
+    /// of higher-priority work, or the pool shutting down). Runs `f` on the
+    /// calling thread if the lane has no thread.
+    pub fn submit<R: Send + 'static>(
+        &self,
+        lane: Lane,
+        priority: Priority,
+        f: impl FnOnce() -> R + Send + 'static,
+    ) -> mpsc::Receiver<R> {
+        let (tx, rx) = mpsc::channel();
+        let worker = match lane {
+            Lane::Main => &self.main,
+            Lane::Light => &self.light,
+        };
+        let task: Task = Box::new(move || {
+            let _ = tx.send(f());
+        });
+        match worker.queue() {
+            Some(queue) => {
+                queue.push(priority, task);
+            }
+            None => task(),
+        }
+        rx
+    }
+}
+
+impl Default for InferencePool {
+    fn default() -> Self {
+        Self::new()
+    }
+}
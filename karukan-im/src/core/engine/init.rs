@@ -1,20 +1,74 @@
 //! Engine initialization (model loading, dictionary setup)
 
-use anyhow::Result;
-use tracing::debug;
+use std::path::PathBuf;
+use std::sync::atomic::Ordering;
+use std::sync::{Arc, Mutex};
+use std::time::Instant;
 
+use anyhow::{Context, Result};
+use karukan_engine::kanji::{ConversionConfig, HardwareProfile, ModelOptions, hardware};
+use tracing::{debug, info, warn};
+
+use crate::config::settings::StrategyMode;
+
+use super::inference_pool::{InferencePool, Lane, Priority};
+use super::learning_writer::{self, LearningWriter};
+use super::models::DaemonModels;
+use super::residency::{LightLoader, Residency};
 use super::*;
 
 /// Create a KanaKanjiConverter from a variant id, optionally setting thread count.
-fn create_converter(variant_id: &str, n_threads: u32) -> Result<KanaKanjiConverter> {
-    let backend = karukan_engine::Backend::from_variant_id(variant_id)?;
-    let mut converter = KanaKanjiConverter::new(backend)?;
+///
+/// With `runtime.auto_tune` the variant is swapped for the family's best one for
+/// this device and the runtime options come from `hardware::tune`.
+fn create_converter(
+    variant_id: &str,
+    n_threads: u32,
+    runtime: &ModelRuntime,
+) -> Result<KanaKanjiConverter> {
+    let (backend, options) = if runtime.auto_tune {
+        let profile = HardwareProfile::probe();
+        let variant_id = karukan_engine::kanji::registry()
+            .variant_for_device(variant_id, profile.gpu_offload)
+            .map_or(variant_id, |v| v.id.as_str());
+        let backend = karukan_engine::Backend::from_variant_id(variant_id)?;
+        let cache_path = Settings::cache_dir().map(|dir| dir.join("tuning.toml"));
+        let options = hardware::tune(&backend, n_threads, &profile, cache_path.as_deref())?;
+        (backend, options)
+    } else {
+        (
+            karukan_engine::Backend::from_variant_id(variant_id)?,
+            runtime.options,
+        )
+    };
+    let mut converter =
+        KanaKanjiConverter::with_options(backend, ConversionConfig::default(), options)?;
     if n_threads > 0 {
         converter.set_n_threads(n_threads);
     }
     Ok(converter)
 }
 
+/// Split the `n_threads` budget between the main and light models.
+///
+/// Parallel beam runs both models at once, so their thread counts add up to
+/// `n_threads` instead of each taking all of it. `light_n_threads == 0` gives
+/// the light model half. With `n_threads == 0` (llama.cpp default) there is no
+/// budget and only an explicit `light_n_threads` is applied.
+pub(super) fn split_thread_budget(n_threads: u32, light_n_threads: u32) -> (u32, u32) {
+    if n_threads == 0 {
+        return (0, light_n_threads);
+    }
+    if n_threads == 1 {
+        return (1, 1);
+    }
+    let light = match light_n_threads {
+        0 => n_threads / 2,
+        n => n.min(n_threads - 1),
+    };
+    (n_threads - light, light)
+}
+
 /// Format the n_threads value for debug logging.
 fn threads_label(n_threads: u32) -> String {
     if n_threads > 0 {
@@ -24,47 +78,91 @@ fn threads_label(n_threads: u32) -> String {
     }
 }
 
-impl InputMethodEngine {
-    /// Initialize the kanji converter (call this early to avoid latency)
-    /// Uses the default model from the registry.
-    pub fn init_kanji_converter(&mut self) -> Result<()> {
-        let default_id = karukan_engine::kanji::registry().default_model.clone();
-        self.init_kanji_converter_with_model(&default_id, 0)
+/// The in-process models with the lane each of them runs on
+pub(super) fn loaded_models(residency: &Residency) -> Vec<(Lane, Arc<KanaKanjiConverter>)> {
+    [
+        (Lane::Main, residency.main()),
+        (Lane::Light, residency.light()),
+    ]
+    .into_iter()
+    .filter_map(|(lane, converter)| Some((lane, converter?)))
+    .collect()
+}
+
+/// Run `KanaKanjiConverter::warm_up` on every model on its own lane, waiting
+/// until all of them finished (they warm up in parallel)
+pub(super) fn warm_up_models(
+    pool: &InferencePool,
+    models: Vec<(Lane, Arc<KanaKanjiConverter>)>,
+    lock_pages: bool,
+) {
+    let pending: Vec<_> = models
+        .into_iter()
+        .map(|(lane, converter)| {
+            let name = converter.model_display_name().to_string();
+            let rx = pool.submit(lane, Priority::Speculative, move || {
+                converter.warm_up(lock_pages)
+            });
+            (name, rx)
+        })
+        .collect();
+    for (name, rx) in pending {
+        match rx.recv() {
+            Ok(Ok(())) => debug!("Warm-up done: {}", name),
+            Ok(Err(e)) => warn!("Warm-up failed for {}: {}", name, e),
+            Err(_) => debug!("Warm-up dropped for {}", name),
+        }
     }
+}
 
+impl SharedResources {
     /// Initialize the kanji converter with a specific variant id
     pub fn init_kanji_converter_with_model(
         &mut self,
         variant_id: &str,
         n_threads: u32,
+        runtime: &ModelRuntime,
     ) -> Result<()> {
-        if self.converters.kanji.is_none() {
+        if self.residency.main().is_none() {
             debug!("Initializing kanji converter with variant: {}", variant_id);
-            let converter = create_converter(variant_id, n_threads)?;
+            let converter = create_converter(variant_id, n_threads, runtime)?;
             debug!(
                 "Kanji converter initialized: {} (n_threads={})",
                 converter.model_display_name(),
                 threads_label(n_threads)
             );
-            self.converters.kanji = Some(converter);
+            self.residency.set_main(converter);
+            self.conversion_cache.clear();
         }
         Ok(())
     }
 
     /// Initialize the light model for beam search (generates multiple candidates on Space conversion)
-    pub fn init_light_kanji_converter(&mut self, variant_id: &str, n_threads: u32) -> Result<()> {
-        if self.converters.light_kanji.is_none() {
+    ///
+    /// It is loaded the same way again if the residency monitor released it.
+    pub fn init_light_kanji_converter(
+        &mut self,
+        variant_id: &str,
+        n_threads: u32,
+        runtime: &ModelRuntime,
+    ) -> Result<()> {
+        if self.residency.light().is_none() {
             debug!(
                 "Initializing light kanji converter with variant: {}",
                 variant_id
             );
-            let converter = create_converter(variant_id, n_threads)?;
+            let converter = create_converter(variant_id, n_threads, runtime)?;
             debug!(
                 "Light kanji converter initialized: {} (n_threads={})",
                 converter.model_display_name(),
                 threads_label(n_threads)
             );
-            self.converters.light_kanji = Some(converter);
+            let variant_id = variant_id.to_string();
+            let runtime = *runtime;
+            let loader: LightLoader =
+                Box::new(move || create_converter(&variant_id, n_threads, &runtime));
+            self.residency.set_light(converter, Some(loader));
+            self.conversion_cache.clear();
         }
         Ok(())
     }
@@ -95,7 +193,7 @@ impl InputMethodEngine {
         match Dictionary::load(&path) {
             Ok(dict) => {
                 debug!("System dictionary loaded from {:?}", path);
-                self.dicts.system = Some(dict);
+                self.dicts.system = Some(Arc::new(dict));
             }
             Err(e) => {
                 debug!("Failed to load system dictionary from {:?}: {}", path, e);
@@ -112,38 +210,48 @@ impl InputMethodEngine {
             return;
         }
 
-        let Some(path) = Settings::learning_file() else {
-            debug!("Could not determine learning cache path");
-            self.learning = Some(LearningCache::new(max_entries));
-            return;
-        };
-
-        if path.exists() {
-            match LearningCache::load(&path, max_entries) {
+        let path = Settings::learning_file();
+        let cache = match path.clone() {
+            None => {
+                debug!("Could not determine learning cache path");
+                LearningCache::new(max_entries)
+            }
+            Some(path) if path.exists() => match LearningCache::load(&path, max_entries) {
                 Ok(cache) => {
                     debug!(
                         "Learning cache loaded from {:?} ({} entries)",
                         path,
                         cache.entry_count()
                     );
-                    self.learning = Some(cache);
+                    cache
                 }
                 Err(e) => {
                     debug!("Failed to load learning cache from {:?}: {}", path, e);
-                    self.learning = Some(LearningCache::new(max_entries));
+                    LearningCache::new(max_entries)
                 }
+            },
+            Some(path) => {
+                debug!("Learning cache not found at {:?}, starting empty", path);
+                LearningCache::new(max_entries)
+            }
+        };
+        let cache = Arc::new(Mutex::new(cache));
+        if let Some(path) = path {
+            match LearningWriter::spawn(Arc::clone(&cache), path, learning_writer::SAVE_DEBOUNCE) {
+                Ok(writer) => self.learning_writer = Some(Arc::new(writer)),
+                Err(e) => warn!("Failed to start learning cache writer: {}", e),
             }
-        } else {
-            debug!("Learning cache not found at {:?}, starting empty", path);
-            self.learning = Some(LearningCache::new(max_entries));
         }
+        self.learning = Some(cache);
     }
 
     /// Initialize user dictionaries by scanning the user dictionary directory.
     ///
     /// All files in the directory are loaded with `Dictionary::load_auto()`
     /// (auto-detects KRKN binary or Mozc TSV). Files are loaded in sorted
-    /// order; earlier files have higher priority after merging.
+    /// order; earlier files have higher priority after merging. The merged
+    /// result is cached in `Settings::user_dict_cache_file()` and reused until
+    /// a source file changes.
     ///
     /// Default directory: `~/.local/share/karukan-im/user_dicts/`
     pub fn init_user_dictionaries(&mut self) {
@@ -182,35 +290,259 @@ impl InputMethodEngine {
         // Sort for deterministic load order (alphabetical)
         paths.sort();
 
-        let mut dicts = Vec::new();
-        for path in &paths {
-            match Dictionary::load_auto(path) {
-                Ok(dict) => {
-                    debug!("User dictionary loaded from {:?}", path);
-                    dicts.push(dict);
+        let cache = Settings::user_dict_cache_file();
+        if let Some(merged) = user_dict::load_user_dictionaries(&paths, cache.as_deref()) {
+            debug!(
+                "User dictionaries ready ({} files from {:?})",
+                paths.len(),
+                dir
+            );
+            self.dicts.user = Some(Arc::new(merged));
+            self.conversion_cache.clear();
+        }
+    }
+}
+
+impl SharedResources {
+    /// Load dictionaries, the learning cache and the model(s) selected by `settings`.
+    ///
+    /// Which models are loaded depends on the strategy mode:
+    /// - `light`: light_model into the main (kanji) slot only
+    /// - `main`: main model only
+    /// - `adaptive`: main model + light model (light model failure is non-fatal)
+    ///
+    /// Dictionaries and the learning cache are loaded even if model loading fails,
+    /// so the returned error only concerns the model(s).
+    pub fn init_from_settings(&mut self, settings: &Settings) -> Result<()> {
+        let strategy = settings.conversion.strategy;
+        info!(
+            "Karukan init: model={:?}, light_model={:?}, strategy={:?}",
+            settings.conversion.model, settings.conversion.light_model, strategy,
+        );
+
+        self.init_system_dictionary(settings.conversion.dict_path.as_deref());
+        self.init_user_dictionaries();
+        self.init_learning_cache(settings.learning.enabled, settings.learning.max_entries);
+
+        if settings.conversion.daemon {
+            match self.init_daemon(settings) {
+                Ok(()) => {
+                    info!("Karukan init complete: {} (daemon)", self.model_name());
+                    return Ok(());
                 }
-                Err(e) => {
-                    debug!("Failed to load user dictionary from {:?}: {}", path, e);
+                Err(e) => warn!("Daemon unavailable, loading models in-process: {:#}", e),
+            }
+        }
+
+        let n_threads = settings.conversion.n_threads;
+        let runtime = ModelRuntime {
+            auto_tune: settings.conversion.auto_tune,
+            options: ModelOptions {
+                n_gpu_layers: settings.conversion.n_gpu_layers,
+                kv_cache_type: settings.conversion.kv_cache_type,
+                ..ModelOptions::default()
+            },
+        };
+
+        match strategy {
+            StrategyMode::Light => {
+                // Light mode: load light_model into the main (kanji) slot only
+                let light_variant = resolve_variant_id(settings.conversion.light_model.as_deref())
+                    .context("Invalid light_model settings")?;
+                self.init_kanji_converter_with_model(&light_variant, n_threads, &runtime)
+                    .context("Failed to initialize light model")?;
+                info!("Light model loaded into main slot: {}", self.model_name());
+            }
+            StrategyMode::Main => {
+                // Main mode: load main model only, no light model
+                let main_variant = resolve_variant_id(settings.conversion.model.as_deref())
+                    .context("Invalid model settings")?;
+                self.init_kanji_converter_with_model(&main_variant, n_threads, &runtime)
+                    .context("Failed to initialize main model")?;
+                info!("Main model loaded: {}", self.model_name());
+            }
+            StrategyMode::Adaptive => {
+                // Adaptive mode: load both main and light models within one thread budget
+                let (main_threads, light_threads) =
+                    split_thread_budget(n_threads, settings.conversion.light_n_threads);
+                let main_variant = resolve_variant_id(settings.conversion.model.as_deref())
+                    .context("Invalid model settings")?;
+                self.init_kanji_converter_with_model(&main_variant, main_threads, &runtime)
+                    .context("Failed to initialize default model")?;
+                info!("Default model loaded: {}", self.model_name());
+
+                // Initialize light model for beam search (non-fatal on failure)
+                let light_model = settings.conversion.light_model.as_deref();
+                let light_variant = match resolve_variant_id(light_model) {
+                    Ok(id) => id,
+                    Err(e) => {
+                        warn!("Invalid light_model settings, using default: {}", e);
+                        karukan_engine::kanji::registry().default_model.clone()
+                    }
+                };
+                if let Err(e) =
+                    self.init_light_kanji_converter(&light_variant, light_threads, &runtime)
+                {
+                    warn!(
+                        "Failed to initialize beam model (light_model={:?}): {}",
+                        light_model, e
+                    );
+                } else {
+                    info!("Beam model loaded");
                 }
             }
         }
 
-        if dicts.is_empty() {
+        info!("Karukan init complete: {}", self.model_name());
+        Ok(())
+    }
+
+    /// Use the models of a running `karukan-daemon` instead of loading them.
+    ///
+    /// Asks the daemon for the same models `init_from_settings` would load for
+    /// the strategy mode; a light model it cannot load is skipped, like a
+    /// failing in-process light model.
+    fn init_daemon(&mut self, settings: &Settings) -> Result<()> {
+        let socket = settings
+            .conversion
+            .daemon_socket
+            .as_ref()
+            .map(PathBuf::from)
+            .or_else(karukan_engine::daemon::default_socket_path)
+            .context("No daemon socket: set daemon_socket or $XDG_RUNTIME_DIR")?;
+        let (main, light) = match settings.conversion.strategy {
+            StrategyMode::Light => (
+                resolve_variant_id(settings.conversion.light_model.as_deref())
+                    .context("Invalid light_model settings")?,
+                None,
+            ),
+            StrategyMode::Main => (
+                resolve_variant_id(settings.conversion.model.as_deref())
+                    .context("Invalid model settings")?,
+                None,
+            ),
+            StrategyMode::Adaptive => (
+                resolve_variant_id(settings.conversion.model.as_deref())
+                    .context("Invalid model settings")?,
+                resolve_variant_id(settings.conversion.light_model.as_deref()).ok(),
+            ),
+        };
+        let daemon = DaemonModels::connect(&socket, &main, light.as_deref())?;
+        info!("Using daemon at {:?}", socket);
+        self.daemon = Some(Arc::new(daemon));
+        self.conversion_cache.clear();
+        Ok(())
+    }
+
+    /// Whether the models are still being warmed up (see `start_warm_up`)
+    pub fn is_warming(&self) -> bool {
+        self.warming.load(Ordering::Acquire)
+    }
+
+    /// Warm up every loaded model on a background thread.
+    ///
+    /// Each model runs `KanaKanjiConverter::warm_up` on its own inference lane,
+    /// so warm-up never overlaps a conversion on the same model and the models
+    /// warm up in parallel. `is_warming` is true until all of them finished.
+    /// Does nothing if no model is loaded.
+    pub fn start_warm_up(&self, lock_pages: bool) {
+        let models = loaded_models(&self.residency);
+        if models.is_empty() {
             return;
         }
 
-        match Dictionary::merge(dicts) {
-            Ok(Some(merged)) => {
-                debug!(
-                    "User dictionaries merged successfully ({} files from {:?})",
-                    paths.len(),
-                    dir
+        self.warming.store(true, Ordering::Release);
+        let warming = Arc::clone(&self.warming);
+        let pool = Arc::clone(&self.inference);
+        let spawned = std::thread::Builder::new()
+            .name("karukan-warmup".to_string())
+            .spawn(move || {
+                let start = Instant::now();
+                warm_up_models(&pool, models, lock_pages);
+                info!(
+                    "Model warm-up complete in {} ms",
+                    start.elapsed().as_millis()
                 );
-                self.dicts.user = Some(merged);
+                warming.store(false, Ordering::Release);
+            });
+        if let Err(e) = spawned {
+            warn!("Failed to start warm-up thread: {}", e);
+            self.warming.store(false, Ordering::Release);
+        }
+    }
+
+    /// Get the model name being used ("main+light", "main", or "unknown")
+    pub fn model_name(&self) -> String {
+        let models = self.models();
+        let main = models.as_ref().map(|m| m.main_name());
+        let sub = models.as_ref().and_then(|m| m.light_name());
+        match (main, sub) {
+            (Some(m), Some(s)) => format!("{}+{}", m, s),
+            (Some(m), None) => m.to_string(),
+            _ => "unknown".to_string(),
+        }
+    }
+
+    /// Save the learning cache to disk if it has unsaved changes.
+    ///
+    /// With a background writer this only queues the save (coalesced with other
+    /// requests and written off-thread); the final write happens when the last
+    /// handle to the resources is dropped.
+    pub fn save_learning(&self) {
+        if let Some(writer) = &self.learning_writer {
+            writer.request_save();
+            return;
+        }
+        if let Some(learning) = &self.learning
+            && let Ok(mut cache) = learning.lock()
+            && cache.is_dirty()
+            && let Some(path) = Settings::learning_file()
+        {
+            if let Err(e) = cache.save(&path) {
+                debug!("Failed to save learning cache: {}", e);
+            } else {
+                debug!("Learning cache saved to {:?}", path);
             }
-            Ok(None) => {}
+        }
+    }
+
+    /// Write the learning cache changes now, blocking until they are on disk.
+    /// Used on shutdown, when engines may never be freed.
+    pub fn flush_learning(&self) {
+        match &self.learning_writer {
+            Some(writer) => writer.flush(),
+            None => self.save_learning(),
+        }
+    }
+}
+
+impl InputMethodEngine {
+    /// Initialize the kanji converter (call this early to avoid latency)
+    /// Uses the default model from the registry.
+    ///
+    /// Only this engine's resources are affected; engines sharing resources
+    /// should load models through `SharedResources` instead.
+    pub fn init_kanji_converter(&mut self) -> Result<()> {
+        let default_id = karukan_engine::kanji::registry().default_model.clone();
+        self.resources
+            .init_kanji_converter_with_model(&default_id, 0, &ModelRuntime::default())
+    }
+
+    /// Make sure a kanji converter is available (in-process or on the daemon),
+    /// loading the default model lazily if allowed. Returns false if conversion
+    /// must fall back to the reading.
+    pub(super) fn ensure_kanji_converter(&mut self) -> bool {
+        if self.resources.models().is_some() {
+            return true;
+        }
+        if !self.lazy_model_init {
+            return false;
+        }
+        match self.init_kanji_converter() {
+            Ok(()) => true,
             Err(e) => {
-                debug!("Failed to merge user dictionaries: {}", e);
+                debug!("Failed to initialize kanji converter: {}", e);
+                false
             }
         }
     }
@@ -27,11 +27,23 @@ impl InputMethodEngine {
         let candidates =
             if self.input_mode != InputMode::Alphabet && !self.input_buf.text.is_empty() {
                 let reading = self.input_buf.text.clone();
-                let result = self.run_auto_suggest(&reading, 1);
-                if !result.is_empty() && result[0] != self.input_buf.text {
-                    Some((result, reading))
+                if self.is_async_suggest() {
+                    match self.live_tail(&reading) {
+                        // Back at the stable head: its conversion is already known
+                        Some((head, tail)) if tail.is_empty() => Some((vec![head], reading)),
+                        _ => {
+                            // Async mode: echo hiragana now, apply the model result when it is ready
+                            self.submit_auto_suggest(&reading);
+                            None
+                        }
+                    }
                 } else {
-                    None
+                    let result = self.run_auto_suggest(&reading, 1);
+                    if !result.is_empty() && result[0] != self.input_buf.text {
+                        Some((result, reading))
+                    } else {
+                        None
+                    }
                 }
             } else {
                 None
@@ -58,16 +70,29 @@ impl InputMethodEngine {
                 .with_action(EngineAction::UpdateAuxText(self.format_aux_composing()));
         };
 
+        self.build_suggest_result(candidates, &reading)
+    }
+
+    /// Build the composing UI for model auto-suggest `candidates` of `reading`.
+    ///
+    /// Live conversion shows the top candidate in the preedit; otherwise the
+    /// preedit stays hiragana and the model candidates join the candidate list.
+    pub(super) fn build_suggest_result(
+        &mut self,
+        candidates: Vec<String>,
+        reading: &str,
+    ) -> EngineResult {
         // Live conversion mode: show converted text in preedit
         if self.live.enabled && self.input_mode != InputMode::Katakana {
             self.live.text = candidates[0].clone();
+            self.update_live_head(reading, &candidates[0]);
             let preedit = self.set_composing_state();
             let mut result =
                 EngineResult::consumed().with_action(EngineAction::UpdatePreedit(preedit));
 
             // Learning candidates first, then dictionary candidates
-            let mut all_candidates = self.lookup_learning_candidates(&reading);
-            append_candidates_dedup(&mut all_candidates, self.lookup_dict_candidates(&reading));
+            let mut all_candidates = self.lookup_learning_candidates(reading);
+            append_candidates_dedup(&mut all_candidates, self.lookup_dict_candidates(reading));
             if all_candidates.is_empty() {
                 result = result.with_action(EngineAction::HideCandidates);
             } else {
@@ -83,15 +108,15 @@ impl InputMethodEngine {
         self.live.text.clear();
         let preedit = self.set_composing_state();
         // Learning candidates first (highest priority)
-        let mut all_candidates = self.lookup_learning_candidates(&reading);
+        let mut all_candidates = self.lookup_learning_candidates(reading);
         // Then model inference candidates
         let model_candidates: Vec<Candidate> = candidates
             .into_iter()
-            .map(|s| Candidate::with_reading(s, &reading))
+            .map(|s| Candidate::with_reading(s, reading))
             .collect();
         append_candidates_dedup(&mut all_candidates, model_candidates);
         // Then dictionary candidates
-        append_candidates_dedup(&mut all_candidates, self.lookup_dict_candidates(&reading));
+        append_candidates_dedup(&mut all_candidates, self.lookup_dict_candidates(reading));
         let aux = self.format_aux_suggest(&self.input_buf.text.clone());
         EngineResult::consumed()
             .with_action(EngineAction::UpdatePreedit(preedit))
@@ -148,7 +173,7 @@ impl InputMethodEngine {
             self.input_buf.insert(&ch.to_string());
         } else {
             let prev_output_len = 0;
-            let event = self.converters.romaji.push(ch);
+            let event = latency::time(Stage::Romaji, || self.converters.romaji.push(ch));
             let romaji_buffer = self.converters.romaji.buffer().to_string();
 
             // Check for PassThrough FIRST: the converter adds PassThrough chars
@@ -269,7 +294,7 @@ impl InputMethodEngine {
         }
 
         let prev_output_len = self.converters.romaji.output().chars().count();
-        let event = self.converters.romaji.push(ch);
+        let event = latency::time(Stage::Romaji, || self.converters.romaji.push(ch));
         let curr_output_len = self.converters.romaji.output().chars().count();
         let romaji_buffer = self.converters.romaji.buffer().to_string();
 
@@ -26,17 +26,21 @@ impl InputBuffer {
         self.cursor_pos = 0;
     }
 
+    /// Byte offset of the cursor in `text`.
+    pub fn cursor_byte(&self) -> usize {
+        self.text
+            .char_indices()
+            .nth(self.cursor_pos)
+            .map(|(i, _)| i)
+            .unwrap_or(self.text.len())
+    }
+
     /// Insert text at the current cursor position.
     pub fn insert(&mut self, text: &str) {
         if text.is_empty() {
             return;
         }
-        let byte_pos = self
-            .text
-            .char_indices()
-            .nth(self.cursor_pos)
-            .map(|(i, _)| i)
-            .unwrap_or(self.text.len());
+        let byte_pos = self.cursor_byte();
         self.text.insert_str(byte_pos, text);
         let char_count = text.chars().count();
         self.cursor_pos += char_count;
@@ -0,0 +1,139 @@
+//! Background persistence for the learning cache
+//!
+//! `save_learning` runs on the input thread (e.g. on every focus change), so it
+//! only queues a request here. A single writer thread per learning cache
+//! coalesces the requests that arrive within a short window, takes the pending
+//! changes under the cache lock and does the file I/O after releasing it.
+//! Dropping the writer performs a final synchronous write.
+
+use std::path::PathBuf;
+use std::sync::mpsc::{self, RecvTimeoutError};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use karukan_engine::LearningCache;
+use tracing::{debug, warn};
+
+/// How long save requests are coalesced before writing
+pub(super) const SAVE_DEBOUNCE: Duration = Duration::from_secs(2);
+
+enum Request {
+    /// Write within the debounce window
+    Save,
+    /// Write now and signal the sender once done
+    Flush(mpsc::Sender<()>),
+}
+
+/// Handle to the writer thread of one learning cache
+pub(in crate::core) struct LearningWriter {
+    requests: Option<mpsc::Sender<Request>>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl LearningWriter {
+    /// Spawn the writer thread for `cache`, persisted at `path`
+    pub fn spawn(
+        cache: Arc<Mutex<LearningCache>>,
+        path: PathBuf,
+        debounce: Duration,
+    ) -> std::io::Result<Self> {
+        let (requests, rx) = mpsc::channel();
+        let thread = std::thread::Builder::new()
+            .name("karukan-learning".to_string())
+            .spawn(move || run(&cache, &path, &rx, debounce))?;
+        Ok(Self {
+            requests: Some(requests),
+            thread: Some(thread),
+        })
+    }
+
+    /// Queue a write of the pending changes (returns immediately)
+    pub fn request_save(&self) {
+        if let Some(requests) = &self.requests {
+            let _ = requests.send(Request::Save);
+        }
+    }
+
+    /// Write the pending changes now, blocking until they are on disk
+    pub fn flush(&self) {
+        let (done, wait) = mpsc::channel();
+        if let Some(requests) = &self.requests
+            && requests.send(Request::Flush(done)).is_ok()
+        {
+            let _ = wait.recv();
+        }
+    }
+}
+
+impl Drop for LearningWriter {
+    fn drop(&mut self) {
+        // Closing the channel makes the thread write once more and exit
+        self.requests = None;
+        if let Some(thread) = self.thread.take()
+            && thread.join().is_err()
+        {
+            warn!("Learning cache writer thread panicked");
+        }
+    }
+}
+
+fn run(
+    cache: &Mutex<LearningCache>,
+    path: &std::path::Path,
+    rx: &mpsc::Receiver<Request>,
+    debounce: Duration,
+) {
+    while let Ok(first) = rx.recv() {
+        let mut waiters = Vec::new();
+        let mut closed = false;
+        match first {
+            Request::Flush(done) => waiters.push(done),
+            Request::Save => {
+                // Coalesce everything that arrives before the deadline
+                let deadline = Instant::now() + debounce;
+                loop {
+                    let timeout = deadline.saturating_duration_since(Instant::now());
+                    match rx.recv_timeout(timeout) {
+                        Ok(Request::Save) => continue,
+                        Ok(Request::Flush(done)) => {
+                            waiters.push(done);
+                            break;
+                        }
+                        Err(RecvTimeoutError::Timeout) => break,
+                        Err(RecvTimeoutError::Disconnected) => {
+                            closed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        write_pending(cache, path);
+        for done in waiters {
+            let _ = done.send(());
+        }
+        if closed {
+            return;
+        }
+    }
+    // All handles dropped: persist whatever is left
+    write_pending(cache, path);
+}
+
+/// Take the pending write under the lock, then commit it without holding the lock
+fn write_pending(cache: &Mutex<LearningCache>, path: &std::path::Path) {
+    let Some(write) = cache.lock().unwrap_or_else(|e| e.into_inner()).take_write() else {
+        return;
+    };
+    match write.commit(path) {
+        Ok(()) => debug!("Learning cache saved to {:?}", path),
+        Err(e) => {
+            debug!("Failed to save learning cache: {}", e);
+            cache
+                .lock()
+                .unwrap_or_else(|e| e.into_inner())
+                .write_failed();
+        }
+    }
+}
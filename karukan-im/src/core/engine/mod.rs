@@ -4,22 +4,38 @@
 //! the romaji converter, kanji converter, and manages the IME state.
 
 mod conversion;
+mod conversion_cache;
 mod cursor;
 mod display;
+mod inference_pool;
 mod init;
 mod input;
 mod input_buffer;
+mod learning_writer;
 mod mode;
+mod models;
+mod residency;
+mod segment;
 mod strategy;
+mod suggest;
 mod types;
+mod user_dict;
 
+pub use residency::{ResidencyConfig, ResidencyState};
+pub use suggest::SuggestNotifier;
 pub use types::*;
 
+use suggest::SuggestHandle;
+
 use input_buffer::InputBuffer;
 
 #[cfg(test)]
 mod tests;
 
+use std::sync::Arc;
+use std::time::Duration;
+
+use karukan_engine::latency::{self, Stage};
 use karukan_engine::{Dictionary, KanaKanjiConverter, LearningCache, RomajiConverter};
 use tracing::{debug, trace};
 
@@ -88,8 +104,12 @@ pub fn resolve_variant_id(model: Option<&str>) -> anyhow::Result<String> {
 pub struct InputMethodEngine {
     /// Current input state
     state: InputState,
-    /// Converters (romaji, kanji, light kanji)
+    /// Romaji converter (per-engine composition state)
     converters: Converters,
+    /// Models, dictionaries and learning cache (possibly shared with other engines)
+    resources: SharedResources,
+    /// Load the default model on the first conversion if no model is attached
+    lazy_model_init: bool,
     /// Surrounding text context from the editor (text around cursor)
     surrounding_context: Option<SurroundingContext>,
     /// Engine configuration
@@ -102,10 +122,10 @@ pub struct InputMethodEngine {
     input_buf: InputBuffer,
     /// Live conversion state
     live: LiveConversion,
-    /// Dictionaries (system, user)
-    dicts: Dictionaries,
-    /// Learning cache (user conversion history)
-    learning: Option<LearningCache>,
+    /// Background auto-suggest results (None = synchronous auto-suggest)
+    suggest: Option<SuggestHandle>,
+    /// Speculative Space conversions and the idle delay before they start
+    speculate: Option<(SuggestHandle, Duration)>,
 }
 
 impl InputMethodEngine {
@@ -115,17 +135,17 @@ impl InputMethodEngine {
             state: InputState::Empty,
             converters: Converters {
                 romaji: RomajiConverter::new(),
-                kanji: None,
-                light_kanji: None,
             },
+            resources: SharedResources::default(),
+            lazy_model_init: true,
             surrounding_context: None,
             config: EngineConfig::default(),
             metrics: ConversionMetrics::default(),
             input_mode: InputMode::Hiragana,
             input_buf: InputBuffer::new(),
             live: LiveConversion::default(),
-            dicts: Dictionaries::default(),
-            learning: None,
+            suggest: None,
+            speculate: None,
         }
     }
 
@@ -149,21 +169,58 @@ impl InputMethodEngine {
 
     /// Get the model name being used
     pub fn model_name(&self) -> String {
-        let main = self
-            .converters
-            .kanji
-            .as_ref()
-            .map(|c| c.model_display_name());
-        let sub = self
-            .converters
-            .light_kanji
-            .as_ref()
-            .map(|c| c.model_display_name());
-        match (main, sub) {
-            (Some(m), Some(s)) => format!("{}+{}", m, s),
-            (Some(m), None) => m.to_string(),
-            _ => "unknown".to_string(),
-        }
+        self.resources.model_name()
+    }
+
+    /// Get the models, dictionaries and learning cache used by this engine
+    pub fn resources(&self) -> &SharedResources {
+        &self.resources
+    }
+
+    /// Replace this engine's models, dictionaries and learning cache with a shared set.
+    ///
+    /// Only the heavy resources are swapped; composition state (preedit, romaji
+    /// buffer, input mode) is untouched, so this is safe to call between keys.
+    pub fn attach_resources(&mut self, resources: SharedResources) {
+        self.resources = resources;
+    }
+
+    /// The input context gained focus: keep the models resident, or start
+    /// reloading them in the background if they were released while idle.
+    /// Keys typed before the reload finishes get kana only (see `residency.rs`).
+    pub fn activate(&self) {
+        self.resources.touch_models();
+    }
+
+    /// Enable or disable loading the default model on the first conversion.
+    ///
+    /// Disable this when resources are loaded elsewhere (e.g. in the background
+    /// by a shared handle); conversions then fall back to the reading until a
+    /// model is attached.
+    pub fn set_lazy_model_init(&mut self, enabled: bool) {
+        self.lazy_model_init = enabled;
+    }
+
+    /// Run auto-suggest inference on a background thread.
+    ///
+    /// `process_key` then returns the hiragana preedit immediately. `notify` is
+    /// called from the background thread when a result is ready; the caller
+    /// should then call `apply_pending_suggestion` from the input thread. The
+    /// thread belongs to the shared resources, so engines add none of their own.
+    pub fn enable_async_suggest(&mut self, notify: SuggestNotifier) {
+        self.suggest = Some(SuggestHandle::new(notify));
+    }
+
+    /// Precompute the Space conversion in the background once typing has been
+    /// idle for `delay`, so the candidate window opens from the cached result.
+    pub fn enable_speculative_conversion(&mut self, delay: Duration) {
+        // Results go to the conversion cache; nothing to notify
+        self.speculate = Some((SuggestHandle::new(Arc::new(|| {})), delay));
+    }
+
+    /// Whether auto-suggest runs on a background thread
+    pub fn is_async_suggest(&self) -> bool {
+        self.suggest.is_some()
     }
 
     /// Get the current state
@@ -187,11 +244,13 @@ impl InputMethodEngine {
     /// the session. fcitx5 may send reset events between activate
     /// and the first keyEvent, which would wipe the context.
     pub fn reset(&mut self) {
+        self.cancel_pending_suggestion();
         self.state = InputState::Empty;
         self.converters.romaji.reset();
         self.input_mode = InputMode::Hiragana;
         self.input_buf.clear();
         self.live.text.clear();
+        self.live.head = None;
         self.metrics = ConversionMetrics::default();
     }
 
@@ -307,6 +366,12 @@ impl InputMethodEngine {
         self.surrounding_context = Some(SurroundingContext { left, right });
     }
 
+    /// Number of characters kept on each side of the cursor by
+    /// `set_surrounding_context`; callers never need to pass more than this
+    pub fn surrounding_window_len(&self) -> usize {
+        self.config.max_api_context_len
+    }
+
     /// Handle mode toggle keys (Right Alt/Super/Meta/Hyper): one-way non-Hiragana → Hiragana.
     /// Returns `Some(result)` if the key was handled, `None` if not a mode toggle key.
     fn handle_mode_toggle_key(&mut self, key: &KeyEvent) -> Option<EngineResult> {
@@ -338,6 +403,9 @@ impl InputMethodEngine {
 
     /// Process a key event
     pub fn process_key(&mut self, key: &KeyEvent) -> EngineResult {
+        // Keeps the models resident, or reloads them if released while idle
+        self.resources.touch_models();
+
         // Log modifier key events for debugging key mapping issues
         if key.keysym.is_modifier() {
             debug!(
@@ -361,6 +429,12 @@ impl InputMethodEngine {
             return EngineResult::not_consumed();
         }
 
+        // Any key press makes an in-flight background suggestion stale, except
+        // fast-path model candidates still being computed for the open conversion
+        if !matches!(self.state, InputState::Conversion { .. }) {
+            self.cancel_pending_suggestion();
+        }
+
         // Ctrl+Shift+L: toggle live conversion (works in all states)
         if key.modifiers.control_key
             && key.modifiers.shift_key
@@ -369,9 +443,10 @@ impl InputMethodEngine {
             return self.toggle_live_conversion();
         }
 
-        // Reset adaptive model flag when starting a new word (first key in Empty state)
+        // Reset the adaptive model flag and live head when starting a new word (first key in Empty state)
         if matches!(self.state, InputState::Empty) {
             self.metrics.adaptive_use_light_model = false;
+            self.live.head = None;
         }
 
         trace!(
@@ -389,13 +464,17 @@ impl InputMethodEngine {
             InputState::Conversion { .. } => self.process_key_conversion(key),
         };
 
-        self.metrics.process_key_ms = start.elapsed().as_millis() as u64;
+        let elapsed = start.elapsed();
+        self.metrics.process_key_ms = elapsed.as_millis() as u64;
+        latency::record(Stage::ProcessKey, elapsed);
 
+        self.submit_speculative_conversion();
         result
     }
 
     /// Commit any pending input and return the text
     pub fn commit(&mut self) -> String {
+        self.cancel_pending_suggestion();
         match &self.state {
             InputState::Empty => String::new(),
             InputState::Composing { .. } => {
@@ -431,18 +510,10 @@ impl InputMethodEngine {
         }
     }
 
-    /// Save the learning cache to disk if it has unsaved changes.
+    /// Save the learning cache to disk if it has unsaved changes
+    /// (queued on the background writer when there is one).
     pub fn save_learning(&mut self) {
-        if let Some(cache) = &mut self.learning
-            && cache.is_dirty()
-            && let Some(path) = Settings::learning_file()
-        {
-            if let Err(e) = cache.save(&path) {
-                debug!("Failed to save learning cache: {}", e);
-            } else {
-                debug!("Learning cache saved to {:?}", path);
-            }
-        }
+        self.resources.save_learning();
     }
 }
 
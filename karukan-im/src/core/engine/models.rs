@@ -0,0 +1,179 @@
+//! The kana-kanji models a conversion runs on: in-process or in a shared daemon
+//!
+//! With `daemon = true` the models stay in `karukan-daemon` (one copy per
+//! machine instead of one per fcitx5 process) and every inference request,
+//! including the token counts behind the strategy choice, goes over its socket.
+//! `SharedResources::models` hides the difference from the conversion code.
+//!
+//! If the daemon does not answer at startup the models are loaded in-process
+//! as usual. If it goes away later, conversions fall back to the reading until
+//! it is back, or to a lazily loaded in-process model where lazy init is allowed.
+
+use std::path::Path;
+
+use anyhow::Context;
+use karukan_engine::daemon::DaemonClient;
+use karukan_engine::kanji::{KanjiError, ThroughputSnapshot};
+use tracing::warn;
+
+use super::inference_pool::Lane;
+use super::*;
+
+/// A model variant loaded by the daemon
+pub(in crate::core) struct RemoteModel {
+    pub id: String,
+    pub display_name: String,
+}
+
+/// Connection to the daemon and the models this process uses there
+pub(in crate::core) struct DaemonModels {
+    pub client: DaemonClient,
+    pub main: RemoteModel,
+    /// Loaded only when the daemon could load the light model
+    pub light: Option<RemoteModel>,
+}
+
+impl DaemonModels {
+    /// Connect to the daemon at `socket` and have it load `main` and, unless
+    /// None, `light` (a light model the daemon cannot load is skipped)
+    pub fn connect(socket: &Path, main: &str, light: Option<&str>) -> anyhow::Result<Self> {
+        let client =
+            DaemonClient::connect(socket).with_context(|| format!("no daemon at {:?}", socket))?;
+        let load = |id: &str| {
+            client.load(id).map(|display_name| RemoteModel {
+                id: id.to_string(),
+                display_name,
+            })
+        };
+        let main = load(main).with_context(|| format!("daemon failed to load {}", main))?;
+        let light = light.and_then(|id| match load(id) {
+            Ok(model) => Some(model),
+            Err(e) => {
+                warn!("Daemon failed to load light model {}: {}", id, e);
+                None
+            }
+        });
+        Ok(Self {
+            client,
+            main,
+            light,
+        })
+    }
+}
+
+/// Main and light model of a conversion, wherever they run
+#[derive(Clone)]
+pub(in crate::core) enum Models {
+    Local {
+        main: Arc<KanaKanjiConverter>,
+        light: Option<Arc<KanaKanjiConverter>>,
+    },
+    Daemon(Arc<DaemonModels>),
+}
+
+impl Models {
+    pub fn has_light(&self) -> bool {
+        match self {
+            Models::Local { light, .. } => light.is_some(),
+            Models::Daemon(daemon) => daemon.light.is_some(),
+        }
+    }
+
+    pub fn main_name(&self) -> &str {
+        match self {
+            Models::Local { main, .. } => main.model_display_name(),
+            Models::Daemon(daemon) => &daemon.main.display_name,
+        }
+    }
+
+    pub fn light_name(&self) -> Option<&str> {
+        match self {
+            Models::Local { light, .. } => light.as_ref().map(|c| c.model_display_name()),
+            Models::Daemon(daemon) => daemon.light.as_ref().map(|m| m.display_name.as_str()),
+        }
+    }
+
+    /// Count the reading's tokens with the main model's tokenizer
+    pub fn count_input_tokens(&self, reading: &str) -> Result<usize, KanjiError> {
+        match self {
+            Models::Local { main, .. } => main.count_input_tokens(reading),
+            Models::Daemon(daemon) => daemon.client.count_input_tokens(&daemon.main.id, reading),
+        }
+    }
+
+    /// Measured per-token cost of the model on `lane`. Not reported by the
+    /// daemon: its costs include other clients' load, so strategy selection
+    /// falls back to the measured conversion time there.
+    pub fn throughput(&self, lane: Lane) -> Option<ThroughputSnapshot> {
+        match (self, lane) {
+            (Models::Local { main, .. }, Lane::Main) => main.throughput(),
+            (Models::Local { light, .. }, Lane::Light) => light.as_ref()?.throughput(),
+            (Models::Daemon(_), _) => None,
+        }
+    }
+
+    /// `KanaKanjiConverter::convert_cancellable` on the model of `lane`
+    /// (no candidates if that lane has no model)
+    pub fn convert_cancellable(
+        &self,
+        lane: Lane,
+        reading: &str,
+        context: &str,
+        num_candidates: usize,
+        should_stop: &dyn Fn() -> bool,
+    ) -> Result<Vec<String>, KanjiError> {
+        match self {
+            Models::Local { main, light } => {
+                let converter = match lane {
+                    Lane::Main => main,
+                    Lane::Light => match light {
+                        Some(light) => light,
+                        None => return Ok(vec![]),
+                    },
+                };
+                converter.convert_cancellable(reading, context, num_candidates, should_stop)
+            }
+            Models::Daemon(daemon) => {
+                let model = match lane {
+                    Lane::Main => &daemon.main,
+                    Lane::Light => match &daemon.light {
+                        Some(light) => light,
+                        None => return Ok(vec![]),
+                    },
+                };
+                daemon.client.convert_cancellable(
+                    &model.id,
+                    reading,
+                    context,
+                    num_candidates,
+                    should_stop,
+                )
+            }
+        }
+    }
+}
+
+impl SharedResources {
+    /// The models to convert with: the in-process ones if loaded, otherwise the
+    /// daemon's while it is reachable. None if neither is available.
+    pub(in crate::core) fn models(&self) -> Option<Models> {
+        if let Some(main) = self.residency.main() {
+            return Some(Models::Local {
+                main,
+                light: self.residency.light(),
+            });
+        }
+        self.daemon
+            .as_ref()
+            .filter(|daemon| daemon.client.is_available())
+            .map(|daemon| Models::Daemon(Arc::clone(daemon)))
+    }
+
+    /// Whether conversions have a light model (see `models`)
+    pub(in crate::core) fn has_light_model(&self) -> bool {
+        match self.residency.main() {
+            Some(_) => self.residency.light().is_some(),
+            None => self.daemon.as_ref().is_some_and(|d| d.light.is_some()),
+        }
+    }
+}
@@ -0,0 +1,366 @@
+//! In-process models, released while the IME sits idle and reloaded on use
+//!
+//! A desktop session spends most of its time not typing, yet the loaded models
+//! keep their llama.cpp contexts (KV cache, compute buffers) and the light model
+//! allocated. With `idle_unload_secs` or `memory_pressure_threshold` set, a
+//! monitor thread releases them in two steps: first the light model (the main
+//! model converts alone meanwhile), then the main model's context. The main
+//! model's weights stay mapped from its GGUF file, so the kernel is free to
+//! evict those pages and read them back on demand.
+//!
+//! The next activation (`SharedResources::touch_models`, also run on every key)
+//! reloads in the background: the light model is loaded again and the models
+//! are warmed up. `is_warming` is set meanwhile, so typing never waits for the
+//! reload; auto-suggest and live conversion show hiragana until it is done.
+
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, RwLock, Weak};
+use std::time::{Duration, Instant};
+
+use tracing::{debug, info, warn};
+
+use super::init::{loaded_models, warm_up_models};
+use super::*;
+
+/// How often the monitor thread checks idle time and memory pressure
+const MONITOR_INTERVAL: Duration = Duration::from_secs(2);
+
+/// Memory pressure only releases models once typing paused for this long,
+/// so a reload is not undone between two keys
+const PRESSURE_MIN_IDLE: Duration = Duration::from_secs(10);
+
+/// Where the in-process models are in the release/reload cycle
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ResidencyState {
+    /// Everything loaded (also the state without in-process models)
+    Resident = 0,
+    /// Light model dropped; the main model converts alone
+    LightReleased = 1,
+    /// Light model dropped and the main model's context freed
+    Released = 2,
+    /// Reloading in the background after a release
+    Reloading = 3,
+}
+
+/// When the monitor releases models, and how they are warmed up again
+#[derive(Debug, Clone, Copy, Default)]
+pub struct ResidencyConfig {
+    /// Idle time before each release step (None = never release when idle)
+    pub idle_timeout: Option<Duration>,
+    /// PSI `some avg10` percentage that releases a step (0 = ignore pressure)
+    pub pressure_threshold: f64,
+    /// Run `KanaKanjiConverter::warm_up` on the models after a reload
+    pub warm_up: bool,
+    /// Lock the model pages again during that warm-up
+    pub lock_pages: bool,
+}
+
+impl ResidencyConfig {
+    /// Whether anything would ever be released
+    pub fn is_enabled(&self) -> bool {
+        self.idle_timeout.is_some() || self.pressure_threshold > 0.0
+    }
+}
+
+/// Loads the light model again after it was released
+pub(in crate::core) type LightLoader =
+    Box<dyn Fn() -> anyhow::Result<KanaKanjiConverter> + Send + Sync>;
+
+/// The in-process main and light model, plus their release/reload state
+pub(in crate::core) struct Residency {
+    main: RwLock<Option<Arc<KanaKanjiConverter>>>,
+    light: RwLock<Option<Arc<KanaKanjiConverter>>>,
+    /// Set with the light model when it can be reloaded after a release
+    light_loader: Mutex<Option<LightLoader>>,
+    /// Also serializes release and reload steps
+    pub(super) state: Mutex<ResidencyState>,
+    /// Last key or activation of any engine using these models
+    last_use: Mutex<Instant>,
+    /// Settings of the running monitor (None until one is started)
+    config: Mutex<Option<ResidencyConfig>>,
+    /// Duration of the last reload in milliseconds (0 = none yet)
+    reload_ms: AtomicU64,
+}
+
+impl Default for Residency {
+    fn default() -> Self {
+        Self {
+            main: RwLock::new(None),
+            light: RwLock::new(None),
+            light_loader: Mutex::new(None),
+            state: Mutex::new(ResidencyState::Resident),
+            last_use: Mutex::new(Instant::now()),
+            config: Mutex::new(None),
+            reload_ms: AtomicU64::new(0),
+        }
+    }
+}
+
+impl Residency {
+    pub fn main(&self) -> Option<Arc<KanaKanjiConverter>> {
+        self.main.read().unwrap_or_else(|e| e.into_inner()).clone()
+    }
+
+    pub fn light(&self) -> Option<Arc<KanaKanjiConverter>> {
+        self.light.read().unwrap_or_else(|e| e.into_inner()).clone()
+    }
+
+    pub fn set_main(&self, converter: KanaKanjiConverter) {
+        *self.main.write().unwrap_or_else(|e| e.into_inner()) = Some(Arc::new(converter));
+    }
+
+    /// Install the light model; `loader` (if any) reloads it after a release
+    pub fn set_light(&self, converter: KanaKanjiConverter, loader: Option<LightLoader>) {
+        *self.light.write().unwrap_or_else(|e| e.into_inner()) = Some(Arc::new(converter));
+        *self.light_loader.lock().unwrap_or_else(|e| e.into_inner()) = loader;
+    }
+
+    pub fn state(&self) -> ResidencyState {
+        *self.state.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Duration of the last completed reload (None before the first one)
+    pub fn last_reload(&self) -> Option<Duration> {
+        match self.reload_ms.load(Ordering::Acquire) {
+            0 => None,
+            ms => Some(Duration::from_millis(ms)),
+        }
+    }
+
+    fn mark_used(&self) {
+        *self.last_use.lock().unwrap_or_else(|e| e.into_inner()) = Instant::now();
+    }
+
+    fn idle_for(&self) -> Duration {
+        self.last_use
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .elapsed()
+    }
+
+    /// Release the next step if the models have been idle long enough or
+    /// memory is under pressure (`pressure` = current PSI percentage)
+    pub fn check(&self, config: &ResidencyConfig, pressure: Option<f64>) {
+        let idle = self.idle_for();
+        let steps_due = config
+            .idle_timeout
+            .map_or(0, |timeout| idle.as_millis() / timeout.as_millis().max(1));
+        let pressured = config.pressure_threshold > 0.0
+            && pressure.is_some_and(|p| p >= config.pressure_threshold)
+            && idle >= PRESSURE_MIN_IDLE;
+        let due = match self.state() {
+            ResidencyState::Resident => steps_due >= 1,
+            ResidencyState::LightReleased => steps_due >= 2,
+            ResidencyState::Released | ResidencyState::Reloading => return,
+        };
+        if due || pressured {
+            self.release_step(if pressured { "memory pressure" } else { "idle" });
+        }
+    }
+
+    /// Drop the light model if it is loaded, otherwise free the main model's
+    /// context. A step is retried on the next check while a conversion runs.
+    pub fn release_step(&self, reason: &str) {
+        let mut state = self.state.lock().unwrap_or_else(|e| e.into_inner());
+        match *state {
+            ResidencyState::Resident => {
+                if self
+                    .light
+                    .write()
+                    .unwrap_or_else(|e| e.into_inner())
+                    .take()
+                    .is_some()
+                {
+                    info!("Released the light model ({})", reason);
+                    *state = ResidencyState::LightReleased;
+                    return;
+                }
+                // Nothing to drop first: go straight to the main model
+                if self.release_main(reason) {
+                    *state = ResidencyState::Released;
+                }
+            }
+            ResidencyState::LightReleased => {
+                if self.release_main(reason) {
+                    *state = ResidencyState::Released;
+                }
+            }
+            ResidencyState::Released | ResidencyState::Reloading => {}
+        }
+    }
+
+    fn release_main(&self, reason: &str) -> bool {
+        let Some(main) = self.main() else {
+            return false;
+        };
+        if !main.release_buffers() {
+            debug!("Main model busy, releasing its buffers later");
+            return false;
+        }
+        info!("Released the main model's buffers ({})", reason);
+        true
+    }
+
+    /// Switch a released state to `Reloading`; false if there is nothing to reload
+    fn begin_reload(&self) -> bool {
+        let mut state = self.state.lock().unwrap_or_else(|e| e.into_inner());
+        match *state {
+            ResidencyState::LightReleased | ResidencyState::Released => {
+                *state = ResidencyState::Reloading;
+                true
+            }
+            ResidencyState::Resident | ResidencyState::Reloading => false,
+        }
+    }
+
+    /// Load the light model again (if it was released and can be reloaded)
+    fn reload_light(&self) {
+        if self.light().is_some() {
+            return;
+        }
+        let loader = self.light_loader.lock().unwrap_or_else(|e| e.into_inner());
+        let Some(load) = loader.as_ref() else {
+            return;
+        };
+        match load() {
+            Ok(converter) => {
+                *self.light.write().unwrap_or_else(|e| e.into_inner()) = Some(Arc::new(converter));
+            }
+            Err(e) => warn!("Failed to reload the light model: {:#}", e),
+        }
+    }
+
+    fn finish_reload(&self, elapsed: Duration) {
+        self.reload_ms
+            .store((elapsed.as_millis() as u64).max(1), Ordering::Release);
+        *self.state.lock().unwrap_or_else(|e| e.into_inner()) = ResidencyState::Resident;
+        info!("Models reloaded in {} ms", elapsed.as_millis());
+    }
+}
+
+impl SharedResources {
+    /// Where the in-process models are in the release/reload cycle
+    pub fn residency_state(&self) -> ResidencyState {
+        self.residency.state()
+    }
+
+    /// Duration of the last reload after a release (None before the first one)
+    pub fn last_reload(&self) -> Option<Duration> {
+        self.residency.last_reload()
+    }
+
+    /// Record a use of the models (key or activation), starting a background
+    /// reload if they were released. Never blocks on the reload.
+    pub fn touch_models(&self) {
+        let residency = &self.residency;
+        residency.mark_used();
+        if !residency.begin_reload() {
+            return;
+        }
+
+        let config = residency
+            .config
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .unwrap_or_default();
+        self.warming.store(true, Ordering::Release);
+        let thread_residency = Arc::clone(residency);
+        let warming = Arc::clone(&self.warming);
+        let pool = Arc::clone(&self.inference);
+        let spawned = std::thread::Builder::new()
+            .name("karukan-reload".to_string())
+            .spawn(move || {
+                let start = Instant::now();
+                thread_residency.reload_light();
+                if config.warm_up {
+                    let models = loaded_models(&thread_residency);
+                    warm_up_models(&pool, models, config.lock_pages);
+                }
+                thread_residency.finish_reload(start.elapsed());
+                warming.store(false, Ordering::Release);
+            });
+        if let Err(e) = spawned {
+            // The main model recreates its context on the next conversion anyway
+            warn!("Failed to start reload thread: {}", e);
+            residency.finish_reload(Duration::ZERO);
+            self.warming.store(false, Ordering::Release);
+        }
+    }
+
+    /// Start the thread releasing idle models (does nothing if `config`
+    /// releases nothing or no model is loaded in-process).
+    ///
+    /// The thread only holds a weak reference and exits once every handle to
+    /// these resources is gone.
+    pub fn start_residency_monitor(&self, config: ResidencyConfig) {
+        if !config.is_enabled() || self.residency.main().is_none() {
+            return;
+        }
+        *self
+            .residency
+            .config
+            .lock()
+            .unwrap_or_else(|e| e.into_inner()) = Some(config);
+        let residency = Arc::downgrade(&self.residency);
+        let pressure_file = (config.pressure_threshold > 0.0)
+            .then(memory_pressure_file)
+            .flatten();
+        if config.pressure_threshold > 0.0 && pressure_file.is_none() {
+            warn!("Memory pressure (PSI) is unavailable; only idle time releases models");
+        }
+        let spawned = std::thread::Builder::new()
+            .name("karukan-residency".to_string())
+            .spawn(move || run_monitor(residency, config, pressure_file));
+        if let Err(e) = spawned {
+            warn!("Failed to start residency monitor: {}", e);
+        }
+    }
+}
+
+fn run_monitor(
+    residency: Weak<Residency>,
+    config: ResidencyConfig,
+    pressure_file: Option<PathBuf>,
+) {
+    loop {
+        std::thread::sleep(MONITOR_INTERVAL);
+        let Some(residency) = residency.upgrade() else {
+            return;
+        };
+        let pressure = pressure_file.as_deref().and_then(read_memory_pressure);
+        residency.check(&config, pressure);
+    }
+}
+
+/// Memory pressure file of this process's cgroup (v2), else the system-wide one
+fn memory_pressure_file() -> Option<PathBuf> {
+    let cgroup = std::fs::read_to_string("/proc/self/cgroup")
+        .ok()
+        .and_then(|cgroups| {
+            let path = cgroups.lines().find_map(|line| line.strip_prefix("0::"))?;
+            let file = Path::new("/sys/fs/cgroup")
+                .join(path.trim_start_matches('/'))
+                .join("memory.pressure");
+            file.exists().then_some(file)
+        });
+    cgroup.or_else(|| {
+        let file = PathBuf::from("/proc/pressure/memory");
+        file.exists().then_some(file)
+    })
+}
+
+fn read_memory_pressure(file: &Path) -> Option<f64> {
+    parse_memory_pressure(&std::fs::read_to_string(file).ok()?)
+}
+
+/// `avg10` of the `some` line of a PSI file
+/// (`some avg10=1.23 avg60=0.50 avg300=0.10 total=12345`)
+pub(in crate::core) fn parse_memory_pressure(psi: &str) -> Option<f64> {
+    psi.lines()
+        .find_map(|line| line.strip_prefix("some "))?
+        .split_whitespace()
+        .find_map(|field| field.strip_prefix("avg10="))?
+        .parse()
+        .ok()
+}
@@ -0,0 +1,95 @@
+//! Incremental live conversion of long inputs
+//!
+//! Once the live-conversion reading contains a clause delimiter (、。！？) that
+//! the model kept in its output, everything up to the last delimiter is frozen
+//! as the composition's stable head. Later keys only re-convert the reading
+//! after the head, with the head's converted text appended to the API context,
+//! so per-key inference cost follows the current clause instead of the whole
+//! composition.
+//!
+//! The head is dropped as soon as the reading no longer starts with it
+//! (backspace or an edit inside the head) and is replaced by a longer one when
+//! a later delimiter is reached.
+
+use super::*;
+
+/// Characters that end a clause; the model reproduces them verbatim
+const CLAUSE_DELIMITERS: &[char] = &['、', '。', '，', '．', '！', '？', '!', '?'];
+
+/// Context kept for the tail even when surrounding-text context is disabled,
+/// so the tail is still converted as a continuation of the head
+const MIN_HEAD_CONTEXT_CHARS: usize = 20;
+
+/// Number of clause delimiters in `text` and the byte offset just past the last one
+fn delimiter_split(text: &str) -> (usize, usize) {
+    text.char_indices()
+        .filter(|(_, c)| CLAUSE_DELIMITERS.contains(c))
+        .fold((0, 0), |(count, _), (i, c)| (count + 1, i + c.len_utf8()))
+}
+
+/// Split `surface` (the conversion of `reading`) after the last clause delimiter.
+///
+/// Returns None if the reading has no delimiter, or if the model dropped or
+/// added one, since the head could then not be aligned with its reading.
+pub(super) fn stable_head(reading: &str, surface: &str) -> Option<LiveHead> {
+    let (reading_count, reading_end) = delimiter_split(reading);
+    let (surface_count, surface_end) = delimiter_split(surface);
+    if reading_count == 0 || reading_count != surface_count {
+        return None;
+    }
+    Some(LiveHead {
+        reading: reading[..reading_end].to_string(),
+        surface: surface[..surface_end].to_string(),
+    })
+}
+
+impl InputMethodEngine {
+    /// Split `reading` at the stable head: the head's converted text and the
+    /// reading still to convert. None when live conversion is off or no head
+    /// matches the reading.
+    pub(super) fn live_tail(&self, reading: &str) -> Option<(String, String)> {
+        if !self.live.enabled || self.input_mode == InputMode::Katakana {
+            return None;
+        }
+        let head = self.live.head.as_ref()?;
+        let tail = reading.strip_prefix(head.reading.as_str())?;
+        Some((head.surface.clone(), tail.to_string()))
+    }
+
+    /// API context for converting the tail: the surrounding text followed by the head
+    pub(super) fn live_tail_context(&self, head_surface: &str) -> String {
+        let context = format!("{}{}", self.truncate_context_for_api(), head_surface);
+        let limit = self.config.max_api_context_len.max(MIN_HEAD_CONTEXT_CHARS);
+        let char_count = context.chars().count();
+        if char_count > limit {
+            context.chars().skip(char_count - limit).collect()
+        } else {
+            context
+        }
+    }
+
+    /// Advance the stable head after `surface` was shown as the live conversion of `reading`
+    pub(super) fn update_live_head(&mut self, reading: &str, surface: &str) {
+        if self
+            .live
+            .head
+            .as_ref()
+            .is_some_and(|head| !reading.starts_with(head.reading.as_str()))
+        {
+            self.live.head = None;
+        }
+        if let Some(head) = stable_head(reading, surface)
+            && self
+                .live
+                .head
+                .as_ref()
+                .is_none_or(|old| head.reading.len() > old.reading.len())
+        {
+            debug!(
+                "live: stable head \"{}\" -> \"{}\"",
+                head.reading, head.surface
+            );
+            self.live.head = Some(head);
+        }
+    }
+}
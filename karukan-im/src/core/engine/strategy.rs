@@ -1,23 +1,75 @@
 //! Conversion strategy determination and adaptive model selection
 
+use karukan_engine::kanji::ThroughputSnapshot;
 use tracing::debug;
 
 use crate::config::settings::StrategyMode;
 
+use super::inference_pool::Lane;
+use super::models::Models;
 use super::*;
 
-/// Pure function to determine conversion strategy from token counts, adaptive flag,
-/// and configuration.
+/// Prompt tokens besides the reading and context (input/output start markers)
+const PROMPT_OVERHEAD_TOKENS: usize = 2;
+
+/// Inputs for predicting how long a conversion will take
+#[derive(Debug, Default, Clone, Copy)]
+pub(super) struct CostModel {
+    /// Measured per-token cost of the main model (None = not measured yet)
+    pub main: Option<ThroughputSnapshot>,
+    /// Measured per-token cost of the light model (None = not measured yet)
+    pub light: Option<ThroughputSnapshot>,
+    /// Tokens of the API context (prefilled again by every beam search)
+    pub context_tokens: usize,
+}
+
+/// Predict the latency of `strategy` in milliseconds for a reading of
+/// `reading_tokens` tokens.
+///
+/// Assumes the output is as long as the reading (plus EOS) and that greedy
+/// decoding finds the context already in its KV cache. Beam search steps are
+/// estimated from the greedy decode cost times the beam width until a beam
+/// search has been measured. Returns None if a model the strategy runs has not
+/// been measured yet.
+pub(super) fn predict_latency_ms(
+    strategy: &ConversionStrategy,
+    reading_tokens: usize,
+    costs: &CostModel,
+) -> Option<f64> {
+    let prompt = (reading_tokens + PROMPT_OVERHEAD_TOKENS) as f64;
+    let steps = (reading_tokens + 1) as f64;
+    let greedy = |c: ThroughputSnapshot| c.prefill_us * prompt + c.decode_us * steps;
+    let beam = |c: ThroughputSnapshot, beam_width: usize| {
+        let step_us = c.beam_step_us.unwrap_or(c.decode_us * beam_width as f64);
+        c.prefill_us * (prompt + costs.context_tokens as f64) + step_us * steps
+    };
+    let us = match strategy {
+        ConversionStrategy::MainModelOnly => greedy(costs.main?),
+        ConversionStrategy::LightModelOnly => greedy(costs.light?),
+        ConversionStrategy::MainModelBeam { beam_width } => beam(costs.main?, *beam_width),
+        // Both lanes run at once
+        ConversionStrategy::ParallelBeam { beam_width } => {
+            greedy(costs.main?).max(beam(costs.light?, *beam_width))
+        }
+    };
+    Some(us / 1000.0)
+}
+
+/// Pure function to determine conversion strategy from token counts, measured
+/// model costs, adaptive flag, and configuration.
 ///
 /// This is separated from `InputMethodEngine` to enable unit testing without model instances.
 ///
 /// `adaptive_use_light_model` is set by the engine when the main model's last
-/// conversion exceeded `max_latency_ms`. It is reset when a new word begins.
+/// conversion exceeded `max_latency_ms`. It is reset when a new word begins, and
+/// overrides the prediction: a conversion measured over budget means the
+/// prediction underestimated it.
 pub(super) fn determine_conversion_strategy(
     reading_tokens: usize,
     num_candidates: usize,
     has_light_model: bool,
     adaptive_use_light_model: bool,
+    costs: &CostModel,
     config: &EngineConfig,
 ) -> ConversionStrategy {
     match config.strategy {
@@ -26,6 +78,7 @@ pub(super) fn determine_conversion_strategy(
             num_candidates,
             has_light_model,
             adaptive_use_light_model,
+            costs,
             config,
         ),
         StrategyMode::Light => {
@@ -47,61 +100,81 @@ pub(super) fn determine_conversion_strategy(
 }
 
 /// Adaptive strategy: dynamically switch between main and light models based on latency.
+///
+/// With `max_latency_ms` set and the models measured, picks the better-quality
+/// option (main model, parallel beam) only if its predicted latency fits the
+/// budget, and the light model otherwise. The adaptive flag (a real conversion
+/// went over budget) always selects the light model, measured or not.
 fn determine_adaptive_strategy(
     reading_tokens: usize,
     num_candidates: usize,
     has_light_model: bool,
     adaptive_use_light_model: bool,
+    costs: &CostModel,
     config: &EngineConfig,
 ) -> ConversionStrategy {
     if !has_light_model {
         return ConversionStrategy::MainModelOnly;
     }
 
+    // Whether `strategy` is predicted to finish within the budget (None = unknown)
+    let fits_budget = |strategy: &ConversionStrategy| {
+        if config.max_latency_ms == 0 {
+            return None;
+        }
+        let predicted_ms = predict_latency_ms(strategy, reading_tokens, costs)?;
+        debug!(
+            "strategy: {:?} predicted {:.1}ms for {} tokens (budget {}ms)",
+            strategy, predicted_ms, reading_tokens, config.max_latency_ms
+        );
+        Some(predicted_ms <= config.max_latency_ms as f64)
+    };
+
     if num_candidates == 1 {
-        // Auto-suggest: adapt based on measured latency
-        if adaptive_use_light_model {
-            ConversionStrategy::LightModelOnly
-        } else {
+        // Auto-suggest: adapt based on measured, then predicted latency
+        let main_fast_enough = !adaptive_use_light_model
+            && fits_budget(&ConversionStrategy::MainModelOnly) != Some(false);
+        if main_fast_enough {
             ConversionStrategy::MainModelOnly
+        } else {
+            ConversionStrategy::LightModelOnly
         }
     } else {
         // Explicit conversion (Space key)
-        if adaptive_use_light_model {
-            // Main model was too slow — use light model only
-            ConversionStrategy::LightModelOnly
-        } else if reading_tokens <= config.short_input_threshold {
+        let parallel = ConversionStrategy::ParallelBeam {
+            beam_width: num_candidates.min(config.beam_width),
+        };
+        if reading_tokens > config.short_input_threshold {
+            // Long input: proactively use light model
+            return ConversionStrategy::LightModelOnly;
+        }
+        let main_fast_enough = !adaptive_use_light_model && fits_budget(&parallel) != Some(false);
+        if main_fast_enough {
             // Short input + main model is fast enough: parallel beam search
-            ConversionStrategy::ParallelBeam {
-                beam_width: num_candidates.min(config.beam_width),
-            }
+            parallel
         } else {
-            // Long input: proactively use light model
+            // Main model too slow — use light model only
             ConversionStrategy::LightModelOnly
         }
     }
 }
 
 impl InputMethodEngine {
-    /// Determine the conversion strategy based on input token counts, adaptive latency
-    /// flag, and configuration.
+    /// Determine the conversion strategy based on input token counts, the models'
+    /// measured throughput, adaptive latency flag, and configuration.
     ///
     /// Counts tokens using the main model's tokenizer and delegates to
     /// `determine_conversion_strategy` for the actual decision logic.
     pub(super) fn determine_strategy(
         &self,
+        models: &Models,
         reading: &str,
         num_candidates: usize,
     ) -> ConversionStrategy {
-        let has_light_model = self.converters.light_kanji.is_some();
         let katakana = karukan_engine::kana::hiragana_to_katakana(reading);
 
         // Count tokens using main model's tokenizer
-        let Some(converter) = &self.converters.kanji else {
-            return ConversionStrategy::MainModelOnly;
-        };
-
-        let reading_tokens = match converter.count_input_tokens(&katakana) {
+        let reading_tokens = match models.count_input_tokens(&katakana) {
             Ok(n) => n,
             Err(e) => {
                 debug!(
@@ -112,11 +185,17 @@ impl InputMethodEngine {
             }
         };
 
+        let costs = CostModel {
+            main: models.throughput(Lane::Main),
+            light: models.throughput(Lane::Light),
+            context_tokens: self.truncate_context_for_api().chars().count(),
+        };
         determine_conversion_strategy(
             reading_tokens,
             num_candidates,
-            has_light_model,
+            models.has_light(),
             self.metrics.adaptive_use_light_model,
+            &costs,
             &self.config,
         )
     }
@@ -128,7 +207,7 @@ impl InputMethodEngine {
         if self.config.strategy != StrategyMode::Adaptive {
             return;
         }
-        if self.config.max_latency_ms == 0 || self.converters.light_kanji.is_none() {
+        if self.config.max_latency_ms == 0 || !self.resources.has_light_model() {
             return;
         }
         match strategy {
@@ -0,0 +1,461 @@
+//! Background auto-suggest (asynchronous live conversion)
+//!
+//! In async mode `process_key` only updates the hiragana preedit and submits the
+//! reading here; inference runs on a dispatcher thread shared by every engine
+//! (`SuggestDispatcher` in `SharedResources`) and the finished result is routed
+//! back to the submitting engine, which applies it later in
+//! `InputMethodEngine::apply_pending_suggestion`.
+//!
+//! Every submission supersedes the engine's previous one: queued jobs that are
+//! no longer its latest are skipped, and an in-flight greedy decode is aborted
+//! as soon as a newer job is submitted or the pending one is cancelled.
+//!
+//! A second dispatcher thread runs speculative Space conversions: once typing
+//! pauses, the beam search for the current reading is run ahead of time and
+//! stored in the shared conversion cache.
+//!
+//! When Space opens the candidate window from learning/dictionary hits alone
+//! (the fast path), the suggest dispatcher runs the model afterwards and its
+//! candidates are merged into the open window.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, OnceLock, mpsc};
+use std::time::{Duration, Instant};
+
+use karukan_engine::kanji::KanjiError;
+use tracing::{debug, warn};
+
+use super::conversion;
+use super::conversion_cache::ConversionKey;
+use super::inference_pool::{Priority, StopProbe};
+use super::*;
+
+/// Inference run on the dispatcher thread. Receives a probe that returns true once
+/// the job has been superseded.
+pub(super) type SuggestFn = Box<dyn FnOnce(&StopProbe) -> Result<Vec<String>, KanjiError> + Send>;
+
+/// How often a job waiting for typing to go idle checks whether it was superseded
+const IDLE_POLL_INTERVAL: Duration = Duration::from_millis(10);
+
+/// Callback invoked on the dispatcher thread after a result is ready
+pub type SuggestNotifier = Arc<dyn Fn() + Send + Sync>;
+
+/// What a finished job's candidates are used for
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(super) enum SuggestKind {
+    /// Live conversion / auto-suggest while composing
+    LiveConversion,
+    /// Model candidates for a conversion opened by the fast path
+    CandidateMerge,
+}
+
+/// A queued auto-suggest request
+pub(super) struct SuggestJob {
+    pub kind: SuggestKind,
+    /// Reading the job was submitted for (hiragana)
+    pub reading: String,
+    /// Strategy chosen on the input thread
+    pub strategy: ConversionStrategy,
+    /// Display name of the model that runs the job
+    pub model_name: String,
+    pub run: SuggestFn,
+}
+
+/// A finished auto-suggest result waiting to be applied
+pub(super) struct SuggestOutcome {
+    pub seq: u64,
+    pub kind: SuggestKind,
+    pub reading: String,
+    pub strategy: ConversionStrategy,
+    pub model_name: String,
+    pub candidates: Vec<String>,
+    /// Inference time in milliseconds
+    pub conversion_ms: u64,
+}
+
+/// Where an engine's finished jobs go
+struct SuggestRoute {
+    /// Sequence number of the engine's newest job (0 = nothing pending)
+    latest: AtomicU64,
+    done: Mutex<Option<SuggestOutcome>>,
+    notify: SuggestNotifier,
+}
+
+/// A submitted job and the engine it belongs to
+struct Dispatch {
+    seq: u64,
+    job: SuggestJob,
+    route: Arc<SuggestRoute>,
+}
+
+/// One dispatcher thread, spawned on first use and shared by every engine
+pub(in crate::core) struct SuggestThread {
+    name: &'static str,
+    jobs: OnceLock<Option<mpsc::Sender<Dispatch>>>,
+}
+
+impl SuggestThread {
+    const fn new(name: &'static str) -> Self {
+        Self {
+            name,
+            jobs: OnceLock::new(),
+        }
+    }
+
+    /// The thread's queue, or None if it could not be started
+    fn jobs(&self) -> Option<&mpsc::Sender<Dispatch>> {
+        self.jobs
+            .get_or_init(|| {
+                let (jobs, rx) = mpsc::channel();
+                let spawned = std::thread::Builder::new()
+                    .name(self.name.to_string())
+                    .spawn(move || run_dispatcher(&rx));
+                match spawned {
+                    Ok(_) => Some(jobs),
+                    Err(e) => {
+                        warn!("Failed to start {} thread: {}", self.name, e);
+                        None
+                    }
+                }
+            })
+            .as_ref()
+    }
+}
+
+/// Run jobs in submission order, skipping those their engine has superseded
+fn run_dispatcher(jobs: &mpsc::Receiver<Dispatch>) {
+    while let Ok(Dispatch { seq, job, route }) = jobs.recv() {
+        let probe_route = Arc::clone(&route);
+        let superseded: StopProbe =
+            Arc::new(move || probe_route.latest.load(Ordering::Acquire) != seq);
+        if superseded() {
+            continue;
+        }
+
+        let start = Instant::now();
+        let candidates = match (job.run)(&superseded) {
+            Ok(candidates) => candidates,
+            Err(KanjiError::Cancelled) => {
+                debug!("suggest: cancelled stale job for \"{}\"", job.reading);
+                continue;
+            }
+            Err(e) => {
+                debug!("suggest: inference failed: {}", e);
+                Vec::new()
+            }
+        };
+        let conversion_ms = start.elapsed().as_millis() as u64;
+        if superseded() {
+            continue;
+        }
+
+        *route.done.lock().unwrap_or_else(|e| e.into_inner()) = Some(SuggestOutcome {
+            seq,
+            kind: job.kind,
+            reading: job.reading,
+            strategy: job.strategy,
+            model_name: job.model_name,
+            candidates,
+            conversion_ms,
+        });
+        (route.notify)();
+    }
+}
+
+/// Background threads running the suggest jobs of every engine that shares
+/// the resources: one for auto-suggest and fast-path merges, one for
+/// speculative conversions (which wait for typing to pause). Thread count
+/// therefore does not grow with the number of input contexts; the inference
+/// itself is serialized on the `InferencePool` lanes anyway.
+pub(in crate::core) struct SuggestDispatcher {
+    pub live: SuggestThread,
+    pub speculative: SuggestThread,
+}
+
+impl Default for SuggestDispatcher {
+    fn default() -> Self {
+        Self {
+            live: SuggestThread::new("karukan-suggest"),
+            speculative: SuggestThread::new("karukan-speculate"),
+        }
+    }
+}
+
+/// An engine's handle on a dispatcher thread: submits its jobs and receives
+/// their results
+pub(super) struct SuggestHandle {
+    route: Arc<SuggestRoute>,
+    next_seq: u64,
+}
+
+impl SuggestHandle {
+    /// `notify` is called (on the dispatcher thread) whenever a result becomes
+    /// available through `take_finished`
+    pub fn new(notify: SuggestNotifier) -> Self {
+        Self {
+            route: Arc::new(SuggestRoute {
+                latest: AtomicU64::new(0),
+                done: Mutex::new(None),
+                notify,
+            }),
+            next_seq: 0,
+        }
+    }
+
+    /// Queue a job on `thread`, superseding this engine's pending one
+    pub fn submit(&mut self, thread: &SuggestThread, job: SuggestJob) {
+        self.next_seq += 1;
+        let seq = self.next_seq;
+        self.route.latest.store(seq, Ordering::Release);
+        let dispatch = Dispatch {
+            seq,
+            job,
+            route: Arc::clone(&self.route),
+        };
+        if thread
+            .jobs()
+            .is_none_or(|jobs| jobs.send(dispatch).is_err())
+        {
+            warn!("suggest thread is not running; dropping job");
+        }
+    }
+
+    /// Mark the pending job (if any) as stale so its result is never applied
+    pub fn cancel(&mut self) {
+        self.route.latest.store(0, Ordering::Release);
+    }
+
+    /// Take the finished result if it still belongs to the latest job
+    pub fn take_finished(&mut self) -> Option<SuggestOutcome> {
+        let outcome = self
+            .route
+            .done
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .take()?;
+        (outcome.seq == self.route.latest.load(Ordering::Acquire)).then_some(outcome)
+    }
+}
+
+impl Drop for SuggestHandle {
+    fn drop(&mut self) {
+        // Abort any in-flight decode and skip the engine's queued jobs
+        self.cancel();
+    }
+}
+
+/// Sleep for `delay`, returning false as soon as `should_stop` fires
+pub(super) fn wait_for_idle(delay: Duration, should_stop: &dyn Fn() -> bool) -> bool {
+    let deadline = Instant::now() + delay;
+    loop {
+        if should_stop() {
+            return false;
+        }
+        let remaining = deadline.saturating_duration_since(Instant::now());
+        if remaining.is_zero() {
+            return true;
+        }
+        std::thread::sleep(IDLE_POLL_INTERVAL.min(remaining));
+    }
+}
+
+impl InputMethodEngine {
+    /// Build a background job converting `reading` with the strategy for
+    /// `num_candidates`. The job waits `idle_delay` first (aborting if superseded
+    /// meanwhile), then serves the shared conversion cache or runs the model at
+    /// `priority` and stores the result there. Returns None if no model is loaded.
+    fn conversion_job(
+        &self,
+        reading: &str,
+        num_candidates: usize,
+        idle_delay: Duration,
+        priority: Priority,
+    ) -> Option<SuggestJob> {
+        let key = self.conversion_key(reading, num_candidates)?;
+        self.conversion_job_for_key(reading, key, idle_delay, priority)
+    }
+
+    /// `conversion_job` for a prebuilt cache key
+    fn conversion_job_for_key(
+        &self,
+        reading: &str,
+        key: ConversionKey,
+        idle_delay: Duration,
+        priority: Priority,
+    ) -> Option<SuggestJob> {
+        let models = self.resources.models()?;
+        let cache = Arc::clone(&self.resources.conversion_cache);
+        let pool = Arc::clone(&self.resources.inference);
+        Some(SuggestJob {
+            kind: SuggestKind::LiveConversion,
+            reading: reading.to_string(),
+            strategy: key.strategy.clone(),
+            model_name: key.model.clone(),
+            run: Box::new(move |should_stop| {
+                if !wait_for_idle(idle_delay, &**should_stop) {
+                    return Err(KanjiError::Cancelled);
+                }
+                if let Some(candidates) = cache.get(&key) {
+                    return Ok(candidates);
+                }
+                let output =
+                    conversion::convert_with_strategy(&pool, &models, &key, priority, should_stop)?;
+                // A partial result (a lane dropped or failed) is not cached
+                if output.complete {
+                    cache.insert(key, output.candidates.clone());
+                }
+                Ok(output.candidates)
+            }),
+        })
+    }
+
+    /// Queue auto-suggest inference for `reading` on the background dispatcher.
+    /// Does nothing if no model is loaded or the models are still warming up.
+    /// Live conversion behind a stable head only converts the reading after it.
+    pub(super) fn submit_auto_suggest(&mut self, reading: &str) {
+        if self.suggest.is_none() || self.resources.is_warming() || !self.ensure_kanji_converter() {
+            return;
+        }
+        // Auto-suggest asks for one candidate, so only greedy strategies apply
+        let job = match self.live_tail(reading) {
+            Some((head, tail)) => {
+                let context = self.live_tail_context(&head);
+                self.conversion_key_in_context(&tail, 1, context)
+                    .and_then(|key| {
+                        self.conversion_job_for_key(
+                            &tail,
+                            key,
+                            Duration::ZERO,
+                            Priority::Interactive,
+                        )
+                    })
+                    .map(|job| {
+                        let run = job.run;
+                        SuggestJob {
+                            reading: reading.to_string(),
+                            run: Box::new(move |should_stop| {
+                                Ok(run(should_stop)?
+                                    .into_iter()
+                                    .map(|c| format!("{}{}", head, c))
+                                    .collect())
+                            }),
+                            ..job
+                        }
+                    })
+            }
+            None => self.conversion_job(reading, 1, Duration::ZERO, Priority::Interactive),
+        };
+        let Some(job) = job else {
+            return;
+        };
+        debug!(
+            "suggest: submit reading=\"{}\" strategy={:?}",
+            reading, job.strategy
+        );
+        if let Some(handle) = &mut self.suggest {
+            handle.submit(&self.resources.suggest.live, job);
+        }
+    }
+
+    /// Run the Space conversion model for `reading` in the background after the
+    /// fast path opened the candidate window; the result is merged by
+    /// `apply_pending_suggestion`.
+    pub(super) fn submit_candidate_merge(&mut self, reading: &str) {
+        if self.suggest.is_none() || !self.ensure_kanji_converter() {
+            return;
+        }
+        let Some(job) = self.conversion_job(
+            reading,
+            self.config.num_candidates,
+            Duration::ZERO,
+            Priority::Conversion,
+        ) else {
+            return;
+        };
+        if let Some(handle) = &mut self.suggest {
+            handle.submit(
+                &self.resources.suggest.live,
+                SuggestJob {
+                    kind: SuggestKind::CandidateMerge,
+                    ..job
+                },
+            );
+        }
+    }
+
+    /// Start precomputing the Space conversion of the current reading once
+    /// typing has paused for the configured delay. The result lands in the
+    /// shared conversion cache, so `start_conversion` opens the candidate window
+    /// without waiting for beam search. Every key press cancels the job.
+    pub(super) fn submit_speculative_conversion(&mut self) {
+        let Some((_, delay)) = &self.speculate else {
+            return;
+        };
+        let delay = *delay;
+        // Space flushes a pending romaji buffer ("n" → "ん"), which would change the reading
+        if !matches!(self.state, InputState::Composing { .. })
+            || self.input_mode == InputMode::Alphabet
+            || self.input_buf.text.is_empty()
+            || !self.converters.romaji.buffer().is_empty()
+        {
+            return;
+        }
+        let reading = self.input_buf.text.clone();
+        let Some(job) = self.conversion_job(
+            &reading,
+            self.config.num_candidates,
+            delay,
+            Priority::Speculative,
+        ) else {
+            return;
+        };
+        if let Some((handle, _)) = &mut self.speculate {
+            handle.submit(&self.resources.suggest.speculative, job);
+        }
+    }
+
+    /// Drop any in-flight background suggestion or speculative conversion
+    pub(super) fn cancel_pending_suggestion(&mut self) {
+        if let Some(handle) = &mut self.suggest {
+            handle.cancel();
+        }
+        if let Some((handle, _)) = &mut self.speculate {
+            handle.cancel();
+        }
+    }
+
+    /// Apply a finished background auto-suggest result (or merge fast-path
+    /// model candidates into the open conversion).
+    ///
+    /// Returns the UI actions to perform, or None if nothing is ready or the
+    /// result no longer matches the current input (it is then discarded).
+    pub fn apply_pending_suggestion(&mut self) -> Option<EngineResult> {
+        let outcome = self.suggest.as_mut()?.take_finished()?;
+        if outcome.kind == SuggestKind::CandidateMerge {
+            self.metrics.conversion_ms = outcome.conversion_ms;
+            self.metrics.model_name = outcome.model_name;
+            self.update_adaptive_model_flag(&outcome.strategy);
+            return self.merge_model_candidates(&outcome.reading, outcome.candidates);
+        }
+        if !matches!(self.state, InputState::Composing { .. })
+            || self.input_mode == InputMode::Alphabet
+            || outcome.reading != self.input_buf.text
+        {
+            return None;
+        }
+
+        self.metrics.conversion_ms = outcome.conversion_ms;
+        self.metrics.model_name = outcome.model_name;
+        self.update_adaptive_model_flag(&outcome.strategy);
+
+        // The hiragana preedit is already showing; only a real conversion changes the UI
+        if outcome
+            .candidates
+            .first()
+            .is_none_or(|c| *c == outcome.reading)
+        {
+            return None;
+        }
+        Some(self.build_suggest_result(outcome.candidates, &outcome.reading))
+    }
+}
@@ -0,0 +1,93 @@
+use std::sync::Arc;
+
+use super::super::conversion_cache::{ConversionCache, ConversionKey};
+use super::*;
+
+// --- Conversion result cache tests ---
+
+fn key(katakana: &str) -> ConversionKey {
+    ConversionKey {
+        model: "test-model".to_string(),
+        strategy: ConversionStrategy::MainModelOnly,
+        katakana: katakana.to_string(),
+        context: String::new(),
+    }
+}
+
+fn result(text: &str) -> Vec<String> {
+    vec![text.to_string()]
+}
+
+#[test]
+fn test_cache_hit_requires_identical_request() {
+    let cache = ConversionCache::new(8);
+    cache.insert(key("アイ"), result("愛"));
+    assert_eq!(cache.get(&key("アイ")), Some(result("愛")));
+
+    let mut other_context = key("アイ");
+    other_context.context = "恋と".to_string();
+    assert_eq!(cache.get(&other_context), None);
+
+    let mut other_model = key("アイ");
+    other_model.model = "other-model".to_string();
+    assert_eq!(cache.get(&other_model), None);
+
+    let mut other_strategy = key("アイ");
+    other_strategy.strategy = ConversionStrategy::MainModelBeam { beam_width: 3 };
+    assert_eq!(cache.get(&other_strategy), None);
+}
+
+#[test]
+fn test_cache_evicts_least_recently_used() {
+    let cache = ConversionCache::new(2);
+    cache.insert(key("ア"), result("亜"));
+    cache.insert(key("イ"), result("伊"));
+    // Touch ア so イ becomes the oldest
+    assert!(cache.get(&key("ア")).is_some());
+    cache.insert(key("ウ"), result("宇"));
+
+    assert!(cache.get(&key("ア")).is_some());
+    assert!(cache.get(&key("イ")).is_none());
+    assert!(cache.get(&key("ウ")).is_some());
+
+    // Replacing an existing key does not evict anything
+    cache.insert(key("ウ"), result("羽"));
+    assert_eq!(cache.get(&key("ウ")), Some(result("羽")));
+    assert!(cache.get(&key("ア")).is_some());
+}
+
+#[test]
+fn test_cache_skips_empty_results_and_clears() {
+    let cache = ConversionCache::new(4);
+    cache.insert(key("ア"), Vec::new());
+    assert!(cache.get(&key("ア")).is_none());
+
+    cache.insert(key("ア"), result("亜"));
+    cache.clear();
+    assert!(cache.get(&key("ア")).is_none());
+
+    let disabled = ConversionCache::new(0);
+    disabled.insert(key("ア"), result("亜"));
+    assert!(disabled.get(&key("ア")).is_none());
+}
+
+#[test]
+fn test_cache_shared_between_engines() {
+    let resources = SharedResources::default();
+    let mut a = InputMethodEngine::new();
+    let mut b = InputMethodEngine::new();
+    a.attach_resources(resources.clone());
+    b.attach_resources(resources);
+    assert!(Arc::ptr_eq(
+        &a.resources.conversion_cache,
+        &b.resources.conversion_cache
+    ));
+
+    a.resources
+        .conversion_cache
+        .insert(key("アイ"), result("愛"));
+    assert_eq!(
+        b.resources.conversion_cache.get(&key("アイ")),
+        Some(result("愛"))
+    );
+}
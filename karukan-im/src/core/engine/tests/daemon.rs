@@ -0,0 +1,93 @@
+use std::os::unix::net::UnixListener;
+use std::sync::Arc;
+
+use karukan_engine::daemon::{DaemonClient, DaemonServer};
+use karukan_engine::kanji::{BatchConfig, ModelOptions};
+
+use super::super::conversion::convert_with_strategy;
+use super::super::inference_pool::{Priority, never_stop};
+use super::models::{DaemonModels, RemoteModel};
+use super::*;
+
+// --- Daemon client tests ---
+
+#[test]
+fn test_no_daemon_means_no_models() {
+    let dir = tempfile::tempdir().unwrap();
+    assert!(
+        DaemonModels::connect(&dir.path().join("missing.sock"), "jinen-v1-small-q5", None).is_err()
+    );
+
+    // Without a daemon or an in-process model there is nothing to convert with
+    let mut engine = InputMethodEngine::new();
+    engine.attach_resources(SharedResources::default());
+    assert!(engine.resources().models().is_none());
+    assert!(!engine.resources().has_light_model());
+    assert_eq!(engine.resources().model_name(), "unknown");
+}
+
+#[test]
+fn test_daemon_failing_to_load_main_model_is_not_used() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("daemon.sock");
+    let listener = UnixListener::bind(&path).unwrap();
+    let server = Arc::new(DaemonServer::new(
+        0,
+        ModelOptions::default(),
+        BatchConfig::default(),
+    ));
+    std::thread::spawn(move || server.serve(listener));
+
+    // The daemon answers but cannot load the model, so the caller falls back
+    let err = DaemonModels::connect(&path, "no-such-model", None)
+        .err()
+        .expect("main model must load");
+    assert!(format!("{:#}", err).contains("no-such-model"), "{:#}", err);
+}
+
+#[test]
+fn test_failed_conversion_is_not_cached() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("daemon.sock");
+    let listener = UnixListener::bind(&path).unwrap();
+    let server = Arc::new(DaemonServer::new(
+        0,
+        ModelOptions::default(),
+        BatchConfig::default(),
+    ));
+    std::thread::spawn(move || server.serve(listener));
+
+    // Every request for this model fails on the daemon
+    let daemon = DaemonModels {
+        client: DaemonClient::connect(&path).unwrap(),
+        main: RemoteModel {
+            id: "no-such-model".to_string(),
+            display_name: "missing".to_string(),
+        },
+        light: None,
+    };
+    let resources = SharedResources {
+        daemon: Some(Arc::new(daemon)),
+        ..SharedResources::default()
+    };
+    let mut engine = InputMethodEngine::new();
+    engine.set_lazy_model_init(false);
+    engine.attach_resources(resources.clone());
+
+    let key = engine.conversion_key("かんじ", 1).unwrap();
+    let models = resources.models().unwrap();
+    let output = convert_with_strategy(
+        &resources.inference,
+        &models,
+        &key,
+        Priority::Interactive,
+        &never_stop(),
+    )
+    .unwrap();
+    assert!(!output.complete);
+    assert!(output.candidates.is_empty());
+
+    // The engine falls back to the reading and leaves the cache empty
+    assert_eq!(engine.run_auto_suggest("かんじ", 1), ["かんじ"]);
+    assert!(resources.conversion_cache.get(&key).is_none());
+}
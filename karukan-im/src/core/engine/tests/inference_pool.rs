@@ -0,0 +1,116 @@
+use std::sync::{Arc, Mutex, mpsc};
+use std::time::Duration;
+
+use super::super::inference_pool::{InferencePool, Lane, Priority};
+use super::super::init::split_thread_budget;
+
+// --- Inference pool tests ---
+
+const TIMEOUT: Duration = Duration::from_secs(5);
+
+/// Occupy `lane` until the returned sender is dropped or signalled
+fn block_lane(pool: &InferencePool, lane: Lane) -> mpsc::Sender<()> {
+    let (started_tx, started) = mpsc::channel();
+    let (release, released) = mpsc::channel::<()>();
+    let _ = pool.submit(lane, Priority::Interactive, move || {
+        let _ = started_tx.send(());
+        let _ = released.recv_timeout(TIMEOUT);
+    });
+    started.recv_timeout(TIMEOUT).unwrap();
+    release
+}
+
+#[test]
+fn test_pool_returns_results() {
+    let pool = InferencePool::new();
+    let main = pool.submit(Lane::Main, Priority::Conversion, || 1);
+    let light = pool.submit(Lane::Light, Priority::Conversion, || 2);
+    assert_eq!(main.recv_timeout(TIMEOUT), Ok(1));
+    assert_eq!(light.recv_timeout(TIMEOUT), Ok(2));
+}
+
+#[test]
+fn test_pool_lanes_run_concurrently() {
+    let pool = InferencePool::new();
+    let release = block_lane(&pool, Lane::Main);
+    // The light lane is not held up by the busy main lane
+    let light = pool.submit(Lane::Light, Priority::Speculative, || "light");
+    assert_eq!(light.recv_timeout(TIMEOUT), Ok("light"));
+    drop(release);
+}
+
+#[test]
+fn test_pool_runs_higher_priority_first() {
+    let pool = InferencePool::new();
+    let release = block_lane(&pool, Lane::Main);
+
+    let order = Arc::new(Mutex::new(Vec::new()));
+    let mut results = Vec::new();
+    for (name, priority) in [
+        ("speculative", Priority::Speculative),
+        ("conversion", Priority::Conversion),
+        ("interactive", Priority::Interactive),
+        ("conversion2", Priority::Conversion),
+    ] {
+        let order = Arc::clone(&order);
+        results.push(pool.submit(Lane::Main, priority, move || {
+            order.lock().unwrap().push(name);
+        }));
+    }
+    release.send(()).unwrap();
+    for rx in results {
+        rx.recv_timeout(TIMEOUT).unwrap();
+    }
+    assert_eq!(
+        *order.lock().unwrap(),
+        vec!["interactive", "conversion", "conversion2", "speculative"]
+    );
+}
+
+#[test]
+fn test_pool_full_queue_drops_lowest_priority() {
+    let pool = InferencePool::new();
+    let release = block_lane(&pool, Lane::Main);
+
+    let speculative: Vec<_> = (0..8)
+        .map(|i| pool.submit(Lane::Main, Priority::Speculative, move || i))
+        .collect();
+    // Queue is full of speculative work: another one is rejected...
+    let rejected = pool.submit(Lane::Main, Priority::Speculative, || 99);
+    assert!(rejected.recv_timeout(TIMEOUT).is_err());
+    // ...but interactive work evicts the newest speculative request
+    let interactive = pool.submit(Lane::Main, Priority::Interactive, || 100);
+
+    release.send(()).unwrap();
+    assert_eq!(interactive.recv_timeout(TIMEOUT), Ok(100));
+    let completed = speculative
+        .iter()
+        .filter(|rx| rx.recv_timeout(TIMEOUT).is_ok())
+        .count();
+    assert_eq!(completed, 7);
+}
+
+#[test]
+fn test_pool_survives_panicking_task() {
+    let pool = InferencePool::new();
+    let panicked = pool.submit(Lane::Main, Priority::Interactive, || -> u32 {
+        panic!("inference failed")
+    });
+    assert!(panicked.recv_timeout(TIMEOUT).is_err());
+    let next = pool.submit(Lane::Main, Priority::Interactive, || 7);
+    assert_eq!(next.recv_timeout(TIMEOUT), Ok(7));
+}
+
+#[test]
+fn test_split_thread_budget() {
+    // Default: light model gets half of the budget
+    assert_eq!(split_thread_budget(4, 0), (2, 2));
+    assert_eq!(split_thread_budget(5, 0), (3, 2));
+    // Explicit light share, clamped so the main model keeps at least one thread
+    assert_eq!(split_thread_budget(4, 1), (3, 1));
+    assert_eq!(split_thread_budget(4, 8), (1, 3));
+    assert_eq!(split_thread_budget(1, 0), (1, 1));
+    // No budget: llama.cpp default for main, explicit light value kept
+    assert_eq!(split_thread_budget(0, 0), (0, 0));
+    assert_eq!(split_thread_budget(0, 2), (0, 2));
+}
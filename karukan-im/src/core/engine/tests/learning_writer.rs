@@ -0,0 +1,65 @@
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
+
+use karukan_engine::LearningCache;
+use karukan_engine::learning::journal_path;
+
+use super::super::learning_writer::LearningWriter;
+
+// --- Background learning writer tests ---
+
+fn spawn_writer(
+    debounce: Duration,
+) -> (
+    tempfile::TempDir,
+    std::path::PathBuf,
+    Arc<Mutex<LearningCache>>,
+    LearningWriter,
+) {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("learning.tsv");
+    let cache = Arc::new(Mutex::new(LearningCache::new(100)));
+    let writer = LearningWriter::spawn(Arc::clone(&cache), path.clone(), debounce).unwrap();
+    (dir, path, cache, writer)
+}
+
+#[test]
+fn test_request_save_does_not_block() {
+    let (_dir, path, cache, writer) = spawn_writer(Duration::from_secs(60));
+    cache.lock().unwrap().record("きょう", "今日");
+
+    // Queued behind a long debounce: nothing written yet
+    writer.request_save();
+    writer.request_save();
+    assert!(!path.exists());
+
+    // A flush writes immediately and waits for it
+    writer.flush();
+    let content = std::fs::read_to_string(&path).unwrap();
+    assert!(content.contains("きょう\t今日\t1\t"));
+    assert!(!cache.lock().unwrap().is_dirty());
+}
+
+#[test]
+fn test_later_updates_go_to_journal() {
+    let (_dir, path, cache, writer) = spawn_writer(Duration::from_millis(10));
+    cache.lock().unwrap().record("きょう", "今日");
+    writer.flush();
+
+    cache.lock().unwrap().record("あした", "明日");
+    writer.flush();
+    let journal = std::fs::read_to_string(journal_path(&path)).unwrap();
+    assert!(journal.contains("あした\t明日\t1\t"));
+    assert!(!std::fs::read_to_string(&path).unwrap().contains("明日"));
+}
+
+#[test]
+fn test_drop_writes_pending_changes() {
+    let (_dir, path, cache, writer) = spawn_writer(Duration::from_secs(60));
+    cache.lock().unwrap().record("きょう", "今日");
+    writer.request_save();
+    drop(writer);
+
+    let loaded = LearningCache::load(&path, 100).unwrap();
+    assert_eq!(loaded.entry_count(), 1);
+}
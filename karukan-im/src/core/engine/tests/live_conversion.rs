@@ -149,6 +149,79 @@ fn test_live_conversion_build_preedit() {
     assert_eq!(preedit.caret(), 2); // 漢字 = 2 chars
 }
 
+// --- Stable head (incremental live conversion) tests ---
+
+#[test]
+fn test_stable_head_splits_after_last_delimiter() {
+    let head =
+        segment::stable_head("きょうは、いいてんき。あした", "今日は、いい天気。明日").unwrap();
+    assert_eq!(head.reading, "きょうは、いいてんき。");
+    assert_eq!(head.surface, "今日は、いい天気。");
+
+    // No delimiter, or the model dropped one: nothing can be aligned
+    assert_eq!(segment::stable_head("きょうは", "今日は"), None);
+    assert_eq!(segment::stable_head("きょうは、あめ", "今日は雨"), None);
+}
+
+#[test]
+fn test_live_head_converts_only_tail() {
+    let mut engine = make_live_conversion_engine();
+    engine.build_suggest_result(vec!["今日は、いい".to_string()], "きょうは、いい");
+    assert_eq!(engine.live.text, "今日は、いい");
+
+    assert_eq!(
+        engine.live_tail("きょうは、いいてんき"),
+        Some(("今日は、".to_string(), "いいてんき".to_string()))
+    );
+    // Back at the head: nothing left to convert
+    assert_eq!(
+        engine.live_tail("きょうは、"),
+        Some(("今日は、".to_string(), String::new()))
+    );
+    // An edit inside the head invalidates it
+    assert_eq!(engine.live_tail("きょうわ、いい"), None);
+
+    // Live conversion off: always convert the whole reading
+    engine.live.enabled = false;
+    assert_eq!(engine.live_tail("きょうは、いいてんき"), None);
+}
+
+#[test]
+fn test_live_head_advances_and_resets() {
+    let mut engine = make_live_conversion_engine();
+    engine.build_suggest_result(vec!["今日は、いい".to_string()], "きょうは、いい");
+    engine.build_suggest_result(
+        vec!["今日は、いい天気。明日".to_string()],
+        "きょうは、いいてんき。あした",
+    );
+    assert_eq!(
+        engine.live.head.as_ref().map(|h| h.surface.as_str()),
+        Some("今日は、いい天気。")
+    );
+
+    // Backspace into the head drops it; the next result freezes a new one
+    engine.build_suggest_result(vec!["今日は、良い".to_string()], "きょうは、よい");
+    assert_eq!(
+        engine.live.head.as_ref().map(|h| h.reading.as_str()),
+        Some("きょうは、")
+    );
+
+    engine.reset();
+    assert_eq!(engine.live.head, None);
+}
+
+#[test]
+fn test_live_tail_context_follows_head() {
+    let mut engine = make_live_conversion_engine();
+    engine.config.max_api_context_len = 50;
+    engine.set_surrounding_context("前の文。", "");
+    assert_eq!(engine.live_tail_context("今日は、"), "前の文。今日は、");
+
+    // Without surrounding context the head is still passed to the model
+    engine.config.max_api_context_len = 0;
+    assert_eq!(engine.live_tail_context("今日は、"), "今日は、");
+}
+
 // --- Ctrl+Space full-width space tests ---
 
 #[test]
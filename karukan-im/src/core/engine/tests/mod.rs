@@ -7,13 +7,21 @@ mod alphabet;
 mod basic;
 mod candidates;
 mod conversion;
+mod conversion_cache;
 mod cursor;
+mod daemon;
+mod inference_pool;
 mod katakana;
+mod learning_writer;
 mod live_conversion;
 mod mode_toggle;
 mod passthrough;
+mod residency;
+mod shared;
 mod strategy;
+mod suggest;
 mod surrounding;
+mod user_dict;
 
 fn press(ch: char) -> KeyEvent {
     KeyEvent::press(Keysym(ch as u32))
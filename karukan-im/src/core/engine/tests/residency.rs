@@ -0,0 +1,112 @@
+use std::sync::atomic::Ordering;
+use std::time::{Duration, Instant};
+
+use super::super::residency::parse_memory_pressure;
+use super::*;
+
+/// Put the residency of `shared` into `state` as if the monitor had released it
+fn force_state(shared: &SharedResources, state: ResidencyState) {
+    *shared.residency.state.lock().unwrap() = state;
+}
+
+fn wait_resident(shared: &SharedResources) {
+    let deadline = Instant::now() + Duration::from_secs(10);
+    while shared.residency_state() != ResidencyState::Resident {
+        assert!(Instant::now() < deadline, "reload did not finish");
+        std::thread::sleep(Duration::from_millis(5));
+    }
+}
+
+#[test]
+fn test_parse_memory_pressure() {
+    let psi = "some avg10=12.50 avg60=3.00 avg300=0.75 total=123456\n\
+               full avg10=1.00 avg60=0.00 avg300=0.00 total=100\n";
+    assert_eq!(parse_memory_pressure(psi), Some(12.5));
+    assert_eq!(
+        parse_memory_pressure("some avg10=0.00 avg60=0.00 avg300=0.00 total=0"),
+        Some(0.0)
+    );
+    assert_eq!(parse_memory_pressure("full avg10=1.00"), None);
+    assert_eq!(parse_memory_pressure("some avg10=abc"), None);
+    assert_eq!(parse_memory_pressure(""), None);
+}
+
+#[test]
+fn test_residency_config_enabled() {
+    assert!(!ResidencyConfig::default().is_enabled());
+    let idle = ResidencyConfig {
+        idle_timeout: Some(Duration::from_secs(60)),
+        ..ResidencyConfig::default()
+    };
+    assert!(idle.is_enabled());
+    let pressure = ResidencyConfig {
+        pressure_threshold: 10.0,
+        ..ResidencyConfig::default()
+    };
+    assert!(pressure.is_enabled());
+}
+
+#[test]
+fn test_release_without_models_stays_resident() {
+    let shared = SharedResources::default();
+    let config = ResidencyConfig {
+        idle_timeout: Some(Duration::from_millis(1)),
+        ..ResidencyConfig::default()
+    };
+    std::thread::sleep(Duration::from_millis(5));
+    shared.residency.check(&config, None);
+    assert_eq!(shared.residency_state(), ResidencyState::Resident);
+    // Nothing to reload either
+    shared.touch_models();
+    assert!(!shared.is_warming());
+    assert_eq!(shared.last_reload(), None);
+}
+
+#[test]
+fn test_touch_after_release_reloads_in_background() {
+    let shared = SharedResources::default();
+    force_state(&shared, ResidencyState::Released);
+
+    shared.touch_models();
+    assert_ne!(shared.residency_state(), ResidencyState::Released);
+    wait_resident(&shared);
+    assert!(!shared.is_warming());
+    assert!(shared.last_reload().is_some());
+}
+
+#[test]
+fn test_reloading_is_not_released_again() {
+    let shared = SharedResources::default();
+    force_state(&shared, ResidencyState::Reloading);
+    shared.residency.release_step("test");
+    assert_eq!(shared.residency_state(), ResidencyState::Reloading);
+    // A second activation does not start another reload
+    shared.touch_models();
+    assert!(!shared.is_warming());
+}
+
+#[test]
+fn test_key_after_release_reloads_and_types_kana() {
+    let shared = SharedResources::default();
+    let mut engine = InputMethodEngine::new();
+    engine.attach_resources(shared.clone());
+    force_state(&shared, ResidencyState::LightReleased);
+
+    engine.process_key(&press('k'));
+    engine.process_key(&press('a'));
+    assert_eq!(engine.preedit().unwrap().text(), "か");
+    wait_resident(&shared);
+    assert!(!shared.warming.load(Ordering::Acquire));
+}
+
+#[test]
+fn test_activate_reloads() {
+    let shared = SharedResources::default();
+    let mut engine = InputMethodEngine::new();
+    engine.attach_resources(shared.clone());
+    force_state(&shared, ResidencyState::Released);
+
+    engine.activate();
+    wait_resident(&shared);
+    assert!(shared.last_reload().is_some());
+}
@@ -0,0 +1,74 @@
+use std::sync::{Arc, Mutex};
+
+use karukan_engine::LearningCache;
+
+use super::*;
+
+// --- SharedResources tests ---
+
+fn shared_with_learning() -> SharedResources {
+    SharedResources {
+        learning: Some(Arc::new(Mutex::new(LearningCache::new(100)))),
+        ..SharedResources::default()
+    }
+}
+
+#[test]
+fn test_attached_engines_share_learning_cache() {
+    let shared = shared_with_learning();
+    let mut a = InputMethodEngine::new();
+    let mut b = InputMethodEngine::new();
+    a.attach_resources(shared.clone());
+    b.attach_resources(shared);
+
+    // Commit "あい" in engine A
+    a.process_key(&press('a'));
+    a.process_key(&press('i'));
+    assert_eq!(a.commit(), "あい");
+
+    // Engine B sees the learning entry recorded by A
+    let candidates = b.lookup_learning_candidates("あい");
+    assert_eq!(candidates.len(), 1);
+    assert_eq!(candidates[0].text, "あい");
+}
+
+#[test]
+fn test_attach_resources_keeps_composition_state() {
+    let mut engine = InputMethodEngine::new();
+    engine.process_key(&press('k'));
+    engine.process_key(&press('a'));
+
+    engine.attach_resources(shared_with_learning());
+
+    // Composition continues where it left off
+    assert_eq!(engine.preedit().unwrap().text(), "か");
+    engine.process_key(&press('n'));
+    engine.process_key(&press('a'));
+    assert_eq!(engine.preedit().unwrap().text(), "かな");
+}
+
+#[test]
+fn test_shared_resources_model_name_unknown_without_models() {
+    assert_eq!(SharedResources::default().model_name(), "unknown");
+}
+
+#[test]
+fn test_start_warm_up_without_models_is_noop() {
+    let shared = SharedResources::default();
+    shared.start_warm_up(false);
+    assert!(!shared.is_warming());
+}
+
+#[test]
+fn test_typing_while_warming_shows_hiragana() {
+    let shared = SharedResources::default();
+    shared
+        .warming
+        .store(true, std::sync::atomic::Ordering::Release);
+    let mut engine = InputMethodEngine::new();
+    engine.attach_resources(shared);
+
+    engine.process_key(&press('k'));
+    engine.process_key(&press('a'));
+    assert_eq!(engine.preedit().unwrap().text(), "か");
+}
@@ -1,5 +1,6 @@
-use super::super::strategy::determine_conversion_strategy;
+use super::super::strategy::{CostModel, determine_conversion_strategy, predict_latency_ms};
 use super::*;
+use karukan_engine::kanji::ThroughputSnapshot;
 
 // --- ConversionStrategy tests ---
 
@@ -18,6 +19,28 @@ fn default_strategy_config() -> EngineConfig {
     strategy_config(10, 3)
 }
 
+/// Models not measured yet
+fn no_costs() -> CostModel {
+    CostModel::default()
+}
+
+/// Main model 1ms/token prefill + 5ms/token decode, light model 5x faster
+fn measured_costs() -> CostModel {
+    CostModel {
+        main: Some(ThroughputSnapshot {
+            prefill_us: 1000.0,
+            decode_us: 5000.0,
+            beam_step_us: None,
+        }),
+        light: Some(ThroughputSnapshot {
+            prefill_us: 200.0,
+            decode_us: 1000.0,
+            beam_step_us: Some(1500.0),
+        }),
+        context_tokens: 0,
+    }
+}
+
 // --- No sub model: always MainModelOnly ---
 
 #[test]
@@ -25,15 +48,15 @@ fn strategy_no_light_model_returns_main_model_only() {
     let config = default_strategy_config();
     // Without light model, always MainModelOnly regardless of other params
     assert_eq!(
-        determine_conversion_strategy(5, 1, false, false, &config),
+        determine_conversion_strategy(5, 1, false, false, &no_costs(), &config),
         ConversionStrategy::MainModelOnly,
     );
     assert_eq!(
-        determine_conversion_strategy(5, 9, false, false, &config),
+        determine_conversion_strategy(5, 9, false, false, &no_costs(), &config),
         ConversionStrategy::MainModelOnly,
     );
     assert_eq!(
-        determine_conversion_strategy(50, 9, false, true, &config),
+        determine_conversion_strategy(50, 9, false, true, &no_costs(), &config),
         ConversionStrategy::MainModelOnly,
     );
 }
@@ -45,7 +68,7 @@ fn strategy_auto_suggest_adaptive_false_returns_main_model() {
     let config = default_strategy_config();
     // adaptive=false → MainModelOnly
     assert_eq!(
-        determine_conversion_strategy(5, 1, true, false, &config),
+        determine_conversion_strategy(5, 1, true, false, &no_costs(), &config),
         ConversionStrategy::MainModelOnly,
     );
 }
@@ -55,7 +78,7 @@ fn strategy_auto_suggest_adaptive_true_returns_light_model() {
     let config = default_strategy_config();
     // adaptive=true → LightModelOnly (main model was too slow)
     assert_eq!(
-        determine_conversion_strategy(5, 1, true, true, &config),
+        determine_conversion_strategy(5, 1, true, true, &no_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
@@ -65,7 +88,7 @@ fn strategy_auto_suggest_adaptive_true_even_short_input() {
     let config = default_strategy_config();
     // Even with very short input, adaptive=true → LightModelOnly
     assert_eq!(
-        determine_conversion_strategy(1, 1, true, true, &config),
+        determine_conversion_strategy(1, 1, true, true, &no_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
@@ -77,7 +100,7 @@ fn strategy_explicit_adaptive_true_returns_light_model() {
     let config = default_strategy_config();
     // adaptive=true → LightModelOnly (main model was too slow)
     assert_eq!(
-        determine_conversion_strategy(5, 9, true, true, &config),
+        determine_conversion_strategy(5, 9, true, true, &no_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
@@ -87,7 +110,7 @@ fn strategy_explicit_short_reading_returns_parallel_beam() {
     let config = default_strategy_config();
     // adaptive=false, reading_tokens=5 <= 10 → ParallelBeam
     assert_eq!(
-        determine_conversion_strategy(5, 9, true, false, &config),
+        determine_conversion_strategy(5, 9, true, false, &no_costs(), &config),
         ConversionStrategy::ParallelBeam { beam_width: 3 },
     );
 }
@@ -97,7 +120,7 @@ fn strategy_explicit_long_reading_returns_light_model() {
     let config = default_strategy_config();
     // adaptive=false, reading_tokens=15 > 10 → LightModelOnly
     assert_eq!(
-        determine_conversion_strategy(15, 9, true, false, &config),
+        determine_conversion_strategy(15, 9, true, false, &no_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
@@ -107,12 +130,12 @@ fn strategy_explicit_reading_boundary_at_threshold() {
     let config = default_strategy_config();
     // reading_tokens == threshold → ParallelBeam (<=)
     assert_eq!(
-        determine_conversion_strategy(10, 9, true, false, &config),
+        determine_conversion_strategy(10, 9, true, false, &no_costs(), &config),
         ConversionStrategy::ParallelBeam { beam_width: 3 },
     );
     // reading_tokens == threshold + 1 → LightModelOnly
     assert_eq!(
-        determine_conversion_strategy(11, 9, true, false, &config),
+        determine_conversion_strategy(11, 9, true, false, &no_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
@@ -124,7 +147,7 @@ fn strategy_beam_width_capped_by_num_candidates() {
     let config = strategy_config(10, 5);
     // num_candidates=2 < beam_width=5 → beam_width = min(2, 5) = 2
     assert_eq!(
-        determine_conversion_strategy(5, 2, true, false, &config),
+        determine_conversion_strategy(5, 2, true, false, &no_costs(), &config),
         ConversionStrategy::ParallelBeam { beam_width: 2 },
     );
 }
@@ -134,7 +157,7 @@ fn strategy_beam_width_capped_by_beam_width() {
     let config = strategy_config(10, 3);
     // num_candidates=9 > beam_width=3 → beam_width = min(9, 3) = 3
     assert_eq!(
-        determine_conversion_strategy(5, 9, true, false, &config),
+        determine_conversion_strategy(5, 9, true, false, &no_costs(), &config),
         ConversionStrategy::ParallelBeam { beam_width: 3 },
     );
 }
@@ -146,7 +169,7 @@ fn strategy_adaptive_flag_overrides_short_input_for_explicit() {
     let config = default_strategy_config();
     // Short reading but adaptive=true → LightModelOnly (not ParallelBeam)
     assert_eq!(
-        determine_conversion_strategy(3, 9, true, true, &config),
+        determine_conversion_strategy(3, 9, true, true, &no_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
@@ -156,7 +179,100 @@ fn strategy_adaptive_false_long_reading_still_uses_light() {
     let config = default_strategy_config();
     // Long reading, adaptive=false → LightModelOnly (proactive, too long for beam)
     assert_eq!(
-        determine_conversion_strategy(20, 9, true, false, &config),
+        determine_conversion_strategy(20, 9, true, false, &no_costs(), &config),
+        ConversionStrategy::LightModelOnly,
+    );
+}
+
+// --- Predicted latency from measured throughput ---
+
+#[test]
+fn predict_latency_from_throughput() {
+    let costs = measured_costs();
+    // 5 reading tokens: 7 prompt tokens, 6 decode steps
+    let main = predict_latency_ms(&ConversionStrategy::MainModelOnly, 5, &costs).unwrap();
+    assert!((main - 37.0).abs() < 1e-9, "{}", main);
+    let light = predict_latency_ms(&ConversionStrategy::LightModelOnly, 5, &costs).unwrap();
+    assert!((light - 7.4).abs() < 1e-9, "{}", light);
+    // Parallel beam waits for the slower lane
+    let parallel = predict_latency_ms(
+        &ConversionStrategy::ParallelBeam { beam_width: 3 },
+        5,
+        &costs,
+    );
+    assert_eq!(parallel, Some(main));
+    // Beam search without a measured step cost: greedy decode x beam width
+    let beam = predict_latency_ms(
+        &ConversionStrategy::MainModelBeam { beam_width: 3 },
+        5,
+        &costs,
+    );
+    assert!((beam.unwrap() - 97.0).abs() < 1e-9);
+
+    assert_eq!(
+        predict_latency_ms(&ConversionStrategy::MainModelOnly, 5, &no_costs()),
+        None
+    );
+}
+
+#[test]
+fn strategy_auto_suggest_uses_prediction() {
+    let config = default_strategy_config();
+    // Main model predicted at 37ms: fits the 100ms budget
+    assert_eq!(
+        determine_conversion_strategy(5, 1, true, false, &measured_costs(), &config),
+        ConversionStrategy::MainModelOnly,
+    );
+    // 20 tokens predicted at 127ms: switch before running the main model at all
+    assert_eq!(
+        determine_conversion_strategy(20, 1, true, false, &measured_costs(), &config),
+        ConversionStrategy::LightModelOnly,
+    );
+}
+
+#[test]
+fn strategy_space_uses_prediction() {
+    let mut config = default_strategy_config();
+    // 10 tokens: parallel beam predicted at 67ms
+    assert_eq!(
+        determine_conversion_strategy(10, 9, true, false, &measured_costs(), &config),
+        ConversionStrategy::ParallelBeam { beam_width: 3 },
+    );
+    config.max_latency_ms = 50;
+    assert_eq!(
+        determine_conversion_strategy(10, 9, true, false, &measured_costs(), &config),
+        ConversionStrategy::LightModelOnly,
+    );
+}
+
+#[test]
+fn strategy_measured_over_budget_overrides_prediction() {
+    let config = default_strategy_config();
+    // Both predicted within the 100ms budget, but a real conversion went over
+    // it: the prediction underestimates, so fall back to the light model
+    assert_eq!(
+        determine_conversion_strategy(5, 1, true, true, &measured_costs(), &config),
+        ConversionStrategy::LightModelOnly,
+    );
+    assert_eq!(
+        determine_conversion_strategy(10, 9, true, true, &measured_costs(), &config),
+        ConversionStrategy::LightModelOnly,
+    );
+}
+
+#[test]
+fn strategy_prediction_disabled_without_budget() {
+    let config = EngineConfig {
+        max_latency_ms: 0,
+        ..default_strategy_config()
+    };
+    // No budget: the adaptive flag decides, as before the models were measured
+    assert_eq!(
+        determine_conversion_strategy(20, 1, true, false, &measured_costs(), &config),
+        ConversionStrategy::MainModelOnly,
+    );
+    assert_eq!(
+        determine_conversion_strategy(20, 1, true, true, &measured_costs(), &config),
         ConversionStrategy::LightModelOnly,
     );
 }
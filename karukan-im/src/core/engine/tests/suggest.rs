@@ -0,0 +1,340 @@
+use std::sync::atomic::Ordering;
+use std::sync::{Arc, Mutex, mpsc};
+use std::time::Duration;
+
+use karukan_engine::kanji::KanjiError;
+
+use super::super::suggest::{
+    SuggestDispatcher, SuggestHandle, SuggestJob, SuggestKind, wait_for_idle,
+};
+use super::*;
+
+// --- Async auto-suggest tests ---
+
+const TIMEOUT: Duration = Duration::from_secs(5);
+
+/// A handle whose notifications are forwarded to the returned channel
+fn new_handle() -> (SuggestHandle, mpsc::Receiver<()>) {
+    let (tx, rx) = mpsc::channel();
+    let handle = SuggestHandle::new(Arc::new(move || {
+        let _ = tx.send(());
+    }));
+    (handle, rx)
+}
+
+fn fixed_job(reading: &str, result: &str) -> SuggestJob {
+    let result = result.to_string();
+    SuggestJob {
+        kind: SuggestKind::LiveConversion,
+        reading: reading.to_string(),
+        strategy: ConversionStrategy::MainModelOnly,
+        model_name: "test-model".to_string(),
+        run: Box::new(move |_| Ok(vec![result])),
+    }
+}
+
+/// A job that keeps "decoding" until it is superseded, reporting when it starts
+fn blocking_job(reading: &str, started: mpsc::Sender<()>) -> SuggestJob {
+    SuggestJob {
+        kind: SuggestKind::LiveConversion,
+        reading: reading.to_string(),
+        strategy: ConversionStrategy::MainModelOnly,
+        model_name: "test-model".to_string(),
+        run: Box::new(move |should_stop| {
+            let _ = started.send(());
+            let deadline = std::time::Instant::now() + TIMEOUT;
+            while !should_stop() {
+                assert!(
+                    std::time::Instant::now() < deadline,
+                    "job was never cancelled"
+                );
+                std::thread::sleep(Duration::from_millis(1));
+            }
+            Err(KanjiError::Cancelled)
+        }),
+    }
+}
+
+fn make_async_engine() -> (InputMethodEngine, mpsc::Receiver<()>) {
+    let (tx, rx) = mpsc::channel();
+    let mut engine = make_live_conversion_engine();
+    engine.set_lazy_model_init(false);
+    engine.enable_async_suggest(Arc::new(move || {
+        let _ = tx.send(());
+    }));
+    (engine, rx)
+}
+
+#[test]
+fn test_worker_delivers_result_and_notifies() {
+    let dispatcher = SuggestDispatcher::default();
+    let (mut handle, notified) = new_handle();
+    handle.submit(&dispatcher.live, fixed_job("あい", "愛"));
+    notified.recv_timeout(TIMEOUT).unwrap();
+
+    let outcome = handle.take_finished().unwrap();
+    assert_eq!(outcome.reading, "あい");
+    assert_eq!(outcome.candidates, vec!["愛".to_string()]);
+    // Taken only once
+    assert!(handle.take_finished().is_none());
+}
+
+#[test]
+fn test_worker_aborts_superseded_job() {
+    let dispatcher = SuggestDispatcher::default();
+    let (mut handle, notified) = new_handle();
+    let (started_tx, started) = mpsc::channel();
+    handle.submit(&dispatcher.live, blocking_job("あ", started_tx));
+    started.recv_timeout(TIMEOUT).unwrap();
+
+    // A newer keystroke supersedes the in-flight decode
+    handle.submit(&dispatcher.live, fixed_job("あい", "愛"));
+    notified.recv_timeout(TIMEOUT).unwrap();
+    let outcome = handle.take_finished().unwrap();
+    assert_eq!(outcome.reading, "あい");
+    assert!(notified.try_recv().is_err());
+}
+
+#[test]
+fn test_worker_cancel_discards_result() {
+    let dispatcher = SuggestDispatcher::default();
+    let (mut handle, notified) = new_handle();
+    let (started_tx, started) = mpsc::channel();
+    handle.submit(&dispatcher.live, blocking_job("あ", started_tx));
+    started.recv_timeout(TIMEOUT).unwrap();
+    handle.cancel();
+
+    assert!(notified.recv_timeout(Duration::from_millis(100)).is_err());
+    assert!(handle.take_finished().is_none());
+}
+
+#[test]
+fn test_dispatcher_routes_results_to_each_engine() {
+    let dispatcher = SuggestDispatcher::default();
+    let (mut first, first_notified) = new_handle();
+    let (mut second, second_notified) = new_handle();
+    first.submit(&dispatcher.live, fixed_job("あ", "亜"));
+    second.submit(&dispatcher.live, fixed_job("い", "意"));
+    // A newer job of one engine does not supersede the other's
+    first.submit(&dispatcher.live, fixed_job("あい", "愛"));
+
+    first_notified.recv_timeout(TIMEOUT).unwrap();
+    second_notified.recv_timeout(TIMEOUT).unwrap();
+    assert_eq!(first.take_finished().unwrap().candidates, ["愛"]);
+    assert_eq!(second.take_finished().unwrap().candidates, ["意"]);
+}
+
+#[test]
+fn test_engines_sharing_resources_share_the_dispatcher() {
+    let shared = SharedResources::default();
+    let mut engines = [InputMethodEngine::new(), InputMethodEngine::new()];
+    for engine in &mut engines {
+        engine.attach_resources(shared.clone());
+        engine.enable_async_suggest(Arc::new(|| {}));
+    }
+    assert!(Arc::ptr_eq(
+        &engines[0].resources.suggest,
+        &engines[1].resources.suggest
+    ));
+}
+
+#[test]
+fn test_async_engine_without_model_echoes_hiragana() {
+    let (mut engine, _notified) = make_async_engine();
+    assert!(engine.is_async_suggest());
+
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+    assert_eq!(engine.preedit().unwrap().text(), "あい");
+    assert!(engine.live.text.is_empty());
+    assert!(engine.apply_pending_suggestion().is_none());
+}
+
+#[test]
+fn test_async_result_applied_to_live_conversion() {
+    let (mut engine, notified) = make_async_engine();
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+
+    engine
+        .suggest
+        .as_mut()
+        .unwrap()
+        .submit(&engine.resources.suggest.live, fixed_job("あい", "愛"));
+    notified.recv_timeout(TIMEOUT).unwrap();
+
+    let result = engine.apply_pending_suggestion().unwrap();
+    assert!(
+        result
+            .actions
+            .iter()
+            .any(|a| matches!(a, EngineAction::UpdatePreedit(p) if p.text() == "愛"))
+    );
+    assert_eq!(engine.live.text, "愛");
+    assert_eq!(engine.metrics.model_name, "test-model");
+}
+
+#[test]
+fn test_async_result_discarded_after_newer_key() {
+    let (mut engine, notified) = make_async_engine();
+    engine.process_key(&press('a'));
+
+    engine
+        .suggest
+        .as_mut()
+        .unwrap()
+        .submit(&engine.resources.suggest.live, fixed_job("あ", "亜"));
+    notified.recv_timeout(TIMEOUT).unwrap();
+
+    // The next key makes the finished result stale before it is applied
+    engine.process_key(&press('i'));
+    assert!(engine.apply_pending_suggestion().is_none());
+    assert!(engine.live.text.is_empty());
+    assert_eq!(engine.preedit().unwrap().text(), "あい");
+}
+
+#[test]
+fn test_async_result_discarded_for_other_reading() {
+    let (mut engine, notified) = make_async_engine();
+    engine.process_key(&press('a'));
+
+    engine
+        .suggest
+        .as_mut()
+        .unwrap()
+        .submit(&engine.resources.suggest.live, fixed_job("か", "化"));
+    notified.recv_timeout(TIMEOUT).unwrap();
+    assert!(engine.apply_pending_suggestion().is_none());
+    assert_eq!(engine.preedit().unwrap().text(), "あ");
+}
+
+// --- Speculative conversion tests ---
+
+#[test]
+fn test_wait_for_idle_elapses() {
+    let start = std::time::Instant::now();
+    assert!(wait_for_idle(Duration::from_millis(30), &|| false));
+    assert!(start.elapsed() >= Duration::from_millis(30));
+    assert!(wait_for_idle(Duration::ZERO, &|| false));
+}
+
+#[test]
+fn test_wait_for_idle_aborts_when_superseded() {
+    let start = std::time::Instant::now();
+    assert!(!wait_for_idle(TIMEOUT, &|| true));
+    assert!(start.elapsed() < TIMEOUT);
+}
+
+#[test]
+fn test_speculative_conversion_without_model() {
+    let mut engine = make_live_conversion_engine();
+    engine.set_lazy_model_init(false);
+    engine.enable_speculative_conversion(Duration::from_millis(1));
+
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+    assert_eq!(engine.preedit().unwrap().text(), "あい");
+
+    // Space still falls back to the reading
+    engine.process_key(&press_key(Keysym::SPACE));
+    assert!(matches!(engine.state(), InputState::Conversion { .. }));
+}
+
+// --- Fast path tests ---
+
+/// Async engine whose learning cache has "あい" → "愛" (score ≈ 10.7)
+fn make_fast_path_engine(min_score: f64) -> (InputMethodEngine, mpsc::Receiver<()>) {
+    let (mut engine, notified) = make_async_engine();
+    let mut cache = LearningCache::new(100);
+    cache.record("あい", "愛");
+    engine.resources.learning = Some(Arc::new(Mutex::new(cache)));
+    engine.config.fast_path_min_score = min_score;
+    (engine, notified)
+}
+
+fn candidate_texts(engine: &InputMethodEngine) -> Vec<String> {
+    engine
+        .candidates()
+        .unwrap()
+        .candidates()
+        .iter()
+        .map(|c| c.text.clone())
+        .collect()
+}
+
+#[test]
+fn test_fast_path_shows_learning_candidates() {
+    let (mut engine, _notified) = make_fast_path_engine(10.0);
+    let hits = FAST_PATH_STATS.hits.load(Ordering::Relaxed);
+
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+    engine.process_key(&press_key(Keysym::SPACE));
+
+    assert!(matches!(engine.state(), InputState::Conversion { .. }));
+    assert_eq!(candidate_texts(&engine), vec!["愛", "あい", "アイ"]);
+    assert!(FAST_PATH_STATS.hits.load(Ordering::Relaxed) > hits);
+}
+
+#[test]
+fn test_fast_path_below_threshold_uses_normal_conversion() {
+    let (mut engine, _notified) = make_fast_path_engine(50.0);
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+    engine.process_key(&press_key(Keysym::SPACE));
+
+    // Without a model the normal path only offers the reading
+    assert_eq!(candidate_texts(&engine), vec!["あい"]);
+}
+
+#[test]
+fn test_fast_path_merges_model_candidates() {
+    let (mut engine, notified) = make_fast_path_engine(10.0);
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+    engine.process_key(&press_key(Keysym::SPACE));
+
+    engine.suggest.as_mut().unwrap().submit(
+        &engine.resources.suggest.live,
+        SuggestJob {
+            kind: SuggestKind::CandidateMerge,
+            ..fixed_job("あい", "藍")
+        },
+    );
+    // Navigating the open window does not cancel the pending merge
+    engine.process_key(&press_key(Keysym::DOWN));
+    assert_eq!(engine.candidates().unwrap().selected_text(), Some("あい"));
+    notified.recv_timeout(TIMEOUT).unwrap();
+
+    let result = engine.apply_pending_suggestion().unwrap();
+    assert!(
+        result
+            .actions
+            .iter()
+            .any(|a| matches!(a, EngineAction::ShowCandidates(_)))
+    );
+    assert_eq!(candidate_texts(&engine), vec!["愛", "藍", "あい", "アイ"]);
+    // The selection stays on the candidate the user had moved to
+    assert_eq!(engine.candidates().unwrap().selected_text(), Some("あい"));
+    assert_eq!(engine.preedit().unwrap().text(), "あい");
+}
+
+#[test]
+fn test_fast_path_merge_discarded_after_cancel() {
+    let (mut engine, notified) = make_fast_path_engine(10.0);
+    engine.process_key(&press('a'));
+    engine.process_key(&press('i'));
+    engine.process_key(&press_key(Keysym::SPACE));
+
+    engine.suggest.as_mut().unwrap().submit(
+        &engine.resources.suggest.live,
+        SuggestJob {
+            kind: SuggestKind::CandidateMerge,
+            ..fixed_job("あい", "藍")
+        },
+    );
+    engine.process_key(&press_key(Keysym::ESCAPE));
+    let _ = notified.recv_timeout(Duration::from_millis(200));
+    assert!(engine.apply_pending_suggestion().is_none());
+    assert_eq!(engine.preedit().unwrap().text(), "あい");
+}
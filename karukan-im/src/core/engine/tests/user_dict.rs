@@ -0,0 +1,131 @@
+use std::path::PathBuf;
+
+use super::super::user_dict::{load_user_dictionaries, source_key};
+
+// --- User dictionary cache tests ---
+
+fn write_tsv(dir: &std::path::Path, name: &str, content: &str) -> PathBuf {
+    let path = dir.join(name);
+    std::fs::write(&path, content).unwrap();
+    path
+}
+
+fn first_surface(dict: &karukan_engine::Dictionary, reading: &str) -> String {
+    let result = dict.exact_match_search(reading).unwrap();
+    result.candidates.get(0).unwrap().surface.to_string()
+}
+
+#[test]
+fn test_user_dict_cache_built_then_reused() {
+    let dir = tempfile::tempdir().unwrap();
+    let a = write_tsv(dir.path(), "a.tsv", "きょう\t今日\t名詞\t\n");
+    let b = write_tsv(
+        dir.path(),
+        "b.tsv",
+        "きょう\t京\t名詞\t\nおおさか\t大阪\t名詞\t\n",
+    );
+    let paths = vec![a, b];
+    let cache = dir.path().join("cache").join("user_dicts.bin");
+
+    let built = load_user_dictionaries(&paths, Some(&cache)).unwrap();
+    assert!(cache.exists());
+    assert!(cache.with_extension("key").exists());
+    assert_eq!(first_surface(&built, "きょう"), "今日");
+
+    // Second load maps the compiled cache without rewriting it
+    let written = std::fs::metadata(&cache).unwrap().modified().unwrap();
+    let cached = load_user_dictionaries(&paths, Some(&cache)).unwrap();
+    assert!(cached.is_mapped());
+    assert_eq!(
+        std::fs::metadata(&cache).unwrap().modified().unwrap(),
+        written
+    );
+    assert_eq!(cached.len(), 2);
+    assert_eq!(
+        cached
+            .exact_match_search("きょう")
+            .unwrap()
+            .candidates
+            .len(),
+        2
+    );
+}
+
+fn surfaces(dict: &karukan_engine::Dictionary, reading: &str) -> Vec<String> {
+    let result = dict.exact_match_search(reading).unwrap();
+    result
+        .candidates
+        .iter()
+        .map(|c| c.surface.to_string())
+        .collect()
+}
+
+#[test]
+fn test_user_dict_cache_keeps_priority_order() {
+    let dir = tempfile::tempdir().unwrap();
+    // A KRKN dictionary with positive costs, sorted before a TSV one (score 0)
+    let json = write_tsv(
+        dir.path(),
+        "a.json",
+        r#"[{"reading": "キョウ", "candidates": [
+            {"surface": "今日", "score": 1.5},
+            {"surface": "教", "score": 2.0}
+        ]}]"#,
+    );
+    let krkn = dir.path().join("a.bin");
+    karukan_engine::Dictionary::build_from_json(&json)
+        .unwrap()
+        .save(&krkn)
+        .unwrap();
+    std::fs::remove_file(&json).unwrap();
+    let tsv = write_tsv(dir.path(), "b.tsv", "きょう\t京\t名詞\t\n");
+    let paths = vec![krkn, tsv];
+    let cache = dir.path().join("user_dicts.bin");
+
+    // Fresh merge: earlier dictionaries' candidates first
+    let merged = load_user_dictionaries(&paths, None).unwrap();
+    assert!(!merged.is_mapped());
+    let expected = ["今日", "教", "京"];
+    assert_eq!(surfaces(&merged, "きょう"), expected);
+
+    // Same order when the cache is written and when it is mapped later
+    let built = load_user_dictionaries(&paths, Some(&cache)).unwrap();
+    assert_eq!(surfaces(&built, "きょう"), expected);
+    let cached = load_user_dictionaries(&paths, Some(&cache)).unwrap();
+    assert!(cached.is_mapped());
+    assert_eq!(surfaces(&cached, "きょう"), expected);
+}
+
+#[test]
+fn test_user_dict_cache_rebuilt_when_source_changes() {
+    let dir = tempfile::tempdir().unwrap();
+    let a = write_tsv(dir.path(), "a.tsv", "きょう\t今日\t名詞\t\n");
+    let paths = vec![a.clone()];
+    let cache = dir.path().join("user_dicts.bin");
+    load_user_dictionaries(&paths, Some(&cache)).unwrap();
+    let old_key = source_key(&paths).unwrap();
+
+    write_tsv(
+        dir.path(),
+        "a.tsv",
+        "きょう\t教\t名詞\t\nきょうと\t京都\t名詞\t\n",
+    );
+    assert_ne!(source_key(&paths).unwrap(), old_key);
+    let dict = load_user_dictionaries(&paths, Some(&cache)).unwrap();
+    assert_eq!(first_surface(&dict, "きょう"), "教");
+    assert!(dict.exact_match_search("きょうと").is_some());
+
+    // Adding a file also invalidates the cache
+    let b = write_tsv(dir.path(), "b.tsv", "おおさか\t大阪\t名詞\t\n");
+    let dict = load_user_dictionaries(&[a, b], Some(&cache)).unwrap();
+    assert!(dict.exact_match_search("おおさか").is_some());
+}
+
+#[test]
+fn test_user_dict_without_cache_path() {
+    let dir = tempfile::tempdir().unwrap();
+    let a = write_tsv(dir.path(), "a.tsv", "きょう\t今日\t名詞\t\n");
+    let dict = load_user_dictionaries(&[a], None).unwrap();
+    assert!(!dict.is_mapped());
+    assert!(load_user_dictionaries(&[], None).is_none());
+}
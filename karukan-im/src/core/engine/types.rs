@@ -1,11 +1,21 @@
 //! Type definitions for the IME engine
 
-use karukan_engine::{Dictionary, KanaKanjiConverter, RomajiConverter};
+use std::sync::atomic::{AtomicBool, AtomicU64};
+use std::sync::{Arc, Mutex};
+
+use karukan_engine::kanji::ModelOptions;
+use karukan_engine::{Dictionary, LearningCache, RomajiConverter};
 
 use crate::config::settings::StrategyMode;
 
 use super::super::candidate::CandidateList;
 use super::super::preedit::Preedit;
+use super::conversion_cache::ConversionCache;
+use super::inference_pool::InferencePool;
+use super::learning_writer::LearningWriter;
+use super::models::DaemonModels;
+use super::residency::Residency;
+use super::suggest::SuggestDispatcher;
 
 /// Action to be performed by the framework/UI layer
 #[derive(Debug, Clone)]
@@ -81,6 +91,9 @@ pub struct EngineConfig {
     pub max_latency_ms: u64,
     /// Conversion strategy mode (adaptive, light, main)
     pub strategy: StrategyMode,
+    /// Learning score at which Space shows learning/user dictionary candidates
+    /// without waiting for the model (0 = disabled, needs async suggest)
+    pub fast_path_min_score: f64,
 }
 
 impl Default for EngineConfig {
@@ -93,18 +106,53 @@ impl Default for EngineConfig {
             beam_width: 3,
             max_latency_ms: 100,
             strategy: StrategyMode::default(),
+            fast_path_min_score: 0.0,
         }
     }
 }
 
-/// Converter bundle: romaji → hiragana, kana → kanji (main + light)
+/// How the llama.cpp runtime options of each loaded model are chosen
+#[derive(Debug, Clone, Copy, Default)]
+pub struct ModelRuntime {
+    /// Benchmark the model on this device instead of using `options` (see `karukan_engine::kanji::hardware`)
+    pub auto_tune: bool,
+    /// Options used when `auto_tune` is off
+    pub options: ModelOptions,
+}
+
+/// Per-engine converter state: romaji → hiragana
 pub(in crate::core) struct Converters {
     /// Romaji to hiragana converter
     pub romaji: RomajiConverter,
-    /// Kanji converter (lazy loaded)
-    pub kanji: Option<KanaKanjiConverter>,
-    /// Light model for beam search
-    pub light_kanji: Option<KanaKanjiConverter>,
+}
+
+/// Heavy resources (kana → kanji models, dictionaries, learning cache) that can be
+/// shared between engine instances.
+///
+/// Every field is reference-counted, so cloning is cheap and all clones refer to
+/// the same loaded model / dictionary / learning data. The fcitx5 addon keeps one
+/// of these per process and attaches it to every input context's engine.
+#[derive(Clone, Default)]
+pub struct SharedResources {
+    /// In-process kanji converter (lazy loaded) and light model for beam search,
+    /// released when idle (see `residency.rs`)
+    pub(in crate::core) residency: Arc<Residency>,
+    /// Models served by `karukan-daemon`, used while no model is loaded in-process
+    pub(in crate::core) daemon: Option<Arc<DaemonModels>>,
+    /// Dictionaries (system, user)
+    pub(in crate::core) dicts: Dictionaries,
+    /// Learning cache (user conversion history)
+    pub(in crate::core) learning: Option<Arc<Mutex<LearningCache>>>,
+    /// Background writer persisting `learning` (None if it has no file path)
+    pub(in crate::core) learning_writer: Option<Arc<LearningWriter>>,
+    /// Model results for recently converted readings (shared by all engines)
+    pub(in crate::core) conversion_cache: Arc<ConversionCache>,
+    /// Per-model inference threads every conversion is scheduled on
+    pub(in crate::core) inference: Arc<InferencePool>,
+    /// Threads running every engine's async suggest and speculative jobs
+    pub(in crate::core) suggest: Arc<SuggestDispatcher>,
+    /// True while the models are being warmed up (see `start_warm_up`)
+    pub(in crate::core) warming: Arc<AtomicBool>,
 }
 
 /// Input mode for the IME engine
@@ -125,19 +173,30 @@ pub(in crate::core) struct LiveConversion {
     pub enabled: bool,
     /// Converted text (non-empty when live conversion produced a result)
     pub text: String,
+    /// Frozen head of the current composition (see `segment.rs`)
+    pub head: Option<LiveHead>,
+}
+
+/// Reading prefix whose live conversion is no longer re-run
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub(in crate::core) struct LiveHead {
+    /// Hiragana reading up to and including a clause delimiter
+    pub reading: String,
+    /// Converted text of `reading`
+    pub surface: String,
 }
 
 /// Dictionary store: system, user, and future cache dictionaries
-#[derive(Default)]
+#[derive(Clone, Default)]
 pub(in crate::core) struct Dictionaries {
     /// System dictionary for yada double-array trie lookup
-    pub system: Option<Dictionary>,
+    pub system: Option<Arc<Dictionary>>,
     /// User dictionary (merged from user_dict_paths)
-    pub user: Option<Dictionary>,
+    pub user: Option<Arc<Dictionary>>,
 }
 
 /// Conversion model dispatch strategy based on input length
-#[derive(Debug, Clone, PartialEq, Eq)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
 pub(in crate::core) enum ConversionStrategy {
     /// Short input: main model greedy + light model beam search (parallel)
     ParallelBeam { beam_width: usize },
@@ -162,3 +221,27 @@ pub(in crate::core) struct ConversionMetrics {
     /// Reset when a new word begins (Empty state)
     pub adaptive_use_light_model: bool,
 }
+
+/// Process-wide counters for the Space conversion fast path
+#[derive(Debug)]
+pub struct FastPathStats {
+    /// Space conversions started with a non-empty reading
+    pub conversions: AtomicU64,
+    /// Conversions shown from learning/user dictionary before the model ran
+    pub hits: AtomicU64,
+    /// Model results merged into a fast-path candidate list afterwards
+    pub merged: AtomicU64,
+}
+
+impl FastPathStats {
+    const fn new() -> Self {
+        Self {
+            conversions: AtomicU64::new(0),
+            hits: AtomicU64::new(0),
+            merged: AtomicU64::new(0),
+        }
+    }
+}
+
+/// Fast path counters of every engine in the process
+pub static FAST_PATH_STATS: FastPathStats = FastPathStats::new();
@@ -0,0 +1,125 @@
+//! Compiled cache of the merged user dictionaries
+//!
+//! Merging `user_dicts/` means parsing every source file (often Mozc TSV) and
+//! rebuilding the trie. The merged result is saved as a KRKN binary next to a
+//! key file listing each source's path, size and mtime; as long as the key
+//! matches, later inits memory-map the cache instead of re-parsing the sources.
+
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+use karukan_engine::Dictionary;
+use tracing::debug;
+
+/// Bump when the key format or the merge semantics change
+const KEY_VERSION: &str = "karukan-user-dicts 2";
+
+/// Key file stored next to the cache (`user_dicts.bin` → `user_dicts.key`)
+fn key_path(cache: &Path) -> PathBuf {
+    cache.with_extension("key")
+}
+
+/// Describe the source files (in load order) by path, size and mtime.
+/// Returns None if any file cannot be stat'ed.
+pub(super) fn source_key(paths: &[PathBuf]) -> Option<String> {
+    let mut key = String::from(KEY_VERSION);
+    for path in paths {
+        let meta = std::fs::metadata(path).ok()?;
+        let mtime = meta.modified().ok()?.duration_since(UNIX_EPOCH).ok()?;
+        key.push_str(&format!(
+            "\n{}\t{}\t{}",
+            meta.len(),
+            mtime.as_nanos(),
+            path.display()
+        ));
+    }
+    key.push('\n');
+    Some(key)
+}
+
+/// Load the cached merged dictionary if it was built from exactly `key`
+fn load_cached(cache: &Path, key: &str) -> Option<Dictionary> {
+    let stored = std::fs::read_to_string(key_path(cache)).ok()?;
+    if stored != key {
+        debug!("User dictionary cache {:?} is stale", cache);
+        return None;
+    }
+    match Dictionary::load(cache) {
+        Ok(dict) => Some(dict),
+        Err(e) => {
+            debug!("Failed to load user dictionary cache {:?}: {}", cache, e);
+            None
+        }
+    }
+}
+
+/// Save `dict` as the cache for `key`. The dictionary is written first, so a
+/// crash in between leaves an old key that no longer matches the sources.
+fn store(cache: &Path, key: &str, dict: &Dictionary) -> std::io::Result<()> {
+    if let Some(dir) = cache.parent() {
+        std::fs::create_dir_all(dir)?;
+    }
+    dict.save(cache).map_err(std::io::Error::other)?;
+    // A unique temp file: another process may be storing the same cache
+    let key_file = key_path(cache);
+    let mut tmp = tempfile::NamedTempFile::new_in(key_file.parent().unwrap_or(Path::new(".")))?;
+    tmp.write_all(key.as_bytes())?;
+    tmp.persist(&key_file)?;
+    Ok(())
+}
+
+/// Parse every source with `Dictionary::load_auto` and merge them in order
+fn load_and_merge(paths: &[PathBuf]) -> Option<Dictionary> {
+    let mut dicts = Vec::new();
+    for path in paths {
+        match Dictionary::load_auto(path) {
+            Ok(dict) => {
+                debug!("User dictionary loaded from {:?}", path);
+                dicts.push(dict);
+            }
+            Err(e) => {
+                debug!("Failed to load user dictionary from {:?}: {}", path, e);
+            }
+        }
+    }
+
+    match Dictionary::merge(dicts) {
+        Ok(merged) => merged,
+        Err(e) => {
+            debug!("Failed to merge user dictionaries: {}", e);
+            None
+        }
+    }
+}
+
+/// Load the merged user dictionary for `paths`, going through the compiled
+/// cache at `cache` when given. The cache is rebuilt whenever a source file is
+/// added, removed or modified.
+pub(super) fn load_user_dictionaries(
+    paths: &[PathBuf],
+    cache: Option<&Path>,
+) -> Option<Dictionary> {
+    let key = source_key(paths);
+    if let (Some(cache), Some(key)) = (cache, &key)
+        && let Some(dict) = load_cached(cache, key)
+    {
+        debug!("User dictionaries loaded from cache {:?}", cache);
+        return Some(dict);
+    }
+
+    let merged = load_and_merge(paths)?;
+    if let (Some(cache), Some(key)) = (cache, &key) {
+        match store(cache, key, &merged) {
+            Ok(()) => {
+                debug!("User dictionary cache written to {:?}", cache);
+                // Serve the mapped copy so the merged entries don't stay on the heap
+                if let Ok(mapped) = Dictionary::load(cache) {
+                    return Some(mapped);
+                }
+            }
+            Err(e) => debug!("Failed to write user dictionary cache {:?}: {}", cache, e),
+        }
+    }
+    Some(merged)
+}
@@ -1,10 +1,11 @@
 #![allow(clippy::not_unsafe_ptr_arg_deref)]
 
 use std::ffi::{c_char, c_int, c_uint};
+use std::os::fd::AsRawFd;
 
 use crate::core::keycode::{KeyEvent, KeyModifiers, Keysym};
 
-use super::{KarukanEngine, ffi_mut};
+use super::{KarukanEngine, UPDATE_CONSUMED, ffi_mut, ffi_ref};
 
 /// Process a key event
 /// Returns 1 if the key was consumed, 0 if not
@@ -15,8 +16,23 @@ pub extern "C" fn karukan_engine_process_key(
     state: c_uint,
     is_release: c_int,
 ) -> c_int {
+    let flags = karukan_engine_process_key_flags(engine, keysym, state, is_release);
+    if flags & UPDATE_CONSUMED != 0 { 1 } else { 0 }
+}
+
+/// Process a key event
+/// Returns a KARUKAN_UPDATE_* mask: whether the key was consumed plus every
+/// pending UI update, so the caller needs no separate has_* queries
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_process_key_flags(
+    engine: *mut KarukanEngine,
+    keysym: c_uint,
+    state: c_uint,
+    is_release: c_int,
+) -> c_uint {
     let engine = ffi_mut!(engine, 0);
     engine.clear_flags();
+    engine.sync_shared();
 
     // Convert modifier state
     let modifiers = KeyModifiers::from_modifier_state(state);
@@ -27,7 +43,45 @@ pub extern "C" fn karukan_engine_process_key(
     engine.apply_actions(result.actions);
     engine.sync_timing();
 
-    if result.consumed { 1 } else { 0 }
+    let consumed = if result.consumed { UPDATE_CONSUMED } else { 0 };
+    engine.update_flags() | consumed
+}
+
+/// Get the pending UI updates as a KARUKAN_UPDATE_* mask (never has the
+/// consumed bit); use after karukan_engine_apply_suggestion
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_get_update_flags(engine: *const KarukanEngine) -> c_uint {
+    let engine = ffi_ref!(engine, 0);
+    engine.update_flags()
+}
+
+/// Get a file descriptor that becomes readable when a background auto-suggest
+/// result is ready (see karukan_engine_apply_suggestion)
+/// Returns -1 if async suggest is disabled
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_suggest_fd(engine: *const KarukanEngine) -> c_int {
+    let engine = ffi_ref!(engine, -1);
+    engine
+        .suggest_notify
+        .as_ref()
+        .map_or(-1, |rx| rx.as_raw_fd())
+}
+
+/// Apply a finished background auto-suggest result
+/// Call when the fd from karukan_engine_suggest_fd becomes readable
+/// Returns 1 if the preedit/candidates/aux changed (query them as after a key event), 0 otherwise
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_apply_suggestion(engine: *mut KarukanEngine) -> c_int {
+    let engine = ffi_mut!(engine, 0);
+    engine.drain_suggest_notify();
+    engine.clear_flags();
+
+    let Some(result) = engine.engine.apply_pending_suggestion() else {
+        return 0;
+    };
+    engine.apply_actions(result.actions);
+    engine.sync_timing();
+    1
 }
 
 /// Reset the engine state
@@ -88,3 +142,48 @@ pub extern "C" fn karukan_engine_set_surrounding_text(
         .engine
         .set_surrounding_context(left_context, right_context);
 }
+
+/// Set the surrounding context from a bounded window around the cursor
+/// `before`/`after` are UTF-8 byte slices (not null-terminated) ending and
+/// starting at the cursor; only the last/first
+/// karukan_engine_surrounding_window characters are used
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_set_surrounding_window(
+    engine: *mut KarukanEngine,
+    before: *const c_char,
+    before_len: c_uint,
+    after: *const c_char,
+    after_len: c_uint,
+) {
+    let engine = ffi_mut!(engine);
+    // SAFETY: each pointer is either null or points to `len` readable bytes from the caller
+    let (before, after) = unsafe { (window_str(before, before_len), window_str(after, after_len)) };
+    let (Some(before), Some(after)) = (before, after) else {
+        tracing::warn!("set_surrounding_window: invalid UTF-8");
+        // Clear context on invalid input to avoid stale data
+        engine.engine.set_surrounding_context("", "");
+        return;
+    };
+    engine.engine.set_surrounding_context(before, after);
+}
+
+/// Number of characters before/after the cursor the engine uses as context
+/// (the most worth passing to karukan_engine_set_surrounding_window)
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_surrounding_window(engine: *const KarukanEngine) -> c_uint {
+    let engine = ffi_ref!(engine, 0);
+    engine.engine.surrounding_window_len() as c_uint
+}
+
+/// View a (pointer, byte length) pair as UTF-8; null or zero length is empty
+///
+/// # Safety
+/// A non-null `ptr` must point to `len` readable bytes.
+unsafe fn window_str<'a>(ptr: *const c_char, len: c_uint) -> Option<&'a str> {
+    if ptr.is_null() || len == 0 {
+        return Some("");
+    }
+    // SAFETY: guaranteed by the caller
+    let bytes = unsafe { std::slice::from_raw_parts(ptr.cast::<u8>(), len as usize) };
+    std::str::from_utf8(bytes).ok()
+}
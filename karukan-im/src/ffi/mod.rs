@@ -3,12 +3,20 @@
 //! This module provides C-compatible functions that can be called from
 //! the fcitx5 C++ addon wrapper.
 
-use std::ffi::CString;
-use std::sync::Once;
+use std::ffi::{CString, c_char, c_int, c_uint};
+use std::hash::{DefaultHasher, Hash, Hasher};
+use std::io::{Read, Write};
+use std::os::fd::AsRawFd;
+use std::os::unix::net::UnixStream;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, Once, OnceLock, RwLock};
+use std::time::{Duration, Instant};
 
 mod input;
 mod lifecycle;
 mod query;
+mod shared;
+mod stats;
 
 #[cfg(test)]
 mod tests;
@@ -44,8 +52,13 @@ macro_rules! ffi_mut {
 pub(crate) use ffi_mut;
 pub(crate) use ffi_ref;
 
+use karukan_engine::latency::{self, Stage};
+
 use crate::config::Settings;
-use crate::core::engine::{EngineAction, EngineConfig, InputMethodEngine};
+use crate::core::candidate::CandidateList;
+use crate::core::engine::{
+    EngineAction, EngineConfig, InputMethodEngine, ResidencyConfig, SharedResources,
+};
 
 static INIT_LOGGING: Once = Once::new();
 
@@ -61,25 +74,242 @@ fn init_logging() {
     });
 }
 
+/// Bits of the KARUKAN_UPDATE_* mask returned by `karukan_engine_process_key_flags`
+/// and `karukan_engine_get_update_flags` (must match include/karukan.h)
+const UPDATE_CONSUMED: c_uint = 1 << 0;
+const UPDATE_PREEDIT: c_uint = 1 << 1;
+const UPDATE_COMMIT: c_uint = 1 << 2;
+const UPDATE_AUX: c_uint = 1 << 3;
+const UPDATE_CANDIDATES: c_uint = 1 << 4;
+const UPDATE_HIDE_CANDIDATES: c_uint = 1 << 5;
+/// `CandidateChange` of a candidates update is stored in bits 8-9
+const UPDATE_CANDIDATE_CHANGE_SHIFT: u32 = 8;
+
 /// Cached preedit text and caret position for FFI consumption.
-#[derive(Default)]
+///
+/// Updated in place: only the bytes between the common prefix and suffix of
+/// the old and new text are rewritten, and the span that changed since the UI
+/// last showed the preedit is kept as a delta (`karukan_engine_get_preedit_delta`).
 struct PreeditCache {
-    text: CString,
+    /// UTF-8 text followed by a NUL terminator
+    text: Vec<u8>,
     caret_bytes: u32,
+    /// Length of the preedit the UI is showing
+    shown_len: usize,
+    /// Bytes at the start and end unchanged since the UI showed `shown_len`
+    /// bytes (None = nothing changed)
+    unchanged: Option<(usize, usize)>,
     dirty: bool,
 }
 
-/// Cached candidate list for FFI consumption.
+impl Default for PreeditCache {
+    fn default() -> Self {
+        Self {
+            text: vec![0],
+            caret_bytes: 0,
+            shown_len: 0,
+            unchanged: None,
+            dirty: false,
+        }
+    }
+}
+
+impl PreeditCache {
+    /// Preedit bytes without the NUL terminator
+    fn as_bytes(&self) -> &[u8] {
+        &self.text[..self.text.len() - 1]
+    }
+
+    fn c_str(&self) -> *const c_char {
+        self.text.as_ptr() as *const c_char
+    }
+
+    /// Replace the cached text with `new` (caret in characters), rewriting only
+    /// the bytes that differ. Text with interior NULs is cached as empty.
+    fn update(&mut self, new: &str, caret_chars: usize) {
+        let old = self.as_bytes();
+        let mut prefix = old
+            .iter()
+            .zip(new.as_bytes())
+            .take_while(|(a, b)| a == b)
+            .count();
+        while !new.is_char_boundary(prefix) {
+            prefix -= 1;
+        }
+        let mut suffix = old[prefix..]
+            .iter()
+            .rev()
+            .zip(new.as_bytes()[prefix..].iter().rev())
+            .take_while(|(a, b)| a == b)
+            .count();
+        while !new.is_char_boundary(new.len() - suffix) {
+            suffix -= 1;
+        }
+        let inserted = &new[prefix..new.len() - suffix];
+        if inserted.contains('\0') {
+            self.update("", 0);
+            return;
+        }
+
+        let old_end = old.len() - suffix;
+        self.text.splice(prefix..old_end, inserted.bytes());
+        // Several updates in one key event: the unchanged ends only shrink
+        self.unchanged = Some(match self.unchanged {
+            Some((p, s)) => (p.min(prefix), s.min(suffix)),
+            None => (prefix, suffix),
+        });
+        self.caret_bytes = new
+            .char_indices()
+            .nth(caret_chars)
+            .map_or(new.len(), |(i, _)| i) as u32;
+        self.dirty = true;
+    }
+
+    /// The UI clears its preedit on commit; start over from an empty text
+    fn mark_cleared(&mut self) {
+        self.text.clear();
+        self.text.push(0);
+        self.caret_bytes = 0;
+        self.shown_len = 0;
+        self.unchanged = Some((0, 0));
+    }
+
+    /// The UI has taken the pending update
+    fn mark_shown(&mut self) {
+        self.shown_len = self.as_bytes().len();
+        self.unchanged = None;
+        self.dirty = false;
+    }
+
+    /// Pending change as (start, removed_len, inserted bytes) relative to the
+    /// preedit the UI is showing
+    fn delta(&self) -> (usize, usize, &[u8]) {
+        let text = self.as_bytes();
+        let Some((prefix, suffix)) = self.unchanged else {
+            return (text.len(), 0, &[]);
+        };
+        (
+            prefix,
+            self.shown_len - prefix - suffix,
+            &text[prefix..text.len() - suffix],
+        )
+    }
+}
+
+/// What changed in the candidate list since the UI last showed it.
+///
+/// Ordered by severity so several updates in one key event merge with `max`.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+enum CandidateChange {
+    /// Same page, only the cursor moved
+    Cursor = 0,
+    /// Same list, different page
+    Page = 1,
+    /// New list (or the list was hidden in between)
+    #[default]
+    Full = 2,
+}
+
+/// Cached candidate list (current page) for FFI consumption.
+///
+/// All surfaces and annotations live in one NUL-separated UTF-8 arena, so the
+/// page can be handed out as a single snapshot (`karukan_engine_get_candidate_snapshot`)
+/// and every string is also a valid C string for the per-index getters.
 #[derive(Default)]
 struct CandidateCache {
-    texts: Vec<CString>,
-    annotations: Vec<CString>,
-    count: usize,
+    arena: Vec<u8>,
+    text_offsets: Vec<u32>,
+    text_lens: Vec<u32>,
+    annotation_offsets: Vec<u32>,
+    annotation_lens: Vec<u32>,
     cursor: usize,
+    page: usize,
+    total_pages: usize,
+    total_count: usize,
+    /// Fingerprint of the whole list last shown (None while hidden)
+    list_hash: Option<u64>,
+    change: CandidateChange,
     dirty: bool,
     hide: bool,
 }
 
+impl CandidateCache {
+    /// Append `s` plus a NUL terminator to the arena, returning (offset, len).
+    fn push_str(&mut self, s: &str) -> (u32, u32) {
+        let offset = self.arena.len() as u32;
+        self.arena.extend_from_slice(s.as_bytes());
+        self.arena.push(0);
+        (offset, s.len() as u32)
+    }
+
+    /// Hash every candidate of `list` (not just the current page)
+    fn list_hash(list: &CandidateList) -> u64 {
+        let mut hasher = DefaultHasher::new();
+        list.len().hash(&mut hasher);
+        for c in list.candidates() {
+            c.text.hash(&mut hasher);
+            c.annotation.hash(&mut hasher);
+        }
+        hasher.finish()
+    }
+
+    /// Replace the cached page with the current page of `list`, recording
+    /// whether only the cursor, the page, or the whole list changed.
+    fn fill(&mut self, list: &CandidateList) {
+        let list_hash = Self::list_hash(list);
+        let change = if self.list_hash != Some(list_hash) {
+            CandidateChange::Full
+        } else if list.current_page() != self.page {
+            CandidateChange::Page
+        } else {
+            CandidateChange::Cursor
+        };
+        self.change = if self.dirty {
+            self.change.max(change)
+        } else {
+            change
+        };
+        self.list_hash = Some(list_hash);
+        self.cursor = list.page_cursor();
+        if change == CandidateChange::Cursor {
+            // Page contents are unchanged; keep the arena as is
+            return;
+        }
+
+        let page = list.page_candidates();
+        self.arena.clear();
+        self.text_offsets.clear();
+        self.text_lens.clear();
+        self.annotation_offsets.clear();
+        self.annotation_lens.clear();
+        for c in page {
+            // Interior NULs cannot cross the C boundary
+            if c.text.contains('\0') {
+                continue;
+            }
+            let (offset, len) = self.push_str(&c.text);
+            self.text_offsets.push(offset);
+            self.text_lens.push(len);
+            let ann = c.annotation.as_deref().filter(|a| !a.contains('\0'));
+            let (offset, len) = self.push_str(ann.unwrap_or(""));
+            self.annotation_offsets.push(offset);
+            self.annotation_lens.push(len);
+        }
+        self.page = list.current_page();
+        self.total_pages = list.total_pages();
+        self.total_count = list.len();
+    }
+
+    fn count(&self) -> usize {
+        self.text_offsets.len()
+    }
+
+    /// Pointer to the NUL-terminated string at `offset` in the arena.
+    fn c_str_at(&self, offset: u32) -> *const c_char {
+        self.arena[offset as usize..].as_ptr() as *const c_char
+    }
+}
+
 /// Cached commit text for FFI consumption.
 #[derive(Default)]
 struct CommitCache {
@@ -94,10 +324,172 @@ struct AuxCache {
     dirty: bool,
 }
 
+/// Opaque handle to process-wide resources (models, dictionaries, learning cache)
+/// shared by every engine created with `karukan_engine_new_with_shared`.
+pub struct KarukanShared {
+    settings: Settings,
+    resources: RwLock<SharedResources>,
+    /// Bumped every time `resources` is replaced, so engines can re-attach cheaply
+    generation: AtomicU64,
+    /// Serializes loading so concurrent init calls load only once
+    init_lock: Mutex<()>,
+    /// Result of the first completed init (unset until initialized)
+    init_status: OnceLock<c_int>,
+    /// Set once a background init thread has been spawned
+    init_started: AtomicBool,
+    /// Socket pair (read end, write end); one byte is written when init completes
+    notify: Option<(UnixStream, UnixStream)>,
+}
+
+impl KarukanShared {
+    fn new() -> Self {
+        Self::with_settings(Settings::load().unwrap_or_default())
+    }
+
+    fn with_settings(settings: Settings) -> Self {
+        let notify = UnixStream::pair()
+            .and_then(|(rx, tx)| {
+                rx.set_nonblocking(true)?;
+                Ok((rx, tx))
+            })
+            .map_err(|e| tracing::warn!("Failed to create init notify socket: {}", e))
+            .ok();
+        Self {
+            settings,
+            resources: RwLock::new(SharedResources::default()),
+            generation: AtomicU64::new(0),
+            init_lock: Mutex::new(()),
+            init_status: OnceLock::new(),
+            init_started: AtomicBool::new(false),
+            notify,
+        }
+    }
+
+    /// Load resources once; later calls return the first call's status.
+    /// Blocks while another thread is loading.
+    fn init(&self) -> c_int {
+        if let Some(&status) = self.init_status.get() {
+            return status;
+        }
+        let _guard = self.init_lock.lock().unwrap_or_else(|e| e.into_inner());
+        if let Some(&status) = self.init_status.get() {
+            return status;
+        }
+
+        let mut resources = SharedResources::default();
+        let result = match resources.init_from_settings(&self.settings) {
+            Ok(()) => 0,
+            Err(e) => {
+                tracing::error!("Karukan shared init failed: {:#}", e);
+                -1
+            }
+        };
+        if self.settings.conversion.warm_up {
+            resources.start_warm_up(self.settings.conversion.lock_model);
+        }
+        resources.start_residency_monitor(self.residency_config());
+        // Publish even on model failure: dictionaries and learning are still usable
+        self.publish(resources);
+        let _ = self.init_status.set(result);
+        self.notify_ready();
+        result
+    }
+
+    /// Start `init` on a background thread (at most once).
+    /// Returns 0 if loading started or already happened, -1 if the thread could not be spawned.
+    fn init_async(self: &Arc<Self>) -> c_int {
+        if self.init_status.get().is_some() || self.init_started.swap(true, Ordering::AcqRel) {
+            return 0;
+        }
+        let shared = Arc::clone(self);
+        match std::thread::Builder::new()
+            .name("karukan-init".to_string())
+            .spawn(move || {
+                shared.init();
+            }) {
+            Ok(_) => 0,
+            Err(e) => {
+                tracing::error!("Failed to spawn Karukan init thread: {}", e);
+                self.init_started.store(false, Ordering::Release);
+                -1
+            }
+        }
+    }
+
+    /// When idle models are released, from the conversion settings
+    fn residency_config(&self) -> ResidencyConfig {
+        let conversion = &self.settings.conversion;
+        ResidencyConfig {
+            idle_timeout: (conversion.idle_unload_secs > 0)
+                .then(|| Duration::from_secs(conversion.idle_unload_secs)),
+            pressure_threshold: conversion.memory_pressure_threshold,
+            warm_up: conversion.warm_up,
+            lock_pages: conversion.lock_model,
+        }
+    }
+
+    /// Whether init completed and the loaded models finished warming up
+    fn is_warm(&self) -> bool {
+        self.init_status.get().is_some()
+            && !self
+                .resources
+                .read()
+                .unwrap_or_else(|e| e.into_inner())
+                .is_warming()
+    }
+
+    /// File descriptor that becomes readable once init completes (-1 if unavailable).
+    fn notify_fd(&self) -> c_int {
+        self.notify.as_ref().map_or(-1, |(rx, _)| rx.as_raw_fd())
+    }
+
+    fn notify_ready(&self) {
+        if let Some((_, tx)) = &self.notify
+            && let Err(e) = (&*tx).write_all(&[1])
+        {
+            tracing::warn!("Failed to signal init completion: {}", e);
+        }
+    }
+
+    /// Replace the shared resources and notify attached engines.
+    fn publish(&self, resources: SharedResources) {
+        *self.resources.write().unwrap_or_else(|e| e.into_inner()) = resources;
+        self.generation.fetch_add(1, Ordering::Release);
+    }
+}
+
+/// Run the engine's auto-suggest in the background, waking the returned socket
+/// whenever a result is ready. Returns None (synchronous mode) on failure.
+fn enable_async_suggest(engine: &mut InputMethodEngine) -> Option<UnixStream> {
+    let (rx, tx) = match UnixStream::pair() {
+        Ok(pair) => pair,
+        Err(e) => {
+            tracing::warn!("Failed to create suggest notify socket: {}", e);
+            return None;
+        }
+    };
+    // Never block either side: wakeups coalesce and are drained before applying
+    if let Err(e) = rx.set_nonblocking(true).and(tx.set_nonblocking(true)) {
+        tracing::warn!("Failed to configure suggest notify socket: {}", e);
+        return None;
+    }
+    let notify = Arc::new(move || {
+        let _ = (&tx).write(&[1]);
+    });
+    engine.enable_async_suggest(notify);
+    Some(rx)
+}
+
 /// Opaque handle to an IME engine instance
 pub struct KarukanEngine {
     engine: InputMethodEngine,
     settings: Settings,
+    /// Shared resource handle (None for standalone engines)
+    shared: Option<Arc<KarukanShared>>,
+    /// `KarukanShared::generation` last attached to `engine`
+    shared_generation: u64,
+    /// Read end of the async suggest wakeup socket (None in synchronous mode)
+    suggest_notify: Option<UnixStream>,
     preedit: PreeditCache,
     candidates: CandidateCache,
     commit: CommitCache,
@@ -111,8 +503,21 @@ pub struct KarukanEngine {
 impl KarukanEngine {
     fn new() -> Self {
         // Load user settings from config.toml, fall back to defaults
-        let settings = Settings::load().unwrap_or_default();
+        Self::with_settings(Settings::load().unwrap_or_default())
+    }
 
+    /// Create an engine that uses the resources of `shared` (and its settings).
+    fn with_shared(shared: Arc<KarukanShared>) -> Self {
+        let mut engine = Self::with_settings(shared.settings.clone());
+        // Models are loaded by the shared handle (possibly in the background);
+        // never block a keystroke on a private lazy load.
+        engine.engine.set_lazy_model_init(false);
+        engine.shared = Some(shared);
+        engine.sync_shared();
+        engine
+    }
+
+    fn with_settings(settings: Settings) -> Self {
         let config = EngineConfig {
             num_candidates: settings.conversion.num_candidates,
             display_context_len: 10,
@@ -125,11 +530,24 @@ impl KarukanEngine {
             beam_width: settings.conversion.beam_width,
             max_latency_ms: settings.conversion.max_latency_ms,
             strategy: settings.conversion.strategy,
+            fast_path_min_score: settings.conversion.fast_path_min_score,
         };
-        let engine = InputMethodEngine::with_config(config);
+        let mut engine = InputMethodEngine::with_config(config);
+        let suggest_notify = if settings.conversion.async_suggest {
+            enable_async_suggest(&mut engine)
+        } else {
+            None
+        };
+        if settings.conversion.speculative_delay_ms > 0 {
+            let delay = Duration::from_millis(settings.conversion.speculative_delay_ms);
+            engine.enable_speculative_conversion(delay);
+        }
         Self {
             engine,
             settings,
+            shared: None,
+            shared_generation: 0,
+            suggest_notify,
             preedit: PreeditCache::default(),
             candidates: CandidateCache::default(),
             commit: CommitCache::default(),
@@ -139,8 +557,58 @@ impl KarukanEngine {
         }
     }
 
+    /// Attach the latest shared resources if they changed since the last sync.
+    /// A single atomic load when nothing changed.
+    fn sync_shared(&mut self) {
+        let Some(shared) = &self.shared else {
+            return;
+        };
+        let generation = shared.generation.load(Ordering::Acquire);
+        if generation == self.shared_generation {
+            return;
+        }
+        let resources = shared
+            .resources
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .clone();
+        self.engine.attach_resources(resources);
+        self.shared_generation = generation;
+    }
+
+    /// Discard pending wakeups on the async suggest socket.
+    fn drain_suggest_notify(&self) {
+        let Some(rx) = &self.suggest_notify else {
+            return;
+        };
+        let mut buf = [0u8; 64];
+        while matches!((&*rx).read(&mut buf), Ok(n) if n > 0) {}
+    }
+
+    /// Pending UI updates as a KARUKAN_UPDATE_* mask (without the consumed bit)
+    fn update_flags(&self) -> c_uint {
+        let mut flags = 0;
+        if self.preedit.dirty {
+            flags |= UPDATE_PREEDIT;
+        }
+        if self.commit.dirty {
+            flags |= UPDATE_COMMIT;
+        }
+        if self.aux.dirty {
+            flags |= UPDATE_AUX;
+        }
+        if self.candidates.dirty {
+            flags |= UPDATE_CANDIDATES
+                | (self.candidates.change as c_uint) << UPDATE_CANDIDATE_CHANGE_SHIFT;
+            if self.candidates.hide {
+                flags |= UPDATE_HIDE_CANDIDATES;
+            }
+        }
+        flags
+    }
+
     fn clear_flags(&mut self) {
-        self.preedit.dirty = false;
+        self.preedit.mark_shown();
         self.candidates.dirty = false;
         self.candidates.hide = false;
         self.commit.dirty = false;
@@ -155,43 +623,25 @@ impl KarukanEngine {
 
     /// Process engine actions and cache results for FFI consumption.
     fn apply_actions(&mut self, actions: Vec<EngineAction>) {
+        let start = Instant::now();
         for action in actions {
             match action {
                 EngineAction::UpdatePreedit(preedit) => {
-                    let caret_chars = preedit.caret();
-                    let caret_bytes = preedit
-                        .text()
-                        .char_indices()
-                        .nth(caret_chars)
-                        .map(|(i, _)| i)
-                        .unwrap_or(preedit.text().len());
-                    self.preedit.caret_bytes = caret_bytes as u32;
-                    self.preedit.text = CString::new(preedit.text()).unwrap_or_default();
-                    self.preedit.dirty = true;
+                    self.preedit.update(preedit.text(), preedit.caret());
                 }
                 EngineAction::ShowCandidates(candidates) => {
-                    let page = candidates.page_candidates();
-                    self.candidates.texts = page
-                        .iter()
-                        .filter_map(|c| CString::new(c.text.as_str()).ok())
-                        .collect();
-                    self.candidates.annotations = page
-                        .iter()
-                        .map(|c| {
-                            let ann = c.annotation.as_deref().unwrap_or("");
-                            CString::new(ann).unwrap_or_default()
-                        })
-                        .collect();
-                    self.candidates.count = self.candidates.texts.len();
-                    self.candidates.cursor = candidates.page_cursor();
+                    self.candidates.fill(&candidates);
                     self.candidates.dirty = true;
                     self.candidates.hide = false;
                 }
                 EngineAction::HideCandidates => {
+                    self.candidates.list_hash = None;
                     self.candidates.hide = true;
                     self.candidates.dirty = true;
                 }
                 EngineAction::Commit(text) => {
+                    // The UI drops its preedit when it commits
+                    self.preedit.mark_cleared();
                     self.commit.text = CString::new(text).unwrap_or_default();
                     self.commit.dirty = true;
                 }
@@ -205,5 +655,6 @@ impl KarukanEngine {
                 }
             }
         }
+        latency::record(Stage::CacheFill, start.elapsed());
     }
 }
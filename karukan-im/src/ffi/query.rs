@@ -3,7 +3,7 @@
 use std::ffi::{CString, c_char, c_int, c_uint};
 use std::ptr;
 
-use super::{KarukanEngine, ffi_mut, ffi_ref};
+use super::{CandidateChange, KarukanEngine, ffi_mut, ffi_ref};
 
 /// Check if there's a preedit update pending
 #[unsafe(no_mangle)]
@@ -17,14 +17,14 @@ pub extern "C" fn karukan_engine_has_preedit(engine: *const KarukanEngine) -> c_
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_get_preedit(engine: *const KarukanEngine) -> *const c_char {
     let engine = ffi_ref!(engine, ptr::null());
-    engine.preedit.text.as_ptr()
+    engine.preedit.c_str()
 }
 
 /// Get the preedit length in bytes
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_get_preedit_len(engine: *const KarukanEngine) -> c_uint {
     let engine = ffi_ref!(engine, 0);
-    engine.preedit.text.as_bytes().len() as c_uint
+    engine.preedit.as_bytes().len() as c_uint
 }
 
 /// Get the preedit caret position in bytes
@@ -34,6 +34,47 @@ pub extern "C" fn karukan_engine_get_preedit_caret(engine: *const KarukanEngine)
     engine.preedit.caret_bytes as c_uint
 }
 
+/// Pending preedit change, filled by `karukan_engine_get_preedit_delta`.
+///
+/// Replacing `removed_len` bytes at `start` of the preedit the UI is showing
+/// with the `inserted_len` bytes at `inserted` gives the new preedit. A commit
+/// counts as clearing the shown preedit. `inserted` is not NUL-terminated and
+/// stays valid until the next call that mutates the engine.
+#[repr(C)]
+pub struct KarukanPreeditDelta {
+    /// Byte offset of the change
+    pub start: c_uint,
+    /// Bytes removed at `start`
+    pub removed_len: c_uint,
+    pub inserted: *const c_char,
+    pub inserted_len: c_uint,
+    /// Caret position in the new preedit (bytes)
+    pub caret: c_uint,
+}
+
+/// Fill `out` with the pending preedit change
+/// Returns 1 if a preedit update is pending, 0 otherwise (or if either pointer is null)
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_get_preedit_delta(
+    engine: *const KarukanEngine,
+    out: *mut KarukanPreeditDelta,
+) -> c_int {
+    let engine = ffi_ref!(engine, 0);
+    let out = ffi_mut!(out, 0);
+    if !engine.preedit.dirty {
+        return 0;
+    }
+    let (start, removed_len, inserted) = engine.preedit.delta();
+    *out = KarukanPreeditDelta {
+        start: start as c_uint,
+        removed_len: removed_len as c_uint,
+        inserted: inserted.as_ptr() as *const c_char,
+        inserted_len: inserted.len() as c_uint,
+        caret: engine.preedit.caret_bytes as c_uint,
+    };
+    1
+}
+
 /// Check if there's a commit pending
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_has_commit(engine: *const KarukanEngine) -> c_int {
@@ -69,11 +110,19 @@ pub extern "C" fn karukan_engine_should_hide_candidates(engine: *const KarukanEn
     if engine.candidates.hide { 1 } else { 0 }
 }
 
+/// Get what changed in the pending candidates update
+/// Returns 0 (cursor only), 1 (page changed) or 2 (new list)
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_get_candidate_change(engine: *const KarukanEngine) -> c_int {
+    let engine = ffi_ref!(engine, CandidateChange::Full as c_int);
+    engine.candidates.change as c_int
+}
+
 /// Get the number of candidates
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_get_candidate_count(engine: *const KarukanEngine) -> c_uint {
     let engine = ffi_ref!(engine, 0);
-    engine.candidates.count as c_uint
+    engine.candidates.count() as c_uint
 }
 
 /// Get a candidate by index
@@ -86,9 +135,9 @@ pub extern "C" fn karukan_engine_get_candidate(
     let engine = ffi_ref!(engine, ptr::null());
     engine
         .candidates
-        .texts
+        .text_offsets
         .get(index as usize)
-        .map(|c| c.as_ptr())
+        .map(|&offset| engine.candidates.c_str_at(offset))
         .unwrap_or(ptr::null())
 }
 
@@ -102,12 +151,64 @@ pub extern "C" fn karukan_engine_get_candidate_annotation(
     let engine = ffi_ref!(engine, ptr::null());
     engine
         .candidates
-        .annotations
+        .annotation_offsets
         .get(index as usize)
-        .map(|c| c.as_ptr())
+        .map(|&offset| engine.candidates.c_str_at(offset))
         .unwrap_or(ptr::null())
 }
 
+/// Borrowed view of the current candidate page, filled by
+/// `karukan_engine_get_candidate_snapshot`.
+///
+/// String `i` is `arena[text_offsets[i]..text_offsets[i] + text_lens[i]]` (UTF-8,
+/// followed by a NUL); annotations use the same layout. All pointers stay valid
+/// until the next call that mutates the engine.
+#[repr(C)]
+pub struct KarukanCandidateSnapshot {
+    /// Number of candidates on the current page
+    pub count: c_uint,
+    /// Cursor position within the page
+    pub cursor: c_uint,
+    /// Current page (0-indexed)
+    pub page: c_uint,
+    /// Total number of pages
+    pub total_pages: c_uint,
+    /// Total number of candidates across all pages
+    pub total_count: c_uint,
+    pub arena: *const c_char,
+    pub arena_len: c_uint,
+    pub text_offsets: *const c_uint,
+    pub text_lens: *const c_uint,
+    pub annotation_offsets: *const c_uint,
+    pub annotation_lens: *const c_uint,
+}
+
+/// Fill `out` with a snapshot of the current candidate page in one call
+/// Returns 1 on success, 0 if either pointer is null
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_get_candidate_snapshot(
+    engine: *const KarukanEngine,
+    out: *mut KarukanCandidateSnapshot,
+) -> c_int {
+    let engine = ffi_ref!(engine, 0);
+    let out = ffi_mut!(out, 0);
+    let cache = &engine.candidates;
+    *out = KarukanCandidateSnapshot {
+        count: cache.count() as c_uint,
+        cursor: cache.cursor as c_uint,
+        page: cache.page as c_uint,
+        total_pages: cache.total_pages as c_uint,
+        total_count: cache.total_count as c_uint,
+        arena: cache.arena.as_ptr() as *const c_char,
+        arena_len: cache.arena.len() as c_uint,
+        text_offsets: cache.text_offsets.as_ptr(),
+        text_lens: cache.text_lens.as_ptr(),
+        annotation_offsets: cache.annotation_offsets.as_ptr(),
+        annotation_lens: cache.annotation_lens.as_ptr(),
+    };
+    1
+}
+
 /// Get the current candidate cursor position
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_get_candidate_cursor(engine: *const KarukanEngine) -> c_uint {
@@ -152,6 +253,7 @@ pub extern "C" fn karukan_engine_get_last_process_key_ms(engine: *const KarukanE
 
 /// Save the learning cache to disk if there are unsaved changes.
 /// Called on deactivate (IME switch / window switch) for periodic persistence.
+/// Returns immediately; the write is done by the background learning writer.
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_save_learning(engine: *mut KarukanEngine) {
     let engine = ffi_mut!(engine);
@@ -176,12 +278,14 @@ pub extern "C" fn karukan_engine_is_empty(engine: *const KarukanEngine) -> c_int
 #[unsafe(no_mangle)]
 pub extern "C" fn karukan_engine_commit(engine: *mut KarukanEngine) -> c_int {
     let engine = ffi_mut!(engine, 0);
+    engine.sync_shared();
     let text = engine.engine.commit();
 
     if text.is_empty() {
         return 0;
     }
 
+    engine.preedit.mark_cleared();
     engine.commit.text = CString::new(text).unwrap_or_default();
     engine.commit.dirty = true;
     1
@@ -0,0 +1,134 @@
+#![allow(clippy::not_unsafe_ptr_arg_deref)]
+
+use std::ffi::c_int;
+use std::sync::Arc;
+
+use super::{KarukanEngine, KarukanShared, ffi_ref, init_logging};
+
+/// Create a shared resource handle (models, dictionaries, learning cache)
+/// Returns a pointer to the handle; nothing is loaded until karukan_shared_init
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_new() -> *mut KarukanShared {
+    init_logging();
+    Arc::into_raw(Arc::new(KarukanShared::new())) as *mut KarukanShared
+}
+
+/// Take an additional strong reference to a handle created by karukan_shared_new
+///
+/// # Safety
+/// `shared` must be non-null and come from `karukan_shared_new`.
+unsafe fn clone_shared(shared: *mut KarukanShared) -> Arc<KarukanShared> {
+    // SAFETY: Guaranteed by the caller; the extra strong count keeps the
+    // caller's reference valid.
+    unsafe {
+        Arc::increment_strong_count(shared as *const KarukanShared);
+        Arc::from_raw(shared as *const KarukanShared)
+    }
+}
+
+/// Load the shared resources (once per handle; later calls return the first result)
+/// Blocks until loading finishes, including a load started by karukan_shared_init_async
+/// Returns 0 on success, -1 on failure
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_init(shared: *mut KarukanShared) -> c_int {
+    let shared = ffi_ref!(shared, -1);
+    shared.init()
+}
+
+/// Start loading the shared resources on a background thread
+/// Engines keep working (romaji-to-kana only) and switch to kanji conversion
+/// on their next key once loading completes
+/// Returns 0 if loading started (or already happened), -1 on failure
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_init_async(shared: *mut KarukanShared) -> c_int {
+    if shared.is_null() {
+        return -1;
+    }
+    // SAFETY: Pointer is non-null (checked above) and was created by karukan_shared_new
+    let shared = unsafe { clone_shared(shared) };
+    shared.init_async()
+}
+
+/// Get a file descriptor that becomes readable when initialization completes
+/// The descriptor is owned by the handle; do not close or read from it
+/// Returns -1 if unavailable
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_notify_fd(shared: *const KarukanShared) -> c_int {
+    let shared = ffi_ref!(shared, -1);
+    shared.notify_fd()
+}
+
+/// Check whether karukan_shared_init has completed
+/// Returns 1 if initialized (successfully or not), 0 otherwise
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_is_initialized(shared: *const KarukanShared) -> c_int {
+    let shared = ffi_ref!(shared, 0);
+    if shared.init_status.get().is_some() {
+        1
+    } else {
+        0
+    }
+}
+
+/// Check whether the models are ready for live conversion
+/// Returns 1 once karukan_shared_init has completed and the background model
+/// warm-up (conversion.warm_up) has finished, 0 otherwise
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_is_warm(shared: *const KarukanShared) -> c_int {
+    let shared = ffi_ref!(shared, 0);
+    if shared.is_warm() { 1 } else { 0 }
+}
+
+/// Get where the shared in-process models are in the idle release cycle
+/// Returns a KARUKAN_RESIDENCY_* value, or -1 if `shared` is null
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_residency(shared: *const KarukanShared) -> c_int {
+    let shared = ffi_ref!(shared, -1);
+    shared
+        .resources
+        .read()
+        .unwrap_or_else(|e| e.into_inner())
+        .residency_state() as c_int
+}
+
+/// Get how long the last reload after an idle release took, in milliseconds
+/// Returns 0 if no reload has completed yet
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_reload_ms(shared: *const KarukanShared) -> u64 {
+    let shared = ffi_ref!(shared, 0);
+    shared
+        .resources
+        .read()
+        .unwrap_or_else(|e| e.into_inner())
+        .last_reload()
+        .map_or(0, |d| d.as_millis() as u64)
+}
+
+/// Release the caller's reference to a shared resource handle
+/// Engines created from the handle keep it alive until they are freed
+/// Pending learning cache changes are written before this returns
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_shared_free(shared: *mut KarukanShared) {
+    if !shared.is_null() {
+        // SAFETY: Pointer is non-null (checked above) and was created by Arc::into_raw in karukan_shared_new
+        let shared = unsafe { Arc::from_raw(shared as *const KarukanShared) };
+        shared
+            .resources
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .flush_learning();
+    }
+}
+
+/// Create a new engine instance that uses the resources of a shared handle
+/// Returns a pointer to the engine, or null if `shared` is null
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_engine_new_with_shared(shared: *mut KarukanShared) -> *mut KarukanEngine {
+    if shared.is_null() {
+        return std::ptr::null_mut();
+    }
+    init_logging();
+    // SAFETY: Pointer is non-null (checked above) and was created by karukan_shared_new
+    let shared = unsafe { clone_shared(shared) };
+    Box::into_raw(Box::new(KarukanEngine::with_shared(shared)))
+}
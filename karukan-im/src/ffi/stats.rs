@@ -0,0 +1,204 @@
+#![allow(clippy::not_unsafe_ptr_arg_deref)]
+
+use std::ffi::{CStr, c_char, c_int, c_uint};
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::Ordering;
+use std::sync::{OnceLock, mpsc};
+
+use karukan_engine::latency::{self, Stage};
+use tracing::{debug, warn};
+
+use crate::config::Settings;
+use crate::core::engine::FAST_PATH_STATS;
+
+/// Latency summary of one stage, in microseconds
+#[repr(C)]
+#[derive(Debug, Default)]
+pub struct KarukanLatencySummary {
+    pub count: u64,
+    pub mean_us: u64,
+    pub p50_us: u64,
+    pub p90_us: u64,
+    pub p99_us: u64,
+    pub max_us: u64,
+}
+
+/// Space conversion fast path counters
+#[repr(C)]
+#[derive(Debug, Default)]
+pub struct KarukanFastPathStats {
+    pub conversions: u64,
+    pub hits: u64,
+    pub merged: u64,
+}
+
+/// Get the number of latency stages (valid stage ids are 0..count)
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_latency_stage_count() -> c_uint {
+    Stage::COUNT as c_uint
+}
+
+/// Record a frontend-side measurement (e.g. KARUKAN_STAGE_UPDATE_UI)
+/// Unknown stage ids are ignored
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_latency_record(stage: c_uint, us: u64) {
+    if let Some(stage) = Stage::from_index(stage as usize) {
+        latency::record_us(stage, us);
+    }
+}
+
+/// Get the summary of a stage since the last reset
+/// Returns 0 on success, -1 for an unknown stage or null `out`
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_latency_get(stage: c_uint, out: *mut KarukanLatencySummary) -> c_int {
+    let Some(stage) = Stage::from_index(stage as usize) else {
+        return -1;
+    };
+    if out.is_null() {
+        return -1;
+    }
+    let s = latency::summary(stage);
+    // SAFETY: Pointer is non-null (checked above); the caller provides writable storage
+    unsafe {
+        *out = KarukanLatencySummary {
+            count: s.count,
+            mean_us: s.mean_us,
+            p50_us: s.p50_us,
+            p90_us: s.p90_us,
+            p99_us: s.p99_us,
+            max_us: s.max_us,
+        };
+    }
+    0
+}
+
+/// Get the Space conversion fast path counters since the last reset
+/// Returns 0 on success, -1 for null `out`
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_fast_path_get(out: *mut KarukanFastPathStats) -> c_int {
+    if out.is_null() {
+        return -1;
+    }
+    // SAFETY: Pointer is non-null (checked above); the caller provides writable storage
+    unsafe {
+        *out = KarukanFastPathStats {
+            conversions: FAST_PATH_STATS.conversions.load(Ordering::Relaxed),
+            hits: FAST_PATH_STATS.hits.load(Ordering::Relaxed),
+            merged: FAST_PATH_STATS.merged.load(Ordering::Relaxed),
+        };
+    }
+    0
+}
+
+/// Clear all latency histograms and fast path counters
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_latency_reset() {
+    latency::reset();
+    FAST_PATH_STATS.conversions.store(0, Ordering::Relaxed);
+    FAST_PATH_STATS.hits.store(0, Ordering::Relaxed);
+    FAST_PATH_STATS.merged.store(0, Ordering::Relaxed);
+}
+
+/// Latency table followed by the fast path counters
+fn report() -> String {
+    format!(
+        "{}fast_path conversions={} hits={} merged={}\n",
+        latency::report(),
+        FAST_PATH_STATS.conversions.load(Ordering::Relaxed),
+        FAST_PATH_STATS.hits.load(Ordering::Relaxed),
+        FAST_PATH_STATS.merged.load(Ordering::Relaxed),
+    )
+}
+
+/// Resolve the C path argument (NULL = `Settings::latency_report_file`)
+fn report_path(path: *const c_char) -> Option<PathBuf> {
+    if path.is_null() {
+        Settings::latency_report_file()
+    } else {
+        // SAFETY: Pointer is non-null (checked above); the caller passes a NUL-terminated string
+        let path = unsafe { CStr::from_ptr(path) };
+        path.to_str().ok().map(PathBuf::from)
+    }
+}
+
+/// Write the current report to `path` through a temp file, so readers (and an
+/// exit mid-write) never see a truncated report
+fn write_report(path: &Path) -> c_int {
+    let dir = match path.parent() {
+        Some(dir) if !dir.as_os_str().is_empty() => dir,
+        _ => Path::new("."),
+    };
+    let _ = std::fs::create_dir_all(dir);
+    let written = tempfile::NamedTempFile::new_in(dir).and_then(|mut tmp| {
+        tmp.write_all(report().as_bytes())?;
+        tmp.persist(path)?;
+        Ok(())
+    });
+    match written {
+        Ok(()) => {
+            debug!("Latency report written to {:?}", path);
+            0
+        }
+        Err(e) => {
+            debug!("Failed to write latency report {:?}: {}", path, e);
+            -1
+        }
+    }
+}
+
+/// Queue of the report writer thread, started on first use (None if it could
+/// not be spawned)
+fn report_queue() -> Option<&'static mpsc::Sender<PathBuf>> {
+    static QUEUE: OnceLock<Option<mpsc::Sender<PathBuf>>> = OnceLock::new();
+    QUEUE
+        .get_or_init(|| {
+            let (queue, rx) = mpsc::channel::<PathBuf>();
+            std::thread::Builder::new()
+                .name("karukan-latency-report".to_string())
+                .spawn(move || {
+                    while let Ok(path) = rx.recv() {
+                        // The report is cumulative: requests queued meanwhile
+                        // for the same path are covered by one write
+                        let mut paths = vec![path];
+                        for path in rx.try_iter() {
+                            if !paths.contains(&path) {
+                                paths.push(path);
+                            }
+                        }
+                        for path in &paths {
+                            write_report(path);
+                        }
+                    }
+                })
+                .map_err(|e| warn!("Failed to start the latency report writer: {}", e))
+                .ok()
+                .map(|_| queue)
+        })
+        .as_ref()
+}
+
+/// Write the per-stage latency table to `path`
+/// Pass NULL to use the default location (~/.cache/karukan-im/latency.txt)
+/// Returns 0 on success, -1 on failure
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_latency_write_report(path: *const c_char) -> c_int {
+    match report_path(path) {
+        Some(path) => write_report(&path),
+        None => -1,
+    }
+}
+
+/// `karukan_latency_write_report` on a background thread: returns at once,
+/// so the caller's thread never waits on disk I/O
+/// Returns 0 if the write was queued, -1 on failure
+#[unsafe(no_mangle)]
+pub extern "C" fn karukan_latency_queue_report(path: *const c_char) -> c_int {
+    let (Some(path), Some(queue)) = (report_path(path), report_queue()) else {
+        return -1;
+    };
+    match queue.send(path) {
+        Ok(()) => 0,
+        Err(_) => -1,
+    }
+}
@@ -2,7 +2,11 @@ use super::*;
 use input::*;
 use lifecycle::*;
 use query::*;
-use std::ffi::CStr;
+use shared::*;
+use stats::*;
+use std::ffi::{CStr, c_uint};
+
+use crate::core::candidate::CandidateList;
 use std::ptr;
 
 // XKB keysyms for common keys
@@ -12,9 +16,27 @@ const XKB_KEY_K: u32 = 0x6b;
 const XKB_KEY_RETURN: u32 = 0xff0d;
 const XKB_KEY_ESCAPE: u32 = 0xff1b;
 const XKB_KEY_BACKSPACE: u32 = 0xff08;
+const XKB_KEY_LEFT: u32 = 0xff51;
 const XKB_KEY_SHIFT_L: u32 = 0xffe1;
 const SHIFT_MASK: u32 = crate::core::keycode::KeyModifiers::SHIFT_MASK;
 
+/// Point the XDG data and cache directories at a scratch directory for the
+/// rest of the test process, so `init` never reads the user's dictionaries or
+/// rewrites their caches.
+fn isolate_user_dirs() {
+    static DIRS: std::sync::OnceLock<tempfile::TempDir> = std::sync::OnceLock::new();
+    DIRS.get_or_init(|| {
+        let dir = tempfile::tempdir().unwrap();
+        // SAFETY: set once per process; the engine reads them only through
+        // std::env (via `directories`), which serializes environment access
+        unsafe {
+            std::env::set_var("XDG_DATA_HOME", dir.path().join("data"));
+            std::env::set_var("XDG_CACHE_HOME", dir.path().join("cache"));
+        }
+        dir
+    });
+}
+
 /// RAII wrapper around a raw `KarukanEngine` pointer.
 /// Automatically frees the engine on drop, preventing leaks in tests.
 struct TestEngine(*mut KarukanEngine);
@@ -115,9 +137,207 @@ fn test_null_engine_safety() {
     assert!(karukan_engine_get_commit(ptr::null()).is_null());
     assert_eq!(karukan_engine_has_candidates(ptr::null()), 0);
     assert_eq!(karukan_engine_get_candidate_count(ptr::null()), 0);
+    let mut snapshot = std::mem::MaybeUninit::<KarukanCandidateSnapshot>::uninit();
+    assert_eq!(
+        karukan_engine_get_candidate_snapshot(ptr::null(), snapshot.as_mut_ptr()),
+        0
+    );
     assert_eq!(karukan_engine_get_last_conversion_ms(ptr::null()), 0);
     karukan_engine_reset(ptr::null_mut());
+    assert_eq!(karukan_engine_suggest_fd(ptr::null()), -1);
+    assert_eq!(karukan_engine_apply_suggestion(ptr::null_mut()), 0);
     karukan_engine_free(ptr::null_mut());
+    assert!(karukan_engine_new_with_shared(ptr::null_mut()).is_null());
+    assert_eq!(karukan_shared_init(ptr::null_mut()), -1);
+    assert_eq!(karukan_shared_is_initialized(ptr::null()), 0);
+    assert_eq!(karukan_shared_init_async(ptr::null_mut()), -1);
+    assert_eq!(karukan_shared_notify_fd(ptr::null()), -1);
+    assert_eq!(karukan_shared_is_warm(ptr::null()), 0);
+    karukan_engine_activate(ptr::null_mut());
+    assert_eq!(karukan_shared_residency(ptr::null()), -1);
+    assert_eq!(karukan_shared_reload_ms(ptr::null()), 0);
+    karukan_shared_free(ptr::null_mut());
+}
+
+#[test]
+fn test_shared_init_async_signals_notify_fd() {
+    use std::io::Read;
+
+    // Settings that fail fast without touching the network or the user's data
+    isolate_user_dirs();
+    let mut settings = Settings::default();
+    settings.conversion.strategy = crate::config::settings::StrategyMode::Main;
+    settings.conversion.model = Some("no-such-model".to_string());
+    settings.conversion.dict_path = Some("/nonexistent/karukan/dict.bin".to_string());
+    settings.learning.enabled = false;
+    let shared = Arc::into_raw(Arc::new(KarukanShared::with_settings(settings))) as *mut _;
+    assert!(karukan_shared_notify_fd(shared) >= 0);
+
+    let e = TestEngine(karukan_engine_new_with_shared(shared));
+    assert_eq!(karukan_shared_init_async(shared), 0);
+    // A second call does not start another load
+    assert_eq!(karukan_shared_init_async(shared), 0);
+
+    // Typing works while loading; it must not fall back to a blocking lazy load
+    assert!(e.press(XKB_KEY_A));
+    assert_eq!(e.preedit(), "あ");
+
+    let handle = unsafe { &*shared };
+    let deadline = std::time::Instant::now() + std::time::Duration::from_secs(10);
+    while karukan_shared_is_initialized(shared) == 0 {
+        assert!(std::time::Instant::now() < deadline, "init did not finish");
+        std::thread::sleep(std::time::Duration::from_millis(5));
+    }
+    let (rx, _) = handle.notify.as_ref().unwrap();
+    let mut buf = [0u8; 1];
+    assert_eq!((&*rx).read(&mut buf).unwrap(), 1);
+
+    // The stored result is returned without reloading
+    assert_eq!(karukan_shared_init(shared), -1);
+    // No model loaded: nothing to warm up
+    assert_eq!(karukan_shared_is_warm(shared), 1);
+    // ... or to release and reload
+    karukan_engine_activate(e.0);
+    assert_eq!(karukan_shared_residency(shared), 0);
+    assert_eq!(karukan_shared_reload_ms(shared), 0);
+    karukan_shared_free(shared);
+}
+
+/// Read string `i` of a snapshot's text (or annotation) arrays.
+fn snapshot_str(
+    snapshot: &KarukanCandidateSnapshot,
+    offsets: *const c_uint,
+    lens: *const c_uint,
+    i: usize,
+) -> String {
+    unsafe {
+        let offset = *offsets.add(i) as usize;
+        let len = *lens.add(i) as usize;
+        let bytes = std::slice::from_raw_parts(snapshot.arena.add(offset) as *const u8, len);
+        String::from_utf8(bytes.to_vec()).unwrap()
+    }
+}
+
+#[test]
+fn test_candidate_snapshot_matches_per_index_getters() {
+    let e = TestEngine::new();
+    // Two pages (9 + 3); cursor on the second candidate of page 2
+    let mut candidates = CandidateList::from_strings((0..12).map(|i| format!("候補{}", i)))
+        .candidates()
+        .to_vec();
+    candidates[10].annotation = Some("📚 辞書".to_string());
+    let mut list = CandidateList::new(candidates);
+    list.next_page();
+    list.move_next();
+    unsafe { &mut *e.ptr() }.apply_actions(vec![EngineAction::ShowCandidates(list)]);
+
+    let mut snapshot = std::mem::MaybeUninit::<KarukanCandidateSnapshot>::uninit();
+    assert_eq!(
+        karukan_engine_get_candidate_snapshot(e.ptr(), snapshot.as_mut_ptr()),
+        1
+    );
+    let snapshot = unsafe { snapshot.assume_init() };
+    assert_eq!(snapshot.count, 3);
+    assert_eq!(snapshot.cursor, 1);
+    assert_eq!(snapshot.page, 1);
+    assert_eq!(snapshot.total_pages, 2);
+    assert_eq!(snapshot.total_count, 12);
+    assert_eq!(karukan_engine_get_candidate_count(e.ptr()), snapshot.count);
+
+    for i in 0..snapshot.count as usize {
+        let text = snapshot_str(&snapshot, snapshot.text_offsets, snapshot.text_lens, i);
+        assert_eq!(text, format!("候補{}", 9 + i));
+        let c_text = unsafe { CStr::from_ptr(karukan_engine_get_candidate(e.ptr(), i as u32)) };
+        assert_eq!(c_text.to_str().unwrap(), text);
+    }
+    let ann = snapshot_str(
+        &snapshot,
+        snapshot.annotation_offsets,
+        snapshot.annotation_lens,
+        1,
+    );
+    assert_eq!(ann, "📚 辞書");
+    let c_ann = unsafe { CStr::from_ptr(karukan_engine_get_candidate_annotation(e.ptr(), 1)) };
+    assert_eq!(c_ann.to_str().unwrap(), "📚 辞書");
+    assert_eq!(
+        snapshot_str(
+            &snapshot,
+            snapshot.annotation_offsets,
+            snapshot.annotation_lens,
+            0
+        ),
+        ""
+    );
+}
+
+#[test]
+fn test_candidate_change_kinds() {
+    let e = TestEngine::new();
+    let show = |list: &CandidateList| {
+        let engine = unsafe { &mut *e.ptr() };
+        engine.clear_flags();
+        engine.apply_actions(vec![EngineAction::ShowCandidates(list.clone())]);
+        karukan_engine_get_candidate_change(e.ptr())
+    };
+    let mut list = CandidateList::from_strings((0..12).map(|i| format!("候補{}", i)));
+    assert_eq!(show(&list), CandidateChange::Full as c_int);
+
+    list.move_next();
+    assert_eq!(show(&list), CandidateChange::Cursor as c_int);
+    assert_eq!(karukan_engine_get_candidate_cursor(e.ptr()), 1);
+
+    list.next_page();
+    assert_eq!(show(&list), CandidateChange::Page as c_int);
+    assert_eq!(karukan_engine_get_candidate_count(e.ptr()), 3);
+
+    // A different list is always a full update
+    let other = CandidateList::from_strings(["別", "候補"]);
+    assert_eq!(show(&other), CandidateChange::Full as c_int);
+
+    // Hiding in between forces a full rebuild even for the same list
+    unsafe { &mut *e.ptr() }.apply_actions(vec![EngineAction::HideCandidates]);
+    assert_eq!(show(&other), CandidateChange::Full as c_int);
+
+    // Several updates in one key event merge to the most severe change
+    let engine = unsafe { &mut *e.ptr() };
+    engine.clear_flags();
+    engine.apply_actions(vec![
+        EngineAction::ShowCandidates(list.clone()),
+        EngineAction::ShowCandidates(list),
+    ]);
+    assert_eq!(
+        karukan_engine_get_candidate_change(e.ptr()),
+        CandidateChange::Full as c_int
+    );
+    assert_eq!(karukan_engine_get_candidate_change(ptr::null()), 2);
+}
+
+#[test]
+fn test_shared_engines_input_independently() {
+    let shared = karukan_shared_new();
+    let a = TestEngine(karukan_engine_new_with_shared(shared));
+    let b = TestEngine(karukan_engine_new_with_shared(shared));
+    assert!(!a.ptr().is_null() && !b.ptr().is_null());
+    assert_eq!(karukan_shared_is_initialized(shared), 0);
+
+    // Composition state is per engine
+    a.press(XKB_KEY_A);
+    b.press(XKB_KEY_K);
+    assert_eq!(a.preedit(), "あ");
+    assert_eq!(b.preedit(), "k");
+
+    karukan_shared_free(shared);
+}
+
+#[test]
+fn test_shared_freed_before_engines() {
+    let shared = karukan_shared_new();
+    let e = TestEngine(karukan_engine_new_with_shared(shared));
+
+    // Engines keep the shared resources alive after the handle is released
+    karukan_shared_free(shared);
+    assert!(e.press(XKB_KEY_A));
+    assert_eq!(e.preedit(), "あ");
 }
 
 #[test]
@@ -214,6 +434,90 @@ fn test_key_release_ignored() {
     assert!(!e.release(XKB_KEY_A));
 }
 
+/// Applying every delta to a mirror of the shown preedit reproduces the full text
+#[test]
+fn test_preedit_delta_replays_to_full_text() {
+    let e = TestEngine::new();
+    let mut shown = String::new();
+    let mut press = |keysym: u32| -> KarukanPreeditDelta {
+        let flags = karukan_engine_process_key_flags(e.ptr(), keysym, 0, 0);
+        let mut delta = KarukanPreeditDelta {
+            start: 0,
+            removed_len: 0,
+            inserted: ptr::null(),
+            inserted_len: 0,
+            caret: 0,
+        };
+        let pending = karukan_engine_get_preedit_delta(e.ptr(), &mut delta) == 1;
+        assert_eq!(pending, flags & UPDATE_PREEDIT != 0);
+        if flags & UPDATE_COMMIT != 0 {
+            shown.clear();
+        }
+        if pending {
+            let inserted = unsafe {
+                std::slice::from_raw_parts(delta.inserted as *const u8, delta.inserted_len as usize)
+            };
+            let start = delta.start as usize;
+            shown.replace_range(
+                start..start + delta.removed_len as usize,
+                std::str::from_utf8(inserted).unwrap(),
+            );
+            assert_eq!(shown, e.preedit());
+            assert_eq!(delta.caret, karukan_engine_get_preedit_caret(e.ptr()));
+        }
+        delta
+    };
+
+    press(XKB_KEY_K);
+    press(XKB_KEY_A);
+    // Appending touches only the new bytes: "か" + "k"
+    let delta = press(XKB_KEY_K);
+    assert_eq!(
+        (delta.start, delta.removed_len, delta.inserted_len),
+        (3, 0, 1)
+    );
+    // "k" becomes "か" in place
+    let delta = press(XKB_KEY_A);
+    assert_eq!(
+        (delta.start, delta.removed_len, delta.inserted_len),
+        (3, 1, 3)
+    );
+    press(XKB_KEY_LEFT);
+    press(XKB_KEY_I);
+    press(XKB_KEY_BACKSPACE);
+    press(XKB_KEY_RETURN);
+    assert!(e.has_commit());
+    // The first preedit after a commit inserts the whole text
+    press(XKB_KEY_A);
+    assert_eq!(e.preedit(), "あ");
+}
+
+/// Several updates in one key event merge into one delta; NULs are dropped
+#[test]
+fn test_preedit_cache_in_place_update() {
+    let mut cache = PreeditCache::default();
+    cache.update("あいう", 3);
+    cache.mark_shown();
+
+    // "あいう" → "あえう" → "あえうお" is shown as "いう" replaced by "えうお"
+    cache.update("あえう", 2);
+    cache.update("あえうお", 4);
+    assert_eq!(cache.as_bytes(), "あえうお".as_bytes());
+    assert_eq!(cache.delta(), (3, 6, "えうお".as_bytes()));
+    assert_eq!(cache.caret_bytes as usize, "あえうお".len());
+
+    // Same-prefix multibyte characters are never split ("あ" vs "い" share 2 bytes)
+    cache.mark_shown();
+    cache.update("いえうお", 0);
+    assert_eq!(cache.delta(), (0, 3, "い".as_bytes()));
+    assert_eq!(cache.caret_bytes, 0);
+
+    cache.mark_shown();
+    cache.update("a\0b", 1);
+    assert!(cache.as_bytes().is_empty());
+    assert_eq!(*cache.text.last().unwrap(), 0);
+}
+
 #[test]
 fn test_cstring_null_termination() {
     let e = TestEngine::new();
@@ -245,6 +549,74 @@ fn test_conversion_timing() {
     assert!(timing < 60000); // Should be less than 60 seconds
 }
 
+#[test]
+fn test_latency_stats() {
+    // Histograms are process-wide and other tests record concurrently, so only
+    // lower bounds are checked and nothing is reset
+    let e = TestEngine::new();
+    e.press(XKB_KEY_A);
+    e.press(XKB_KEY_I);
+    karukan_latency_record(Stage::UpdateUi as c_uint, 1500);
+
+    let mut summary = KarukanLatencySummary::default();
+    assert_eq!(
+        karukan_latency_get(Stage::ProcessKey as c_uint, &mut summary),
+        0
+    );
+    assert!(summary.count >= 2);
+    assert_eq!(
+        karukan_latency_get(Stage::Romaji as c_uint, &mut summary),
+        0
+    );
+    assert!(summary.count >= 2);
+    assert_eq!(
+        karukan_latency_get(Stage::UpdateUi as c_uint, &mut summary),
+        0
+    );
+    assert!(summary.count >= 1);
+    assert!(summary.max_us >= 1500);
+    assert!(summary.p50_us <= summary.p99_us && summary.p99_us <= summary.max_us);
+
+    // Unknown stages and null output are rejected
+    let count = karukan_latency_stage_count();
+    assert_eq!(count as usize, Stage::COUNT);
+    assert_eq!(karukan_latency_get(count, &mut summary), -1);
+    assert_eq!(karukan_latency_get(0, ptr::null_mut()), -1);
+    karukan_latency_record(count, 1);
+
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("latency.txt");
+    let c_path = CString::new(path.to_str().unwrap()).unwrap();
+    assert_eq!(karukan_latency_write_report(c_path.as_ptr()), 0);
+    let report = std::fs::read_to_string(&path).unwrap();
+    assert!(report.contains("process_key"));
+    assert!(report.contains("update_ui"));
+    assert!(report.contains("fast_path conversions="));
+
+    // Queued writes land on disk without the caller waiting for them
+    let queued = dir.path().join("queued").join("latency.txt");
+    let c_queued = CString::new(queued.to_str().unwrap()).unwrap();
+    assert_eq!(karukan_latency_queue_report(c_queued.as_ptr()), 0);
+    let deadline = std::time::Instant::now() + std::time::Duration::from_secs(10);
+    while !queued.exists() {
+        assert!(
+            std::time::Instant::now() < deadline,
+            "queued report not written"
+        );
+        std::thread::sleep(std::time::Duration::from_millis(5));
+    }
+    assert!(
+        std::fs::read_to_string(&queued)
+            .unwrap()
+            .contains("process_key")
+    );
+
+    let mut fast_path = KarukanFastPathStats::default();
+    assert_eq!(karukan_fast_path_get(&mut fast_path), 0);
+    assert!(fast_path.hits <= fast_path.conversions);
+    assert_eq!(karukan_fast_path_get(ptr::null_mut()), -1);
+}
+
 #[test]
 fn test_surrounding_text_sets_context() {
     let e = TestEngine::new();
@@ -411,6 +783,113 @@ fn test_surrounding_text_char_offset_middle() {
     );
 }
 
+#[test]
+fn test_surrounding_window_sets_context() {
+    let e = TestEngine::new();
+
+    // Byte slices without terminators, cut out of a larger buffer
+    let text = "前の行\n左側右側\n次の行";
+    let (before, after) = text.split_at(text.find("右側").unwrap());
+    karukan_engine_set_surrounding_window(
+        e.ptr(),
+        before.as_ptr().cast(),
+        before.len() as u32,
+        after.as_ptr().cast(),
+        after.len() as u32,
+    );
+
+    e.press(XKB_KEY_A);
+
+    assert!(e.aux().contains("lctx: 左側"), "aux: {}", e.aux());
+    assert!(e.aux().contains("rctx: 右側"), "aux: {}", e.aux());
+    assert!(!e.aux().contains("行"), "aux: {}", e.aux());
+}
+
+#[test]
+fn test_surrounding_window_invalid_utf8_clears_context() {
+    let e = TestEngine::new();
+    let text = std::ffi::CString::new("左側").unwrap();
+    karukan_engine_set_surrounding_text(e.ptr(), text.as_ptr(), 2);
+
+    // Cut in the middle of a multibyte character
+    let before = "左側".as_bytes();
+    karukan_engine_set_surrounding_window(e.ptr(), before.as_ptr().cast(), 4, ptr::null(), 0);
+
+    e.press(XKB_KEY_A);
+    assert!(!e.aux().contains("lctx:"), "aux: {}", e.aux());
+}
+
+#[test]
+fn test_surrounding_window_len() {
+    let e = TestEngine::new();
+    assert!(karukan_engine_surrounding_window(e.ptr()) > 0);
+    assert_eq!(karukan_engine_surrounding_window(ptr::null()), 0);
+
+    // Should not crash with null engine or null slices
+    karukan_engine_set_surrounding_window(ptr::null_mut(), ptr::null(), 0, ptr::null(), 0);
+    karukan_engine_set_surrounding_window(e.ptr(), ptr::null(), 0, ptr::null(), 0);
+}
+
+// --- Update flags FFI tests ---
+
+#[test]
+fn test_process_key_flags_match_has_queries() {
+    let e = TestEngine::new();
+    for keysym in [XKB_KEY_K, XKB_KEY_A, 0x20, XKB_KEY_RETURN] {
+        let flags = karukan_engine_process_key_flags(e.ptr(), keysym, 0, 0);
+        assert_eq!(flags & UPDATE_PREEDIT != 0, e.has_preedit());
+        assert_eq!(flags & UPDATE_COMMIT != 0, e.has_commit());
+        assert_eq!(flags & UPDATE_CANDIDATES != 0, e.has_candidates());
+        assert_eq!(
+            flags & UPDATE_AUX != 0,
+            karukan_engine_has_aux(e.ptr()) == 1
+        );
+        assert_eq!(
+            flags & UPDATE_HIDE_CANDIDATES != 0,
+            karukan_engine_should_hide_candidates(e.ptr()) == 1
+        );
+        if flags & UPDATE_CANDIDATES != 0 {
+            assert_eq!(
+                (flags >> UPDATE_CANDIDATE_CHANGE_SHIFT) & 0x3,
+                karukan_engine_get_candidate_change(e.ptr()) as u32
+            );
+        }
+        assert_eq!(
+            flags & !UPDATE_CONSUMED,
+            karukan_engine_get_update_flags(e.ptr())
+        );
+    }
+    assert!(e.has_commit(), "Enter should have committed");
+
+    assert_eq!(
+        karukan_engine_process_key_flags(ptr::null_mut(), XKB_KEY_A, 0, 0),
+        0
+    );
+    assert_eq!(karukan_engine_get_update_flags(ptr::null()), 0);
+}
+
+/// The addon skips the FFI call for releases and non-toggle modifiers
+/// (karukan.cpp keysym table), so they must never do anything in any state
+#[test]
+fn test_release_and_modifier_keys_produce_no_updates() {
+    const PASS_THROUGH_MODIFIERS: [u32; 8] = [
+        0xffe1, 0xffe2, 0xffe3, 0xffe4, 0xffe7, 0xffe9, 0xffeb, 0xffed,
+    ];
+    let e = TestEngine::new();
+    for setup in [&[][..], &[XKB_KEY_K, XKB_KEY_A][..], &[0x20][..]] {
+        for &keysym in setup {
+            e.press(keysym);
+        }
+        for keysym in [XKB_KEY_A, XKB_KEY_RETURN, 0x20, 0xffea, 0xffec] {
+            assert_eq!(karukan_engine_process_key_flags(e.ptr(), keysym, 0, 1), 0);
+        }
+        for keysym in PASS_THROUGH_MODIFIERS {
+            assert_eq!(karukan_engine_process_key_flags(e.ptr(), keysym, 0, 0), 0);
+            assert_eq!(karukan_engine_process_key_flags(e.ptr(), keysym, 0, 1), 0);
+        }
+    }
+}
+
 // --- Shift+letter alphabet mode FFI tests ---
 
 #[test]